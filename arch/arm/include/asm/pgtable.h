@@ -260,7 +260,6 @@ extern struct page *empty_zero_page;
 #define pfn_pte(pfn,prot)	(__pte(((pfn) << PAGE_SHIFT) | pgprot_val(prot)))
 
 #define pte_none(pte)		(!pte_val(pte))
-#define pte_clear(mm,addr,ptep)	set_pte_ext(ptep, __pte(0), 0)
 #define pte_page(pte)		(pfn_to_page(pte_pfn(pte)))
 #define pte_offset_kernel(dir,addr)	(pmd_page_vaddr(*(dir)) + __pte_index(addr))
 
@@ -279,6 +278,36 @@ extern struct page *empty_zero_page;
 
 #define set_pte_ext(ptep,pte,ext) cpu_set_pte_ext(ptep,pte,ext)
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Transparent huge pages are mapped with 64K large page descriptors: the
+ * same descriptor repeated in the 16 h/w entries of an aligned group,
+ * while the Linux entries stay per page.  pte_mklarge() installs them
+ * once all 16 Linux entries agree; any later write to one of the entries
+ * first puts the whole group back to small pages.
+ */
+#define PTE_LARGE_SHIFT		16
+#define PTRS_PER_PTE_LARGE	(1 << (PTE_LARGE_SHIFT - PAGE_SHIFT))
+
+#define pte_hw_large(ptep)	\
+	((pte_val((ptep)[-PTRS_PER_PTE]) & PTE_TYPE_MASK) == PTE_TYPE_LARGE)
+
+extern void pte_mklarge(struct mm_struct *mm, unsigned long addr,
+			pte_t *ptep);
+extern void pte_split_large(struct mm_struct *mm, unsigned long addr,
+			    pte_t *ptep);
+#else
+#define pte_hw_large(ptep)	(0)
+#define pte_split_large(mm,addr,ptep)	do { } while (0)
+#endif
+
+#define pte_clear(mm,addr,ptep)					\
+	do {							\
+		if (pte_hw_large(ptep))				\
+			pte_split_large(mm, addr, ptep);	\
+		set_pte_ext(ptep, __pte(0), 0);			\
+	} while (0)
+
 #ifndef CONFIG_SMP
 static inline void __sync_icache_dcache(pte_t pteval)
 {
@@ -290,6 +319,8 @@ extern void __sync_icache_dcache(pte_t pteval);
 static inline void set_pte_at(struct mm_struct *mm, unsigned long addr,
 			      pte_t *ptep, pte_t pteval)
 {
+	if (pte_hw_large(ptep))
+		pte_split_large(mm, addr, ptep);
 	if (addr >= TASK_SIZE)
 		set_pte_ext(ptep, pteval, 0);
 	else {
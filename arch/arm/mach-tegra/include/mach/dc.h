@@ -20,6 +20,7 @@
 #ifndef __MACH_TEGRA_DC_H
 #define __MACH_TEGRA_DC_H
 
+#include <linux/ktime.h>
 #include <linux/pm.h>
 
 #define TEGRA_MAX_DC		2
@@ -369,6 +370,11 @@ int tegra_dc_set_dynamic_emc(struct tegra_dc_win *windows[], int n);
 int tegra_dc_update_windows(struct tegra_dc_win *windows[], int n);
 int tegra_dc_sync_windows(struct tegra_dc_win *windows[], int n);
 
+/* program windows and the EMC rate they need in one step; 'queued' is when
+ * the flip was requested and is used for latency accounting */
+int tegra_dc_commit_windows(struct tegra_dc_win *windows[], int n,
+			    ktime_t queued);
+
 int tegra_dc_set_mode(struct tegra_dc *dc, const struct tegra_dc_mode *mode);
 
 unsigned tegra_dc_get_out_height(const struct tegra_dc *dc);
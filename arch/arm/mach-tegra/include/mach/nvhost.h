@@ -128,6 +128,27 @@ struct nvhost_set_nvmap_fd_args {
 	__u32 fd;
 };
 
+#define NVHOST_SUBMIT_FLAG_NULL_KICKOFF		(1 << 0)
+
+/* single-call submit: header, arrays and returned fence. the arrays are
+ * passed as user pointers cast to __u64, so that the layout is the same
+ * for 32-bit and 64-bit callers */
+struct nvhost_submit_args {
+	__u32 submit_version;
+	__u32 syncpt_id;
+	__u32 syncpt_incrs;
+	__u32 num_cmdbufs;
+	__u32 num_relocs;
+	__u32 num_waitchks;
+	__u32 waitchk_mask;
+	__u32 flags;
+	__u64 cmdbufs;			/* struct nvhost_cmdbuf __user * */
+	__u64 relocs;			/* struct nvhost_reloc __user * */
+	__u64 waitchks;			/* struct nvhost_waitchk __user * */
+	__u32 fence;			/* out: syncpt value at completion */
+	__u32 pad;
+};
+
 #define NVHOST_IOCTL_CHANNEL_FLUSH		\
 	_IOR(NVHOST_IOCTL_MAGIC, 1, struct nvhost_get_param_args)
 #define NVHOST_IOCTL_CHANNEL_GET_SYNCPOINTS	\
@@ -142,9 +163,11 @@ struct nvhost_set_nvmap_fd_args {
 	_IOR(NVHOST_IOCTL_MAGIC, 6, struct nvhost_get_param_args)
 #define NVHOST_IOCTL_CHANNEL_SUBMIT_EXT    	\
 	_IOW(NVHOST_IOCTL_MAGIC, 7, struct nvhost_submit_hdr_ext)
+#define NVHOST_IOCTL_CHANNEL_SUBMIT		\
+	_IOWR(NVHOST_IOCTL_MAGIC, 8, struct nvhost_submit_args)
 #define NVHOST_IOCTL_CHANNEL_LAST		\
-	_IOC_NR(NVHOST_IOCTL_CHANNEL_SUBMIT_EXT)
-#define NVHOST_IOCTL_CHANNEL_MAX_ARG_SIZE sizeof(struct nvhost_submit_hdr_ext)
+	_IOC_NR(NVHOST_IOCTL_CHANNEL_SUBMIT)
+#define NVHOST_IOCTL_CHANNEL_MAX_ARG_SIZE sizeof(struct nvhost_submit_args)
 
 struct nvhost_ctrl_syncpt_read_args {
 	__u32 id;
@@ -182,6 +205,18 @@ struct nvhost_ctrl_module_regrdwr_args {
 	__u32 write;
 };
 
+struct nvhost_ctrl_syncpt_fence_args {
+	__u32 id;
+	__u32 thresh;
+	__s32 fd;			/* out: pollable fence fd */
+};
+
+struct nvhost_ctrl_fence_merge_args {
+	__s32 fd1;
+	__s32 fd2;
+	__s32 fd;			/* out: signals when both have */
+};
+
 #define NVHOST_IOCTL_CTRL_SYNCPT_READ		\
 	_IOWR(NVHOST_IOCTL_MAGIC, 1, struct nvhost_ctrl_syncpt_read_args)
 #define NVHOST_IOCTL_CTRL_SYNCPT_INCR		\
@@ -197,8 +232,13 @@ struct nvhost_ctrl_module_regrdwr_args {
 #define NVHOST_IOCTL_CTRL_SYNCPT_WAITEX		\
 	_IOWR(NVHOST_IOCTL_MAGIC, 6, struct nvhost_ctrl_syncpt_waitex_args)
 
+#define NVHOST_IOCTL_CTRL_SYNCPT_FENCE		\
+	_IOWR(NVHOST_IOCTL_MAGIC, 7, struct nvhost_ctrl_syncpt_fence_args)
+#define NVHOST_IOCTL_CTRL_FENCE_MERGE		\
+	_IOWR(NVHOST_IOCTL_MAGIC, 8, struct nvhost_ctrl_fence_merge_args)
+
 #define NVHOST_IOCTL_CTRL_LAST			\
-	_IOC_NR(NVHOST_IOCTL_CTRL_SYNCPT_WAITEX)
+	_IOC_NR(NVHOST_IOCTL_CTRL_FENCE_MERGE)
 #define NVHOST_IOCTL_CTRL_MAX_ARG_SIZE sizeof(struct nvhost_ctrl_module_regrdwr_args)
 
 #endif
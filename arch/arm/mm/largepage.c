@@ -0,0 +1,127 @@
+/*
+ *  linux/arch/arm/mm/largepage.c
+ *
+ *  64K large page mappings for transparent huge pages.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Only the h/w page table is touched here.  The Linux entries always
+ * describe single 4K pages, so everything outside this file keeps
+ * working on them unchanged; set_pte_at() and pte_clear() call
+ * pte_split_large() before they modify an entry of a large group.
+ */
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/vmstat.h>
+
+#include <asm/cacheflush.h>
+#include <asm/pgtable.h>
+#include <asm/tlbflush.h>
+
+#define LARGE_SIZE	(1UL << PTE_LARGE_SHIFT)
+#define LARGE_MASK	(~(LARGE_SIZE - 1))
+#define LARGE_HW_BYTES	(PTRS_PER_PTE_LARGE * sizeof(u32))
+
+/*
+ * Bits that mean the same in small and large descriptors.
+ */
+#define PTE_COMMON_MASK	(PTE_BUFFERABLE | PTE_CACHEABLE | PTE_EXT_AP_MASK | \
+			 PTE_EXT_APX | PTE_EXT_SHARED | PTE_EXT_NG)
+
+static inline u32 *large_group_hw(pte_t *ptep)
+{
+	unsigned long p = (unsigned long)ptep;
+
+	p &= ~(LARGE_HW_BYTES - 1);
+	return (u32 *)((pte_t *)p - PTRS_PER_PTE);
+}
+
+static u32 small_to_large(u32 d)
+{
+	u32 large = (d & LARGE_MASK) | (d & PTE_COMMON_MASK) | PTE_TYPE_LARGE;
+
+	if (d & PTE_EXT_XN)
+		large |= PTE_EXT_LARGE_XN;
+	large |= PTE_EXT_LARGE_TEX((d >> 6) & 7);
+	return large;
+}
+
+/*
+ * Remove every h/w entry of the group and make sure no TLB still holds
+ * one of them.  The architecture does not allow small and large entries
+ * for the same address to be live at once, so this always comes before
+ * the group is rewritten in the other format.
+ */
+static void large_group_break(struct mm_struct *mm, unsigned long addr,
+			      u32 *hw)
+{
+	struct vm_area_struct vma;
+	int i;
+
+	for (i = 0; i < PTRS_PER_PTE_LARGE; i++)
+		hw[i] = 0;
+	clean_dcache_area(hw, LARGE_HW_BYTES);
+
+	vma.vm_mm = mm;
+	vma.vm_flags = VM_EXEC;
+	flush_tlb_range(&vma, addr, addr + LARGE_SIZE);
+}
+
+/*
+ * pte_mklarge - map an aligned group of 16 ptes with one TLB entry
+ * @addr:	user address of the first page of the group
+ * @ptep:	first Linux entry of the group
+ *
+ * Does nothing unless the 16 pages are physically contiguous, start on
+ * a 64K boundary and are mapped with identical attributes.  Only young
+ * entries qualify, so that the referenced bit of no page is lost while
+ * the group is large.  Called with the pte lock held.
+ */
+void pte_mklarge(struct mm_struct *mm, unsigned long addr, pte_t *ptep)
+{
+	u32 *hw = (u32 *)(ptep - PTRS_PER_PTE);
+	pte_t first = *ptep;
+	u32 large;
+	int i;
+
+	if (addr >= TASK_SIZE || (addr & ~LARGE_MASK) ||
+	    (unsigned long)ptep & (LARGE_HW_BYTES - 1))
+		return;
+	if (!pte_present(first) || !pte_young(first) ||
+	    (pte_pfn(first) & (PTRS_PER_PTE_LARGE - 1)))
+		return;
+	for (i = 1; i < PTRS_PER_PTE_LARGE; i++)
+		if (pte_val(ptep[i]) != pte_val(first) + (i << PAGE_SHIFT))
+			return;
+	if ((hw[0] & PTE_TYPE_MASK) != PTE_TYPE_SMALL)
+		return;
+
+	large = small_to_large(hw[0]);
+	large_group_break(mm, addr, hw);
+	for (i = 0; i < PTRS_PER_PTE_LARGE; i++)
+		hw[i] = large;
+	clean_dcache_area(hw, LARGE_HW_BYTES);
+}
+
+/*
+ * pte_split_large - go back to small h/w entries for the group of @ptep
+ *
+ * Called with the pte lock held, before one of the group's Linux
+ * entries is changed.
+ */
+void pte_split_large(struct mm_struct *mm, unsigned long addr, pte_t *ptep)
+{
+	u32 *hw = large_group_hw(ptep);
+	pte_t *group = (pte_t *)hw + PTRS_PER_PTE;
+	int i;
+
+	addr &= LARGE_MASK;
+	large_group_break(mm, addr, hw);
+	for (i = 0; i < PTRS_PER_PTE_LARGE; i++)
+		cpu_set_pte_ext(group + i, group[i], PTE_EXT_NG);
+	count_vm_event(THP_SPLIT);
+}
+EXPORT_SYMBOL(pte_split_large);
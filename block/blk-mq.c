@@ -0,0 +1,613 @@
+/*
+ * Multi-queue block submission: per-cpu software queues feeding a small
+ * number of hardware dispatch queues, without the queue lock or an
+ * elevator.  See include/linux/blk-mq.h.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+
+#include <trace/events/block.h>
+
+#include "blk.h"
+
+/*
+ * Per-cpu software queue.  Requests are added by the cpu they were
+ * allocated on and drained by the hardware queue that cpu maps to, so
+ * its lock is never contended across the whole device.
+ */
+struct blk_mq_ctx {
+	spinlock_t		lock;
+	struct list_head	rq_list;
+	unsigned int		cpu;
+	unsigned int		index_hw;	/* bit in hctx->ctx_map */
+	struct request_queue	*queue;
+};
+
+static struct blk_mq_ctx *blk_mq_get_ctx(struct request_queue *q)
+{
+	return per_cpu_ptr(q->queue_ctx, get_cpu());
+}
+
+static void blk_mq_put_ctx(struct blk_mq_ctx *ctx)
+{
+	put_cpu();
+}
+
+/**
+ * blk_mq_map_queue - default cpu to hardware queue mapping
+ * @q:		the multi-queue device
+ * @cpu:	the submitting cpu
+ */
+struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *q, const int cpu)
+{
+	return q->queue_hw_ctx[q->mq_map[cpu]];
+}
+EXPORT_SYMBOL(blk_mq_map_queue);
+
+static struct blk_mq_hw_ctx *blk_mq_ctx_to_hctx(struct blk_mq_ctx *ctx)
+{
+	struct request_queue *q = ctx->queue;
+
+	return q->mq_ops->map_queue(q, ctx->cpu);
+}
+
+/*
+ * Tags are plain bits: allocation and release are atomic bitops on the
+ * hardware queue's map, nothing else is shared between submitters.
+ */
+static int blk_mq_get_tag(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int tag;
+
+	do {
+		tag = find_first_zero_bit(hctx->tag_map, hctx->queue_depth);
+		if (tag >= hctx->queue_depth)
+			return -1;
+	} while (test_and_set_bit_lock(tag, hctx->tag_map));
+
+	return tag;
+}
+
+static void blk_mq_put_tag(struct blk_mq_hw_ctx *hctx, unsigned int tag)
+{
+	clear_bit_unlock(tag, hctx->tag_map);
+	smp_mb__after_clear_bit();
+	if (waitqueue_active(&hctx->tag_wait))
+		wake_up(&hctx->tag_wait);
+}
+
+static bool blk_mq_tags_full(struct blk_mq_hw_ctx *hctx)
+{
+	return find_first_zero_bit(hctx->tag_map, hctx->queue_depth) >=
+		hctx->queue_depth;
+}
+
+/*
+ * Get a request for the current cpu's hardware queue, waiting for a tag
+ * if they are all in flight.  Returns with the software queue pinned.
+ */
+static struct request *blk_mq_get_request(struct request_queue *q,
+					  struct blk_mq_ctx **ctxp)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	DEFINE_WAIT(wait);
+	int tag;
+
+	for (;;) {
+		ctx = blk_mq_get_ctx(q);
+		hctx = q->mq_ops->map_queue(q, ctx->cpu);
+		tag = blk_mq_get_tag(hctx);
+		if (tag >= 0)
+			break;
+		blk_mq_put_ctx(ctx);
+
+		/*
+		 * Push whatever is still queued and wait for a completion.
+		 * Waiters are not exclusive: after sleeping we may well be
+		 * on a cpu that maps to another hardware queue.
+		 */
+		blk_mq_run_hw_queue(hctx, false);
+		prepare_to_wait(&hctx->tag_wait, &wait, TASK_UNINTERRUPTIBLE);
+		if (blk_mq_tags_full(hctx))
+			io_schedule();
+		finish_wait(&hctx->tag_wait, &wait);
+	}
+
+	*ctxp = ctx;
+	return hctx->rqs[tag];
+}
+
+static void blk_mq_bio_to_request(struct request *rq, struct blk_mq_ctx *ctx,
+				  struct bio *bio)
+{
+	struct request_queue *q = ctx->queue;
+	unsigned int tag = rq->tag;
+
+	blk_rq_init(q, rq);
+	rq->tag = tag;
+	rq->mq_ctx = ctx;
+	init_request_from_bio(rq, bio);
+	if (blk_queue_io_stat(q))
+		rq->cmd_flags |= REQ_IO_STAT;
+
+	if (test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags) ||
+	    bio_flagged(bio, BIO_CPU_AFFINE))
+		rq->cpu = blk_cpu_to_group(ctx->cpu);
+}
+
+static void blk_mq_free_request(struct request *rq)
+{
+	struct blk_mq_hw_ctx *hctx = blk_mq_ctx_to_hctx(rq->mq_ctx);
+
+	blk_mq_put_tag(hctx, rq->tag);
+}
+
+/**
+ * blk_mq_end_io - complete all of a request
+ * @rq:		the request, as handed to ->queue_rq()
+ * @error:	0 for success, < 0 for error
+ *
+ * Description:
+ *     Ends all bios of @rq and gives its tag back.  May be called from
+ *     interrupt context.
+ */
+void blk_mq_end_io(struct request *rq, int error)
+{
+	if (blk_update_request(rq, error, blk_rq_bytes(rq)))
+		BUG();
+
+	blk_account_io_done(rq);
+	blk_mq_free_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+static void __blk_mq_insert_request(struct blk_mq_ctx *ctx,
+				    struct blk_mq_hw_ctx *hctx,
+				    struct request *rq)
+{
+	trace_block_rq_insert(ctx->queue, rq);
+	drive_stat_acct(rq, 1);
+
+	/*
+	 * The runner clears the pending bit before taking ctx->lock, so
+	 * setting it under the lock cannot lose a request.
+	 */
+	spin_lock(&ctx->lock);
+	list_add_tail(&rq->queuelist, &ctx->rq_list);
+	if (!test_bit(ctx->index_hw, hctx->ctx_map))
+		set_bit(ctx->index_hw, hctx->ctx_map);
+	spin_unlock(&ctx->lock);
+}
+
+/**
+ * blk_mq_insert_request - queue a request on its software queue
+ * @rq:		the request
+ * @run_queue:	dispatch right away
+ */
+void blk_mq_insert_request(struct request *rq, bool run_queue)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	struct blk_mq_hw_ctx *hctx = blk_mq_ctx_to_hctx(ctx);
+
+	__blk_mq_insert_request(ctx, hctx, rq);
+
+	if (run_queue)
+		blk_mq_run_hw_queue(hctx, false);
+}
+
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	LIST_HEAD(rq_list);
+	unsigned int bit;
+	int ret;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	/*
+	 * Requests the driver bounced earlier go first.
+	 */
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock(&hctx->lock);
+		list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock(&hctx->lock);
+	}
+
+	for_each_set_bit(bit, hctx->ctx_map, hctx->nr_ctx) {
+		clear_bit(bit, hctx->ctx_map);
+		ctx = hctx->ctxs[bit];
+
+		spin_lock(&ctx->lock);
+		list_splice_tail_init(&ctx->rq_list, &rq_list);
+		spin_unlock(&ctx->lock);
+	}
+
+	while (!list_empty(&rq_list)) {
+		rq = list_entry_rq(rq_list.next);
+		list_del_init(&rq->queuelist);
+
+		trace_block_rq_issue(q, rq);
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY) {
+			list_add(&rq->queuelist, &rq_list);
+			break;
+		}
+		if (ret != BLK_MQ_RQ_QUEUE_OK) {
+			WARN_ON_ONCE(ret != BLK_MQ_RQ_QUEUE_ERROR);
+			rq->errors = -EIO;
+			blk_mq_end_io(rq, rq->errors);
+		}
+	}
+
+	/*
+	 * The driver is busy: keep the rest for the next run, either the
+	 * next submission's or the one blk_mq_start_hw_queue() schedules.
+	 */
+	if (!list_empty(&rq_list)) {
+		spin_lock(&hctx->lock);
+		list_splice(&rq_list, &hctx->dispatch);
+		spin_unlock(&hctx->lock);
+	}
+}
+
+static void blk_mq_run_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, run_work);
+	__blk_mq_run_hw_queue(hctx);
+}
+
+/**
+ * blk_mq_run_hw_queue - dispatch the requests queued for a hardware queue
+ * @hctx:	the hardware queue
+ * @async:	leave the work to kblockd instead of running it inline
+ */
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	if (async)
+		kblockd_schedule_work(hctx->queue, &hctx->run_work);
+	else
+		__blk_mq_run_hw_queue(hctx);
+}
+EXPORT_SYMBOL(blk_mq_run_hw_queue);
+
+static bool blk_mq_hctx_has_pending(struct blk_mq_hw_ctx *hctx)
+{
+	return !list_empty_careful(&hctx->dispatch) ||
+		find_first_bit(hctx->ctx_map, hctx->nr_ctx) < hctx->nr_ctx;
+}
+
+/**
+ * blk_mq_run_queues - dispatch pending requests on all hardware queues
+ * @q:		the multi-queue device
+ * @async:	leave the work to kblockd instead of running it inline
+ */
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (blk_mq_hctx_has_pending(hctx))
+			blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+/*
+ * Safe to call from interrupt context: the restarted queue is run by
+ * kblockd.
+ */
+void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	clear_bit(BLK_MQ_S_STOPPED, &hctx->state);
+	blk_mq_run_hw_queue(hctx, true);
+}
+EXPORT_SYMBOL(blk_mq_start_hw_queue);
+
+void blk_mq_start_stopped_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (test_and_clear_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			blk_mq_run_hw_queue(hctx, true);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+/*
+ * ->unplug_fn, for callers that kick the device through the backing dev
+ * while waiting on a page.
+ */
+static void blk_mq_unplug(struct request_queue *q)
+{
+	blk_mq_run_queues(q, false);
+}
+
+static int blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct blk_plug *plug;
+	struct request *rq;
+
+	if (bio->bi_rw & REQ_HARDBARRIER) {
+		bio_endio(bio, -EOPNOTSUPP);
+		return 0;
+	}
+
+	blk_queue_bounce(q, &bio);
+
+	plug = current->plug;
+	if (plug && (bio->bi_rw & REQ_UNPLUG)) {
+		blk_flush_plug_list(plug, false);
+		plug = NULL;
+	}
+
+	if (q->queue_hw_ctx[0]->flags & BLK_MQ_F_SHOULD_MERGE) {
+		if (plug && blk_attempt_list_merge(q, &plug->list, bio))
+			return 0;
+
+		ctx = blk_mq_get_ctx(q);
+		spin_lock(&ctx->lock);
+		if (blk_attempt_list_merge(q, &ctx->rq_list, bio)) {
+			spin_unlock(&ctx->lock);
+			blk_mq_put_ctx(ctx);
+			return 0;
+		}
+		spin_unlock(&ctx->lock);
+		blk_mq_put_ctx(ctx);
+	}
+
+	rq = blk_mq_get_request(q, &ctx);
+	blk_mq_bio_to_request(rq, ctx, bio);
+
+	if (plug) {
+		blk_mq_put_ctx(ctx);
+		blk_add_plugged_request(plug, rq);
+		return 0;
+	}
+
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+	__blk_mq_insert_request(ctx, hctx, rq);
+	blk_mq_put_ctx(ctx);
+
+	blk_mq_run_hw_queue(hctx, false);
+	return 0;
+}
+
+/*
+ * Spread the possible cpus evenly over the hardware queues.
+ */
+static unsigned int *blk_mq_make_queue_map(struct blk_mq_reg *reg,
+					   unsigned int nr_hw_queues)
+{
+	unsigned int *map;
+	unsigned int i = 0;
+	int cpu;
+
+	map = kzalloc_node(sizeof(*map) * nr_cpu_ids, GFP_KERNEL,
+			   reg->numa_node);
+	if (!map)
+		return NULL;
+
+	for_each_possible_cpu(cpu)
+		map[cpu] = i++ % nr_hw_queues;
+
+	return map;
+}
+
+static void blk_mq_free_rq_map(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int i;
+
+	if (hctx->rqs) {
+		for (i = 0; i < hctx->queue_depth; i++)
+			kfree(hctx->rqs[i]);
+		kfree(hctx->rqs);
+	}
+	kfree(hctx->tag_map);
+}
+
+static int blk_mq_init_rq_map(struct blk_mq_hw_ctx *hctx,
+			      struct blk_mq_reg *reg)
+{
+	size_t rq_size = sizeof(struct request) + reg->cmd_size;
+	unsigned int i;
+
+	hctx->queue_depth = reg->queue_depth;
+	hctx->tag_map = kzalloc_node(BITS_TO_LONGS(reg->queue_depth) *
+				     sizeof(unsigned long), GFP_KERNEL,
+				     reg->numa_node);
+	hctx->rqs = kzalloc_node(reg->queue_depth * sizeof(struct request *),
+				 GFP_KERNEL, reg->numa_node);
+	if (!hctx->tag_map || !hctx->rqs)
+		return -ENOMEM;
+
+	for (i = 0; i < reg->queue_depth; i++) {
+		hctx->rqs[i] = kzalloc_node(rq_size, GFP_KERNEL,
+					    reg->numa_node);
+		if (!hctx->rqs[i])
+			return -ENOMEM;
+		hctx->rqs[i]->tag = i;
+	}
+
+	return 0;
+}
+
+static void blk_mq_free_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	for (i = 0; q->queue_hw_ctx && i < q->nr_hw_queues; i++) {
+		hctx = q->queue_hw_ctx[i];
+		if (!hctx)
+			continue;
+		blk_mq_free_rq_map(hctx);
+		kfree(hctx->ctx_map);
+		kfree(hctx->ctxs);
+		kfree(hctx);
+	}
+	kfree(q->queue_hw_ctx);
+	kfree(q->mq_map);
+	free_percpu(q->queue_ctx);
+}
+
+static int blk_mq_init_hw_queues(struct request_queue *q,
+				 struct blk_mq_reg *reg)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	unsigned int i;
+	int cpu;
+
+	for (i = 0; i < q->nr_hw_queues; i++) {
+		hctx = kzalloc_node(sizeof(*hctx), GFP_KERNEL, reg->numa_node);
+		if (!hctx)
+			return -ENOMEM;
+		q->queue_hw_ctx[i] = hctx;
+
+		spin_lock_init(&hctx->lock);
+		INIT_LIST_HEAD(&hctx->dispatch);
+		INIT_WORK(&hctx->run_work, blk_mq_run_work_fn);
+		init_waitqueue_head(&hctx->tag_wait);
+		hctx->queue = q;
+		hctx->queue_num = i;
+		hctx->flags = reg->flags;
+
+		hctx->ctxs = kzalloc_node(nr_cpu_ids * sizeof(void *),
+					  GFP_KERNEL, reg->numa_node);
+		hctx->ctx_map = kzalloc_node(BITS_TO_LONGS(nr_cpu_ids) *
+					     sizeof(unsigned long), GFP_KERNEL,
+					     reg->numa_node);
+		if (!hctx->ctxs || !hctx->ctx_map)
+			return -ENOMEM;
+
+		if (blk_mq_init_rq_map(hctx, reg))
+			return -ENOMEM;
+	}
+
+	for_each_possible_cpu(cpu) {
+		ctx = per_cpu_ptr(q->queue_ctx, cpu);
+		spin_lock_init(&ctx->lock);
+		INIT_LIST_HEAD(&ctx->rq_list);
+		ctx->cpu = cpu;
+		ctx->queue = q;
+
+		hctx = q->mq_ops->map_queue(q, cpu);
+		ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = ctx;
+	}
+
+	return 0;
+}
+
+static void blk_mq_exit_hw_queues(struct request_queue *q, unsigned int nr)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (i == nr)
+			break;
+		cancel_work_sync(&hctx->run_work);
+		if (q->mq_ops->exit_hctx)
+			q->mq_ops->exit_hctx(hctx, i);
+	}
+}
+
+/**
+ * blk_mq_init_queue - allocate a multi-queue request queue
+ * @reg:	hardware queue layout and driver operations
+ * @driver_data: passed to ->init_hctx()
+ *
+ * Description:
+ *     Returns a queue whose bios are turned into requests from per
+ *     hardware queue pools and handed to ->queue_rq() without going
+ *     through an elevator.  At most one hardware queue per possible cpu
+ *     is used.  Tear it down with blk_cleanup_queue().
+ */
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
+					void *driver_data)
+{
+	struct request_queue *q;
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	if (!reg->nr_hw_queues || !reg->queue_depth ||
+	    reg->queue_depth > BLK_MQ_MAX_DEPTH ||
+	    !reg->ops->queue_rq || !reg->ops->map_queue)
+		return ERR_PTR(-EINVAL);
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		return ERR_PTR(-ENOMEM);
+
+	q->mq_ops = reg->ops;
+	q->nr_hw_queues = min_t(unsigned int, reg->nr_hw_queues, nr_cpu_ids);
+	q->queue_ctx = alloc_percpu(struct blk_mq_ctx);
+	q->queue_hw_ctx = kzalloc_node(q->nr_hw_queues * sizeof(hctx),
+				       GFP_KERNEL, reg->numa_node);
+	q->mq_map = blk_mq_make_queue_map(reg, q->nr_hw_queues);
+	if (!q->queue_ctx || !q->queue_hw_ctx || !q->mq_map)
+		goto err_free;
+
+	if (blk_mq_init_hw_queues(q, reg))
+		goto err_free;
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	q->unplug_fn = blk_mq_unplug;
+	if (reg->ops->complete)
+		blk_queue_softirq_done(q, reg->ops->complete);
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (reg->ops->init_hctx &&
+		    reg->ops->init_hctx(hctx, driver_data, i)) {
+			blk_mq_exit_hw_queues(q, i);
+			goto err_free;
+		}
+	}
+
+	return q;
+
+err_free:
+	blk_mq_free_hw_queues(q);
+	q->mq_ops = NULL;
+	blk_cleanup_queue(q);
+	return ERR_PTR(-ENOMEM);
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
+
+/*
+ * Called from blk_cleanup_queue(), once no more I/O can come in.
+ */
+void blk_mq_free_queue(struct request_queue *q)
+{
+	blk_mq_exit_hw_queues(q, q->nr_hw_queues);
+	blk_mq_free_hw_queues(q);
+	q->mq_ops = NULL;
+}
@@ -369,6 +369,20 @@ static struct queue_sysfs_entry queue_random_entry = {
 	.store = queue_store_random,
 };
 
+#ifdef CONFIG_BLK_DEBUG_LOCK_STATS
+static ssize_t queue_lock_stats_show(struct request_queue *q, char *page)
+{
+	return sprintf(page, "%lu %lu\n",
+		       atomic_long_read(&q->lock_stat_bios),
+		       atomic_long_read(&q->lock_stat_locks));
+}
+
+static struct queue_sysfs_entry queue_lock_stats_entry = {
+	.attr = {.name = "lock_stats", .mode = S_IRUGO },
+	.show = queue_lock_stats_show,
+};
+#endif
+
 static struct attribute *default_attrs[] = {
 	&queue_requests_entry.attr,
 	&queue_ra_entry.attr,
@@ -390,6 +404,9 @@ static struct attribute *default_attrs[] = {
 	&queue_rq_affinity_entry.attr,
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
+#ifdef CONFIG_BLK_DEBUG_LOCK_STATS
+	&queue_lock_stats_entry.attr,
+#endif
 	NULL,
 };
 
@@ -16,6 +16,11 @@ void blk_rq_bio_prep(struct request_queue *q, struct request *rq,
 int blk_rq_append_bio(struct request_queue *q, struct request *rq,
 		      struct bio *bio);
 void blk_dequeue_request(struct request *rq);
+void drive_stat_acct(struct request *rq, int new_io);
+void blk_account_io_done(struct request *req);
+bool blk_attempt_list_merge(struct request_queue *q, struct list_head *list,
+			    struct bio *bio);
+void blk_add_plugged_request(struct blk_plug *plug, struct request *rq);
 void __blk_queue_free_tags(struct request_queue *q);
 
 void blk_unplug_work(struct work_struct *work);
@@ -83,6 +88,26 @@ static inline void elv_deactivate_rq(struct request_queue *q, struct request *rq
 		e->ops->elevator_deactivate_req_fn(q, rq);
 }
 
+#ifdef CONFIG_BLK_DEBUG_LOCK_STATS
+static inline void blk_lock_stat_bio(struct request_queue *q)
+{
+	atomic_long_inc(&q->lock_stat_bios);
+}
+
+static inline void blk_lock_stat_lock(struct request_queue *q)
+{
+	atomic_long_inc(&q->lock_stat_locks);
+}
+#else
+static inline void blk_lock_stat_bio(struct request_queue *q)
+{
+}
+
+static inline void blk_lock_stat_lock(struct request_queue *q)
+{
+}
+#endif
+
 #ifdef CONFIG_FAIL_IO_TIMEOUT
 int blk_should_fake_timeout(struct request_queue *);
 ssize_t part_timeout_show(struct device *, struct device_attribute *, char *);
@@ -0,0 +1,382 @@
+/*
+ * Null block device driver.
+ *
+ * Completes every request without touching any data, so that the cost
+ * of the block layer itself can be measured.  The queue can be bio based,
+ * request_fn based or multi-queue, and completions can be done inline or
+ * from the block softirq, as a real driver's interrupt handler would.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/bio.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+#include <linux/log2.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+
+#include <asm/div64.h>
+
+struct nullb {
+	struct list_head	list;
+	unsigned int		index;
+	struct request_queue	*q;
+	struct gendisk		*disk;
+};
+
+static LIST_HEAD(nullb_list);
+static DEFINE_MUTEX(nullb_lock);
+static int null_major;
+static int nullb_indexes;
+
+enum {
+	NULL_IRQ_NONE		= 0,
+	NULL_IRQ_SOFTIRQ	= 1,
+};
+
+enum {
+	NULL_Q_BIO		= 0,
+	NULL_Q_RQ		= 1,
+	NULL_Q_MQ		= 2,
+};
+
+static int submit_queues = 1;
+module_param(submit_queues, int, S_IRUGO);
+MODULE_PARM_DESC(submit_queues, "Number of hardware queues for queue_mode=2");
+
+static int queue_mode = NULL_Q_MQ;
+module_param(queue_mode, int, S_IRUGO);
+MODULE_PARM_DESC(queue_mode, "Queue type: 0=bio, 1=request_fn, 2=multi-queue");
+
+static int gb = 250;
+module_param(gb, int, S_IRUGO);
+MODULE_PARM_DESC(gb, "Size in GB");
+
+static int bs = 512;
+module_param(bs, int, S_IRUGO);
+MODULE_PARM_DESC(bs, "Block size (in bytes)");
+
+static int nr_devices = 2;
+module_param(nr_devices, int, S_IRUGO);
+MODULE_PARM_DESC(nr_devices, "Number of devices to register");
+
+static int irqmode = NULL_IRQ_SOFTIRQ;
+module_param(irqmode, int, S_IRUGO);
+MODULE_PARM_DESC(irqmode, "Completion: 0=inline, 1=block softirq");
+
+static int hw_queue_depth = 64;
+module_param(hw_queue_depth, int, S_IRUGO);
+MODULE_PARM_DESC(hw_queue_depth, "Queue depth of each hardware queue");
+
+static unsigned int bench_ios;
+module_param(bench_ios, uint, S_IRUGO);
+MODULE_PARM_DESC(bench_ios, "Reads to time on nullb0 at load, unplugged and plugged");
+
+static unsigned int bench_batch = 32;
+module_param(bench_batch, uint, S_IRUGO);
+MODULE_PARM_DESC(bench_batch, "Reads submitted under each plug by the benchmark");
+
+static void null_softirq_done_fn(struct request *rq)
+{
+	if (queue_mode == NULL_Q_MQ)
+		blk_mq_end_io(rq, 0);
+	else
+		blk_end_request_all(rq, 0);
+}
+
+static void null_handle_rq(struct request *rq)
+{
+	if (irqmode == NULL_IRQ_SOFTIRQ)
+		blk_complete_request(rq);
+	else
+		null_softirq_done_fn(rq);
+}
+
+static int null_queue_bio(struct request_queue *q, struct bio *bio)
+{
+	bio_endio(bio, 0);
+	return 0;
+}
+
+static void null_request_fn(struct request_queue *q)
+{
+	struct request *rq;
+
+	while ((rq = blk_fetch_request(q)) != NULL) {
+		spin_unlock_irq(q->queue_lock);
+		null_handle_rq(rq);
+		spin_lock_irq(q->queue_lock);
+	}
+}
+
+static int null_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *rq)
+{
+	null_handle_rq(rq);
+	return BLK_MQ_RQ_QUEUE_OK;
+}
+
+static struct blk_mq_ops null_mq_ops = {
+	.queue_rq	= null_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+	.complete	= null_softirq_done_fn,
+};
+
+static struct blk_mq_reg null_mq_reg = {
+	.ops		= &null_mq_ops,
+	.numa_node	= -1,
+};
+
+static const struct block_device_operations null_fops = {
+	.owner		= THIS_MODULE,
+};
+
+static void null_del_dev(struct nullb *nullb)
+{
+	list_del_init(&nullb->list);
+
+	del_gendisk(nullb->disk);
+	blk_cleanup_queue(nullb->q);
+	put_disk(nullb->disk);
+	kfree(nullb);
+}
+
+static void null_del_all(void)
+{
+	struct nullb *nullb, *next;
+
+	mutex_lock(&nullb_lock);
+	list_for_each_entry_safe(nullb, next, &nullb_list, list)
+		null_del_dev(nullb);
+	mutex_unlock(&nullb_lock);
+}
+
+static int null_add_dev(void)
+{
+	struct gendisk *disk;
+	struct nullb *nullb;
+	sector_t size;
+
+	nullb = kzalloc(sizeof(*nullb), GFP_KERNEL);
+	if (!nullb)
+		return -ENOMEM;
+
+	switch (queue_mode) {
+	case NULL_Q_MQ:
+		null_mq_reg.nr_hw_queues = submit_queues;
+		null_mq_reg.queue_depth = hw_queue_depth;
+		nullb->q = blk_mq_init_queue(&null_mq_reg, nullb);
+		if (IS_ERR(nullb->q))
+			nullb->q = NULL;
+		break;
+	case NULL_Q_BIO:
+		nullb->q = blk_alloc_queue(GFP_KERNEL);
+		if (nullb->q)
+			blk_queue_make_request(nullb->q, null_queue_bio);
+		break;
+	default:
+		nullb->q = blk_init_queue(null_request_fn, NULL);
+		if (nullb->q)
+			blk_queue_softirq_done(nullb->q, null_softirq_done_fn);
+		break;
+	}
+	if (!nullb->q)
+		goto out_free_nullb;
+
+	nullb->q->queuedata = nullb;
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, nullb->q);
+	blk_queue_logical_block_size(nullb->q, bs);
+	blk_queue_physical_block_size(nullb->q, bs);
+
+	disk = nullb->disk = alloc_disk(1);
+	if (!disk)
+		goto out_cleanup_queue;
+
+	mutex_lock(&nullb_lock);
+	list_add_tail(&nullb->list, &nullb_list);
+	nullb->index = nullb_indexes++;
+	mutex_unlock(&nullb_lock);
+
+	size = (sector_t) gb * 1024 * 1024 * 1024;
+	set_capacity(disk, size >> 9);
+
+	disk->flags |= GENHD_FL_EXT_DEVT;
+	disk->major		= null_major;
+	disk->first_minor	= nullb->index;
+	disk->fops		= &null_fops;
+	disk->private_data	= nullb;
+	disk->queue		= nullb->q;
+	sprintf(disk->disk_name, "nullb%d", nullb->index);
+	add_disk(disk);
+	return 0;
+
+out_cleanup_queue:
+	blk_cleanup_queue(nullb->q);
+out_free_nullb:
+	kfree(nullb);
+	return -ENOMEM;
+}
+
+/*
+ * Load time benchmark: bench_ios sequential reads of one block are
+ * submitted to nullb0 back to back, first each on its own and then
+ * bench_batch at a time under a plug, and the IOPS of both runs are
+ * reported, along with the queue_lock acquisitions per bio if the block
+ * layer counts them.
+ */
+struct null_bench {
+	atomic_t		pending;
+	struct completion	done;
+};
+
+static void null_bench_end_io(struct bio *bio, int err)
+{
+	struct null_bench *nb = bio->bi_private;
+
+	bio_put(bio);
+	if (atomic_dec_and_test(&nb->pending))
+		complete(&nb->done);
+}
+
+static void null_bench_run(struct block_device *bdev, struct page *page,
+			   bool plugged)
+{
+	struct request_queue *q = bdev_get_queue(bdev);
+	sector_t capacity = get_capacity(bdev->bd_disk);
+	sector_t sector = 0;
+	struct null_bench nb;
+	struct blk_plug plug;
+	unsigned int i;
+	ktime_t start;
+	u64 ns, iops;
+#ifdef CONFIG_BLK_DEBUG_LOCK_STATS
+	long bios = atomic_long_read(&q->lock_stat_bios);
+	long locks = atomic_long_read(&q->lock_stat_locks);
+#endif
+
+	atomic_set(&nb.pending, 1);
+	init_completion(&nb.done);
+	start = ktime_get();
+
+	for (i = 0; i < bench_ios; i++) {
+		struct bio *bio;
+
+		if (plugged && !(i % bench_batch))
+			blk_start_plug(&plug);
+
+		bio = bio_alloc(GFP_KERNEL, 1);
+		bio->bi_bdev = bdev;
+		bio->bi_sector = sector;
+		bio->bi_end_io = null_bench_end_io;
+		bio->bi_private = &nb;
+		bio_add_page(bio, page, bs, 0);
+		atomic_inc(&nb.pending);
+		submit_bio(READ, bio);
+
+		sector += bs >> 9;
+		if (sector >= capacity)
+			sector = 0;
+
+		if (plugged && (i % bench_batch == bench_batch - 1 ||
+				i == bench_ios - 1))
+			blk_finish_plug(&plug);
+	}
+
+	if (!atomic_dec_and_test(&nb.pending))
+		wait_for_completion(&nb.done);
+
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	iops = (u64)bench_ios * NSEC_PER_SEC;
+	do_div(iops, max_t(u64, ns, 1));
+
+	printk(KERN_INFO "null_blk: %s: %u reads of %d bytes, %llu IOPS\n",
+	       plugged ? "plugged" : "unplugged", bench_ios, bs, iops);
+#ifdef CONFIG_BLK_DEBUG_LOCK_STATS
+	bios = atomic_long_read(&q->lock_stat_bios) - bios;
+	locks = atomic_long_read(&q->lock_stat_locks) - locks;
+	if (bios)
+		printk(KERN_INFO "null_blk: %s: %ld bios, %ld queue_lock "
+		       "acquisitions, %ld.%03ld per bio\n",
+		       plugged ? "plugged" : "unplugged", bios, locks,
+		       locks / bios, locks * 1000 / bios % 1000);
+#endif
+}
+
+static void null_bench(void)
+{
+	struct block_device *bdev;
+	struct nullb *nullb;
+	struct page *page;
+
+	nullb = list_first_entry(&nullb_list, struct nullb, list);
+	bdev = bdget_disk(nullb->disk, 0);
+	if (!bdev)
+		return;
+	if (blkdev_get(bdev, FMODE_READ))
+		return;
+
+	page = alloc_page(GFP_KERNEL);
+	if (page) {
+		null_bench_run(bdev, page, false);
+		null_bench_run(bdev, page, true);
+		__free_page(page);
+	}
+	blkdev_put(bdev, FMODE_READ);
+}
+
+static int __init null_init(void)
+{
+	unsigned int i;
+
+	if (bs > PAGE_SIZE || bs < 512 || !is_power_of_2(bs)) {
+		printk(KERN_WARNING "null_blk: invalid block size %d\n", bs);
+		bs = 512;
+	}
+
+	if (queue_mode < NULL_Q_BIO || queue_mode > NULL_Q_MQ)
+		queue_mode = NULL_Q_MQ;
+
+	if (submit_queues < 1)
+		submit_queues = 1;
+	else if (submit_queues > nr_cpu_ids)
+		submit_queues = nr_cpu_ids;
+
+	if (hw_queue_depth < 1 || hw_queue_depth > BLK_MQ_MAX_DEPTH)
+		hw_queue_depth = 64;
+
+	if (!bench_batch)
+		bench_batch = 1;
+
+	null_major = register_blkdev(0, "nullb");
+	if (null_major < 0)
+		return null_major;
+
+	for (i = 0; i < nr_devices; i++) {
+		if (null_add_dev()) {
+			null_del_all();
+			unregister_blkdev(null_major, "nullb");
+			return -ENOMEM;
+		}
+	}
+
+	printk(KERN_INFO "null_blk: module loaded\n");
+
+	if (bench_ios && nr_devices)
+		null_bench();
+	return 0;
+}
+
+static void __exit null_exit(void)
+{
+	null_del_all();
+	unregister_blkdev(null_major, "nullb");
+}
+
+module_init(null_init);
+module_exit(null_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Null block device driver");
@@ -25,6 +25,12 @@
 #include <linux/timer.h>
 #include <linux/workqueue.h>
 #include <linux/kthread.h>
+#include <linux/input.h>
+#include <linux/slab.h>
+#include <linux/pm_qos_params.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/cpufreq_interactive.h>
 
 #include <asm/cputime.h>
 
@@ -67,6 +73,18 @@ static unsigned long go_maxspeed_load;
 #define DEFAULT_MIN_SAMPLE_TIME 80000;
 static unsigned long min_sample_time;
 
+/*
+ * Speed to raise all cpus to on an input event, in kHz (0 disables), and
+ * for how long to hold it, in usecs.
+ */
+static unsigned long input_boost_freq;
+#define DEFAULT_INPUT_BOOST_DURATION 80000
+static unsigned long input_boost_duration;
+static unsigned long input_boost_end;
+
+/* Standing floor from PM_QOS_CPU_FREQ_MIN requests, in kHz */
+static unsigned int qos_min_freq;
+
 #define DEBUG 0
 #define BUFSZ 128
 
@@ -167,6 +185,17 @@ struct cpufreq_governor cpufreq_gov_interactive = {
 	.owner = THIS_MODULE,
 };
 
+static unsigned int cpufreq_interactive_floor(void)
+{
+	unsigned int floor = qos_min_freq;
+
+	if (input_boost_freq > floor &&
+	    time_before(jiffies, input_boost_end))
+		floor = input_boost_freq;
+
+	return floor;
+}
+
 static void cpufreq_interactive_timer(unsigned long data)
 {
 	unsigned int delta_idle;
@@ -179,6 +208,8 @@ static void cpufreq_interactive_timer(unsigned long data)
 		&per_cpu(cpuinfo, data);
 	u64 now_idle;
 	unsigned int new_freq;
+	unsigned int floor;
+	unsigned int relation;
 	unsigned int index;
 	unsigned long flags;
 
@@ -255,8 +286,19 @@ static void cpufreq_interactive_timer(unsigned long data)
 	else
 		new_freq = pcpu->policy->max * cpu_load / 100;
 
+	/*
+	 * Hold at least the input boost or PM QoS floor; round up to the
+	 * table so we never end up just below it.
+	 */
+	relation = CPUFREQ_RELATION_H;
+	floor = cpufreq_interactive_floor();
+	if (new_freq < floor) {
+		new_freq = floor;
+		relation = CPUFREQ_RELATION_L;
+	}
+
 	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
-					   new_freq, CPUFREQ_RELATION_H,
+					   new_freq, relation,
 					   &index)) {
 		dbgpr("timer %d: cpufreq_frequency_table_target error\n", (int) data);
 		goto rearm;
@@ -283,6 +325,8 @@ static void cpufreq_interactive_timer(unsigned long data)
 	}
 
 	dbgpr("timer %d: load=%d cur=%d tgt=%d queue\n", (int) data, cpu_load, pcpu->target_freq, new_freq);
+	trace_cpufreq_interactive_target(data, cpu_load, pcpu->target_freq,
+					 new_freq);
 
 	if (new_freq < pcpu->target_freq) {
 		pcpu->target_freq = new_freq;
@@ -490,6 +534,8 @@ static int cpufreq_interactive_up_task(void *data)
 			pcpu->freq_change_time_in_idle =
 				get_cpu_idle_time_us(cpu,
 						     &pcpu->freq_change_time);
+			trace_cpufreq_interactive_setspeed(cpu,
+					pcpu->target_freq, pcpu->policy->cur);
 			dbgpr("up %d: set tgt=%d (actual=%d)\n", cpu, pcpu->target_freq, pcpu->policy->cur);
 		}
 	}
@@ -523,10 +569,151 @@ static void cpufreq_interactive_freq_down(struct work_struct *work)
 		pcpu->freq_change_time_in_idle =
 			get_cpu_idle_time_us(cpu,
 					     &pcpu->freq_change_time);
+		trace_cpufreq_interactive_setspeed(cpu, pcpu->target_freq,
+						   pcpu->policy->cur);
 		dbgpr("down %d: set tgt=%d (actual=%d)\n", cpu, pcpu->target_freq, pcpu->policy->cur);
 	}
 }
 
+/*
+ * cpufreq_interactive_boost - raise every cpu running this governor to at
+ * least 'freq' right away, without waiting for the next load sample. The
+ * timer keeps it there while cpufreq_interactive_floor() says so.
+ *
+ * Called from input event handlers, so must not sleep.
+ */
+static void cpufreq_interactive_boost(unsigned int freq, const char *reason)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu;
+	unsigned int index;
+	unsigned long flags;
+	int boosted = 0;
+	int cpu;
+
+	spin_lock_irqsave(&up_cpumask_lock, flags);
+
+	for_each_online_cpu(cpu) {
+		pcpu = &per_cpu(cpuinfo, cpu);
+
+		smp_rmb();
+
+		if (!pcpu->governor_enabled)
+			continue;
+
+		if (cpufreq_frequency_table_target(pcpu->policy,
+						   pcpu->freq_table, freq,
+						   CPUFREQ_RELATION_L, &index))
+			continue;
+
+		if (pcpu->target_freq < pcpu->freq_table[index].frequency) {
+			pcpu->target_freq = pcpu->freq_table[index].frequency;
+			cpumask_set_cpu(cpu, &up_cpumask);
+			boosted = 1;
+		}
+	}
+
+	spin_unlock_irqrestore(&up_cpumask_lock, flags);
+
+	if (boosted) {
+		trace_cpufreq_interactive_boost(reason, freq);
+		wake_up_process(up_task);
+	}
+}
+
+static void cpufreq_interactive_input_event(struct input_handle *handle,
+					    unsigned int type,
+					    unsigned int code, int value)
+{
+	if (!input_boost_freq)
+		return;
+
+	input_boost_end = jiffies + usecs_to_jiffies(input_boost_duration);
+	cpufreq_interactive_boost(input_boost_freq, "input");
+}
+
+static int cpufreq_interactive_input_connect(struct input_handler *handler,
+					     struct input_dev *dev,
+					     const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int error;
+
+	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "cpufreq_interactive";
+
+	error = input_register_handle(handle);
+	if (error)
+		goto err_free_handle;
+
+	error = input_open_device(handle);
+	if (error)
+		goto err_unregister_handle;
+
+	return 0;
+
+err_unregister_handle:
+	input_unregister_handle(handle);
+err_free_handle:
+	kfree(handle);
+	return error;
+}
+
+static void cpufreq_interactive_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+/* touchscreens, touchpads and keys */
+static const struct input_device_id cpufreq_interactive_ids[] = {
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.absbit = { [BIT_WORD(ABS_MT_POSITION_X)] =
+			    BIT_MASK(ABS_MT_POSITION_X) },
+	},
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_KEYBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.keybit = { [BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH) },
+		.absbit = { [BIT_WORD(ABS_X)] = BIT_MASK(ABS_X) },
+	},
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT,
+		.evbit = { BIT_MASK(EV_KEY) },
+	},
+	{ },
+};
+
+static struct input_handler cpufreq_interactive_input_handler = {
+	.event		= cpufreq_interactive_input_event,
+	.connect	= cpufreq_interactive_input_connect,
+	.disconnect	= cpufreq_interactive_input_disconnect,
+	.name		= "cpufreq_interactive",
+	.id_table	= cpufreq_interactive_ids,
+};
+
+static int cpufreq_interactive_qos_notify(struct notifier_block *nb,
+					  unsigned long val, void *data)
+{
+	qos_min_freq = val;
+	if (qos_min_freq)
+		cpufreq_interactive_boost(qos_min_freq, "qos");
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block cpufreq_interactive_qos_nb = {
+	.notifier_call = cpufreq_interactive_qos_notify,
+};
+
 static ssize_t show_go_maxspeed_load(struct kobject *kobj,
 				     struct attribute *attr, char *buf)
 {
@@ -557,9 +744,56 @@ static ssize_t store_min_sample_time(struct kobject *kobj,
 static struct global_attr min_sample_time_attr = __ATTR(min_sample_time, 0644,
 		show_min_sample_time, store_min_sample_time);
 
+static ssize_t show_input_boost_freq(struct kobject *kobj,
+				     struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", input_boost_freq);
+}
+
+static ssize_t store_input_boost_freq(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	unsigned long val;
+	int ret;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	input_boost_freq = val;
+	return count;
+}
+
+static struct global_attr input_boost_freq_attr = __ATTR(input_boost_freq,
+		0644, show_input_boost_freq, store_input_boost_freq);
+
+static ssize_t show_input_boost_duration(struct kobject *kobj,
+				struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", input_boost_duration);
+}
+
+static ssize_t store_input_boost_duration(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	unsigned long val;
+	int ret;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	input_boost_duration = val;
+	return count;
+}
+
+static struct global_attr input_boost_duration_attr =
+	__ATTR(input_boost_duration, 0644,
+	       show_input_boost_duration, store_input_boost_duration);
+
 static struct attribute *interactive_attributes[] = {
 	&go_maxspeed_load_attr.attr,
 	&min_sample_time_attr.attr,
+	&input_boost_freq_attr.attr,
+	&input_boost_duration_attr.attr,
 	NULL,
 };
 
@@ -640,12 +874,15 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *new_policy,
 
 static int __init cpufreq_interactive_init(void)
 {
+	int ret;
 	unsigned int i;
 	struct cpufreq_interactive_cpuinfo *pcpu;
 	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
 
 	go_maxspeed_load = DEFAULT_GO_MAXSPEED_LOAD;
 	min_sample_time = DEFAULT_MIN_SAMPLE_TIME;
+	input_boost_duration = DEFAULT_INPUT_BOOST_DURATION;
+	input_boost_end = jiffies;
 
 	/* Initalize per-cpu timers */
 	for_each_possible_cpu(i) {
@@ -667,6 +904,7 @@ static int __init cpufreq_interactive_init(void)
 	   warm cache (probably doesn't matter much). */
 	down_wq = alloc_workqueue("knteractive_down", 0, 1);
 
+	ret = -ENOMEM;
 	if (! down_wq)
 		goto err_freeuptask;
 
@@ -682,11 +920,29 @@ static int __init cpufreq_interactive_init(void)
 	dbg_proc->read_proc = dbg_proc_read;
 #endif
 
-	return cpufreq_register_governor(&cpufreq_gov_interactive);
+	qos_min_freq = pm_qos_request(PM_QOS_CPU_FREQ_MIN);
+	pm_qos_add_notifier(PM_QOS_CPU_FREQ_MIN, &cpufreq_interactive_qos_nb);
 
+	ret = input_register_handler(&cpufreq_interactive_input_handler);
+	if (ret)
+		goto err_qos;
+
+	ret = cpufreq_register_governor(&cpufreq_gov_interactive);
+	if (ret)
+		goto err_input;
+
+	return 0;
+
+err_input:
+	input_unregister_handler(&cpufreq_interactive_input_handler);
+err_qos:
+	pm_qos_remove_notifier(PM_QOS_CPU_FREQ_MIN,
+			       &cpufreq_interactive_qos_nb);
+	destroy_workqueue(down_wq);
 err_freeuptask:
+	kthread_stop(up_task);
 	put_task_struct(up_task);
-	return -ENOMEM;
+	return ret;
 }
 
 #ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_INTERACTIVE
@@ -698,6 +954,9 @@ module_init(cpufreq_interactive_init);
 static void __exit cpufreq_interactive_exit(void)
 {
 	cpufreq_unregister_governor(&cpufreq_gov_interactive);
+	input_unregister_handler(&cpufreq_interactive_input_handler);
+	pm_qos_remove_notifier(PM_QOS_CPU_FREQ_MIN,
+			       &cpufreq_interactive_qos_nb);
 	kthread_stop(up_task);
 	put_task_struct(up_task);
 	destroy_workqueue(down_wq);
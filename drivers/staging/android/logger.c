@@ -25,6 +25,8 @@
 #include <linux/poll.h>
 #include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
 #include "logger.h"
 
 #include <asm/ioctls.h>
@@ -34,14 +36,15 @@
  *
  * This structure lives from module insertion until module removal, so it does
  * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * spinlock 'lock', which is only ever held to copy between kernel buffers;
+ * user copies happen outside of it.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
 	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
+	spinlock_t		lock;	/* lock protecting buffer */
 	size_t			w_off;	/* current write head offset */
 	size_t			head;	/* new readers start here */
 	size_t			size;	/* size of the log */
@@ -51,17 +54,29 @@ struct logger_log {
  * struct logger_reader - a logging device open for reading
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. 'list', 'r_off' and 'batch' are protected by log->lock;
+ * 'mutex' serializes read() calls on the reader and protects 'buf'.
  */
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
 	struct list_head	list;	/* entry in logger_log's list */
 	size_t			r_off;	/* current read head offset */
+	struct mutex		mutex;	/* serializes read() */
+	unsigned char		*buf;	/* bounce buffer for read() */
+	int			batch;	/* read() returns many entries */
 };
 
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
 #define logger_offset(n)	((n) & (log->size - 1))
 
+/*
+ * Per-cpu staging buffers for writers, LOGGER_ENTRY_MAX_PAYLOAD bytes each.
+ * A writer copies its payload in here with page faults disabled and holds
+ * log->lock only for the memcpy into the ring, so writers on different cpus
+ * no longer serialize on the user copy.
+ */
+static void __percpu *logger_stage;
+
 /*
  * file_get_log - Given a file structure, return the associated log
  *
@@ -89,7 +104,7 @@ static inline struct logger_log *file_get_log(struct file *file)
  * get_entry_len - Grabs the length of the payload of the next entry starting
  * from 'off'.
  *
- * Caller needs to hold log->mutex.
+ * Caller needs to hold log->lock.
  */
 static __u32 get_entry_len(struct logger_log *log, size_t off)
 {
@@ -108,38 +123,49 @@ static __u32 get_entry_len(struct logger_log *log, size_t off)
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * clock_interval - is a < c < b in mod-space? Put another way, does the line
+ * from a to b cross c?
+ */
+static inline int clock_interval(size_t a, size_t b, size_t c)
+{
+	if (b < a) {
+		if (a < c || b >= c)
+			return 1;
+	} else {
+		if (a < c && b >= c)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * do_read_log - reads exactly 'count' bytes at offset 'off' from 'log' into
+ * the kernel buffer 'buf', and returns the offset just past them.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static size_t do_read_log(struct logger_log *log, size_t off,
+			  unsigned char *buf, size_t count)
 {
 	size_t len;
 
 	/*
 	 * We read from the log in two disjoint operations. First, we read from
-	 * the current read head offset up to 'count' bytes or to the end of
-	 * the log, whichever comes first.
+	 * the given offset up to 'count' bytes or to the end of the log,
+	 * whichever comes first.
 	 */
-	len = min(count, log->size - reader->r_off);
-	if (copy_to_user(buf, log->buffer + reader->r_off, len))
-		return -EFAULT;
+	len = min(count, log->size - off);
+	memcpy(buf, log->buffer + off, len);
 
 	/*
 	 * Second, we read any remaining bytes, starting back at the head of
 	 * the log.
 	 */
 	if (count != len)
-		if (copy_to_user(buf + len, log->buffer, count - len))
-			return -EFAULT;
+		memcpy(buf + len, log->buffer, count - len);
 
-	reader->r_off = logger_offset(reader->r_off + count);
-
-	return count;
+	return logger_offset(off + count);
 }
 
 /*
@@ -149,26 +175,36 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
  *
  * 	- O_NONBLOCK works
  * 	- If there are no log entries to read, blocks until log is written to
- * 	- Atomically reads exactly one log entry
+ * 	- Atomically reads exactly one log entry, or as many whole entries as
+ * 	  fit in the buffer and in LOGGER_ENTRY_MAX_LEN bytes if the reader
+ * 	  enabled LOGGER_SET_BATCH_READ
  *
  * Optimal read size is LOGGER_ENTRY_MAX_LEN. Will set errno to EINVAL if read
  * buffer is insufficient to hold next entry.
+ *
+ * Entries are gathered into the reader's bounce buffer under log->lock and
+ * copied to user space after dropping it, so a reader never stalls writers
+ * on a page fault. The read head only moves past them once the copy has
+ * succeeded, so a faulting read loses nothing.
  */
 static ssize_t logger_read(struct file *file, char __user *buf,
 			   size_t count, loff_t *pos)
 {
 	struct logger_reader *reader = file->private_data;
 	struct logger_log *log = reader->log;
+	size_t len, start, off;
 	ssize_t ret;
 	DEFINE_WAIT(wait);
 
+	if (mutex_lock_interruptible(&reader->mutex))
+		return -EINTR;
 start:
 	while (1) {
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 		if (!ret)
 			break;
 
@@ -187,28 +223,55 @@ start:
 
 	finish_wait(&log->wq, &wait);
 	if (ret)
-		return ret;
+		goto out;
 
-	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 
 	/* is there still something to read or did we race? */
 	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 		goto start;
 	}
 
 	/* get the size of the next entry */
 	ret = get_entry_len(log, reader->r_off);
 	if (count < ret) {
+		spin_unlock(&log->lock);
 		ret = -EINVAL;
 		goto out;
 	}
 
-	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
+	count = min_t(size_t, count, LOGGER_ENTRY_MAX_LEN);
+	start = off = reader->r_off;
+	len = 0;
+	do {
+		off = do_read_log(log, off, reader->buf + len, ret);
+		len += ret;
+		if (!reader->batch || log->w_off == off)
+			break;
+		ret = get_entry_len(log, off);
+	} while (len + ret <= count);
+
+	spin_unlock(&log->lock);
+
+	if (copy_to_user(buf, reader->buf, len)) {
+		ret = -EFAULT;
+		goto out;
+	}
+	ret = len;
+
+	/*
+	 * Commit the read. A writer which lapped us meanwhile has pulled the
+	 * read head forward; keep its position unless it is still within
+	 * what was just returned.
+	 */
+	spin_lock(&log->lock);
+	if (reader->r_off == start || clock_interval(start, off, reader->r_off))
+		reader->r_off = off;
+	spin_unlock(&log->lock);
 
 out:
-	mutex_unlock(&log->mutex);
+	mutex_unlock(&reader->mutex);
 
 	return ret;
 }
@@ -217,7 +280,7 @@ out:
  * get_next_entry - return the offset of the first valid entry at least 'len'
  * bytes after 'off'.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
 static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
 {
@@ -232,30 +295,13 @@ static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
 	return off;
 }
 
-/*
- * clock_interval - is a < c < b in mod-space? Put another way, does the line
- * from a to b cross c?
- */
-static inline int clock_interval(size_t a, size_t b, size_t c)
-{
-	if (b < a) {
-		if (a < c || b >= c)
-			return 1;
-	} else {
-		if (a < c && b >= c)
-			return 1;
-	}
-
-	return 0;
-}
-
 /*
  * fix_up_readers - walk the list of all readers and "fix up" any who were
  * lapped by the writer; also do the same for the default "start head".
  * We do this by "pulling forward" the readers and start head to the first
  * entry after the new write head.
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
 static void fix_up_readers(struct logger_log *log, size_t len)
 {
@@ -274,7 +320,7 @@ static void fix_up_readers(struct logger_log *log, size_t len)
 /*
  * do_write_log - writes 'len' bytes from 'buf' to 'log'
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
 static void do_write_log(struct logger_log *log, const void *buf, size_t count)
 {
@@ -291,92 +337,132 @@ static void do_write_log(struct logger_log *log, const void *buf, size_t count)
 }
 
 /*
- * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
+ * copy_payload_from_user - gathers up to 'count' bytes of payload from the
+ * iovec into 'buf'. With 'atomic' set the caller has page faults disabled
+ * and any fault fails the copy.
  *
- * The caller needs to hold log->mutex.
- *
- * Returns 'count' on success, negative error code on failure.
+ * Returns the number of bytes copied, negative error code on failure.
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
-				      const void __user *buf, size_t count)
+static ssize_t copy_payload_from_user(unsigned char *buf,
+				      const struct iovec *iov,
+				      unsigned long nr_segs, size_t count,
+				      int atomic)
 {
-	size_t len;
+	size_t done = 0;
 
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
-		return -EFAULT;
+	while (nr_segs-- > 0 && done < count) {
+		size_t len;
+		unsigned long left;
 
-	if (count != len)
-		if (copy_from_user(log->buffer, buf + len, count - len))
+		/* figure out how much of this vector we can keep */
+		len = min_t(size_t, iov->iov_len, count - done);
+
+		if (atomic) {
+			if (!access_ok(VERIFY_READ, iov->iov_base, len))
+				return -EFAULT;
+			left = __copy_from_user_inatomic(buf + done,
+							 iov->iov_base, len);
+		} else
+			left = copy_from_user(buf + done, iov->iov_base, len);
+		if (unlikely(left))
 			return -EFAULT;
 
-	log->w_off = logger_offset(log->w_off + count);
+		iov++;
+		done += len;
+	}
 
-	return count;
+	return done;
+}
+
+/*
+ * do_commit_log - appends the entry 'header' with payload 'payload' to 'log'
+ *
+ * The timestamp is taken under log->lock, so entries land in the ring in
+ * timestamp order whichever cpu staged them.
+ */
+static void do_commit_log(struct logger_log *log, struct logger_entry *header,
+			  const void *payload)
+{
+	struct timespec now;
+
+	spin_lock(&log->lock);
+
+	now = current_kernel_time();
+	header->sec = now.tv_sec;
+	header->nsec = now.tv_nsec;
+
+	/*
+	 * Fix up any readers, pulling them forward to the first readable
+	 * entry after (what will be) the new write offset.
+	 */
+	fix_up_readers(log, sizeof(struct logger_entry) + header->len);
+
+	do_write_log(log, header, sizeof(struct logger_entry));
+	do_write_log(log, payload, header->len);
+
+	spin_unlock(&log->lock);
 }
 
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
  * them above all else.
+ *
+ * The payload is first staged in this cpu's staging buffer with page faults
+ * disabled. If that faults, it is copied into a temporary buffer instead,
+ * where faulting is fine. Either way the log itself is only touched once the
+ * whole entry is in kernel memory, so a failed copy leaves the log intact.
  */
 ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
 	struct logger_entry header;
-	struct timespec now;
-	ssize_t ret = 0;
-
-	now = current_kernel_time();
+	unsigned char *payload;
+	ssize_t ret;
 
 	header.pid = current->tgid;
 	header.tid = current->pid;
-	header.sec = now.tv_sec;
-	header.nsec = now.tv_nsec;
 	header.len = min_t(size_t, iocb->ki_left, LOGGER_ENTRY_MAX_PAYLOAD);
 
 	/* null writes succeed, return zero */
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
-
-	/*
-	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
-	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
-
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	payload = per_cpu_ptr(logger_stage, get_cpu());
+	pagefault_disable();
+	ret = copy_payload_from_user(payload, iov, nr_segs, header.len, 1);
+	pagefault_enable();
+	if (likely(ret >= 0)) {
+		header.len = ret;
+		do_commit_log(log, &header, payload);
+		put_cpu();
+	} else {
+		put_cpu();
 
-	while (nr_segs-- > 0) {
-		size_t len;
-		ssize_t nr;
+		payload = kmalloc(header.len, GFP_KERNEL);
+		if (!payload)
+			return -ENOMEM;
 
-		/* figure out how much of this vector we can keep */
-		len = min_t(size_t, iov->iov_len, header.len - ret);
-
-		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
-		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
+		ret = copy_payload_from_user(payload, iov, nr_segs,
+					     header.len, 0);
+		if (likely(ret >= 0)) {
+			header.len = ret;
+			do_commit_log(log, &header, payload);
 		}
-
-		iov++;
-		ret += nr;
+		kfree(payload);
+		if (unlikely(ret < 0))
+			return ret;
 	}
 
-	mutex_unlock(&log->mutex);
-
-	/* wake up any blocked readers */
-	wake_up_interruptible(&log->wq);
+	/*
+	 * wake up any blocked readers; pairs with the barrier in
+	 * prepare_to_wait() so a reader either sees the new w_off or is
+	 * on the wait queue by now
+	 */
+	smp_mb();
+	if (waitqueue_active(&log->wq))
+		wake_up_interruptible(&log->wq);
 
 	return ret;
 }
@@ -408,13 +494,21 @@ static int logger_open(struct inode *inode, struct file *file)
 		if (!reader)
 			return -ENOMEM;
 
+		reader->buf = kmalloc(LOGGER_ENTRY_MAX_LEN, GFP_KERNEL);
+		if (!reader->buf) {
+			kfree(reader);
+			return -ENOMEM;
+		}
+
 		reader->log = log;
+		reader->batch = 0;
+		mutex_init(&reader->mutex);
 		INIT_LIST_HEAD(&reader->list);
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		reader->r_off = log->head;
 		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 
 		file->private_data = reader;
 	} else
@@ -432,7 +526,12 @@ static int logger_release(struct inode *ignored, struct file *file)
 {
 	if (file->f_mode & FMODE_READ) {
 		struct logger_reader *reader = file->private_data;
+		struct logger_log *log = reader->log;
+
+		spin_lock(&log->lock);
 		list_del(&reader->list);
+		spin_unlock(&log->lock);
+		kfree(reader->buf);
 		kfree(reader);
 	}
 
@@ -462,10 +561,10 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 	if (log->w_off != reader->r_off)
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -476,7 +575,7 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	struct logger_reader *reader;
 	long ret = -ENOTTY;
 
-	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
@@ -514,9 +613,18 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		log->head = log->w_off;
 		ret = 0;
 		break;
+	case LOGGER_SET_BATCH_READ:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		reader = file->private_data;
+		reader->batch = !!arg;
+		ret = 0;
+		break;
 	}
 
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -549,7 +657,7 @@ static struct logger_log VAR = { \
 	}, \
 	.wq = __WAIT_QUEUE_HEAD_INITIALIZER(VAR .wq), \
 	.readers = LIST_HEAD_INIT(VAR .readers), \
-	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
+	.lock = __SPIN_LOCK_UNLOCKED(VAR .lock), \
 	.w_off = 0, \
 	.head = 0, \
 	.size = SIZE, \
@@ -594,6 +702,10 @@ static int __init logger_init(void)
 {
 	int ret;
 
+	logger_stage = __alloc_percpu(LOGGER_ENTRY_MAX_PAYLOAD, SMP_CACHE_BYTES);
+	if (!logger_stage)
+		return -ENOMEM;
+
 	ret = init_log(&log_main);
 	if (unlikely(ret))
 		goto out;
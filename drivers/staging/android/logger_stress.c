@@ -0,0 +1,317 @@
+/*
+ * drivers/staging/android/logger_stress.c
+ *
+ * Concurrent writer stress test for the Android logger
+ *
+ * Starts a number of kernel threads which write liblog style entries
+ * (priority, tag, message) to a log device through writev() as fast as
+ * they can for a fixed time, optionally with non-blocking readers draining
+ * the log at the same time, then reports writes per second and the mean and
+ * worst writer latency. Load the module to run the test; the results are
+ * printed when the run is over, and unloading the module stops a run early.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/uio.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/err.h>
+#include <linux/uaccess.h>
+#include "logger.h"
+
+#include <asm/div64.h>
+
+static char *log_path = "/dev/log/main";
+module_param(log_path, charp, 0444);
+MODULE_PARM_DESC(log_path, "Log device to write to");
+
+static int nr_writers;
+module_param(nr_writers, int, 0444);
+MODULE_PARM_DESC(nr_writers, "Writer threads (default: two per online cpu)");
+
+static int nr_readers = 1;
+module_param(nr_readers, int, 0444);
+MODULE_PARM_DESC(nr_readers, "Reader threads draining the log");
+
+static int duration = 10;
+module_param(duration, int, 0444);
+MODULE_PARM_DESC(duration, "Length of the run in seconds");
+
+static int payload = 128;
+module_param(payload, int, 0444);
+MODULE_PARM_DESC(payload, "Message length of each entry in bytes");
+
+#define STRESS_TAG	"logger_stress"
+#define STRESS_PRIO	4		/* ANDROID_LOG_INFO */
+
+struct stress_thread {
+	struct task_struct *task;
+	unsigned long ops;		/* entries written or read */
+	unsigned long errors;
+	u64 total_ns;
+	u64 max_ns;
+};
+
+static struct stress_thread *writers;
+static struct stress_thread *readers;
+static struct task_struct *reporter;
+
+static unsigned long stress_deadline;
+static ktime_t stress_start;
+static atomic_t stress_running;
+static DECLARE_WAIT_QUEUE_HEAD(stress_wq);
+
+/* kthread_stop() must find the thread alive, so finished threads park */
+static void stress_idle(void)
+{
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+}
+
+static bool stress_over(void)
+{
+	return kthread_should_stop() || time_after(jiffies, stress_deadline);
+}
+
+static int stress_writer(void *arg)
+{
+	struct stress_thread *w = arg;
+	unsigned char prio = STRESS_PRIO;
+	struct file *file;
+	struct iovec iov[3];
+	mm_segment_t old_fs;
+	char *msg;
+
+	msg = kmalloc(payload, GFP_KERNEL);
+	file = filp_open(log_path, O_WRONLY, 0);
+	if (!msg || IS_ERR(file)) {
+		w->errors++;
+		goto out;
+	}
+	memset(msg, 'x', payload - 1);
+	msg[payload - 1] = '\0';
+
+	iov[0].iov_base = &prio;
+	iov[0].iov_len = 1;
+	iov[1].iov_base = STRESS_TAG;
+	iov[1].iov_len = sizeof(STRESS_TAG);
+	iov[2].iov_base = msg;
+	iov[2].iov_len = payload;
+
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+	while (!stress_over()) {
+		loff_t pos = 0;
+		ktime_t start = ktime_get();
+		ssize_t ret;
+		u64 ns;
+
+		ret = vfs_writev(file, (const struct iovec __user *)iov, 3,
+				 &pos);
+		ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+		if (ret < 0) {
+			w->errors++;
+			continue;
+		}
+		w->ops++;
+		w->total_ns += ns;
+		w->max_ns = max(w->max_ns, ns);
+		cond_resched();
+	}
+	set_fs(old_fs);
+
+out:
+	if (!IS_ERR_OR_NULL(file))
+		filp_close(file, NULL);
+	kfree(msg);
+	if (atomic_dec_and_test(&stress_running))
+		wake_up(&stress_wq);
+	stress_idle();
+	return 0;
+}
+
+/* readers never block, so that they cannot hold up kthread_stop() */
+static int stress_reader(void *arg)
+{
+	struct stress_thread *r = arg;
+	struct file *file;
+	mm_segment_t old_fs;
+	char *buf;
+
+	buf = kmalloc(LOGGER_ENTRY_MAX_LEN, GFP_KERNEL);
+	file = filp_open(log_path, O_RDONLY | O_NONBLOCK, 0);
+	if (!buf || IS_ERR(file)) {
+		r->errors++;
+		goto out;
+	}
+
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+	while (!stress_over()) {
+		loff_t pos = 0;
+		ssize_t ret;
+
+		ret = vfs_read(file, (char __user *)buf, LOGGER_ENTRY_MAX_LEN,
+			       &pos);
+		if (ret == -EAGAIN)
+			schedule_timeout_interruptible(1);
+		else if (ret < 0)
+			r->errors++;
+		else
+			r->ops++;
+		cond_resched();
+	}
+	set_fs(old_fs);
+
+out:
+	if (!IS_ERR_OR_NULL(file))
+		filp_close(file, NULL);
+	kfree(buf);
+	if (atomic_dec_and_test(&stress_running))
+		wake_up(&stress_wq);
+	stress_idle();
+	return 0;
+}
+
+static int stress_reporter(void *arg)
+{
+	unsigned long writes = 0, reads = 0, errors = 0;
+	u64 total_ns = 0, max_ns = 0;
+	u64 elapsed_ms, rate, avg_ns;
+	int i;
+
+	wait_event_interruptible(stress_wq, !atomic_read(&stress_running) ||
+				 kthread_should_stop());
+	if (atomic_read(&stress_running))
+		goto out;
+
+	elapsed_ms = ktime_to_ns(ktime_sub(ktime_get(), stress_start));
+	do_div(elapsed_ms, NSEC_PER_MSEC);
+
+	for (i = 0; i < nr_writers; i++) {
+		writes += writers[i].ops;
+		errors += writers[i].errors;
+		total_ns += writers[i].total_ns;
+		max_ns = max(max_ns, writers[i].max_ns);
+	}
+	for (i = 0; i < nr_readers; i++) {
+		reads += readers[i].ops;
+		errors += readers[i].errors;
+	}
+
+	rate = (u64)writes * MSEC_PER_SEC;
+	do_div(rate, max_t(u64, elapsed_ms, 1));
+	avg_ns = total_ns;
+	if (writes)
+		do_div(avg_ns, writes);
+
+	pr_info("logger_stress: %s: %d writers, %d readers, %d byte entries, "
+		"%llu ms\n", log_path, nr_writers, nr_readers, payload,
+		elapsed_ms);
+	pr_info("logger_stress: %lu writes, %llu writes/s, latency avg %llu ns "
+		"max %llu ns, %lu reads, %lu errors\n",
+		writes, rate, avg_ns, max_ns, reads, errors);
+out:
+	stress_idle();
+	return 0;
+}
+
+static void stress_stop(void)
+{
+	int i;
+
+	if (reporter)
+		kthread_stop(reporter);
+	for (i = 0; writers && i < nr_writers; i++)
+		if (writers[i].task)
+			kthread_stop(writers[i].task);
+	for (i = 0; readers && i < nr_readers; i++)
+		if (readers[i].task)
+			kthread_stop(readers[i].task);
+	kfree(writers);
+	kfree(readers);
+}
+
+static int __init logger_stress_init(void)
+{
+	int i;
+
+	if (nr_writers <= 0)
+		nr_writers = 2 * num_online_cpus();
+	if (nr_readers < 0)
+		nr_readers = 0;
+	if (duration <= 0)
+		duration = 10;
+	payload = clamp_t(int, payload, 1,
+			  LOGGER_ENTRY_MAX_PAYLOAD - 1 - sizeof(STRESS_TAG));
+
+	writers = kcalloc(nr_writers, sizeof(*writers), GFP_KERNEL);
+	readers = kcalloc(nr_readers, sizeof(*readers), GFP_KERNEL);
+	if (!writers || (nr_readers && !readers)) {
+		kfree(writers);
+		kfree(readers);
+		return -ENOMEM;
+	}
+
+	atomic_set(&stress_running, nr_writers + nr_readers);
+	stress_deadline = jiffies + duration * HZ;
+	stress_start = ktime_get();
+
+	for (i = 0; i < nr_readers; i++) {
+		readers[i].task = kthread_run(stress_reader, &readers[i],
+					      "logger_rd/%d", i);
+		if (IS_ERR(readers[i].task))
+			goto fail;
+	}
+	for (i = 0; i < nr_writers; i++) {
+		writers[i].task = kthread_run(stress_writer, &writers[i],
+					      "logger_wr/%d", i);
+		if (IS_ERR(writers[i].task))
+			goto fail;
+	}
+	reporter = kthread_run(stress_reporter, NULL, "logger_stress");
+	if (IS_ERR(reporter))
+		goto fail;
+	return 0;
+
+fail:
+	/* threads which never started are not waited for */
+	if (IS_ERR(reporter))
+		reporter = NULL;
+	for (i = 0; i < nr_readers; i++)
+		if (IS_ERR(readers[i].task))
+			readers[i].task = NULL;
+	for (i = 0; i < nr_writers; i++)
+		if (IS_ERR(writers[i].task))
+			writers[i].task = NULL;
+	stress_stop();
+	return -ENOMEM;
+}
+
+static void __exit logger_stress_exit(void)
+{
+	stress_stop();
+}
+
+module_init(logger_stress_init);
+module_exit(logger_stress_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Android logger concurrent writer stress test");
@@ -16,6 +16,17 @@
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
  *
+ * Processes are kept in one bucket per oom_adj value, updated from the
+ * oom_adj and task free notifiers, so a shrink pass only looks at the
+ * buckets at or above the selected oom_adj instead of walking the task
+ * list. Each bucket is ordered by the rss last seen for its processes;
+ * before a victim is taken from a bucket, the rss of every process in it
+ * is refreshed. Processes that could not be tracked when their notifier
+ * ran are picked up by a task list walk on the next pass. A single pass
+ * kills up to /sys/module/lowmemorykiller/parameters/max_victims processes,
+ * stopping as soon as their rss covers the shortfall below the minfree
+ * threshold that triggered it.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -35,6 +46,11 @@
 #include <linux/oom.h>
 #include <linux/sched.h>
 #include <linux/notifier.h>
+#include <linux/slab.h>
+#include <linux/mempool.h>
+#include <linux/hash.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
 
 static uint32_t lowmem_debug_level = 2;
 static int lowmem_adj[6] = {
@@ -52,7 +68,45 @@ static size_t lowmem_minfree[6] = {
 };
 static int lowmem_minfree_size = 4;
 
-static struct task_struct *lowmem_deathpending;
+static int lowmem_max_victims = 4;
+
+/*
+ * One entry per tracked thread group, keyed by its group leader. Entries
+ * are created and moved between buckets from the oom_adj notifier and
+ * removed when the group leader is freed. lowmem_lock protects the hash,
+ * the buckets and every field below; it is taken with interrupts disabled
+ * because the task free notifier can run from an RCU callback.
+ */
+struct lowmem_task {
+	struct hlist_node hash;
+	struct list_head bucket;
+	struct task_struct *task;
+	int oom_adj;
+	int rss;
+	unsigned int rss_seq;
+	unsigned int skip_seq;
+	int killed;
+};
+
+#define LOWMEM_HASH_BITS	7
+#define LOWMEM_BUCKETS		(OOM_ADJUST_MAX - OOM_DISABLE + 1)
+
+/* entries kept in reserve for forks under memory pressure */
+#define LOWMEM_RESERVE		32
+
+static DEFINE_SPINLOCK(lowmem_lock);
+static struct hlist_head lowmem_task_hash[1 << LOWMEM_HASH_BITS];
+static struct list_head lowmem_buckets[LOWMEM_BUCKETS];
+static struct kmem_cache *lowmem_task_cachep;
+static mempool_t *lowmem_task_pool;
+/* processes the notifiers failed to track, lowmem_lock held */
+static int lowmem_untracked;
+
+/* serializes shrink passes; also protects lowmem_scan_seq */
+static DEFINE_MUTEX(lowmem_scan_mutex);
+static unsigned int lowmem_scan_seq;
+
+static int lowmem_deathpending;
 static unsigned long lowmem_deathpending_timeout;
 
 #define lowmem_print(level, x...)			\
@@ -61,6 +115,93 @@ static unsigned long lowmem_deathpending_timeout;
 			printk(x);			\
 	} while (0)
 
+static struct list_head *lowmem_bucket(int oom_adj)
+{
+	if (oom_adj < OOM_DISABLE)
+		oom_adj = OOM_DISABLE;
+	if (oom_adj > OOM_ADJUST_MAX)
+		oom_adj = OOM_ADJUST_MAX;
+	return &lowmem_buckets[oom_adj - OOM_DISABLE];
+}
+
+static struct lowmem_task *lowmem_find_task(struct task_struct *task)
+{
+	struct lowmem_task *lt;
+	struct hlist_node *node;
+
+	hlist_for_each_entry(lt, node,
+			&lowmem_task_hash[hash_ptr(task, LOWMEM_HASH_BITS)],
+			hash) {
+		if (lt->task == task)
+			return lt;
+	}
+	return NULL;
+}
+
+/* keep each bucket sorted by rss, largest first */
+static void lowmem_bucket_insert(struct lowmem_task *lt)
+{
+	struct list_head *head = lowmem_bucket(lt->oom_adj);
+	struct lowmem_task *pos;
+
+	list_for_each_entry(pos, head, bucket) {
+		if (pos->rss < lt->rss)
+			break;
+	}
+	list_add_tail(&lt->bucket, &pos->bucket);
+}
+
+static int lowmem_track_task(struct task_struct *task, int oom_adj)
+{
+	struct lowmem_task *lt;
+
+	lt = lowmem_find_task(task);
+	if (lt) {
+		if (lt->oom_adj == oom_adj)
+			return 0;
+		list_del(&lt->bucket);
+	} else {
+		/* called under tasklist_lock from fork, so it can't sleep */
+		lt = mempool_alloc(lowmem_task_pool, GFP_ATOMIC);
+		if (!lt) {
+			lowmem_untracked++;
+			return -ENOMEM;
+		}
+		memset(lt, 0, sizeof(*lt));
+		lt->task = task;
+		hlist_add_head(&lt->hash,
+			&lowmem_task_hash[hash_ptr(task, LOWMEM_HASH_BITS)]);
+	}
+	lt->oom_adj = oom_adj;
+	lowmem_bucket_insert(lt);
+	return 0;
+}
+
+static int
+adj_notify_func(struct notifier_block *self, unsigned long val, void *data)
+{
+	struct task_struct *task = ((struct task_struct *)data)->group_leader;
+	unsigned long flags;
+	int ret;
+
+	/* kernel threads are never killed, don't track them */
+	if (!task->mm)
+		return NOTIFY_OK;
+
+	spin_lock_irqsave(&lowmem_lock, flags);
+	ret = lowmem_track_task(task, task->signal->oom_adj);
+	spin_unlock_irqrestore(&lowmem_lock, flags);
+	if (ret)
+		lowmem_print(1, "failed to track %d (%s), adj %d\n",
+			     task->pid, task->comm, task->signal->oom_adj);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block adj_nb = {
+	.notifier_call	= adj_notify_func,
+};
+
 static int
 task_notify_func(struct notifier_block *self, unsigned long val, void *data);
 
@@ -72,23 +213,147 @@ static int
 task_notify_func(struct notifier_block *self, unsigned long val, void *data)
 {
 	struct task_struct *task = data;
+	struct lowmem_task *lt;
+	unsigned long flags;
 
-	if (task == lowmem_deathpending)
-		lowmem_deathpending = NULL;
+	spin_lock_irqsave(&lowmem_lock, flags);
+	lt = lowmem_find_task(task);
+	if (lt) {
+		hlist_del(&lt->hash);
+		list_del(&lt->bucket);
+		if (lt->killed)
+			lowmem_deathpending--;
+	}
+	spin_unlock_irqrestore(&lowmem_lock, flags);
+	if (lt)
+		mempool_free(lt, lowmem_task_pool);
 
 	return NOTIFY_OK;
 }
 
-static int lowmem_shrink(struct shrinker *s, int nr_to_scan, gfp_t gfp_mask)
+/* track every process not tracked yet */
+static void lowmem_track_all(void)
 {
 	struct task_struct *p;
-	struct task_struct *selected = NULL;
+	unsigned long flags;
+
+	read_lock(&tasklist_lock);
+	spin_lock_irqsave(&lowmem_lock, flags);
+	lowmem_untracked = 0;
+	for_each_process(p) {
+		if (!p->mm || lowmem_find_task(p))
+			continue;
+		if (lowmem_track_task(p, p->signal->oom_adj))
+			lowmem_print(1, "failed to track %d (%s)\n",
+				     p->pid, p->comm);
+	}
+	spin_unlock_irqrestore(&lowmem_lock, flags);
+	read_unlock(&tasklist_lock);
+}
+
+/* first candidate not yet killed or skipped in this pass, lowmem_lock held */
+static struct lowmem_task *lowmem_next(int min_adj, unsigned int seq)
+{
+	struct lowmem_task *lt;
+	int adj;
+
+	for (adj = OOM_ADJUST_MAX; adj >= max(min_adj, OOM_DISABLE); adj--) {
+		list_for_each_entry(lt, lowmem_bucket(adj), bucket) {
+			if (!lt->killed && lt->skip_seq != seq)
+				return lt;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * A candidate in the same bucket as lt whose rss was not refreshed in
+ * this pass, or NULL. lowmem_lock held.
+ */
+static struct lowmem_task *lowmem_stale(struct lowmem_task *lt,
+					unsigned int seq)
+{
+	struct lowmem_task *pos;
+
+	list_for_each_entry(pos, lowmem_bucket(lt->oom_adj), bucket) {
+		if (!pos->killed && pos->skip_seq != seq &&
+		    pos->rss_seq != seq)
+			return pos;
+	}
+	return NULL;
+}
+
+/*
+ * Find the next victim: the process with the largest rss in the highest
+ * non-empty bucket at or above min_adj. Every candidate in that bucket
+ * whose cached rss is older than this pass is refreshed and re-sorted
+ * first, so the one returned is the largest as of now. The returned task
+ * holds a reference.
+ */
+static struct task_struct *lowmem_select(int min_adj, unsigned int seq,
+					 int *oom_adj, int *tasksize)
+{
+	struct lowmem_task *lt, *stale;
+	struct task_struct *p;
+	struct mm_struct *mm;
+	unsigned long flags;
+	int rss;
+
+	for (;;) {
+		spin_lock_irqsave(&lowmem_lock, flags);
+		lt = lowmem_next(min_adj, seq);
+		if (!lt) {
+			spin_unlock_irqrestore(&lowmem_lock, flags);
+			return NULL;
+		}
+		stale = lowmem_stale(lt, seq);
+		if (!stale) {
+			p = lt->task;
+			get_task_struct(p);
+			*oom_adj = lt->oom_adj;
+			*tasksize = lt->rss;
+			spin_unlock_irqrestore(&lowmem_lock, flags);
+			return p;
+		}
+		lt = stale;
+		p = lt->task;
+		get_task_struct(p);
+		spin_unlock_irqrestore(&lowmem_lock, flags);
+
+		task_lock(p);
+		mm = p->mm;
+		rss = mm ? get_mm_rss(mm) : 0;
+		task_unlock(p);
+
+		/* the reference on p keeps lt alive, its bucket may change */
+		spin_lock_irqsave(&lowmem_lock, flags);
+		if (rss <= 0) {
+			lt->skip_seq = seq;
+		} else {
+			list_del(&lt->bucket);
+			lt->rss = rss;
+			lt->rss_seq = seq;
+			lowmem_bucket_insert(lt);
+		}
+		spin_unlock_irqrestore(&lowmem_lock, flags);
+		/* may end up in task_notify_func, so not under lowmem_lock */
+		put_task_struct(p);
+	}
+}
+
+static int lowmem_shrink(struct shrinker *s, int nr_to_scan, gfp_t gfp_mask)
+{
+	struct task_struct *selected;
 	int rem = 0;
 	int tasksize;
 	int i;
 	int min_adj = OOM_ADJUST_MAX + 1;
-	int selected_tasksize = 0;
 	int selected_oom_adj;
+	int target = 0;
+	int freed = 0;
+	int victims = 0;
+	unsigned int seq;
+	unsigned long flags;
 	int array_size = ARRAY_SIZE(lowmem_adj);
 	int other_free = global_page_state(NR_FREE_PAGES);
 	int other_file = global_page_state(NR_FILE_PAGES) -
@@ -113,6 +378,7 @@ static int lowmem_shrink(struct shrinker *s, int nr_to_scan, gfp_t gfp_mask)
 		if (other_free < lowmem_minfree[i] &&
 		    other_file < lowmem_minfree[i]) {
 			min_adj = lowmem_adj[i];
+			target = lowmem_minfree[i] - other_free;
 			break;
 		}
 	}
@@ -129,55 +395,40 @@ static int lowmem_shrink(struct shrinker *s, int nr_to_scan, gfp_t gfp_mask)
 			     nr_to_scan, gfp_mask, rem);
 		return rem;
 	}
-	selected_oom_adj = min_adj;
 
-	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		struct mm_struct *mm;
-		struct signal_struct *sig;
-		int oom_adj;
+	/* another pass is already killing for us */
+	if (!mutex_trylock(&lowmem_scan_mutex))
+		return 0;
+	seq = ++lowmem_scan_seq;
 
-		task_lock(p);
-		mm = p->mm;
-		sig = p->signal;
-		if (!mm || !sig) {
-			task_unlock(p);
-			continue;
-		}
-		oom_adj = sig->oom_adj;
-		if (oom_adj < min_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_adj < selected_oom_adj)
-				continue;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
-				continue;
-		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
-	}
-	if (selected) {
+	/* racy check, the walk itself is done under lowmem_lock */
+	if (lowmem_untracked)
+		lowmem_track_all();
+
+	while (freed < target && victims < lowmem_max_victims) {
+		selected = lowmem_select(min_adj, seq, &selected_oom_adj,
+					 &tasksize);
+		if (!selected)
+			break;
 		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
 			     selected->pid, selected->comm,
-			     selected_oom_adj, selected_tasksize);
-		lowmem_deathpending = selected;
+			     selected_oom_adj, tasksize);
+		spin_lock_irqsave(&lowmem_lock, flags);
+		lowmem_find_task(selected)->killed = 1;
+		lowmem_deathpending++;
 		lowmem_deathpending_timeout = jiffies + HZ;
+		spin_unlock_irqrestore(&lowmem_lock, flags);
 		force_sig(SIGKILL, selected);
-		rem -= selected_tasksize;
+		put_task_struct(selected);
+		freed += tasksize;
+		victims++;
 	}
-	lowmem_print(4, "lowmem_shrink %d, %x, return %d\n",
-		     nr_to_scan, gfp_mask, rem);
-	read_unlock(&tasklist_lock);
+	mutex_unlock(&lowmem_scan_mutex);
+
+	rem -= freed;
+	lowmem_print(4, "lowmem_shrink %d, %x, target %d, killed %d (%d), "
+		     "return %d\n", nr_to_scan, gfp_mask, target, victims,
+		     freed, rem);
 	return rem;
 }
 
@@ -188,15 +439,53 @@ static struct shrinker lowmem_shrinker = {
 
 static int __init lowmem_init(void)
 {
+	int i;
+
+	lowmem_task_cachep = KMEM_CACHE(lowmem_task, 0);
+	if (!lowmem_task_cachep)
+		return -ENOMEM;
+	lowmem_task_pool = mempool_create_slab_pool(LOWMEM_RESERVE,
+						    lowmem_task_cachep);
+	if (!lowmem_task_pool) {
+		kmem_cache_destroy(lowmem_task_cachep);
+		return -ENOMEM;
+	}
+	for (i = 0; i < LOWMEM_BUCKETS; i++)
+		INIT_LIST_HEAD(&lowmem_buckets[i]);
+
 	task_free_register(&task_nb);
+	register_oom_adj_notifier(&adj_nb);
+
+	/* pick up the processes that were forked before the notifier */
+	lowmem_track_all();
+
 	register_shrinker(&lowmem_shrinker);
 	return 0;
 }
 
 static void __exit lowmem_exit(void)
 {
+	struct lowmem_task *lt;
+	struct hlist_node *node, *n;
+	unsigned long flags;
+	int i;
+
 	unregister_shrinker(&lowmem_shrinker);
+	unregister_oom_adj_notifier(&adj_nb);
 	task_free_unregister(&task_nb);
+
+	spin_lock_irqsave(&lowmem_lock, flags);
+	for (i = 0; i < ARRAY_SIZE(lowmem_task_hash); i++) {
+		hlist_for_each_entry_safe(lt, node, n, &lowmem_task_hash[i],
+					  hash) {
+			hlist_del(&lt->hash);
+			list_del(&lt->bucket);
+			mempool_free(lt, lowmem_task_pool);
+		}
+	}
+	spin_unlock_irqrestore(&lowmem_lock, flags);
+	mempool_destroy(lowmem_task_pool);
+	kmem_cache_destroy(lowmem_task_cachep);
 }
 
 module_param_named(cost, lowmem_shrinker.seeks, int, S_IRUGO | S_IWUSR);
@@ -205,6 +494,7 @@ module_param_array_named(adj, lowmem_adj, int, &lowmem_adj_size,
 module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
+module_param_named(max_victims, lowmem_max_victims, int, S_IRUGO | S_IWUSR);
 
 module_init(lowmem_init);
 module_exit(lowmem_exit);
@@ -0,0 +1,221 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/lzo.h>
+#include <linux/zlib.h>
+
+#include "zcomp.h"
+
+static void *zcomp_lzo_create(void)
+{
+	return kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
+}
+
+static void zcomp_lzo_destroy(void *private)
+{
+	kfree(private);
+}
+
+static int zcomp_lzo_compress(const unsigned char *src, unsigned char *dst,
+			size_t *dst_len, void *private)
+{
+	int ret;
+
+	ret = lzo1x_1_compress(src, PAGE_SIZE, dst, dst_len, private);
+	return ret == LZO_E_OK ? 0 : ret;
+}
+
+static int zcomp_lzo_decompress(const unsigned char *src, size_t src_len,
+			unsigned char *dst, void *private)
+{
+	int ret;
+	size_t dst_len = PAGE_SIZE;
+
+	ret = lzo1x_decompress_safe(src, src_len, dst, &dst_len);
+	return ret == LZO_E_OK ? 0 : ret;
+}
+
+#if defined(CONFIG_ZRAM_DEFLATE)
+/*
+ * Raw deflate (no zlib header). The window never needs to be larger
+ * than the page being compressed.
+ */
+#define ZCOMP_DEFLATE_LEVEL	Z_DEFAULT_COMPRESSION
+#define ZCOMP_DEFLATE_WINBITS	PAGE_SHIFT
+#define ZCOMP_DEFLATE_MEMLEVEL	MAX_MEM_LEVEL
+
+struct zcomp_deflate {
+	struct z_stream_s def;
+	struct z_stream_s inf;
+};
+
+static void zcomp_deflate_destroy(void *private)
+{
+	struct zcomp_deflate *zd = private;
+
+	if (!zd)
+		return;
+
+	vfree(zd->def.workspace);
+	kfree(zd->inf.workspace);
+	kfree(zd);
+}
+
+static void *zcomp_deflate_create(void)
+{
+	struct zcomp_deflate *zd;
+
+	zd = kzalloc(sizeof(*zd), GFP_KERNEL);
+	if (!zd)
+		return NULL;
+
+	zd->def.workspace = vmalloc(zlib_deflate_workspacesize());
+	zd->inf.workspace = kmalloc(zlib_inflate_workspacesize(), GFP_KERNEL);
+	if (!zd->def.workspace || !zd->inf.workspace)
+		goto fail;
+
+	if (zlib_deflateInit2(&zd->def, ZCOMP_DEFLATE_LEVEL, Z_DEFLATED,
+			-ZCOMP_DEFLATE_WINBITS, ZCOMP_DEFLATE_MEMLEVEL,
+			Z_DEFAULT_STRATEGY) != Z_OK)
+		goto fail;
+
+	if (zlib_inflateInit2(&zd->inf, -ZCOMP_DEFLATE_WINBITS) != Z_OK)
+		goto fail;
+
+	return zd;
+
+fail:
+	zcomp_deflate_destroy(zd);
+	return NULL;
+}
+
+static int zcomp_deflate_compress(const unsigned char *src,
+			unsigned char *dst, size_t *dst_len, void *private)
+{
+	int ret;
+	struct z_stream_s *stream = &((struct zcomp_deflate *)private)->def;
+
+	ret = zlib_deflateReset(stream);
+	if (ret != Z_OK)
+		return ret;
+
+	stream->next_in = src;
+	stream->avail_in = PAGE_SIZE;
+	stream->next_out = dst;
+	stream->avail_out = 2 * PAGE_SIZE;
+
+	ret = zlib_deflate(stream, Z_FINISH);
+	if (ret != Z_STREAM_END)
+		return ret < 0 ? ret : -EINVAL;
+
+	*dst_len = stream->total_out;
+	return 0;
+}
+
+static int zcomp_deflate_decompress(const unsigned char *src, size_t src_len,
+			unsigned char *dst, void *private)
+{
+	int ret;
+	struct z_stream_s *stream = &((struct zcomp_deflate *)private)->inf;
+
+	ret = zlib_inflateReset(stream);
+	if (ret != Z_OK)
+		return ret;
+
+	stream->next_in = src;
+	stream->avail_in = src_len;
+	stream->next_out = dst;
+	stream->avail_out = PAGE_SIZE;
+
+	ret = zlib_inflate(stream, Z_SYNC_FLUSH);
+	/*
+	 * zlib sometimes wants to taste an extra byte in raw deflate mode
+	 * (same workaround as crypto/deflate.c).
+	 */
+	if (ret == Z_OK && !stream->avail_in && stream->avail_out) {
+		u8 zerostuff = 0;
+
+		stream->next_in = &zerostuff;
+		stream->avail_in = 1;
+		ret = zlib_inflate(stream, Z_FINISH);
+	}
+
+	if (ret != Z_STREAM_END || stream->total_out != PAGE_SIZE)
+		return ret < 0 ? ret : -EINVAL;
+
+	return 0;
+}
+#endif /* CONFIG_ZRAM_DEFLATE */
+
+static const struct zcomp_backend zcomp_backends[] = {
+	{
+		.name		= "lzo",
+		.create		= zcomp_lzo_create,
+		.destroy	= zcomp_lzo_destroy,
+		.compress	= zcomp_lzo_compress,
+		.decompress	= zcomp_lzo_decompress,
+	},
+#if defined(CONFIG_ZRAM_DEFLATE)
+	{
+		.name		= "deflate",
+		.create		= zcomp_deflate_create,
+		.destroy	= zcomp_deflate_destroy,
+		.compress	= zcomp_deflate_compress,
+		.decompress	= zcomp_deflate_decompress,
+	},
+#endif
+};
+
+/*
+ * Look up a backend by name; a NULL name gives the default (lzo).
+ * Trailing newlines are ignored so the result of a sysfs write can be
+ * passed in directly.
+ */
+const struct zcomp_backend *zcomp_find(const char *name)
+{
+	int i;
+
+	if (!name)
+		return &zcomp_backends[0];
+
+	for (i = 0; i < ARRAY_SIZE(zcomp_backends); i++)
+		if (sysfs_streq(name, zcomp_backends[i].name))
+			return &zcomp_backends[i];
+
+	return NULL;
+}
+
+/* List all backends, with the current one in brackets */
+ssize_t zcomp_available_show(const struct zcomp_backend *cur, char *buf)
+{
+	int i;
+	ssize_t len = 0;
+
+	for (i = 0; i < ARRAY_SIZE(zcomp_backends); i++) {
+		const struct zcomp_backend *b = &zcomp_backends[i];
+
+		if (b == cur)
+			len += sprintf(buf + len, "[%s] ", b->name);
+		else
+			len += sprintf(buf + len, "%s ", b->name);
+	}
+	buf[len - 1] = '\n';
+
+	return len;
+}
@@ -0,0 +1,43 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#ifndef _ZCOMP_H_
+#define _ZCOMP_H_
+
+#include <linux/types.h>
+
+/*
+ * A compression backend. Each zram stream owns one private state created
+ * with create(). compress() calls on a state are serialized by the stream
+ * lock; decompress() runs with preemption disabled and may overlap with a
+ * compress() on the same state, so the two must not share scratch memory.
+ *
+ * compress() always consumes one page and may write up to 2 * PAGE_SIZE
+ * bytes to dst. decompress() must produce exactly one page. Both return 0
+ * on success and a negative value otherwise.
+ */
+struct zcomp_backend {
+	const char *name;
+	void *(*create)(void);
+	void (*destroy)(void *private);
+	int (*compress)(const unsigned char *src, unsigned char *dst,
+			size_t *dst_len, void *private);
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, void *private);
+};
+
+const struct zcomp_backend *zcomp_find(const char *name);
+ssize_t zcomp_available_show(const struct zcomp_backend *cur, char *buf);
+
+#endif
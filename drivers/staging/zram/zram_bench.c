@@ -0,0 +1,336 @@
+/*
+ * Swap storm benchmark for zram
+ *
+ * Starts a number of kernel threads which read and write single pages at
+ * random offsets of a block device for a fixed time, the way swap in and
+ * swap out hit a zram swap device, then reports MB/s and the mean and
+ * 99th percentile latency of reads and writes. Each written page is half
+ * random bytes and half zeroes, stamped so that no two writes are alike.
+ *
+ * Only the block layer is used, so the same module measures any kernel's
+ * zram, or any other block device. Load it to run the test; the results
+ * are printed when the run is over, and unloading it stops a run early.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/genhd.h>
+#include <linux/completion.h>
+#include <linux/random.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/err.h>
+
+#include <asm/div64.h>
+
+static char *bdev_path = "/dev/zram0";
+module_param(bdev_path, charp, 0444);
+MODULE_PARM_DESC(bdev_path, "Initialized zram device to run on");
+
+static int nr_threads;
+module_param(nr_threads, int, 0444);
+MODULE_PARM_DESC(nr_threads, "I/O threads (default: one per online cpu)");
+
+static int duration = 10;
+module_param(duration, int, 0444);
+MODULE_PARM_DESC(duration, "Length of the run in seconds");
+
+static int write_percent = 50;
+module_param(write_percent, int, 0444);
+MODULE_PARM_DESC(write_percent, "Share of page writes, the rest are reads");
+
+static unsigned long working_set;
+module_param(working_set, ulong, 0444);
+MODULE_PARM_DESC(working_set, "Pages touched (default: the whole device)");
+
+/* 1 us per bucket; slower I/O is counted in the last one */
+#define BENCH_BUCKETS	16384
+
+struct bench_thread {
+	struct task_struct *task;
+	struct rnd_state rnd;
+	unsigned long ops[2];		/* by data direction */
+	unsigned long errors;
+	u64 total_ns[2];
+	u32 hist[2][BENCH_BUCKETS];
+};
+
+static struct block_device *bench_bdev;
+static unsigned long bench_pages;
+static struct bench_thread **threads;
+static struct task_struct *reporter;
+
+static unsigned long bench_deadline;
+static ktime_t bench_start;
+static atomic_t bench_running;
+static DECLARE_WAIT_QUEUE_HEAD(bench_wq);
+
+/* kthread_stop() must find the thread alive, so finished threads park */
+static void bench_idle(void)
+{
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+}
+
+static bool bench_over(void)
+{
+	return kthread_should_stop() || time_after(jiffies, bench_deadline);
+}
+
+static void bench_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+static int bench_page_io(struct page *page, unsigned long index, int rw)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct bio *bio;
+	int err;
+
+	bio = bio_alloc(GFP_KERNEL, 1);
+	bio->bi_bdev = bench_bdev;
+	bio->bi_sector = (sector_t)index << (PAGE_SHIFT - 9);
+	bio->bi_end_io = bench_end_io;
+	bio->bi_private = &done;
+	bio_add_page(bio, page, PAGE_SIZE, 0);
+
+	submit_bio(rw, bio);
+	wait_for_completion(&done);
+
+	err = test_bit(BIO_UPTODATE, &bio->bi_flags) ? 0 : -EIO;
+	bio_put(bio);
+	return err;
+}
+
+static int bench_io(void *arg)
+{
+	struct bench_thread *t = arg;
+	struct page *wpage, *rpage;
+	unsigned long stamp = 0;
+	u32 *words;
+	int i;
+
+	wpage = alloc_page(GFP_KERNEL | __GFP_ZERO);
+	rpage = alloc_page(GFP_KERNEL);
+	if (!wpage || !rpage) {
+		t->errors++;
+		goto out;
+	}
+
+	/* compresses to about half, like typical anonymous memory */
+	words = page_address(wpage);
+	for (i = 0; i < PAGE_SIZE / sizeof(u32) / 2; i++)
+		words[i] = prandom32(&t->rnd);
+
+	while (!bench_over()) {
+		unsigned long index = prandom32(&t->rnd) % bench_pages;
+		int dir = prandom32(&t->rnd) % 100 < write_percent;
+		ktime_t start;
+		u64 ns;
+
+		if (dir == WRITE) {
+			words[0] = index;
+			words[1] = stamp++;
+		}
+
+		start = ktime_get();
+		if (bench_page_io(dir == WRITE ? wpage : rpage, index, dir)) {
+			t->errors++;
+			continue;
+		}
+		ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		t->ops[dir]++;
+		t->total_ns[dir] += ns;
+		t->hist[dir][min_t(u64, div_u64(ns, NSEC_PER_USEC),
+				   BENCH_BUCKETS - 1)]++;
+		cond_resched();
+	}
+
+out:
+	if (wpage)
+		__free_page(wpage);
+	if (rpage)
+		__free_page(rpage);
+	if (atomic_dec_and_test(&bench_running))
+		wake_up(&bench_wq);
+	bench_idle();
+	return 0;
+}
+
+/* latency in us below which p percent of the I/O in dir completed */
+static unsigned int bench_percentile(int dir, unsigned long ops, int p)
+{
+	u64 want = div_u64((u64)ops * p + 99, 100);
+	u64 seen = 0;
+	int b, i;
+
+	for (b = 0; b < BENCH_BUCKETS; b++) {
+		for (i = 0; i < nr_threads; i++)
+			seen += threads[i]->hist[dir][b];
+		if (seen >= want)
+			break;
+	}
+	return min(b + 1, BENCH_BUCKETS);
+}
+
+static void bench_report(const char *what, int dir, u64 elapsed_ms)
+{
+	unsigned long ops = 0;
+	u64 total_ns = 0, rate, avg_ns;
+	int i;
+
+	for (i = 0; i < nr_threads; i++) {
+		ops += threads[i]->ops[dir];
+		total_ns += threads[i]->total_ns[dir];
+	}
+	if (!ops)
+		return;
+
+	rate = ((u64)ops << PAGE_SHIFT) * MSEC_PER_SEC;
+	do_div(rate, max_t(u64, elapsed_ms, 1));
+	avg_ns = total_ns;
+	do_div(avg_ns, ops);
+
+	pr_info("zram_bench: %s: %lu pages, %llu MB/s, latency avg %llu us "
+		"p99 %u us\n", what, ops, rate >> 20,
+		div_u64(avg_ns, NSEC_PER_USEC),
+		bench_percentile(dir, ops, 99));
+}
+
+static int bench_reporter(void *arg)
+{
+	unsigned long errors = 0;
+	u64 elapsed_ms;
+	int i;
+
+	wait_event_interruptible(bench_wq, !atomic_read(&bench_running) ||
+				 kthread_should_stop());
+	if (atomic_read(&bench_running))
+		goto out;
+
+	elapsed_ms = ktime_to_ns(ktime_sub(ktime_get(), bench_start));
+	do_div(elapsed_ms, NSEC_PER_MSEC);
+
+	for (i = 0; i < nr_threads; i++)
+		errors += threads[i]->errors;
+
+	pr_info("zram_bench: %s: %d threads, %d%% writes, %lu pages, "
+		"%llu ms, %lu errors\n", bdev_path, nr_threads, write_percent,
+		bench_pages, elapsed_ms, errors);
+	bench_report("write", WRITE, elapsed_ms);
+	bench_report("read", READ, elapsed_ms);
+out:
+	bench_idle();
+	return 0;
+}
+
+static void bench_stop(void)
+{
+	int i;
+
+	if (reporter)
+		kthread_stop(reporter);
+	for (i = 0; threads && i < nr_threads; i++) {
+		if (threads[i] && threads[i]->task)
+			kthread_stop(threads[i]->task);
+		vfree(threads[i]);
+	}
+	kfree(threads);
+	blkdev_put(bench_bdev, FMODE_READ | FMODE_WRITE);
+}
+
+static int __init zram_bench_init(void)
+{
+	int i, err;
+
+	if (nr_threads <= 0)
+		nr_threads = num_online_cpus();
+	if (duration <= 0)
+		duration = 10;
+	write_percent = clamp(write_percent, 0, 100);
+
+	bench_bdev = lookup_bdev(bdev_path);
+	if (IS_ERR(bench_bdev))
+		return PTR_ERR(bench_bdev);
+	err = blkdev_get(bench_bdev, FMODE_READ | FMODE_WRITE);
+	if (err)
+		return err;
+
+	bench_pages = get_capacity(bench_bdev->bd_disk) >> (PAGE_SHIFT - 9);
+	if (working_set)
+		bench_pages = min(bench_pages, working_set);
+	if (!bench_pages) {
+		pr_err("zram_bench: %s has no capacity, set its disksize "
+		       "first\n", bdev_path);
+		blkdev_put(bench_bdev, FMODE_READ | FMODE_WRITE);
+		return -ENXIO;
+	}
+
+	threads = kcalloc(nr_threads, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		goto fail;
+	for (i = 0; i < nr_threads; i++) {
+		threads[i] = vmalloc(sizeof(*threads[i]));
+		if (!threads[i])
+			goto fail;
+		memset(threads[i], 0, sizeof(*threads[i]));
+		prandom32_seed(&threads[i]->rnd, get_random_int() + i);
+	}
+
+	atomic_set(&bench_running, nr_threads);
+	bench_deadline = jiffies + duration * HZ;
+	bench_start = ktime_get();
+
+	for (i = 0; i < nr_threads; i++) {
+		threads[i]->task = kthread_run(bench_io, threads[i],
+					       "zram_bench/%d", i);
+		if (IS_ERR(threads[i]->task))
+			goto fail;
+	}
+	reporter = kthread_run(bench_reporter, NULL, "zram_bench");
+	if (IS_ERR(reporter))
+		goto fail;
+	return 0;
+
+fail:
+	/* threads which never started are not waited for */
+	if (IS_ERR(reporter))
+		reporter = NULL;
+	for (i = 0; threads && i < nr_threads; i++)
+		if (threads[i] && IS_ERR(threads[i]->task))
+			threads[i]->task = NULL;
+	bench_stop();
+	return -ENOMEM;
+}
+
+static void __exit zram_bench_exit(void)
+{
+	bench_stop();
+}
+
+module_init(zram_bench_init);
+module_exit(zram_bench_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Swap storm benchmark for zram devices");
@@ -21,11 +21,17 @@
 #include <linux/bitops.h>
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
+#include <linux/completion.h>
+#include <linux/debugfs.h>
 #include <linux/device.h>
+#include <linux/fs.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
+#include <linux/jhash.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
 
@@ -34,6 +40,7 @@
 /* Globals */
 static int zram_major;
 static struct zram *devices;
+static struct dentry *zram_debugfs_root;
 
 /* Module params (documentation at end) */
 static unsigned int num_devices;
@@ -56,6 +63,14 @@ static void zram_clear_flag(struct zram *zram, u32 index,
 	zram->table[index].flags &= ~BIT(flag);
 }
 
+/* Whether index holds anything that zram_free_page() must release */
+static int zram_allocated(struct zram *zram, u32 index)
+{
+	return zram->table[index].page ||
+		zram_test_flag(zram, index, ZRAM_ZERO) ||
+		zram_test_flag(zram, index, ZRAM_WB);
+}
+
 static int page_zero_filled(void *ptr)
 {
 	unsigned int pos;
@@ -111,7 +126,7 @@ static void zram_ioctl_get_stats(struct zram *zram,
 	size_t succ_writes, mem_used;
 	unsigned int good_compress_perc = 0, no_compress_perc = 0;
 
-	mem_used = xv_get_total_size_bytes(zram->mem_pool)
+	mem_used = zs_get_total_size_bytes(zram->mem_pool)
 			+ (rs->pages_expand << PAGE_SHIFT);
 	succ_writes = zram_stat64_read(zram, &rs->num_writes) -
 			zram_stat64_read(zram, &rs->failed_writes);
@@ -139,18 +154,181 @@ static void zram_ioctl_get_stats(struct zram *zram,
 	s->orig_data_size = rs->pages_stored << PAGE_SHIFT;
 	s->compr_data_size = rs->compr_size;
 	s->mem_used_total = mem_used;
+
+	s->dedup_hits = zram_stat64_read(zram, &rs->dedup_hits);
+	s->pages_dedup = rs->pages_dedup;
+	if (s->orig_data_size)
+		s->compr_ratio_pct = div64_u64(s->compr_data_size * 100,
+						s->orig_data_size);
+	s->comp_time_ns = zram_stat64_read(zram, &rs->comp_ns);
+	s->decomp_time_ns = zram_stat64_read(zram, &rs->decomp_ns);
 	}
 #endif /* CONFIG_ZRAM_STATS */
+
+	strlcpy(s->backend, zram->backend->name, sizeof(s->backend));
+}
+
+/*
+ * Deduplication index, all under table_lock. Several objects may share
+ * a hash, so lookups walk every node with the given hash starting from
+ * the leftmost one.
+ */
+static struct zram_dedup *zram_dedup_first(struct zram *zram, u32 hash)
+{
+	struct rb_node *node = zram->dedup_root.rb_node;
+	struct zram_dedup *first = NULL;
+
+	while (node) {
+		struct zram_dedup *dedup = rb_entry(node, struct zram_dedup,
+							node);
+
+		if (hash < dedup->hash) {
+			node = node->rb_left;
+		} else if (hash > dedup->hash) {
+			node = node->rb_right;
+		} else {
+			first = dedup;
+			node = node->rb_left;
+		}
+	}
+
+	return first;
+}
+
+static struct zram_dedup *zram_dedup_next(struct zram_dedup *dedup)
+{
+	struct rb_node *node = rb_next(&dedup->node);
+	struct zram_dedup *next;
+
+	if (!node)
+		return NULL;
+
+	next = rb_entry(node, struct zram_dedup, node);
+	return next->hash == dedup->hash ? next : NULL;
+}
+
+static void zram_dedup_insert(struct zram *zram, struct zram_dedup *new)
+{
+	struct rb_node **link = &zram->dedup_root.rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*link) {
+		struct zram_dedup *dedup;
+
+		parent = *link;
+		dedup = rb_entry(parent, struct zram_dedup, node);
+		if (new->hash < dedup->hash)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+
+	rb_link_node(&new->node, parent, link);
+	rb_insert_color(&new->node, &zram->dedup_root);
+}
+
+static struct zram_dedup *zram_dedup_find(struct zram *zram, u32 hash,
+				struct page *page, u16 offset)
+{
+	struct zram_dedup *dedup;
+
+	for (dedup = zram_dedup_first(zram, hash); dedup;
+			dedup = zram_dedup_next(dedup))
+		if (dedup->page == page && dedup->offset == offset)
+			return dedup;
+
+	return NULL;
+}
+
+/* Find the index entry of the object stored at <page, offset> */
+static struct zram_dedup *zram_dedup_lookup(struct zram *zram,
+				struct page *page, u16 offset)
+{
+	u32 hash;
+	void *obj;
+
+	obj = kmap_atomic(page, KM_USER0) + offset;
+	hash = ((struct zobj_header *)obj)->hash;
+	kunmap_atomic(obj, KM_USER0);
+
+	return zram_dedup_find(zram, hash, page, offset);
+}
+
+/* Find a stored object whose compressed data equals src */
+static struct zram_dedup *zram_dedup_match(struct zram *zram, u32 hash,
+				const void *src, size_t clen)
+{
+	struct zram_dedup *dedup;
+
+	for (dedup = zram_dedup_first(zram, hash); dedup;
+			dedup = zram_dedup_next(dedup)) {
+		int match;
+		unsigned char *cmem;
+
+		cmem = kmap_atomic(dedup->page, KM_USER0) + dedup->offset;
+		match = zs_get_object_size(cmem) ==
+				clen + sizeof(struct zobj_header) &&
+			!memcmp(cmem + sizeof(struct zobj_header), src, clen);
+		kunmap_atomic(cmem, KM_USER0);
+
+		if (match)
+			return dedup;
+	}
+
+	return NULL;
+}
+
+/*
+ * Backing device pages are handed out from a bitmap. Block numbers are
+ * in PAGE_SIZE units.
+ */
+static int zram_wb_alloc_block(struct zram *zram, unsigned long *block)
+{
+	unsigned long b;
+
+	spin_lock(&zram->wb_lock);
+	b = find_next_zero_bit(zram->wb_bitmap, zram->wb_nr_blocks,
+				zram->wb_hint);
+	if (b >= zram->wb_nr_blocks)
+		b = find_first_zero_bit(zram->wb_bitmap, zram->wb_nr_blocks);
+	if (b < zram->wb_nr_blocks) {
+		set_bit(b, zram->wb_bitmap);
+		zram->wb_hint = b + 1;
+	}
+	spin_unlock(&zram->wb_lock);
+
+	if (b >= zram->wb_nr_blocks)
+		return -ENOSPC;
+
+	*block = b;
+	return 0;
+}
+
+static void zram_wb_free_block(struct zram *zram, unsigned long block)
+{
+	spin_lock(&zram->wb_lock);
+	clear_bit(block, zram->wb_bitmap);
+	spin_unlock(&zram->wb_lock);
 }
 
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	u32 clen;
 	void *obj;
+	struct zram_dedup *dedup;
 
 	struct page *page = zram->table[index].page;
 	u32 offset = zram->table[index].offset;
 
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+
+	if (unlikely(zram_test_flag(zram, index, ZRAM_WB))) {
+		zram_wb_free_block(zram, zram->table[index].block);
+		zram_clear_flag(zram, index, ZRAM_WB);
+		zram_stat_dec(&zram->stats.pages_wb);
+		goto clear;
+	}
+
 	if (unlikely(!page)) {
 		/*
 		 * No memory is allocated for zero filled pages.
@@ -172,17 +350,36 @@ static void zram_free_page(struct zram *zram, size_t index)
 	}
 
 	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
+	clen = zs_get_object_size(obj) - sizeof(struct zobj_header);
 	kunmap_atomic(obj, KM_USER0);
 
-	xv_free(zram->mem_pool, page, offset);
 	if (clen <= PAGE_SIZE / 2)
 		zram_stat_dec(&zram->stats.good_compress);
 
+	/*
+	 * The index may hold no entry for this object if deduplication was
+	 * off when it was written, or if allocating the entry failed.
+	 */
+	dedup = zram_dedup_lookup(zram, page, offset);
+	if (dedup) {
+		if (--dedup->refcount) {
+			/* Other pages still use this object */
+			zram_stat_dec(&zram->stats.pages_dedup);
+			zram_stat_dec(&zram->stats.pages_stored);
+			goto clear;
+		}
+		rb_erase(&dedup->node, &zram->dedup_root);
+		kfree(dedup);
+	}
+
+	zs_free(zram->mem_pool, page, offset);
+
 out:
 	zram->stats.compr_size -= clen;
 	zram_stat_dec(&zram->stats.pages_stored);
 
+clear:
+
 	zram->table[index].page = NULL;
 	zram->table[index].offset = 0;
 }
@@ -214,12 +411,96 @@ static void handle_uncompressed_page(struct zram *zram,
 	flush_dcache_page(page);
 }
 
+/*
+ * Pages that were written back are read straight into the bio pages.
+ * This runs from zram_make_request(), where waiting for a nested bio
+ * would deadlock, so the original bio completes from the end_io of the
+ * last backing device read instead.
+ */
+struct zram_wb_io {
+	struct zram *zram;
+	struct bio *parent;
+	atomic_t pending;
+	int error;
+	ktime_t start;
+};
+
+static void zram_wb_io_put(struct zram_wb_io *io)
+{
+	if (!atomic_dec_and_test(&io->pending))
+		return;
+
+#if defined(CONFIG_ZRAM_STATS)
+	atomic64_inc(&io->zram->stats.wb_reads);
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), io->start)),
+			&io->zram->stats.wb_read_ns);
+#endif
+
+	if (io->error) {
+		bio_io_error(io->parent);
+	} else {
+		set_bit(BIO_UPTODATE, &io->parent->bi_flags);
+		bio_endio(io->parent, 0);
+	}
+	kfree(io);
+}
+
+static void zram_wb_read_end_io(struct bio *bio, int err)
+{
+	struct zram_wb_io *io = bio->bi_private;
+
+	if (err || !test_bit(BIO_UPTODATE, &bio->bi_flags))
+		io->error = -EIO;
+	else
+		flush_dcache_page(bio->bi_io_vec[0].bv_page);
+
+	bio_put(bio);
+	zram_wb_io_put(io);
+}
+
+static int zram_wb_read(struct zram *zram, struct zram_wb_io **iop,
+			struct bio *parent, struct page *page,
+			unsigned long block)
+{
+	struct bio *bio;
+	struct zram_wb_io *io = *iop;
+
+	if (!io) {
+		io = kmalloc(sizeof(*io), GFP_NOIO);
+		if (!io)
+			return -ENOMEM;
+
+		io->zram = zram;
+		io->parent = parent;
+		atomic_set(&io->pending, 1);
+		io->error = 0;
+		io->start = ktime_get();
+		*iop = io;
+	}
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_bdev = zram->wb_bdev;
+	bio->bi_sector = (sector_t)block << SECTORS_PER_PAGE_SHIFT;
+	bio_add_page(bio, page, PAGE_SIZE, 0);
+	bio->bi_private = io;
+	bio->bi_end_io = zram_wb_read_end_io;
+
+	atomic_inc(&io->pending);
+	submit_bio(READ, bio);
+
+	return 0;
+}
+
 static int zram_read(struct zram *zram, struct bio *bio)
 {
 
 	int i;
 	u32 index;
 	struct bio_vec *bvec;
+	struct zram_wb_io *io = NULL;
 
 	zram_stat64_inc(zram, &zram->stats.num_reads);
 
@@ -227,47 +508,85 @@ static int zram_read(struct zram *zram, struct bio *bio)
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
 		size_t clen;
+		ktime_t start;
 		struct page *page;
 		struct zobj_header *zheader;
+		struct zram_stream *zstrm;
 		unsigned char *user_mem, *cmem;
 
 		page = bvec->bv_page;
 
+		read_lock(&zram->table_lock);
+
+		/*
+		 * Readers only ever clear this bit, so doing it under the
+		 * read lock is safe.
+		 */
+		zram_clear_flag(zram, index, ZRAM_IDLE);
+
+		if (unlikely(zram_test_flag(zram, index, ZRAM_WB))) {
+			unsigned long block = zram->table[index].block;
+
+			read_unlock(&zram->table_lock);
+			if (zram_wb_read(zram, &io, bio, page, block)) {
+				zram_stat64_inc(zram,
+					&zram->stats.failed_reads);
+				goto out;
+			}
+			index++;
+			continue;
+		}
+
 		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
+			read_unlock(&zram->table_lock);
 			handle_zero_page(page);
+			index++;
 			continue;
 		}
 
 		/* Requested page is not present in compressed area */
 		if (unlikely(!zram->table[index].page)) {
+			read_unlock(&zram->table_lock);
 			pr_debug("Read before write: sector=%lu, size=%u",
 				(ulong)(bio->bi_sector), bio->bi_size);
 			/* Do nothing */
+			index++;
 			continue;
 		}
 
 		/* Page is stored uncompressed since it's incompressible */
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 			handle_uncompressed_page(zram, page, index);
+			read_unlock(&zram->table_lock);
+			index++;
 			continue;
 		}
 
 		user_mem = kmap_atomic(page, KM_USER0);
-		clen = PAGE_SIZE;
 
 		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
 				zram->table[index].offset;
+		clen = zs_get_object_size(cmem) - sizeof(*zheader);
 
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			user_mem, &clen);
+		/*
+		 * Decompression state is per-cpu and is only touched with
+		 * preemption disabled, so no stream lock is needed here.
+		 */
+		zstrm = per_cpu_ptr(zram->streams, get_cpu());
+		start = ktime_get();
+		ret = zram->backend->decompress(cmem + sizeof(*zheader), clen,
+						user_mem, zstrm->private);
+		zram_stat64_add(zram, &zram->stats.decomp_ns,
+				ktime_to_ns(ktime_sub(ktime_get(), start)));
+		put_cpu();
 
 		kunmap_atomic(user_mem, KM_USER0);
 		kunmap_atomic(cmem, KM_USER1);
 
+		read_unlock(&zram->table_lock);
+
 		/* Should NEVER happen. Return bio error if it does. */
-		if (unlikely(ret != LZO_E_OK)) {
+		if (unlikely(ret)) {
 			pr_err("Decompression failed! err=%d, page=%u\n",
 				ret, index);
 			zram_stat64_inc(zram, &zram->stats.failed_reads);
@@ -278,15 +597,131 @@ static int zram_read(struct zram *zram, struct bio *bio)
 		index++;
 	}
 
+	if (io) {
+		zram_wb_io_put(io);
+		return 0;
+	}
+
 	set_bit(BIO_UPTODATE, &bio->bi_flags);
 	bio_endio(bio, 0);
 	return 0;
 
 out:
+	if (io) {
+		io->error = -EIO;
+		zram_wb_io_put(io);
+		return 0;
+	}
+
 	bio_io_error(bio);
 	return 0;
 }
 
+/*
+ * Take a compression stream. The CPU only picks which stream to use: the
+ * mutex is what makes it ours, so the caller may sleep or migrate while
+ * holding it. Must not be called from atomic context.
+ */
+static struct zram_stream *zram_stream_get(struct zram *zram)
+{
+	struct zram_stream *zstrm;
+
+	zstrm = per_cpu_ptr(zram->streams, get_cpu());
+	put_cpu();
+
+	mutex_lock(&zstrm->lock);
+	return zstrm;
+}
+
+static void zram_stream_put(struct zram_stream *zstrm)
+{
+	mutex_unlock(&zstrm->lock);
+}
+
+/*
+ * If an object with the same compressed data is already stored, point
+ * index at it and return 1. Otherwise return 0 and leave index alone.
+ */
+static int zram_store_dup(struct zram *zram, u32 index, u32 hash,
+			const void *src, size_t clen)
+{
+	struct zram_dedup *dedup;
+
+	write_lock(&zram->table_lock);
+
+	dedup = zram_dedup_match(zram, hash, src, clen);
+	if (!dedup) {
+		write_unlock(&zram->table_lock);
+		return 0;
+	}
+
+	/* Take our reference first: index may already use this object */
+	dedup->refcount++;
+	if (zram_allocated(zram, index))
+		zram_free_page(zram, index);
+
+	zram->table[index].page = dedup->page;
+	zram->table[index].offset = dedup->offset;
+	zram->table[index].gen++;
+
+	zram_stat_inc(&zram->stats.pages_stored);
+	zram_stat_inc(&zram->stats.pages_dedup);
+	if (clen <= PAGE_SIZE / 2)
+		zram_stat_inc(&zram->stats.good_compress);
+
+	write_unlock(&zram->table_lock);
+
+	zram_stat64_inc(zram, &zram->stats.dedup_hits);
+	return 1;
+}
+
+/*
+ * Replace whatever is stored at index with the given object (or with a
+ * zero page, if page_store is NULL and flags has ZRAM_ZERO). If dedup is
+ * given, it is filled in and added to the deduplication index.
+ */
+static void zram_store_page(struct zram *zram, u32 index,
+			struct page *page_store, u32 offset, size_t clen,
+			u8 flags, u32 hash, struct zram_dedup *dedup)
+{
+	write_lock(&zram->table_lock);
+
+	/*
+	 * System overwrites unused sectors. Free memory associated
+	 * with this sector now.
+	 */
+	if (zram_allocated(zram, index))
+		zram_free_page(zram, index);
+
+	zram->table[index].page = page_store;
+	zram->table[index].offset = offset;
+	zram->table[index].flags |= flags;
+	zram->table[index].gen++;
+
+	if (dedup) {
+		dedup->hash = hash;
+		dedup->refcount = 1;
+		dedup->page = page_store;
+		dedup->offset = offset;
+		zram_dedup_insert(zram, dedup);
+	}
+
+	/* Update stats */
+	if (flags & BIT(ZRAM_ZERO)) {
+		zram_stat_inc(&zram->stats.pages_zero);
+		goto out;
+	}
+
+	if (flags & BIT(ZRAM_UNCOMPRESSED))
+		zram_stat_inc(&zram->stats.pages_expand);
+	zram->stats.compr_size += clen;
+	zram_stat_inc(&zram->stats.pages_stored);
+	if (clen <= PAGE_SIZE / 2)
+		zram_stat_inc(&zram->stats.good_compress);
+out:
+	write_unlock(&zram->table_lock);
+}
+
 static int zram_write(struct zram *zram, struct bio *bio)
 {
 	int i;
@@ -299,41 +734,55 @@ static int zram_write(struct zram *zram, struct bio *bio)
 
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
-		u32 offset;
-		size_t clen;
+		u32 offset = 0;
+		size_t clen, alloc_len = 0;
+		u8 flags = 0;
+		u32 hash = 0;
+		ktime_t start;
 		struct zobj_header *zheader;
-		struct page *page, *page_store;
+		struct zram_stream *zstrm;
+		struct zram_dedup *dedup = NULL;
+		struct page *page, *page_store = NULL;
 		unsigned char *user_mem, *cmem, *src;
 
 		page = bvec->bv_page;
-		src = zram->compress_buffer;
-
-		/*
-		 * System overwrites unused sectors. Free memory associated
-		 * with this sector now.
-		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
-			zram_free_page(zram, index);
-
-		mutex_lock(&zram->lock);
 
 		user_mem = kmap_atomic(page, KM_USER0);
-		if (page_zero_filled(user_mem)) {
-			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
-			zram_stat_inc(&zram->stats.pages_zero);
-			zram_set_flag(zram, index, ZRAM_ZERO);
+		ret = page_zero_filled(user_mem);
+		kunmap_atomic(user_mem, KM_USER0);
+		if (ret) {
+			zram_store_page(zram, index, NULL, 0, 0,
+					BIT(ZRAM_ZERO), 0, NULL);
+			index++;
 			continue;
 		}
 
-		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+		/*
+		 * Other writers may be waiting for our stream, so nothing
+		 * that can sleep is done while it is held. Without an index
+		 * entry the object is simply never shared, so failing to
+		 * allocate one is harmless.
+		 */
+		if (zram->dedup)
+			dedup = kmalloc(sizeof(*dedup), GFP_NOIO);
+
+compress_again:
+		zstrm = zram_stream_get(zram);
+		src = zstrm->buffer;
 
+		user_mem = kmap_atomic(page, KM_USER0);
+		start = ktime_get();
+		ret = zram->backend->compress(user_mem, src, &clen,
+						zstrm->private);
+		zram_stat64_add(zram, &zram->stats.comp_ns,
+				ktime_to_ns(ktime_sub(ktime_get(), start)));
 		kunmap_atomic(user_mem, KM_USER0);
 
-		if (unlikely(ret != LZO_E_OK)) {
-			mutex_unlock(&zram->lock);
+		if (unlikely(ret)) {
+			zram_stream_put(zstrm);
+			if (page_store)
+				zs_free(zram->mem_pool, page_store, offset);
+			kfree(dedup);
 			pr_err("Compression failed! err=%d\n", ret);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
@@ -345,10 +794,14 @@ static int zram_write(struct zram *zram, struct bio *bio)
 		 * errors which has side effect of hanging the system.
 		 */
 		if (unlikely(clen > max_zpage_size)) {
+			zram_stream_put(zstrm);
+			if (page_store)
+				zs_free(zram->mem_pool, page_store, offset);
+			kfree(dedup);
+			dedup = NULL;
 			clen = PAGE_SIZE;
 			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
 			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
 				pr_info("Error allocating memory for "
 					"incompressible page: %u\n", index);
 				zram_stat64_inc(zram,
@@ -357,51 +810,79 @@ static int zram_write(struct zram *zram, struct bio *bio)
 			}
 
 			offset = 0;
-			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-			zram_stat_inc(&zram->stats.pages_expand);
-			zram->table[index].page = page_store;
+			flags = BIT(ZRAM_UNCOMPRESSED);
 			src = kmap_atomic(page, KM_USER0);
 			goto memstore;
 		}
 
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
-				GFP_NOIO | __GFP_HIGHMEM)) {
-			mutex_unlock(&zram->lock);
-			pr_info("Error allocating memory for compressed "
-				"page: %u, size=%zu\n", index, clen);
-			zram_stat64_inc(zram, &zram->stats.failed_writes);
-			goto out;
+		if (zram->dedup) {
+			hash = jhash(src, clen, 0);
+			if (zram_store_dup(zram, index, hash, src, clen)) {
+				zram_stream_put(zstrm);
+				if (page_store)
+					zs_free(zram->mem_pool, page_store,
+						offset);
+				kfree(dedup);
+				index++;
+				continue;
+			}
 		}
 
-memstore:
-		zram->table[index].offset = offset;
+		/*
+		 * The object size is what decompression is fed, so a
+		 * recompression that came out different needs a new one.
+		 */
+		if (page_store && alloc_len != clen + sizeof(*zheader)) {
+			zs_free(zram->mem_pool, page_store, offset);
+			page_store = NULL;
+		}
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+		/*
+		 * Try without sleeping first. If that fails, drop the stream,
+		 * allocate with reclaim allowed and compress again: the
+		 * buffer is not ours anymore once the stream is released.
+		 */
+		if (!page_store) {
+			alloc_len = clen + sizeof(*zheader);
+			if (!zs_malloc(zram->mem_pool, alloc_len, &page_store,
+					&offset, GFP_NOWAIT | __GFP_HIGHMEM |
+					__GFP_NOWARN))
+				goto memstore;
+
+			zram_stream_put(zstrm);
+			if (zs_malloc(zram->mem_pool, alloc_len, &page_store,
+					&offset, GFP_NOIO | __GFP_HIGHMEM)) {
+				kfree(dedup);
+				pr_info("Error allocating memory for "
+					"compressed page: %u, size=%zu\n",
+					index, clen);
+				zram_stat64_inc(zram,
+					&zram->stats.failed_writes);
+				goto out;
+			}
+			goto compress_again;
+		}
+
+memstore:
+		cmem = kmap_atomic(page_store, KM_USER1) + offset;
 
-#if 0
-		/* Back-reference needed for memory defragmentation */
-		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
+		if (!(flags & BIT(ZRAM_UNCOMPRESSED))) {
 			zheader = (struct zobj_header *)cmem;
+			zheader->hash = hash;
 			zheader->table_idx = index;
 			cmem += sizeof(*zheader);
 		}
-#endif
 
 		memcpy(cmem, src, clen);
 
 		kunmap_atomic(cmem, KM_USER1);
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
+		if (unlikely(flags & BIT(ZRAM_UNCOMPRESSED)))
 			kunmap_atomic(src, KM_USER0);
+		else
+			zram_stream_put(zstrm);
 
-		/* Update stats */
-		zram->stats.compr_size += clen;
-		zram_stat_inc(&zram->stats.pages_stored);
-		if (clen <= PAGE_SIZE / 2)
-			zram_stat_inc(&zram->stats.good_compress);
-
-		mutex_unlock(&zram->lock);
+		zram_store_page(zram, index, page_store, offset, clen, flags,
+				hash, dedup);
 		index++;
 	}
 
@@ -414,6 +895,268 @@ out:
 	return 0;
 }
 
+/*
+ * Writeback. A worker scans the table every wb_interval_sec and writes
+ * incompressible pages to the backing device. With wb_age set, every
+ * wb_age seconds it also writes pages still marked idle by the previous
+ * aging pass and then marks all resident pages idle; any access clears
+ * the mark. A page is thus written back after staying untouched for
+ * between wb_age and twice that.
+ */
+static void zram_wb_write_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+static int zram_wb_write_page(struct zram *zram, struct page *page,
+			unsigned long block)
+{
+	int ret;
+	struct bio *bio;
+	DECLARE_COMPLETION_ONSTACK(done);
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_bdev = zram->wb_bdev;
+	bio->bi_sector = (sector_t)block << SECTORS_PER_PAGE_SHIFT;
+	bio_add_page(bio, page, PAGE_SIZE, 0);
+	bio->bi_private = &done;
+	bio->bi_end_io = zram_wb_write_end_io;
+
+	submit_bio(WRITE, bio);
+	wait_for_completion(&done);
+
+	ret = test_bit(BIO_UPTODATE, &bio->bi_flags) ? 0 : -EIO;
+	bio_put(bio);
+
+	return ret;
+}
+
+/*
+ * If index should be written back, copy its data into buf, note which
+ * write of index it holds and return the memory that writeback would
+ * release. Otherwise return 0. Objects shared through deduplication stay.
+ */
+static size_t zram_wb_fetch(struct zram *zram, u32 index, int aging,
+			struct page *buf, u32 *gen)
+{
+	int ret;
+	size_t size = 0;
+	struct zram_stream *zstrm;
+	struct zram_dedup *dedup;
+	unsigned char *dst, *cmem;
+
+	read_lock(&zram->table_lock);
+
+	if (!zram->table[index].page ||
+			zram_test_flag(zram, index, ZRAM_WB) ||
+			zram_test_flag(zram, index, ZRAM_ZERO))
+		goto out;
+
+	*gen = zram->table[index].gen;
+
+	if (zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
+		handle_uncompressed_page(zram, buf, index);
+		size = PAGE_SIZE;
+		goto out;
+	}
+
+	if (!aging || !zram_test_flag(zram, index, ZRAM_IDLE))
+		goto out;
+
+	dedup = zram_dedup_lookup(zram, zram->table[index].page,
+				zram->table[index].offset);
+	if (dedup && dedup->refcount > 1)
+		goto out;
+
+	dst = kmap_atomic(buf, KM_USER0);
+	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
+			zram->table[index].offset;
+	size = zs_get_object_size(cmem);
+
+	zstrm = per_cpu_ptr(zram->streams, get_cpu());
+	ret = zram->backend->decompress(cmem + sizeof(struct zobj_header),
+				size - sizeof(struct zobj_header),
+				dst, zstrm->private);
+	put_cpu();
+
+	kunmap_atomic(dst, KM_USER0);
+	kunmap_atomic(cmem, KM_USER1);
+
+	if (unlikely(ret))
+		size = 0;
+out:
+	read_unlock(&zram->table_lock);
+	return size;
+}
+
+static int zram_wb_page(struct zram *zram, u32 index, int aging,
+			struct page *buf)
+{
+	int ret;
+	u32 gen;
+	size_t size;
+	unsigned long block;
+
+	size = zram_wb_fetch(zram, index, aging, buf, &gen);
+	if (!size)
+		return 0;
+
+	ret = zram_wb_alloc_block(zram, &block);
+	if (ret)
+		return ret;
+
+	ret = zram_wb_write_page(zram, buf, block);
+	if (ret) {
+		zram_wb_free_block(zram, block);
+		return ret;
+	}
+
+	write_lock(&zram->table_lock);
+
+	/*
+	 * Leave it alone if it was freed or rewritten meanwhile. Comparing
+	 * page and offset is not enough: a freed slot is handed out again
+	 * at the same place, and deduplication makes indexes share one.
+	 */
+	if (!zram->table[index].page ||
+			zram->table[index].gen != gen ||
+			zram_test_flag(zram, index, ZRAM_WB) ||
+			zram_test_flag(zram, index, ZRAM_ZERO)) {
+		write_unlock(&zram->table_lock);
+		zram_wb_free_block(zram, block);
+		return 0;
+	}
+
+	zram_free_page(zram, index);
+	zram->table[index].block = block;
+	zram_set_flag(zram, index, ZRAM_WB);
+	zram_stat_inc(&zram->stats.pages_wb);
+
+	write_unlock(&zram->table_lock);
+
+	zram_stat64_add(zram, &zram->stats.wb_bytes, PAGE_SIZE);
+	zram_stat64_add(zram, &zram->stats.wb_saved, size);
+
+	return 0;
+}
+
+/* Mark all resident pages idle, a batch at a time */
+static void zram_wb_mark_idle(struct zram *zram)
+{
+	u32 index, nr_pages = zram->disksize >> PAGE_SHIFT;
+
+	for (index = 0; index < nr_pages; index++) {
+		if (!(index % 256)) {
+			if (index) {
+				write_unlock(&zram->table_lock);
+				cond_resched();
+			}
+			write_lock(&zram->table_lock);
+		}
+
+		if (zram->table[index].page &&
+				!zram_test_flag(zram, index, ZRAM_WB))
+			zram_set_flag(zram, index, ZRAM_IDLE);
+	}
+
+	if (nr_pages)
+		write_unlock(&zram->table_lock);
+}
+
+static void zram_wb_work(struct work_struct *work)
+{
+	u32 index;
+	int aging = 0;
+	struct page *buf;
+	struct zram *zram = container_of(to_delayed_work(work),
+					struct zram, wb_work);
+
+	if (zram->wb_age && time_after_eq(jiffies, zram->wb_last_aging +
+					zram->wb_age * HZ)) {
+		aging = 1;
+		zram->wb_last_aging = jiffies;
+	}
+
+	buf = alloc_page(GFP_KERNEL);
+	if (!buf)
+		goto out;
+
+	/* Stop early on errors, e.g. once the backing device is full */
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		if (zram_wb_page(zram, index, aging, buf))
+			break;
+		cond_resched();
+	}
+
+	__free_page(buf);
+
+	if (aging)
+		zram_wb_mark_idle(zram);
+out:
+	schedule_delayed_work(&zram->wb_work, wb_interval_sec * HZ);
+}
+
+/*
+ * Compaction callback: obj has been copied to <page, offset> and the old
+ * copy is released if we accept. Called with table_lock held for write.
+ */
+static int zram_relocate(void *arg, void *obj,
+			struct page *old_page, u32 old_offset,
+			struct page *page, u32 offset)
+{
+	struct zram *zram = arg;
+	struct zobj_header *zheader = obj;
+	u32 index = zheader->table_idx;
+	struct zram_dedup *dedup;
+
+	/* Stale back-reference: the object was shared at some point */
+	if (index >= zram->disksize >> PAGE_SHIFT ||
+			zram->table[index].page != old_page ||
+			zram->table[index].offset != old_offset)
+		return -EBUSY;
+
+	dedup = zram_dedup_find(zram, zheader->hash, old_page, old_offset);
+	if (dedup) {
+		if (dedup->refcount > 1)
+			return -EBUSY;
+		dedup->page = page;
+		dedup->offset = offset;
+	}
+
+	zram->table[index].page = page;
+	zram->table[index].offset = offset;
+
+	return 0;
+}
+
+/*
+ * Move objects around to release sparsely used allocator pages. I/O is
+ * held off only while one zspage is emptied.
+ */
+static unsigned long zram_compact(struct zram *zram)
+{
+	int more;
+	unsigned int i;
+	unsigned long freed = 0;
+
+	for (i = 0; i < zs_get_nr_classes(); i++) {
+		do {
+			write_lock(&zram->table_lock);
+			more = zs_compact_zspage(zram->mem_pool, i,
+						zram_relocate, zram, &freed);
+			write_unlock(&zram->table_lock);
+			cond_resched();
+		} while (more);
+
+		zs_compact_done(zram->mem_pool, i);
+	}
+
+	return freed;
+}
+
 /*
  * Check if request is within bounds and page aligned.
  */
@@ -463,6 +1206,100 @@ static int zram_make_request(struct request_queue *queue, struct bio *bio)
 	return ret;
 }
 
+static void zram_destroy_streams(struct zram *zram)
+{
+	int cpu;
+
+	if (!zram->streams)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct zram_stream *zstrm = per_cpu_ptr(zram->streams, cpu);
+
+		if (zstrm->private)
+			zram->backend->destroy(zstrm->private);
+		free_pages((unsigned long)zstrm->buffer, 1);
+	}
+
+	free_percpu(zram->streams);
+	zram->streams = NULL;
+}
+
+static int zram_create_streams(struct zram *zram)
+{
+	int cpu;
+
+	zram->streams = alloc_percpu(struct zram_stream);
+	if (!zram->streams)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct zram_stream *zstrm = per_cpu_ptr(zram->streams, cpu);
+
+		mutex_init(&zstrm->lock);
+
+		zstrm->private = zram->backend->create();
+		if (!zstrm->private) {
+			pr_err("Error allocating compressor working memory!\n");
+			return -ENOMEM;
+		}
+
+		zstrm->buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
+		if (!zstrm->buffer) {
+			pr_err("Error allocating compressor buffer space\n");
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static int zram_wb_init(struct zram *zram)
+{
+	size_t bitmap_size;
+	struct block_device *bdev;
+
+	if (!zram->wb_path)
+		return 0;
+
+	bdev = open_bdev_exclusive(zram->wb_path, FMODE_READ | FMODE_WRITE,
+				zram);
+	if (IS_ERR(bdev)) {
+		pr_err("Error opening backing device %s\n", zram->wb_path);
+		return PTR_ERR(bdev);
+	}
+	zram->wb_bdev = bdev;
+
+	zram->wb_nr_blocks = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	bitmap_size = BITS_TO_LONGS(zram->wb_nr_blocks) * sizeof(long);
+	zram->wb_bitmap = vmalloc(bitmap_size);
+	if (!zram->wb_bitmap) {
+		pr_err("Error allocating backing device bitmap\n");
+		return -ENOMEM;
+	}
+	memset(zram->wb_bitmap, 0, bitmap_size);
+	zram->wb_hint = 0;
+
+	zram->wb_last_aging = jiffies;
+	schedule_delayed_work(&zram->wb_work, wb_interval_sec * HZ);
+
+	return 0;
+}
+
+static void zram_wb_exit(struct zram *zram)
+{
+	cancel_delayed_work_sync(&zram->wb_work);
+
+	if (zram->wb_bdev) {
+		close_bdev_exclusive(zram->wb_bdev, FMODE_READ | FMODE_WRITE);
+		zram->wb_bdev = NULL;
+	}
+
+	vfree(zram->wb_bitmap);
+	zram->wb_bitmap = NULL;
+	zram->wb_nr_blocks = 0;
+}
+
 static void reset_device(struct zram *zram)
 {
 	size_t index;
@@ -470,34 +1307,47 @@ static void reset_device(struct zram *zram)
 	/* Do not accept any new I/O request */
 	zram->init_done = 0;
 
-	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
+	/* Stop writeback; pages on the backing device are simply dropped */
+	zram_wb_exit(zram);
 
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	/* Free various per-device buffers */
+	zram_destroy_streams(zram);
 
 	/* Free all pages that are still in this zram device */
-	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+	for (index = 0; zram->table &&
+			index < zram->disksize >> PAGE_SHIFT; index++) {
 		struct page *page;
 		u16 offset;
+		struct zram_dedup *dedup;
 
 		page = zram->table[index].page;
 		offset = zram->table[index].offset;
 
-		if (!page)
+		if (!page || zram_test_flag(zram, index, ZRAM_WB))
 			continue;
 
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
+		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 			__free_page(page);
-		else
-			xv_free(zram->mem_pool, page, offset);
+			continue;
+		}
+
+		/* Shared objects go with their last reference */
+		dedup = zram_dedup_lookup(zram, page, offset);
+		if (dedup) {
+			if (--dedup->refcount)
+				continue;
+			rb_erase(&dedup->node, &zram->dedup_root);
+			kfree(dedup);
+		}
+
+		zs_free(zram->mem_pool, page, offset);
 	}
+	zram->dedup_root = RB_ROOT;
 
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+	zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
 	/* Reset stats */
@@ -518,19 +1368,9 @@ static int zram_ioctl_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
-		ret = -ENOMEM;
+	ret = zram_create_streams(zram);
+	if (ret)
 		goto fail;
-	}
 
 	num_pages = zram->disksize >> PAGE_SHIFT;
 	zram->table = vmalloc(num_pages * sizeof(*zram->table));
@@ -548,13 +1388,17 @@ static int zram_ioctl_init_device(struct zram *zram)
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool();
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
 		goto fail;
 	}
 
+	ret = zram_wb_init(zram);
+	if (ret)
+		goto fail;
+
 	zram->init_done = 1;
 
 	pr_debug("Initialization done!\n");
@@ -610,7 +1454,9 @@ static int zram_ioctl(struct block_device *bdev, fmode_t mode,
 			ret = -ENOMEM;
 			goto out;
 		}
+		mutex_lock(&zram->init_lock);
 		zram_ioctl_get_stats(zram, stats);
+		mutex_unlock(&zram->init_lock);
 		if (copy_to_user((void *)arg, stats, sizeof(*stats))) {
 			kfree(stats);
 			ret = -EFAULT;
@@ -620,7 +1466,9 @@ static int zram_ioctl(struct block_device *bdev, fmode_t mode,
 		break;
 	}
 	case ZRAMIO_INIT:
+		mutex_lock(&zram->init_lock);
 		ret = zram_ioctl_init_device(zram);
+		mutex_unlock(&zram->init_lock);
 		break;
 
 	case ZRAMIO_RESET:
@@ -634,7 +1482,9 @@ static int zram_ioctl(struct block_device *bdev, fmode_t mode,
 		if (bdev)
 			fsync_bdev(bdev);
 
+		mutex_lock(&zram->init_lock);
 		ret = zram_ioctl_reset_device(zram);
+		mutex_unlock(&zram->init_lock);
 		break;
 
 	default:
@@ -651,7 +1501,9 @@ void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	write_lock(&zram->table_lock);
 	zram_free_page(zram, index);
+	write_unlock(&zram->table_lock);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -661,11 +1513,320 @@ static const struct block_device_operations zram_devops = {
 	.owner = THIS_MODULE
 };
 
+/*
+ * sysfs interface, in /sys/block/zram<id>/. backend and dedup can only
+ * be changed while the device is not initialized.
+ */
+static struct zram *dev_to_zram(struct device *dev)
+{
+	return dev_to_disk(dev)->private_data;
+}
+
+static ssize_t backend_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	return zcomp_available_show(dev_to_zram(dev)->backend, buf);
+}
+
+static ssize_t backend_store(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	const struct zcomp_backend *backend;
+	ssize_t ret = len;
+
+	backend = zcomp_find(buf);
+	if (!backend)
+		return -EINVAL;
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done)
+		ret = -EBUSY;
+	else
+		zram->backend = backend;
+	mutex_unlock(&zram->init_lock);
+
+	return ret;
+}
+
+static ssize_t dedup_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", dev_to_zram(dev)->dedup);
+}
+
+static ssize_t dedup_store(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long val;
+	ssize_t ret = len;
+
+	if (strict_strtoul(buf, 10, &val))
+		return -EINVAL;
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done)
+		ret = -EBUSY;
+	else
+		zram->dedup = !!val;
+	mutex_unlock(&zram->init_lock);
+
+	return ret;
+}
+
+static ssize_t compact_store(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long freed;
+
+	mutex_lock(&zram->init_lock);
+	if (!zram->init_done) {
+		mutex_unlock(&zram->init_lock);
+		return -EINVAL;
+	}
+	freed = zram_compact(zram);
+	mutex_unlock(&zram->init_lock);
+
+	pr_debug("%s: compaction released %lu pages\n",
+		zram->disk->disk_name, freed);
+
+	return len;
+}
+
+static ssize_t backing_dev_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret;
+
+	mutex_lock(&zram->init_lock);
+	ret = sprintf(buf, "%s\n", zram->wb_path ? zram->wb_path : "none");
+	mutex_unlock(&zram->init_lock);
+
+	return ret;
+}
+
+static ssize_t backing_dev_store(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	char *path;
+	ssize_t ret = len;
+
+	path = kstrndup(buf, len, GFP_KERNEL);
+	if (!path)
+		return -ENOMEM;
+	strim(path);
+	if (!*path || !strcmp(path, "none")) {
+		kfree(path);
+		path = NULL;
+	}
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done) {
+		kfree(path);
+		ret = -EBUSY;
+	} else {
+		kfree(zram->wb_path);
+		zram->wb_path = path;
+	}
+	mutex_unlock(&zram->init_lock);
+
+	return ret;
+}
+
+static ssize_t writeback_age_show(struct device *dev,
+			struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", dev_to_zram(dev)->wb_age);
+}
+
+static ssize_t writeback_age_store(struct device *dev,
+			struct device_attribute *attr,
+			const char *buf, size_t len)
+{
+	unsigned long val;
+
+	if (strict_strtoul(buf, 10, &val) || val > UINT_MAX / HZ)
+		return -EINVAL;
+
+	dev_to_zram(dev)->wb_age = val;
+	return len;
+}
+
+static DEVICE_ATTR(backend, S_IRUGO | S_IWUSR, backend_show, backend_store);
+static DEVICE_ATTR(dedup, S_IRUGO | S_IWUSR, dedup_show, dedup_store);
+static DEVICE_ATTR(compact, S_IWUSR, NULL, compact_store);
+static DEVICE_ATTR(backing_dev, S_IRUGO | S_IWUSR, backing_dev_show,
+		backing_dev_store);
+static DEVICE_ATTR(writeback_age, S_IRUGO | S_IWUSR, writeback_age_show,
+		writeback_age_store);
+
+#if defined(CONFIG_ZRAM_STATS)
+/* Each stats file shows one field of struct zram_ioctl_stats */
+#define ZRAM_STAT_ATTR(_name)						\
+static ssize_t _name##_show(struct device *dev,				\
+			struct device_attribute *attr, char *buf)	\
+{									\
+	struct zram *zram = dev_to_zram(dev);				\
+	struct zram_ioctl_stats stats;					\
+									\
+	memset(&stats, 0, sizeof(stats));				\
+	mutex_lock(&zram->init_lock);					\
+	if (zram->init_done)						\
+		zram_ioctl_get_stats(zram, &stats);			\
+	mutex_unlock(&zram->init_lock);					\
+									\
+	return sprintf(buf, "%llu\n", (unsigned long long)stats._name);	\
+}									\
+static DEVICE_ATTR(_name, S_IRUGO, _name##_show, NULL)
+
+ZRAM_STAT_ATTR(orig_data_size);
+ZRAM_STAT_ATTR(compr_data_size);
+ZRAM_STAT_ATTR(mem_used_total);
+ZRAM_STAT_ATTR(compr_ratio_pct);
+ZRAM_STAT_ATTR(dedup_hits);
+ZRAM_STAT_ATTR(pages_dedup);
+ZRAM_STAT_ATTR(comp_time_ns);
+ZRAM_STAT_ATTR(decomp_time_ns);
+
+/* Writeback stats are not part of the ioctl interface */
+#define ZRAM_WB_STAT_ATTR(_name, _expr)					\
+static ssize_t _name##_show(struct device *dev,				\
+			struct device_attribute *attr, char *buf)	\
+{									\
+	struct zram *zram = dev_to_zram(dev);				\
+	u64 val = 0;							\
+									\
+	mutex_lock(&zram->init_lock);					\
+	if (zram->init_done)						\
+		val = (_expr);						\
+	mutex_unlock(&zram->init_lock);					\
+									\
+	return sprintf(buf, "%llu\n", (unsigned long long)val);		\
+}									\
+static DEVICE_ATTR(_name, S_IRUGO, _name##_show, NULL)
+
+static u64 zram_wb_read_latency_us(struct zram *zram)
+{
+	u64 reads = atomic64_read(&zram->stats.wb_reads);
+
+	if (!reads)
+		return 0;
+
+	return div64_u64(atomic64_read(&zram->stats.wb_read_ns),
+			reads * NSEC_PER_USEC);
+}
+
+ZRAM_WB_STAT_ATTR(writeback_pages, zram->stats.pages_wb);
+ZRAM_WB_STAT_ATTR(writeback_bytes,
+		zram_stat64_read(zram, &zram->stats.wb_bytes));
+ZRAM_WB_STAT_ATTR(writeback_saved_bytes,
+		zram_stat64_read(zram, &zram->stats.wb_saved));
+ZRAM_WB_STAT_ATTR(readback_count, atomic64_read(&zram->stats.wb_reads));
+ZRAM_WB_STAT_ATTR(readback_latency_us, zram_wb_read_latency_us(zram));
+#endif /* CONFIG_ZRAM_STATS */
+
+static struct attribute *zram_disk_attrs[] = {
+	&dev_attr_backend.attr,
+	&dev_attr_dedup.attr,
+	&dev_attr_compact.attr,
+	&dev_attr_backing_dev.attr,
+	&dev_attr_writeback_age.attr,
+#if defined(CONFIG_ZRAM_STATS)
+	&dev_attr_orig_data_size.attr,
+	&dev_attr_compr_data_size.attr,
+	&dev_attr_mem_used_total.attr,
+	&dev_attr_compr_ratio_pct.attr,
+	&dev_attr_dedup_hits.attr,
+	&dev_attr_pages_dedup.attr,
+	&dev_attr_comp_time_ns.attr,
+	&dev_attr_decomp_time_ns.attr,
+	&dev_attr_writeback_pages.attr,
+	&dev_attr_writeback_bytes.attr,
+	&dev_attr_writeback_saved_bytes.attr,
+	&dev_attr_readback_count.attr,
+	&dev_attr_readback_latency_us.attr,
+#endif
+	NULL,
+};
+
+static struct attribute_group zram_disk_attr_group = {
+	.attrs = zram_disk_attrs,
+};
+
+#ifdef CONFIG_DEBUG_FS
+/* Allocator occupancy per size class, in /sys/kernel/debug/zram/ */
+static int zram_classes_show(struct seq_file *s, void *unused)
+{
+	struct zram *zram = s->private;
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done)
+		zs_show_classes(zram->mem_pool, s);
+	mutex_unlock(&zram->init_lock);
+
+	return 0;
+}
+
+static int zram_classes_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zram_classes_show, inode->i_private);
+}
+
+static const struct file_operations zram_classes_fops = {
+	.open		= zram_classes_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void zram_debugfs_init(void)
+{
+	zram_debugfs_root = debugfs_create_dir("zram", NULL);
+}
+
+static void zram_debugfs_add(struct zram *zram)
+{
+	if (zram_debugfs_root)
+		debugfs_create_file(zram->disk->disk_name, S_IRUGO,
+				zram_debugfs_root, zram, &zram_classes_fops);
+}
+
+static void zram_debugfs_exit(void)
+{
+	debugfs_remove_recursive(zram_debugfs_root);
+}
+#else
+static void zram_debugfs_init(void)
+{
+}
+
+static void zram_debugfs_add(struct zram *zram)
+{
+}
+
+static void zram_debugfs_exit(void)
+{
+}
+#endif
+
 static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	mutex_init(&zram->lock);
+	rwlock_init(&zram->table_lock);
+	mutex_init(&zram->init_lock);
+	spin_lock_init(&zram->wb_lock);
+	INIT_DELAYED_WORK(&zram->wb_work, zram_wb_work);
+	zram->dedup_root = RB_ROOT;
+	zram->backend = zcomp_find(NULL);
 	spin_lock_init(&zram->stat64_lock);
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
@@ -710,6 +1871,13 @@ static int create_device(struct zram *zram, int device_id)
 
 	add_disk(zram->disk);
 
+	if (sysfs_create_group(&disk_to_dev(zram->disk)->kobj,
+				&zram_disk_attr_group))
+		pr_warning("Error creating sysfs group for device %d\n",
+			device_id);
+
+	zram_debugfs_add(zram);
+
 	zram->init_done = 0;
 
 out:
@@ -719,6 +1887,8 @@ out:
 static void destroy_device(struct zram *zram)
 {
 	if (zram->disk) {
+		sysfs_remove_group(&disk_to_dev(zram->disk)->kobj,
+				&zram_disk_attr_group);
 		del_gendisk(zram->disk);
 		put_disk(zram->disk);
 	}
@@ -758,6 +1928,8 @@ static int __init zram_init(void)
 		goto unregister;
 	}
 
+	zram_debugfs_init();
+
 	for (dev_id = 0; dev_id < num_devices; dev_id++) {
 		ret = create_device(&devices[dev_id], dev_id);
 		if (ret)
@@ -767,6 +1939,7 @@ static int __init zram_init(void)
 	return 0;
 
 free_devices:
+	zram_debugfs_exit();
 	while (dev_id)
 		destroy_device(&devices[--dev_id]);
 	kfree(devices);
@@ -781,12 +1954,15 @@ static void __exit zram_exit(void)
 	int i;
 	struct zram *zram;
 
+	zram_debugfs_exit();
+
 	for (i = 0; i < num_devices; i++) {
 		zram = &devices[i];
 
 		destroy_device(zram);
 		if (zram->init_done)
 			reset_device(zram);
+		kfree(zram->wb_path);
 	}
 
 	unregister_blkdev(zram_major, "zram");
@@ -17,9 +17,13 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/percpu.h>
+#include <linux/rbtree.h>
 
 #include "zram_ioctl.h"
-#include "xvmalloc.h"
+#include "zsalloc.h"
+#include "zcomp.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -30,13 +34,18 @@ static const unsigned max_num_devices = 32;
 /*
  * Stored at beginning of each compressed object.
  *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
+ * hash is the jhash of the compressed data (0 if deduplication was off
+ * when the object was written); it lets the free path find the dedup
+ * node of the object.
+ *
+ * table_idx is the back-reference to the table entry which wrote this
+ * object, used to move the object during compaction. It goes stale if
+ * that entry is freed while others share the object; compaction then
+ * leaves the object in place.
  */
 struct zobj_header {
-#if 0
+	u32 hash;
 	u32 table_idx;
-#endif
 };
 
 /*-- Configurable parameters */
@@ -52,10 +61,13 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /*
  * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ *   ZS_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
+ * otherwise, zs_malloc() would always return failure.
  */
 
+/* How often the writeback worker scans the table */
+static const unsigned wb_interval_sec = 5;
+
 /*-- End of configurable params */
 
 #define SECTOR_SHIFT		9
@@ -71,6 +83,12 @@ enum zram_pageflags {
 	/* Page consists entirely of zeros */
 	ZRAM_ZERO,
 
+	/* Page lives on the backing device, at table[page_no].block */
+	ZRAM_WB,
+
+	/* Page was not accessed since the last writeback aging pass */
+	ZRAM_IDLE,
+
 	__NR_ZRAM_PAGEFLAGS,
 };
 
@@ -78,10 +96,14 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
+	union {
+		struct page *page;
+		unsigned long block;	/* if ZRAM_WB is set */
+	};
 	u16 offset;
 	u8 count;	/* object ref count (not yet used) */
 	u8 flags;
+	u32 gen;	/* bumped on every write, see zram_wb_page() */
 } __attribute__((aligned(4)));
 
 struct zram_stats {
@@ -100,20 +122,71 @@ struct zram_stats {
 	u32 pages_stored;	/* no. of pages currently stored */
 	u32 good_compress;	/* % of pages with compression ratio<=50% */
 	u32 pages_expand;	/* % of incompressible pages */
+	u32 pages_dedup;	/* no. of pages sharing another's object */
+	u64 dedup_hits;		/* writes satisfied by an existing object */
+	u64 comp_ns;		/* time spent compressing */
+	u64 decomp_ns;		/* time spent decompressing */
+	u32 pages_wb;		/* no. of pages on the backing device */
+	u64 wb_bytes;		/* bytes written to the backing device */
+	u64 wb_saved;		/* memory released by writeback */
+	/* updated from bio completion, hence atomic */
+	atomic64_t wb_reads;	/* requests served from the backing device */
+	atomic64_t wb_read_ns;	/* time spent waiting for them */
 #endif
 };
 
+/*
+ * Deduplication index entry. One exists for every compressed object
+ * written while deduplication is enabled; entries are kept in an rbtree
+ * keyed by hash (which may have duplicates). refcount is the number of
+ * table entries pointing at the object.
+ */
+struct zram_dedup {
+	struct rb_node node;
+	u32 hash;
+	u32 refcount;
+	struct page *page;
+	u16 offset;
+};
+
+/*
+ * Compression workspace. There is one per possible CPU; a writer uses the
+ * stream of the CPU it starts on, and the mutex only matters if it gets
+ * preempted and another writer lands on the same CPU meanwhile.
+ */
+struct zram_stream {
+	struct mutex lock;
+	void *private;		/* backend state */
+	void *buffer;
+};
+
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *mem_pool;
+	const struct zcomp_backend *backend;
+	struct zram_stream *streams;	/* per-cpu */
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
+	rwlock_t table_lock;	/* protect table entries and the stats
+				 * kept with them; readers decompress
+				 * under the read side */
+	struct rb_root dedup_root;	/* protected by table_lock */
+	struct mutex init_lock;	/* serialize init/reset against sysfs */
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
+	int dedup;		/* deduplicate identical pages */
+
+	/* Writeback to a backing device; all unused if wb_path is NULL */
+	char *wb_path;
+	struct block_device *wb_bdev;
+	unsigned long *wb_bitmap;	/* backing device pages in use */
+	unsigned long wb_nr_blocks;
+	unsigned long wb_hint;	/* where to look for a free block */
+	spinlock_t wb_lock;	/* protect wb_bitmap and wb_hint */
+	struct delayed_work wb_work;
+	unsigned long wb_last_aging;	/* jiffies */
+	unsigned int wb_age;	/* seconds; 0 writes back only
+				 * incompressible pages */
 	/*
 	 * This is the limit on amount of *uncompressed* worth of data
 	 * we can store in a disk.
@@ -144,6 +217,13 @@ static void zram_stat64_inc(struct zram *zram, u64 *v)
 	spin_unlock(&zram->stat64_lock);
 }
 
+static void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
+{
+	spin_lock(&zram->stat64_lock);
+	*v = *v + inc;
+	spin_unlock(&zram->stat64_lock);
+}
+
 static u64 zram_stat64_read(struct zram *zram, u64 *v)
 {
 	u64 val;
@@ -158,6 +238,7 @@ static u64 zram_stat64_read(struct zram *zram, u64 *v)
 #define zram_stat_inc(v)
 #define zram_stat_dec(v)
 #define zram_stat64_inc(r, v)
+#define zram_stat64_add(r, v, i)
 #define zram_stat64_read(r, v)
 #endif /* CONFIG_ZRAM_STATS */
 
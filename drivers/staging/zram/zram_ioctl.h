@@ -15,6 +15,8 @@
 #ifndef _ZRAM_IOCTL_H_
 #define _ZRAM_IOCTL_H_
 
+#define ZRAM_BACKEND_NAME_LEN	16
+
 struct zram_ioctl_stats {
 	u64 disksize;		/* disksize in bytes (user specifies in KB) */
 	u64 num_reads;		/* failed + successful */
@@ -31,6 +33,12 @@ struct zram_ioctl_stats {
 	u64 orig_data_size;
 	u64 compr_data_size;
 	u64 mem_used_total;
+	u64 dedup_hits;		/* writes satisfied by an existing object */
+	u32 pages_dedup;	/* no. of pages sharing another's object */
+	u32 compr_ratio_pct;	/* compr_data_size as % of orig_data_size */
+	u64 comp_time_ns;	/* total time spent in the backend */
+	u64 decomp_time_ns;	/* --do-- */
+	char backend[ZRAM_BACKEND_NAME_LEN];
 } __attribute__ ((packed, aligned(4)));
 
 #define ZRAMIO_SET_DISKSIZE_KB	_IOW('z', 0, size_t)
@@ -0,0 +1,573 @@
+/*
+ * zsalloc size-class memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Objects are grouped by size into classes ZS_CLASS_DELTA bytes apart.
+ * Each class packs its objects into zspages cut into equal slots, and
+ * objects are addressed as <first page of zspage, offset>. Large classes
+ * use zspages of up to 1 << ZS_MAX_ZSPAGE_ORDER pages so that little of
+ * the zspage is left over; those are allocated from lowmem, so that
+ * kmap_atomic() of the first page maps all of it. If such an allocation
+ * fails, a single (possibly highmem) page is used instead.
+ *
+ * Since every slot of a class has the same size, objects can be moved
+ * between zspages of a class, which lets zs_compact_zspage() empty and
+ * release sparsely used zspages.
+ */
+
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/mm.h>
+#include <linux/seq_file.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+
+#include "zsalloc.h"
+#include "zsalloc_int.h"
+
+static u32 get_class_idx(u32 size)
+{
+	if (unlikely(size < ZS_MIN_ALLOC_SIZE))
+		size = ZS_MIN_ALLOC_SIZE;
+	size = ALIGN(size, ZS_CLASS_DELTA);
+	return (size - ZS_MIN_ALLOC_SIZE) >> ZS_CLASS_DELTA_SHIFT;
+}
+
+static struct zspage *get_zspage(struct page *page)
+{
+	return (struct zspage *)page_private(page);
+}
+
+static struct slot_header *get_slot(void *base, u16 offset)
+{
+	return (struct slot_header *)((char *)base + offset);
+}
+
+/* Take the first free slot of a mapped zspage */
+static u16 pop_slot(struct zspage *zspage, void *base, u16 size)
+{
+	u16 offset = zspage->free;
+	struct slot_header *slot = get_slot(base, offset);
+
+	zspage->free = slot->next;
+	zspage->inuse++;
+	slot->size = size;
+
+	return offset;
+}
+
+static void push_slot(struct zspage *zspage, void *base, u16 offset)
+{
+	struct slot_header *slot = get_slot(base, offset);
+
+	slot->size = 0;
+	slot->next = zspage->free;
+	zspage->free = offset;
+	zspage->inuse--;
+}
+
+/*
+ * Pick the zspage order, up to ZS_MAX_ZSPAGE_ORDER, that leaves the
+ * smallest fraction of the zspage unused.
+ */
+static u32 get_class_order(u32 size)
+{
+	u32 order, best = 0, best_waste = PAGE_SIZE % size;
+
+	for (order = 1; order <= ZS_MAX_ZSPAGE_ORDER; order++) {
+		u32 waste = ((PAGE_SIZE << order) % size) >> order;
+
+		if (waste < best_waste) {
+			best = order;
+			best_waste = waste;
+		}
+	}
+
+	return best;
+}
+
+static struct zspage *alloc_zspage(struct zs_pool *pool, u32 class_idx,
+				gfp_t flags)
+{
+	u32 offset, order;
+	void *base;
+	struct page *page = NULL;
+	struct zspage *zspage;
+	struct size_class *class = &pool->classes[class_idx];
+
+	zspage = kmalloc(sizeof(*zspage), flags & ~__GFP_HIGHMEM);
+	if (unlikely(!zspage))
+		return NULL;
+
+	order = class->order;
+	if (order)
+		page = alloc_pages((flags & ~__GFP_HIGHMEM) |
+				__GFP_NOWARN | __GFP_NORETRY, order);
+	if (!page) {
+		order = 0;
+		page = alloc_page(flags);
+	}
+	if (unlikely(!page)) {
+		kfree(zspage);
+		return NULL;
+	}
+
+	INIT_LIST_HEAD(&zspage->list);
+	zspage->page = page;
+	zspage->inuse = 0;
+	zspage->free = 0;
+	zspage->slots = (PAGE_SIZE << order) / class->size;
+	zspage->class_idx = class_idx;
+	zspage->order = order;
+	zspage->fullness = 0;
+	zspage->isolated = 0;
+	set_page_private(page, (unsigned long)zspage);
+
+	/* Chain all slots into the free list */
+	base = kmap_atomic(page, KM_USER0);
+	for (offset = 0; offset < zspage->slots * class->size;
+			offset += class->size) {
+		struct slot_header *slot = get_slot(base, offset);
+
+		slot->size = 0;
+		slot->next = offset + class->size;
+	}
+	get_slot(base, offset - class->size)->next = ZS_NO_FREE;
+	kunmap_atomic(base, KM_USER0);
+
+	return zspage;
+}
+
+static void free_zspage(struct zspage *zspage)
+{
+	set_page_private(zspage->page, 0);
+	__free_pages(zspage->page, zspage->order);
+	kfree(zspage);
+}
+
+static u8 get_fullness(struct zspage *zspage)
+{
+	if (zspage->free == ZS_NO_FREE)
+		return ZS_FULL;
+	return zspage->inuse * ZS_NR_FULLNESS / zspage->slots;
+}
+
+/*
+ * Move a zspage whose use count changed to the matching fullness list.
+ * Isolated zspages stay where they are. Called with pool lock held.
+ */
+static void fix_fullness(struct size_class *class, struct zspage *zspage)
+{
+	u8 fullness;
+
+	if (zspage->isolated)
+		return;
+
+	fullness = get_fullness(zspage);
+	if (fullness != zspage->fullness) {
+		list_move(&zspage->list, &class->fullness[fullness]);
+		zspage->fullness = fullness;
+	}
+}
+
+/* Called with pool lock held */
+static void insert_zspage(struct zs_pool *pool, struct zspage *zspage)
+{
+	struct size_class *class = &pool->classes[zspage->class_idx];
+
+	list_add(&zspage->list, &class->fullness[zspage->fullness]);
+	class->nr_zspages++;
+	class->nr_pages += 1 << zspage->order;
+	class->nr_slots += zspage->slots;
+	pool->total_pages += 1 << zspage->order;
+}
+
+/* Called with pool lock held */
+static void remove_zspage(struct zs_pool *pool, struct zspage *zspage)
+{
+	struct size_class *class = &pool->classes[zspage->class_idx];
+
+	list_del(&zspage->list);
+	if (zspage->isolated)
+		class->isolated_free -= zspage->slots - zspage->inuse;
+	class->nr_zspages--;
+	class->nr_pages -= 1 << zspage->order;
+	class->nr_slots -= zspage->slots;
+	pool->total_pages -= 1 << zspage->order;
+}
+
+/*
+ * Pick a zspage from the fullest group that has a free slot: filling
+ * those up first keeps the other ones emptier. Called with pool lock
+ * held.
+ */
+static struct zspage *fullest_partial(struct size_class *class)
+{
+	int i;
+
+	for (i = ZS_NR_FULLNESS - 1; i >= 0; i--)
+		if (!list_empty(&class->fullness[i]))
+			return list_first_entry(&class->fullness[i],
+						struct zspage, list);
+
+	return NULL;
+}
+
+/* Pick a zspage from the emptiest group. Called with pool lock held. */
+static struct zspage *emptiest_partial(struct size_class *class)
+{
+	int i;
+
+	for (i = 0; i < ZS_NR_FULLNESS; i++)
+		if (!list_empty(&class->fullness[i]))
+			return list_first_entry(&class->fullness[i],
+						struct zspage, list);
+
+	return NULL;
+}
+
+struct zs_pool *zs_create_pool(void)
+{
+	u32 i, j;
+	struct zs_pool *pool;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	spin_lock_init(&pool->lock);
+
+	for (i = 0; i < ZS_NR_CLASSES; i++) {
+		struct size_class *class = &pool->classes[i];
+
+		class->size = ZS_MIN_ALLOC_SIZE + (i << ZS_CLASS_DELTA_SHIFT);
+		class->order = get_class_order(class->size);
+		for (j = 0; j <= ZS_NR_FULLNESS; j++)
+			INIT_LIST_HEAD(&class->fullness[j]);
+		INIT_LIST_HEAD(&class->isolated);
+	}
+
+	return pool;
+}
+
+/*
+ * All objects should have been freed by now. Whatever is left is a leak
+ * in the caller; it is reported and released anyway.
+ */
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	u32 i, j;
+	struct zspage *zspage, *tmp;
+
+	for (i = 0; i < ZS_NR_CLASSES; i++) {
+		struct size_class *class = &pool->classes[i];
+
+		WARN_ONCE(class->nr_inuse, "zsalloc: %u objects of size %u "
+			"left in pool\n", class->nr_inuse, class->size);
+
+		list_splice_init(&class->isolated, &class->fullness[0]);
+		for (j = 0; j <= ZS_NR_FULLNESS; j++)
+			list_for_each_entry_safe(zspage, tmp,
+					&class->fullness[j], list)
+				free_zspage(zspage);
+	}
+
+	kfree(pool);
+}
+
+/**
+ * zs_malloc - allocate block of given size from pool
+ * @pool: pool to allocate from
+ * @size: size of block to allocate
+ * @page: page no. that holds the object
+ * @offset: location of object within page
+ * @flags: gfp flags used if the pool has to grow
+ *
+ * On success, <page, offset> identifies block allocated
+ * and 0 is returned. On failure, <page, offset> is set to
+ * 0 and -ENOMEM is returned.
+ *
+ * Allocation requests with size > ZS_MAX_ALLOC_SIZE will fail.
+ */
+int zs_malloc(struct zs_pool *pool, u32 size, struct page **page,
+		u32 *offset, gfp_t flags)
+{
+	u16 slot;
+	void *base;
+	u32 class_idx;
+	struct zspage *zspage;
+	struct size_class *class;
+
+	*page = NULL;
+	*offset = 0;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
+		return -ENOMEM;
+
+	class_idx = get_class_idx(size + sizeof(struct slot_header));
+	class = &pool->classes[class_idx];
+
+	spin_lock(&pool->lock);
+
+	zspage = fullest_partial(class);
+	if (!zspage) {
+		spin_unlock(&pool->lock);
+
+		zspage = alloc_zspage(pool, class_idx, flags);
+		if (unlikely(!zspage))
+			return -ENOMEM;
+
+		spin_lock(&pool->lock);
+		insert_zspage(pool, zspage);
+	}
+
+	base = kmap_atomic(zspage->page, KM_USER0);
+	slot = pop_slot(zspage, base, size);
+	kunmap_atomic(base, KM_USER0);
+
+	class->nr_inuse++;
+	fix_fullness(class, zspage);
+
+	spin_unlock(&pool->lock);
+
+	*page = zspage->page;
+	*offset = slot + sizeof(struct slot_header);
+
+	return 0;
+}
+
+/*
+ * Free block identified with <page, offset>
+ */
+void zs_free(struct zs_pool *pool, struct page *page, u32 offset)
+{
+	void *base;
+	struct zspage *zspage = get_zspage(page);
+	struct size_class *class = &pool->classes[zspage->class_idx];
+
+	offset -= sizeof(struct slot_header);
+
+	spin_lock(&pool->lock);
+
+	base = kmap_atomic(page, KM_USER0);
+
+	/* Catch double free bugs */
+	BUG_ON(!get_slot(base, offset)->size);
+
+	push_slot(zspage, base, offset);
+	kunmap_atomic(base, KM_USER0);
+
+	class->nr_inuse--;
+	if (zspage->isolated)
+		class->isolated_free++;
+
+	/* No used objects in this page. Free it. */
+	if (!zspage->inuse) {
+		remove_zspage(pool, zspage);
+		spin_unlock(&pool->lock);
+
+		free_zspage(zspage);
+		return;
+	}
+
+	fix_fullness(class, zspage);
+
+	spin_unlock(&pool->lock);
+}
+
+u32 zs_get_object_size(void *obj)
+{
+	return ((struct slot_header *)obj - 1)->size;
+}
+
+/*
+ * Returns total memory used by allocator (userdata + metadata)
+ */
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	u32 i;
+	u64 total;
+
+	spin_lock(&pool->lock);
+	total = (pool->total_pages << PAGE_SHIFT);
+	for (i = 0; i < ZS_NR_CLASSES; i++)
+		total += pool->classes[i].nr_zspages * sizeof(struct zspage);
+	spin_unlock(&pool->lock);
+
+	return total;
+}
+
+unsigned int zs_get_nr_classes(void)
+{
+	return ZS_NR_CLASSES;
+}
+
+/*
+ * Move every movable object of the isolated zspage src into partial
+ * zspages of the class. Returns the number of pages released, which is
+ * zero unless src ended up empty. Called with pool lock held.
+ */
+static unsigned long migrate_zspage(struct zs_pool *pool, struct zspage *src,
+			zs_relocate_fn relocate, void *arg)
+{
+	u32 offset;
+	void *sbase;
+	unsigned long freed;
+	struct zspage *dst = NULL;
+	struct size_class *class = &pool->classes[src->class_idx];
+	const u16 hdr = sizeof(struct slot_header);
+
+	sbase = kmap_atomic(src->page, KM_USER0);
+
+	for (offset = 0; src->inuse &&
+			offset < src->slots * class->size;
+			offset += class->size) {
+		u16 doff;
+		void *dbase;
+		struct slot_header *sslot = get_slot(sbase, offset);
+
+		if (!sslot->size)
+			continue;
+
+		if (!dst) {
+			dst = fullest_partial(class);
+			if (!dst)
+				break;
+		}
+
+		dbase = kmap_atomic(dst->page, KM_USER1);
+		doff = pop_slot(dst, dbase, sslot->size);
+		memcpy(get_slot(dbase, doff) + 1, sslot + 1, sslot->size);
+
+		if (relocate(arg, (char *)dbase + doff + hdr,
+				src->page, offset + hdr,
+				dst->page, doff + hdr)) {
+			push_slot(dst, dbase, doff);
+		} else {
+			push_slot(src, sbase, offset);
+			class->isolated_free++;
+			class->nr_migrated++;
+		}
+
+		kunmap_atomic(dbase, KM_USER1);
+
+		fix_fullness(class, dst);
+		if (dst->free == ZS_NO_FREE)
+			dst = NULL;
+	}
+
+	kunmap_atomic(sbase, KM_USER0);
+
+	if (src->inuse)
+		return 0;
+
+	freed = 1 << src->order;
+	remove_zspage(pool, src);
+	free_zspage(src);
+	class->nr_compacted++;
+
+	return freed;
+}
+
+/**
+ * zs_compact_zspage - release a zspage of a class by moving its objects
+ * @pool: pool to compact
+ * @idx: class index, below zs_get_nr_classes()
+ * @relocate: called for every object moved; see zs_relocate_fn
+ * @arg: passed to relocate
+ * @freed: incremented by the number of pages released
+ *
+ * Takes the emptiest partial zspage of the class and moves its objects
+ * into the fullest ones, if the rest of the class has room for all of
+ * them. A zspage holding objects that relocate() refuses to move is set
+ * aside until zs_compact_done(). relocate() runs under the pool lock
+ * and must not call back into the allocator.
+ *
+ * Only one zspage is handled per call, so that the caller can let other
+ * users of the pool and of its own locks in between. Calls for a class
+ * must be serialized and followed by zs_compact_done().
+ *
+ * Returns 0 once there is nothing left worth moving, 1 otherwise.
+ */
+int zs_compact_zspage(struct zs_pool *pool, unsigned int idx,
+			zs_relocate_fn relocate, void *arg,
+			unsigned long *freed)
+{
+	u32 room;
+	struct zspage *src;
+	struct size_class *class = &pool->classes[idx];
+
+	spin_lock(&pool->lock);
+
+	/* Free slots in the partial zspages that are not set aside */
+	room = class->nr_slots - class->nr_inuse - class->isolated_free;
+
+	src = emptiest_partial(class);
+	if (!src || room - (src->slots - src->inuse) < src->inuse) {
+		spin_unlock(&pool->lock);
+		return 0;
+	}
+
+	list_move(&src->list, &class->isolated);
+	src->isolated = 1;
+	class->isolated_free += src->slots - src->inuse;
+
+	*freed += migrate_zspage(pool, src, relocate, arg);
+
+	spin_unlock(&pool->lock);
+
+	return 1;
+}
+
+/* Give the zspages set aside by zs_compact_zspage() back to the class */
+void zs_compact_done(struct zs_pool *pool, unsigned int idx)
+{
+	struct zspage *zspage, *tmp;
+	struct size_class *class = &pool->classes[idx];
+
+	spin_lock(&pool->lock);
+
+	list_for_each_entry_safe(zspage, tmp, &class->isolated, list) {
+		zspage->isolated = 0;
+		zspage->fullness = get_fullness(zspage);
+		list_move(&zspage->list, &class->fullness[zspage->fullness]);
+	}
+	class->isolated_free = 0;
+
+	spin_unlock(&pool->lock);
+}
+
+/* Per-class occupancy, for debugfs */
+void zs_show_classes(struct zs_pool *pool, struct seq_file *s)
+{
+	u32 i;
+
+	seq_printf(s, "%5s %5s %5s %8s %8s %10s %10s %5s %10s %10s\n",
+		"class", "size", "order", "zspages", "pages", "objects",
+		"capacity", "frag%", "migrated", "compacted");
+
+	spin_lock(&pool->lock);
+	for (i = 0; i < ZS_NR_CLASSES; i++) {
+		struct size_class *class = &pool->classes[i];
+		u32 capacity = class->nr_slots;
+
+		if (!class->nr_zspages && !class->nr_compacted)
+			continue;
+
+		seq_printf(s,
+			"%5u %5u %5u %8u %8u %10u %10u %5u %10llu %10llu\n",
+			i, class->size, class->order, class->nr_zspages,
+			class->nr_pages, class->nr_inuse, capacity, capacity ?
+				100 - class->nr_inuse * 100 / capacity : 0,
+			(unsigned long long)class->nr_migrated,
+			(unsigned long long)class->nr_compacted);
+	}
+	spin_unlock(&pool->lock);
+}
@@ -0,0 +1,48 @@
+/*
+ * zsalloc size-class memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_ALLOC_H_
+#define _ZS_ALLOC_H_
+
+#include <linux/types.h>
+
+struct seq_file;
+struct zs_pool;
+
+/*
+ * Called by zs_compact_zspage() after an object has been copied from
+ * <old_page, old_offset> to <page, offset>; obj points at the new copy.
+ * Return 0 once every reference has been switched over, or nonzero to
+ * keep the object where it was.
+ */
+typedef int (*zs_relocate_fn)(void *arg, void *obj,
+			struct page *old_page, u32 old_offset,
+			struct page *page, u32 offset);
+
+struct zs_pool *zs_create_pool(void);
+void zs_destroy_pool(struct zs_pool *pool);
+
+int zs_malloc(struct zs_pool *pool, u32 size, struct page **page,
+			u32 *offset, gfp_t flags);
+void zs_free(struct zs_pool *pool, struct page *page, u32 offset);
+
+u32 zs_get_object_size(void *obj);
+u64 zs_get_total_size_bytes(struct zs_pool *pool);
+
+unsigned int zs_get_nr_classes(void);
+int zs_compact_zspage(struct zs_pool *pool, unsigned int idx,
+			zs_relocate_fn relocate, void *arg,
+			unsigned long *freed);
+void zs_compact_done(struct zs_pool *pool, unsigned int idx);
+void zs_show_classes(struct zs_pool *pool, struct seq_file *s);
+
+#endif
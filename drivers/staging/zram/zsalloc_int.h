@@ -0,0 +1,103 @@
+/*
+ * zsalloc size-class memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_ALLOC_INT_H_
+#define _ZS_ALLOC_INT_H_
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+/* User configurable params */
+
+/* Size classes are ZS_CLASS_DELTA bytes apart; must be power of two */
+#define ZS_CLASS_DELTA_SHIFT	4
+#define ZS_CLASS_DELTA		(1 << ZS_CLASS_DELTA_SHIFT)
+
+/* Smallest slot, header included */
+#define ZS_MIN_ALLOC_SIZE	32
+
+/*
+ * Largest zspage, as a page order. Offsets within a zspage must fit in
+ * 16 bits.
+ */
+#if PAGE_SHIFT <= 13
+#define ZS_MAX_ZSPAGE_ORDER	2
+#else
+#define ZS_MAX_ZSPAGE_ORDER	0
+#endif
+
+/* End of user params */
+
+#define ZS_MAX_ALLOC_SIZE	(PAGE_SIZE - sizeof(struct slot_header))
+#define ZS_NR_CLASSES		((PAGE_SIZE - ZS_MIN_ALLOC_SIZE) \
+					/ ZS_CLASS_DELTA + 1)
+
+/* End of a zspage's free slot chain */
+#define ZS_NO_FREE		0xffff
+
+/*
+ * Partial zspages are kept on ZS_NR_FULLNESS lists by the fraction of
+ * their slots in use, so that the fullest and emptiest ones are found
+ * without a scan. ZS_FULL is the group of zspages with no free slot.
+ */
+#define ZS_NR_FULLNESS		4
+#define ZS_FULL			ZS_NR_FULLNESS
+
+/*
+ * Starts every slot; the object follows it. Keeping the slot size a
+ * multiple of ZS_CLASS_DELTA keeps objects 4-byte aligned.
+ */
+struct slot_header {
+	u16 size;	/* object size, 0 if the slot is free */
+	u16 next;	/* offset of the next free slot, if free */
+};
+
+/*
+ * A zspage: a block of 1 << order pages cut into equal slots of a single
+ * size class. Reached from its first page through page->private.
+ */
+struct zspage {
+	struct list_head list;	/* in a fullness list or class->isolated */
+	struct page *page;
+	u16 inuse;		/* slots holding an object */
+	u16 free;		/* offset of the first free slot */
+	u16 slots;
+	u16 class_idx;
+	u8 order;
+	u8 fullness;		/* group the zspage is listed in */
+	u8 isolated;		/* set aside by compaction */
+};
+
+struct size_class {
+	u32 size;		/* slot size, header included */
+	u32 order;		/* preferred zspage order */
+	/* indexed by fullness group, ZS_FULL last */
+	struct list_head fullness[ZS_NR_FULLNESS + 1];
+	struct list_head isolated;	/* zspages compaction gave up on */
+	u32 isolated_free;	/* free slots in isolated zspages */
+	u32 nr_zspages;
+	u32 nr_pages;
+	u32 nr_slots;
+	u32 nr_inuse;
+	u64 nr_migrated;	/* objects moved by compaction */
+	u64 nr_compacted;	/* zspages released by compaction */
+};
+
+struct zs_pool {
+	spinlock_t lock;
+	u64 total_pages;
+	struct size_class classes[ZS_NR_CLASSES];
+};
+
+#endif
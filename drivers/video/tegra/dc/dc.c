@@ -28,6 +28,8 @@
 #include <linux/dma-mapping.h>
 #include <linux/workqueue.h>
 #include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
 #include <linux/debugfs.h>
 #include <linux/seq_file.h>
 #include <linux/switch.h>
@@ -56,6 +58,12 @@ static int windows_idle_detection_time = 0;
 module_param_named(windows_idle_detection_time, windows_idle_detection_time,
 		   int, S_IRUGO | S_IWUSR);
 
+/* smallest EMC reduction, in percent of the current rate, worth a change */
+static int emc_hysteresis_pct = 10;
+
+module_param_named(emc_hysteresis_pct, emc_hysteresis_pct,
+		   int, S_IRUGO | S_IWUSR);
+
 struct tegra_dc *tegra_dcs[TEGRA_MAX_DC];
 
 DEFINE_MUTEX(tegra_dc_lock);
@@ -326,12 +334,50 @@ static const struct file_operations dbg_fops = {
 	.release	= single_release,
 };
 
+static int dbg_dc_stats_show(struct seq_file *s, void *unused)
+{
+	struct tegra_dc *dc = s->private;
+	struct tegra_dc_stats *stats = &dc->stats;
+	int i;
+
+	seq_printf(s, "flips: %u\n", stats->flips);
+	seq_printf(s, "scanouts: %u\n", stats->scanouts);
+	seq_printf(s, "latency_avg_us: %llu\n", stats->scanouts ?
+		   div_u64(stats->latency_us, stats->scanouts) : 0);
+	seq_printf(s, "latency_max_us: %u\n", stats->latency_max_us);
+	seq_printf(s, "latency_hist_ms:");
+	for (i = 0; i < TEGRA_DC_FLIP_HIST_BUCKETS; i++)
+		seq_printf(s, " %u", stats->latency_hist[i]);
+	seq_printf(s, "\n");
+	seq_printf(s, "emc_rate: %d\n", dc->emc_clk_rate);
+	seq_printf(s, "emc_raises: %u\n", stats->emc_raises);
+	seq_printf(s, "emc_drops: %u\n", stats->emc_drops);
+	seq_printf(s, "emc_held: %u\n", stats->emc_held);
+
+	return 0;
+}
+
+static int dbg_dc_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dbg_dc_stats_show, inode->i_private);
+}
+
+static const struct file_operations dbg_stats_fops = {
+	.open		= dbg_dc_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static void tegra_dc_dbg_add(struct tegra_dc *dc)
 {
 	char name[32];
 
 	snprintf(name, sizeof(name), "tegra_dc%d_regs", dc->ndev->id);
 	(void) debugfs_create_file(name, S_IRUGO, NULL, dc, &dbg_fops);
+
+	snprintf(name, sizeof(name), "tegra_dc%d_stats", dc->ndev->id);
+	(void) debugfs_create_file(name, S_IRUGO, NULL, dc, &dbg_stats_fops);
 }
 #else
 static void tegra_dc_dbg_add(struct tegra_dc *dc) {}
@@ -605,30 +651,50 @@ static void tegra_dc_reduce_emc_worker(struct work_struct *work)
 		return;
 	}
 
+	if (dc->new_emc_clk_rate < dc->emc_clk_rate)
+		dc->stats.emc_drops++;
 	tegra_dc_change_emc(dc);
 
 	mutex_unlock(&dc->lock);
 }
 
-int  tegra_dc_set_dynamic_emc(struct tegra_dc_win *windows[], int n)
+/*
+ * Pick the EMC rate for the current state of all of the dc's windows, so
+ * fb and overlay flips are accounted for together. Must be called with
+ * dc->lock held, before the new window state is latched.
+ *
+ * Increases take effect at once so the next frame cannot underflow.
+ * Reductions are ignored unless they save at least emc_hysteresis_pct of
+ * the current rate, and are left to the reduce worker so a burst of flips
+ * that moves the rate down and back up never touches the clock.
+ */
+static void tegra_dc_program_emc(struct tegra_dc *dc)
 {
+	struct tegra_dc_win *wins[DC_N_WINDOWS];
+	unsigned long cur_rate = dc->emc_clk_rate;
 	unsigned long new_rate;
-	struct tegra_dc *dc;
-
-	if (!use_dynamic_emc)
-		return 0;
+	int i;
 
-	dc = windows[0]->dc;
+	for (i = 0; i < DC_N_WINDOWS; i++)
+		wins[i] = &dc->windows[i];
+	new_rate = tegra_dc_get_emc_rate(wins, DC_N_WINDOWS);
 
-	mutex_lock(&dc->lock);
-
-	if (!dc->enabled) {
-		mutex_unlock(&dc->lock);
-		return -EFAULT;
+	if (new_rate >= cur_rate) {
+		cancel_delayed_work(&dc->reduce_emc_clk_work);
+		dc->new_emc_clk_rate = new_rate;
+		if (new_rate > cur_rate) {
+			dc->stats.emc_raises++;
+			tegra_dc_change_emc(dc);
+		}
+		return;
 	}
 
-	/* calculate the new rate based on this POST */
-	new_rate = tegra_dc_get_emc_rate(windows, n);
+	if (cur_rate - new_rate < cur_rate / 100 * emc_hysteresis_pct) {
+		cancel_delayed_work(&dc->reduce_emc_clk_work);
+		dc->new_emc_clk_rate = cur_rate;
+		dc->stats.emc_held++;
+		return;
+	}
 
 	dc->new_emc_clk_rate = new_rate;
 
@@ -638,11 +704,32 @@ int  tegra_dc_set_dynamic_emc(struct tegra_dc_win *windows[], int n)
 	 * not be executed if the another POST comes before the idle time
 	 * expired.
 	 */
-	if (NEED_UPDATE_EMC_ON_EVERY_FRAME)
+	if (NEED_UPDATE_EMC_ON_EVERY_FRAME) {
+		dc->stats.emc_drops++;
 		tegra_dc_change_emc(dc);
-	else
+	} else {
 		schedule_delayed_work(&dc->reduce_emc_clk_work,
 			msecs_to_jiffies(windows_idle_detection_time));
+	}
+}
+
+int  tegra_dc_set_dynamic_emc(struct tegra_dc_win *windows[], int n)
+{
+	struct tegra_dc *dc;
+
+	if (!use_dynamic_emc)
+		return 0;
+
+	dc = windows[0]->dc;
+
+	mutex_lock(&dc->lock);
+
+	if (!dc->enabled) {
+		mutex_unlock(&dc->lock);
+		return -EFAULT;
+	}
+
+	tegra_dc_program_emc(dc);
 
 	mutex_unlock(&dc->lock);
 
@@ -676,24 +763,15 @@ int  tegra_dc_set_default_emc(struct tegra_dc *dc)
 	return 0;
 }
 
-/* does not support updating windows on multiple dcs in one call */
-int tegra_dc_update_windows(struct tegra_dc_win *windows[], int n)
+/* must be called with dc->lock held on an enabled dc */
+static void _tegra_dc_update_windows(struct tegra_dc *dc,
+				     struct tegra_dc_win *windows[], int n)
 {
-	struct tegra_dc *dc;
 	unsigned long update_mask = GENERAL_ACT_REQ;
 	unsigned long val;
 	bool update_blend = false;
 	int i;
 
-	dc = windows[0]->dc;
-
-	mutex_lock(&dc->lock);
-
-	if (!dc->enabled) {
-		mutex_unlock(&dc->lock);
-		return -EFAULT;
-	}
-
 	if (no_vsync)
 		tegra_dc_writel(dc, WRITE_MUX_ACTIVE | READ_MUX_ACTIVE, DC_CMD_STATE_ACCESS);
 	else
@@ -847,12 +925,69 @@ int tegra_dc_update_windows(struct tegra_dc_win *windows[], int n)
 	}
 
 	tegra_dc_writel(dc, update_mask, DC_CMD_STATE_CONTROL);
+}
+
+/* does not support updating windows on multiple dcs in one call */
+int tegra_dc_update_windows(struct tegra_dc_win *windows[], int n)
+{
+	struct tegra_dc *dc;
+
+	dc = windows[0]->dc;
+
+	mutex_lock(&dc->lock);
+
+	if (!dc->enabled) {
+		mutex_unlock(&dc->lock);
+		return -EFAULT;
+	}
+
+	_tegra_dc_update_windows(dc, windows, n);
+
 	mutex_unlock(&dc->lock);
 
 	return 0;
 }
 EXPORT_SYMBOL(tegra_dc_update_windows);
 
+/*
+ * Commit a flip: work out the EMC rate for the new window state and
+ * program the windows under a single hold of dc->lock. The windows latch
+ * at the next frame boundary together with anything else committed on the
+ * same dc in that frame.
+ *
+ * does not support committing windows on multiple dcs in one call
+ */
+int tegra_dc_commit_windows(struct tegra_dc_win *windows[], int n,
+			    ktime_t queued)
+{
+	struct tegra_dc *dc;
+	int i;
+
+	dc = windows[0]->dc;
+
+	mutex_lock(&dc->lock);
+
+	if (!dc->enabled) {
+		mutex_unlock(&dc->lock);
+		return -EFAULT;
+	}
+
+	if (use_dynamic_emc)
+		tegra_dc_program_emc(dc);
+
+	/* the irq handler picks these up when the windows go clean */
+	for (i = 0; i < n; i++)
+		dc->flip_queued[windows[i]->idx] = queued;
+	dc->stats.flips++;
+
+	_tegra_dc_update_windows(dc, windows, n);
+
+	mutex_unlock(&dc->lock);
+
+	return 0;
+}
+EXPORT_SYMBOL(tegra_dc_commit_windows);
+
 u32 tegra_dc_get_syncpt_id(const struct tegra_dc *dc)
 {
 	return dc->syncpt_id;
@@ -1374,6 +1509,30 @@ unsigned tegra_dc_get_out_max_pixclock(const struct tegra_dc *dc)
 }
 EXPORT_SYMBOL(tegra_dc_get_out_max_pixclock);
 
+/* account the queue to scanout latency of a window flip, in irq context */
+static void tegra_dc_flip_latched(struct tegra_dc *dc, int idx)
+{
+	struct tegra_dc_stats *stats = &dc->stats;
+	unsigned int bucket;
+	u32 us;
+
+	if (!dc->flip_queued[idx].tv64)
+		return;
+
+	us = (u32)ktime_us_delta(ktime_get(), dc->flip_queued[idx]);
+	dc->flip_queued[idx].tv64 = 0;
+
+	bucket = us >= 2000 ? ilog2(us / 1000) : 0;
+	if (bucket >= TEGRA_DC_FLIP_HIST_BUCKETS)
+		bucket = TEGRA_DC_FLIP_HIST_BUCKETS - 1;
+
+	stats->scanouts++;
+	stats->latency_us += us;
+	if (us > stats->latency_max_us)
+		stats->latency_max_us = us;
+	stats->latency_hist[bucket]++;
+}
+
 static irqreturn_t tegra_dc_irq(int irq, void *ptr)
 {
 	struct tegra_dc *dc = ptr;
@@ -1392,6 +1551,8 @@ static irqreturn_t tegra_dc_irq(int irq, void *ptr)
 		val = tegra_dc_readl(dc, DC_CMD_STATE_CONTROL);
 		for (i = 0; i < DC_N_WINDOWS; i++) {
 			if (!(val & (WIN_A_UPDATE << i))) {
+				if (dc->windows[i].dirty)
+					tegra_dc_flip_latched(dc, i);
 				dc->windows[i].dirty = 0;
 				completed = 1;
 			} else {
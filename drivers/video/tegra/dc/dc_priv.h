@@ -60,6 +60,21 @@ struct tegra_dc_blend {
 	unsigned flags[DC_N_WINDOWS];
 };
 
+/* flip latency histogram: bucket i counts flips of [2^i, 2^(i+1)) ms,
+ * the last bucket also counts everything slower */
+#define TEGRA_DC_FLIP_HIST_BUCKETS	8
+
+struct tegra_dc_stats {
+	u32	flips;			/* window commits */
+	u32	scanouts;		/* commits seen latched */
+	u64	latency_us;		/* total queue to scanout time */
+	u32	latency_max_us;
+	u32	latency_hist[TEGRA_DC_FLIP_HIST_BUCKETS];
+	u32	emc_raises;		/* EMC raised on a commit */
+	u32	emc_drops;		/* EMC lowered by the reduce worker */
+	u32	emc_held;		/* reductions ignored as too small */
+};
+
 struct tegra_dc_out_ops {
 	/* initialize output.  dc clocks are not on at this point */
 	int (*init)(struct tegra_dc *dc);
@@ -121,6 +136,9 @@ struct tegra_dc {
 	struct work_struct		reset_work;
 	struct delayed_work		reduce_emc_clk_work;
 
+	ktime_t				flip_queued[DC_N_WINDOWS];
+	struct tegra_dc_stats		stats;
+
 	struct switch_dev		modeset_switch;
 };
 
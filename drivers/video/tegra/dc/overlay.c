@@ -88,6 +88,7 @@ struct tegra_overlay_flip_data {
 	struct tegra_overlay_flip_win	win[TEGRA_FB_FLIP_N_WINDOWS];
 	u32				syncpt_max;
 	u32				flags;
+	ktime_t				queued;
 };
 
 /* Overlay window manipulation */
@@ -305,12 +306,10 @@ static void tegra_overlay_flip_worker(struct work_struct *work)
 			dcwins[i] = tegra_dc_get_window(overlay->dc, i);
 
 		tegra_overlay_blend_reorder(&overlay->blend, dcwins);
-		tegra_dc_set_dynamic_emc(dcwins, DC_N_WINDOWS);
-		tegra_dc_update_windows(dcwins, DC_N_WINDOWS);
+		tegra_dc_commit_windows(dcwins, DC_N_WINDOWS, data->queued);
 		tegra_dc_sync_windows(dcwins, DC_N_WINDOWS);
 	} else {
-		tegra_dc_set_dynamic_emc(wins, nr_win);
-		tegra_dc_update_windows(wins, nr_win);
+		tegra_dc_commit_windows(wins, nr_win, data->queued);
 		/* TODO: implement swapinterval here */
 		tegra_dc_sync_windows(wins, nr_win);
 	}
@@ -355,6 +354,7 @@ static int tegra_overlay_flip(struct tegra_overlay_info *overlay,
 	INIT_WORK(&data->work, tegra_overlay_flip_worker);
 	data->overlay = overlay;
 	data->flags = args->flags;
+	data->queued = ktime_get();
 
 	for (i = 0; i < TEGRA_FB_FLIP_N_WINDOWS; i++) {
 		flip_win = &data->win[i];
@@ -375,14 +375,9 @@ static int tegra_overlay_flip(struct tegra_overlay_info *overlay,
 	syncpt_max = tegra_dc_incr_syncpt_max(overlay->dc);
 	data->syncpt_max = syncpt_max;
 
+	/* the commit raises the EMC clock itself before the flip latches */
 	queue_work(overlay->flip_wq, &data->work);
 
-	/*
-	 * Before the queued flip_wq get scheduled, we set the EMC clock to the
-	 * default value in order to do FLIP without glitch.
-	 */
-	tegra_dc_set_default_emc(overlay->dc);
-
 	args->post_syncpt_val = syncpt_max;
 	args->post_syncpt_id = tegra_dc_get_syncpt_id(overlay->dc);
 	mutex_unlock(&tegra_flip_lock);
@@ -70,6 +70,7 @@ struct tegra_fb_flip_data {
 	struct tegra_fb_info		*fb;
 	struct tegra_fb_flip_win	win[TEGRA_FB_FLIP_N_WINDOWS];
 	u32				syncpt_max;
+	ktime_t				queued;
 };
 
 /* palette array used by the fbcon */
@@ -517,8 +518,7 @@ static void tegra_fb_flip_worker(struct work_struct *work)
 #endif
 	}
 
-	tegra_dc_set_dynamic_emc(wins, nr_win);
-	tegra_dc_update_windows(wins, nr_win);
+	tegra_dc_commit_windows(wins, nr_win, data->queued);
 	/* TODO: implement swapinterval here */
 	tegra_dc_sync_windows(wins, nr_win);
 
@@ -556,6 +556,7 @@ static int tegra_fb_flip(struct tegra_fb_info *tegra_fb,
 
 	INIT_WORK(&data->work, tegra_fb_flip_worker);
 	data->fb = tegra_fb;
+	data->queued = ktime_get();
 
 	for (i = 0; i < TEGRA_FB_FLIP_N_WINDOWS; i++) {
 		flip_win = &data->win[i];
@@ -573,14 +574,9 @@ static int tegra_fb_flip(struct tegra_fb_info *tegra_fb,
 	syncpt_max = tegra_dc_incr_syncpt_max(tegra_fb->win->dc);
 	data->syncpt_max = syncpt_max;
 
+	/* the commit raises the EMC clock itself before the flip latches */
 	queue_work(tegra_fb->flip_wq, &data->work);
 
-	/*
-	 * Before the queued flip_wq get scheduled, we set the EMC clock to the
-	 * default value in order to do FLIP without glitch.
-	 */
-	tegra_dc_set_default_emc(tegra_fb->win->dc);
-
 	args->post_syncpt_val = syncpt_max;
 	args->post_syncpt_id = tegra_dc_get_syncpt_id(tegra_fb->win->dc);
 
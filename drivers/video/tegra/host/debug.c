@@ -294,6 +294,63 @@ static int nvhost_debug_show(struct seq_file *s, void *unused)
 
 #ifdef CONFIG_DEBUG_FS
 
+static const char *cdma_event_names[CDMA_EVENT_COUNT] = {
+	[CDMA_EVENT_SYNC_QUEUE_EMPTY]	= "sq_empty",
+	[CDMA_EVENT_SYNC_QUEUE_SPACE]	= "sq_space",
+	[CDMA_EVENT_PUSH_BUFFER_SPACE]	= "pb_space",
+};
+
+static int nvhost_debug_cdma_show(struct seq_file *s, void *unused)
+{
+	struct nvhost_master *m = s->private;
+	int i, ev, b;
+
+	for (i = 0; i < NVHOST_NUMCHANNELS; i++) {
+		struct nvhost_channel *ch = &m->channels[i];
+		struct nvhost_cdma_stats stats;
+		u32 pb_slots;
+
+		/* the cdma lock only exists while the channel is open */
+		mutex_lock(&ch->reflock);
+		if (ch->refcount)
+			mutex_lock(&ch->cdma.lock);
+		stats = ch->cdma.stats;
+		pb_slots = ch->cdma.push_buffer.size / 8;
+		if (ch->refcount)
+			mutex_unlock(&ch->cdma.lock);
+		mutex_unlock(&ch->reflock);
+
+		seq_printf(s, "%d-%s: pb_slots %u (next %u) submits %u "
+			   "slots %u pb_high_water %u\n", i, ch->desc->name,
+			   pb_slots, ch->pb_slots, stats.submits, stats.slots,
+			   stats.pb_high_water);
+
+		for (ev = CDMA_EVENT_NONE + 1; ev < CDMA_EVENT_COUNT; ev++) {
+			if (!stats.stalls[ev])
+				continue;
+			seq_printf(s, "  %s: stalls %u total_us %llu hist_us",
+				   cdma_event_names[ev], stats.stalls[ev],
+				   (unsigned long long)stats.stall_us[ev]);
+			for (b = 0; b < NVHOST_CDMA_HIST_BUCKETS; b++)
+				seq_printf(s, " %u", stats.stall_hist[ev][b]);
+			seq_printf(s, "\n");
+		}
+	}
+	return 0;
+}
+
+static int nvhost_debug_cdma_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nvhost_debug_cdma_show, inode->i_private);
+}
+
+static const struct file_operations nvhost_debug_cdma_fops = {
+	.open		= nvhost_debug_cdma_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int nvhost_debug_open(struct inode *inode, struct file *file)
 {
 	return single_open(file, nvhost_debug_show, inode->i_private);
@@ -308,8 +365,26 @@ static const struct file_operations nvhost_debug_fops = {
 
 void nvhost_debug_init(struct nvhost_master *master)
 {
+	struct dentry *de;
+	char name[32];
+	int i;
+
 	debug_master = master;
 	debugfs_create_file("tegra_host", S_IRUGO, NULL, master, &nvhost_debug_fops);
+
+	de = debugfs_create_dir("tegra_host_cdma", NULL);
+	if (!de)
+		return;
+	debugfs_create_file("stats", S_IRUGO, de, master,
+			    &nvhost_debug_cdma_fops);
+
+	/* push buffer depth, applied when a channel is next opened */
+	for (i = 0; i < NVHOST_NUMCHANNELS; i++) {
+		snprintf(name, sizeof(name), "%s_pb_slots",
+			 master->channels[i].desc->name);
+		debugfs_create_u32(name, S_IRUGO | S_IWUSR, de,
+				   &master->channels[i].pb_slots);
+	}
 }
 #else
 void nvhost_debug_init(struct nvhost_master *master)
@@ -21,6 +21,7 @@
  */
 
 #include "dev.h"
+#include "nvhost_fence.h"
 
 #include <linux/slab.h>
 #include <linux/string.h>
@@ -155,6 +156,7 @@ static void reset_submit(struct nvhost_channel_userctx *ctx)
 	ctx->hdr.num_cmdbufs = 0;
 	ctx->hdr.num_relocs = 0;
 	ctx->hdr.num_waitchks = 0;
+	ctx->hdr.submit_version = NVHOST_SUBMIT_VERSION_V0;
 }
 
 static ssize_t nvhost_channelwrite(struct file *filp, const char __user *buf,
@@ -355,6 +357,89 @@ static int nvhost_ioctl_channel_flush(struct nvhost_channel_userctx *ctx,
 	return 0;
 }
 
+static inline void __user *u64_to_user_ptr(u64 p)
+{
+	return (void __user *)(unsigned long)p;
+}
+
+static int nvhost_ioctl_channel_submit(struct nvhost_channel_userctx *ctx,
+				       struct nvhost_submit_args *args)
+{
+	struct nvhost_get_param_args fence;
+	struct nvhost_cmdbuf *cmdbufs;
+	u32 i;
+	int err;
+
+	if (ctx->hdr.num_relocs || ctx->hdr.num_cmdbufs || ctx->hdr.num_waitchks) {
+		reset_submit(ctx);
+		dev_err(&ctx->ch->dev->pdev->dev, "channel submit out of sync\n");
+		return -EFAULT;
+	}
+	if (args->submit_version > NVHOST_SUBMIT_VERSION_MAX_SUPPORTED) {
+		dev_err(&ctx->ch->dev->pdev->dev, "submit version %d > max supported %d\n",
+			args->submit_version, NVHOST_SUBMIT_VERSION_MAX_SUPPORTED);
+		return -EINVAL;
+	}
+
+	/* two gathers are reserved for the ctx switch, and every cmdbuf
+	 * takes a pinarray slot ahead of the relocs */
+	if (!args->num_cmdbufs ||
+	    args->num_cmdbufs > NVHOST_MAX_GATHERS - 2 ||
+	    args->num_relocs > NVHOST_MAX_HANDLES - args->num_cmdbufs ||
+	    args->num_waitchks > NVHOST_MAX_WAIT_CHECKS)
+		return -EINVAL;
+
+	/* only the sync points handed out to this channel may be used */
+	if (args->syncpt_id >= NV_HOST1X_SYNCPT_NB_PTS ||
+	    !(BIT(args->syncpt_id) & ctx->ch->desc->syncpts))
+		return -EINVAL;
+
+	/* cmdbufs are only needed until the gathers are set up, so they are
+	 * not kept in the context */
+	cmdbufs = kmalloc(args->num_cmdbufs * sizeof(*cmdbufs), GFP_KERNEL);
+	if (!cmdbufs)
+		return -ENOMEM;
+
+	/* each array is copied in one go, the others straight into their
+	 * final place */
+	if (copy_from_user(cmdbufs, u64_to_user_ptr(args->cmdbufs),
+			   args->num_cmdbufs * sizeof(*cmdbufs)) ||
+	    copy_from_user(&ctx->pinarray[args->num_cmdbufs],
+			   u64_to_user_ptr(args->relocs),
+			   args->num_relocs * sizeof(struct nvhost_reloc)) ||
+	    copy_from_user(ctx->waitchks, u64_to_user_ptr(args->waitchks),
+			   args->num_waitchks * sizeof(struct nvhost_waitchk))) {
+		kfree(cmdbufs);
+		ctx->num_gathers = 2;
+		ctx->pinarray_size = 0;
+		ctx->num_waitchks = 0;
+		return -EFAULT;
+	}
+
+	ctx->hdr.syncpt_id = args->syncpt_id;
+	ctx->hdr.syncpt_incrs = args->syncpt_incrs;
+	ctx->hdr.submit_version = args->submit_version;
+	ctx->hdr.waitchk_mask = args->waitchk_mask;
+	ctx->num_gathers = 2;
+	ctx->pinarray_size = 0;
+	for (i = 0; i < args->num_cmdbufs; i++)
+		add_gather(ctx, ctx->num_gathers++, cmdbufs[i].mem,
+			   cmdbufs[i].words, cmdbufs[i].offset);
+	kfree(cmdbufs);
+	ctx->pinarray_size += args->num_relocs;
+	ctx->num_waitchks = args->num_waitchks;
+
+	err = nvhost_ioctl_channel_flush(ctx, &fence,
+			args->flags & NVHOST_SUBMIT_FLAG_NULL_KICKOFF);
+	if (!err)
+		args->fence = fence.value;
+
+	/* ctx->hdr is also the state of the legacy write() stream, which
+	 * only parses version 0 headers */
+	reset_submit(ctx);
+	return err;
+}
+
 static long nvhost_channelctl(struct file *filp,
 	unsigned int cmd, unsigned long arg)
 {
@@ -401,6 +486,9 @@ static long nvhost_channelctl(struct file *filp,
 		err = set_submit(priv);
 		break;
 	}
+	case NVHOST_IOCTL_CHANNEL_SUBMIT:
+		err = nvhost_ioctl_channel_submit(priv, (void *)buf);
+		break;
 	case NVHOST_IOCTL_CHANNEL_GET_SYNCPOINTS:
 		/* host syncpt ID is used by the RM (and never be given out) */
 		BUG_ON(priv->ch->desc->syncpts & (1 << NVSYNCPT_GRAPHICS_HOST));
@@ -515,6 +603,28 @@ static int nvhost_ioctl_ctrl_syncpt_waitex(
 					args->thresh, timeout, &args->value);
 }
 
+static int nvhost_ioctl_ctrl_syncpt_fence(
+	struct nvhost_ctrl_userctx *ctx,
+	struct nvhost_ctrl_syncpt_fence_args *args)
+{
+	int fd = nvhost_fence_create(ctx->dev, args->id, args->thresh);
+	if (fd < 0)
+		return fd;
+	args->fd = fd;
+	return 0;
+}
+
+static int nvhost_ioctl_ctrl_fence_merge(
+	struct nvhost_ctrl_userctx *ctx,
+	struct nvhost_ctrl_fence_merge_args *args)
+{
+	int fd = nvhost_fence_merge(ctx->dev, args->fd1, args->fd2);
+	if (fd < 0)
+		return fd;
+	args->fd = fd;
+	return 0;
+}
+
 static int nvhost_ioctl_ctrl_module_mutex(
 	struct nvhost_ctrl_userctx *ctx,
 	struct nvhost_ctrl_module_mutex_args *args)
@@ -621,6 +731,12 @@ static long nvhost_ctrlctl(struct file *filp,
 	case NVHOST_IOCTL_CTRL_SYNCPT_WAITEX:
 		err = nvhost_ioctl_ctrl_syncpt_waitex(priv, (void *)buf);
 		break;
+	case NVHOST_IOCTL_CTRL_SYNCPT_FENCE:
+		err = nvhost_ioctl_ctrl_syncpt_fence(priv, (void *)buf);
+		break;
+	case NVHOST_IOCTL_CTRL_FENCE_MERGE:
+		err = nvhost_ioctl_ctrl_fence_merge(priv, (void *)buf);
+		break;
 	default:
 		err = -ENOTTY;
 		break;
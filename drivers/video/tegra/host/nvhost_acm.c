@@ -25,6 +25,7 @@
 #include <linux/sched.h>
 #include <linux/err.h>
 #include <linux/device.h>
+#include <linux/moduleparam.h>
 #include <mach/powergate.h>
 #include <mach/clk.h>
 #include "nvhost_syncpt.h"
@@ -36,6 +37,18 @@
 
 #define DISABLE_MPE_POWERGATING
 
+/*
+ * Sustained load: once the top level (host1x) module has stayed powered for
+ * sustained_load_ms, i.e. the engines have been kept busy frame after frame,
+ * ask for a cpu frequency floor of sustained_cpu_freq kHz until it powers
+ * down again. The cpufreq governor then does not have to rediscover the load
+ * from idle at the start of every frame. 0 disables.
+ */
+static unsigned int sustained_load_ms = 100;
+module_param(sustained_load_ms, uint, 0644);
+static unsigned int sustained_cpu_freq = 456000;
+module_param(sustained_cpu_freq, uint, 0644);
+
 void nvhost_module_busy(struct nvhost_module *mod)
 {
 	mutex_lock(&mod->lock);
@@ -62,10 +75,24 @@ void nvhost_module_busy(struct nvhost_module *mod)
 		if (mod->func)
 			mod->func(mod, NVHOST_POWER_ACTION_ON);
 		mod->powered = true;
+		if (!mod->parent && sustained_cpu_freq)
+			schedule_delayed_work(&mod->sustained,
+				msecs_to_jiffies(sustained_load_ms));
 	}
 	mutex_unlock(&mod->lock);
 }
 
+static void sustained_handler(struct work_struct *work)
+{
+	struct nvhost_module *mod;
+
+	mod = container_of(to_delayed_work(work), struct nvhost_module, sustained);
+	mutex_lock(&mod->lock);
+	if (mod->powered)
+		pm_qos_update_request(&mod->cpu_freq_req, sustained_cpu_freq);
+	mutex_unlock(&mod->lock);
+}
+
 static void powerdown_handler(struct work_struct *work)
 {
 	struct nvhost_module *mod;
@@ -88,6 +115,10 @@ static void powerdown_handler(struct work_struct *work)
 		mod->powered = false;
 		if (mod->parent)
 			nvhost_module_idle(mod->parent);
+		else {
+			cancel_delayed_work(&mod->sustained);
+			pm_qos_update_request(&mod->cpu_freq_req, 0);
+		}
 	}
 	else if (mod->force_suspend) {
 		pr_warn("tegra_grhost: module %s (refcnt %d)"
@@ -200,6 +231,10 @@ int nvhost_module_init(struct nvhost_module *mod, const char *name,
 	mutex_init(&mod->lock);
 	init_waitqueue_head(&mod->idle);
 	INIT_DELAYED_WORK(&mod->powerdown, powerdown_handler);
+	if (!parent) {
+		INIT_DELAYED_WORK(&mod->sustained, sustained_handler);
+		pm_qos_add_request(&mod->cpu_freq_req, PM_QOS_CPU_FREQ_MIN, 0);
+	}
 
 	return 0;
 }
@@ -306,6 +341,10 @@ void nvhost_module_deinit(struct nvhost_module *mod)
 {
 	int i;
 	nvhost_module_suspend(mod, false);
+	if (!mod->parent) {
+		cancel_delayed_work_sync(&mod->sustained);
+		pm_qos_remove_request(&mod->cpu_freq_req);
+	}
 	for (i = 0; i < mod->num_clks; i++)
 		clk_put(mod->clk[i]);
 }
@@ -27,6 +27,7 @@
 #include <linux/wait.h>
 #include <linux/mutex.h>
 #include <linux/clk.h>
+#include <linux/pm_qos_params.h>
 
 #define NVHOST_MODULE_MAX_CLOCKS 3
 
@@ -52,6 +53,9 @@ struct nvhost_module {
 	struct nvhost_module *parent;
 	int powergate_id;
 	bool force_suspend;
+	/* top level module only: cpu floor while continuously powered */
+	struct delayed_work sustained;
+	struct pm_qos_request_list cpu_freq_req;
 };
 
 int nvhost_module_init(struct nvhost_module *mod, const char *name,
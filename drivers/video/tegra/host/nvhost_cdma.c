@@ -23,12 +23,15 @@
 #include "nvhost_cdma.h"
 #include "dev.h"
 #include <asm/cacheflush.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/nvhost.h>
 
 /*
  * TODO:
- *   stats
- *     - for figuring out what to optimize further
- *   resizable push buffer & sync queue
+ *   resizable sync queue
  *     - some channels hardly need any, some channels (3d) could use more
  */
 
@@ -45,9 +48,6 @@
  * means that the push buffer is full, not empty.
  */
 
-// 8 bytes per slot. (This number does not include the final RESTART.)
-#define PUSH_BUFFER_SIZE (NVHOST_GATHER_QUEUE_SIZE * 8)
-
 static void destroy_push_buffer(struct push_buffer *pb);
 
 /**
@@ -55,24 +55,29 @@ static void destroy_push_buffer(struct push_buffer *pb);
  */
 static void reset_push_buffer(struct push_buffer *pb)
 {
-	pb->fence = PUSH_BUFFER_SIZE - 8;
+	pb->fence = pb->size - 8;
 	pb->cur = 0;
 }
 
 /**
  * Init push buffer resources
  */
-static int init_push_buffer(struct push_buffer *pb)
+static int init_push_buffer(struct push_buffer *pb, unsigned int slots)
 {
 	struct nvhost_cdma *cdma = pb_to_cdma(pb);
 	struct nvmap_client *nvmap = cdma_to_nvmap(cdma);
+
+	/* 8 bytes per slot. (This does not include the final RESTART.) */
+	slots = clamp_t(unsigned int, slots,
+			NVHOST_GATHER_QUEUE_MIN, NVHOST_GATHER_QUEUE_MAX);
+	pb->size = roundup_pow_of_two(slots) * 8;
 	pb->mem = NULL;
 	pb->mapped = NULL;
 	pb->phys = 0;
 	reset_push_buffer(pb);
 
 	/* allocate and map pushbuffer memory */
-	pb->mem = nvmap_alloc(nvmap, PUSH_BUFFER_SIZE + 4, 32,
+	pb->mem = nvmap_alloc(nvmap, pb->size + 4, 32,
 			      NVMAP_HANDLE_WRITE_COMBINE);
 	if (IS_ERR_OR_NULL(pb->mem)) {
 		pb->mem = NULL;
@@ -90,7 +95,7 @@ static int init_push_buffer(struct push_buffer *pb)
 	}
 
 	/* put the restart at the end of pushbuffer memory */
-	*(pb->mapped + (PUSH_BUFFER_SIZE >> 2)) = nvhost_opcode_restart(pb->phys);
+	*(pb->mapped + (pb->size >> 2)) = nvhost_opcode_restart(pb->phys);
 
 	return 0;
 
@@ -131,7 +136,7 @@ static void push_to_push_buffer(struct push_buffer *pb, u32 op1, u32 op2)
 	BUG_ON(cur == pb->fence);
 	*(p++) = op1;
 	*(p++) = op2;
-	pb->cur = (cur + 8) & (PUSH_BUFFER_SIZE - 1);
+	pb->cur = (cur + 8) & (pb->size - 1);
 	/* printk("push_to_push_buffer: op1=%08x; op2=%08x; cur=%x\n", op1, op2, pb->cur); */
 }
 
@@ -141,7 +146,7 @@ static void push_to_push_buffer(struct push_buffer *pb, u32 op1, u32 op2)
  */
 static void pop_from_push_buffer(struct push_buffer *pb, unsigned int slots)
 {
-	pb->fence = (pb->fence + slots * 8) & (PUSH_BUFFER_SIZE - 1);
+	pb->fence = (pb->fence + slots * 8) & (pb->size - 1);
 }
 
 /**
@@ -149,7 +154,15 @@ static void pop_from_push_buffer(struct push_buffer *pb, unsigned int slots)
  */
 static u32 push_buffer_space(struct push_buffer *pb)
 {
-	return ((pb->fence - pb->cur) & (PUSH_BUFFER_SIZE - 1)) / 8;
+	return ((pb->fence - pb->cur) & (pb->size - 1)) / 8;
+}
+
+/**
+ * Return the number of two word slots in use in the push buffer
+ */
+static u32 push_buffer_used(struct push_buffer *pb)
+{
+	return pb->size / 8 - 1 - push_buffer_space(pb);
 }
 
 static u32 push_buffer_putptr(struct push_buffer *pb)
@@ -361,6 +374,25 @@ static unsigned int cdma_status(struct nvhost_cdma *cdma, enum cdma_event event)
 	}
 }
 
+/**
+ * Account a wait that had to sleep, started at 'start'
+ */
+static void account_stall(struct nvhost_cdma *cdma, enum cdma_event event,
+			  ktime_t start)
+{
+	struct nvhost_cdma_stats *stats = &cdma->stats;
+	s64 us = ktime_us_delta(ktime_get(), start);
+	unsigned int bucket = us > 1 ? ilog2(us) : 0;
+
+	if (bucket >= NVHOST_CDMA_HIST_BUCKETS)
+		bucket = NVHOST_CDMA_HIST_BUCKETS - 1;
+
+	stats->stalls[event]++;
+	stats->stall_us[event] += us;
+	stats->stall_hist[event][bucket]++;
+	trace_nvhost_cdma_stall(cdma_to_channel(cdma)->desc->name, event, us);
+}
+
 /**
  * Sleep (if necessary) until the requested event happens
  *   - CDMA_EVENT_SYNC_QUEUE_EMPTY : sync queue is completely empty.
@@ -372,10 +404,21 @@ static unsigned int cdma_status(struct nvhost_cdma *cdma, enum cdma_event event)
  */
 static unsigned int wait_cdma(struct nvhost_cdma *cdma, enum cdma_event event)
 {
+	ktime_t start;
+	bool stalled = false;
+
 	for (;;) {
 		unsigned int space = cdma_status(cdma, event);
-		if (space)
+		if (space) {
+			if (stalled)
+				account_stall(cdma, event, start);
 			return space;
+		}
+
+		if (!stalled) {
+			start = ktime_get();
+			stalled = true;
+		}
 
 		BUG_ON(cdma->event != CDMA_EVENT_NONE);
 		cdma->event = event;
@@ -465,7 +508,7 @@ static void update_cdma(struct nvhost_cdma *cdma)
 /**
  * Create a cdma
  */
-int nvhost_cdma_init(struct nvhost_cdma *cdma)
+int nvhost_cdma_init(struct nvhost_cdma *cdma, unsigned int pb_slots)
 {
 	int err;
 
@@ -473,7 +516,7 @@ int nvhost_cdma_init(struct nvhost_cdma *cdma)
 	sema_init(&cdma->sem, 0);
 	cdma->event = CDMA_EVENT_NONE;
 	cdma->running = false;
-	err = init_push_buffer(&cdma->push_buffer);
+	err = init_push_buffer(&cdma->push_buffer, pb_slots);
 	if (err)
 		return err;
 	reset_sync_queue(&cdma->sync_queue);
@@ -572,6 +615,16 @@ void nvhost_cdma_end(struct nvmap_client *user_nvmap, struct nvhost_cdma *cdma,
 		     u32 sync_point_id, u32 sync_point_value,
 		     struct nvmap_handle **handles, unsigned int nr_handles)
 {
+	struct nvhost_cdma_stats *stats = &cdma->stats;
+	u32 pb_used = push_buffer_used(&cdma->push_buffer);
+
+	stats->submits++;
+	stats->slots += cdma->slots_used;
+	if (pb_used > stats->pb_high_water)
+		stats->pb_high_water = pb_used;
+	trace_nvhost_cdma_end(cdma_to_channel(cdma)->desc->name,
+			      cdma->slots_used, pb_used);
+
 	kick_cdma(cdma);
 
 	while (nr_handles || cdma->slots_used) {
@@ -49,14 +49,19 @@
  * many command buffers. If it is too large, we waste memory. */
 #define NVHOST_SYNC_QUEUE_SIZE 8192
 
-/* Number of gathers we allow to be queued up per channel. Must be a
-   power of two. Currently sized such that pushbuffer is 4KB (512*8B). */
+/* Default number of gathers we allow to be queued up per channel. Must be
+   a power of two. Currently sized such that pushbuffer is 4KB (512*8B). */
 #define NVHOST_GATHER_QUEUE_SIZE 512
 
+/* Bounds for a channel's tunable push buffer depth, in slots */
+#define NVHOST_GATHER_QUEUE_MIN 64
+#define NVHOST_GATHER_QUEUE_MAX 8192
+
 struct push_buffer {
 	struct nvmap_handle_ref *mem; /* handle to pushbuffer memory */
 	u32 *mapped;		/* mapped pushbuffer memory */
 	u32 phys;		/* physical address of pushbuffer */
+	u32 size;		/* size in bytes, excluding the final RESTART */
 	u32 fence;		/* index we've written */
 	u32 cur;		/* index to write to */
 };
@@ -71,7 +76,21 @@ enum cdma_event {
 	CDMA_EVENT_NONE,		/* not waiting for any event */
 	CDMA_EVENT_SYNC_QUEUE_EMPTY,	/* wait for empty sync queue */
 	CDMA_EVENT_SYNC_QUEUE_SPACE,	/* wait for space in sync queue */
-	CDMA_EVENT_PUSH_BUFFER_SPACE	/* wait for space in push buffer */
+	CDMA_EVENT_PUSH_BUFFER_SPACE,	/* wait for space in push buffer */
+	CDMA_EVENT_COUNT
+};
+
+/* Stall latency histogram: bucket i counts waits of [2^i, 2^(i+1)) us,
+ * the last bucket also counts everything longer. */
+#define NVHOST_CDMA_HIST_BUCKETS 16
+
+struct nvhost_cdma_stats {
+	u32 submits;			/* submits queued */
+	u32 slots;			/* push buffer slots submitted */
+	u32 pb_high_water;		/* most push buffer slots in use */
+	u32 stalls[CDMA_EVENT_COUNT];	/* waits that slept, by event */
+	u64 stall_us[CDMA_EVENT_COUNT];	/* total time slept, by event */
+	u32 stall_hist[CDMA_EVENT_COUNT][NVHOST_CDMA_HIST_BUCKETS];
 };
 
 struct nvhost_cdma {
@@ -83,10 +102,11 @@ struct nvhost_cdma {
 	unsigned int last_put;		/* last value written to DMAPUT */
 	struct push_buffer push_buffer;	/* channel's push buffer */
 	struct sync_queue sync_queue;	/* channel's sync queue */
+	struct nvhost_cdma_stats stats;	/* protected by lock */
 	bool running;
 };
 
-int	nvhost_cdma_init(struct nvhost_cdma *cdma);
+int	nvhost_cdma_init(struct nvhost_cdma *cdma, unsigned int pb_slots);
 void	nvhost_cdma_deinit(struct nvhost_cdma *cdma);
 void	nvhost_cdma_stop(struct nvhost_cdma *cdma);
 void	nvhost_cdma_begin(struct nvhost_cdma *cdma);
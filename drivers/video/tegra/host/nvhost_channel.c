@@ -111,6 +111,7 @@ int __init nvhost_channel_init(struct nvhost_channel *ch,
 	ch->dev = dev;
 	ch->desc = &channelmap[index];
 	ch->aperture = channel_aperture(dev->aperture, index);
+	ch->pb_slots = NVHOST_GATHER_QUEUE_SIZE;
 	mutex_init(&ch->reflock);
 	mutex_init(&ch->submitlock);
 
@@ -126,7 +127,7 @@ struct nvhost_channel *nvhost_getchannel(struct nvhost_channel *ch)
 					ch->desc->power, &ch->dev->mod,
 					&ch->dev->pdev->dev);
 		if (!err) {
-			err = nvhost_cdma_init(&ch->cdma);
+			err = nvhost_cdma_init(&ch->cdma, ch->pb_slots);
 			if (err)
 				nvhost_module_deinit(&ch->mod);
 		}
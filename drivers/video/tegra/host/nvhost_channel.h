@@ -60,6 +60,7 @@ struct nvhost_channel {
 	struct nvhost_hwctx_handler ctxhandler;
 	struct nvhost_module mod;
 	struct nvhost_cdma cdma;
+	u32 pb_slots;	/* push buffer depth used when cdma is next set up */
 };
 
 struct nvhost_op_pair {
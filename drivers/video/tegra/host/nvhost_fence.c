@@ -0,0 +1,252 @@
+/*
+ * drivers/video/tegra/host/nvhost_fence.c
+ *
+ * Tegra Graphics Host Syncpoint Fences
+ *
+ * Copyright (c) 2010, NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "nvhost_fence.h"
+#include "dev.h"
+
+#include <linux/anon_inodes.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/wait.h>
+
+struct nvhost_fence_pt {
+	u32 id;
+	u32 thresh;
+	void *ref;		/* pending interrupt action, if any */
+};
+
+struct nvhost_fence {
+	struct nvhost_master *host;
+	wait_queue_head_t wq;
+	atomic_t busy;		/* holding the host module powered */
+	int num_pts;
+	struct nvhost_fence_pt pts[0];
+};
+
+static const struct file_operations nvhost_fence_fops;
+
+static bool fence_signalled(struct nvhost_fence *fence)
+{
+	int i;
+
+	for (i = 0; i < fence->num_pts; i++)
+		if (!nvhost_syncpt_min_cmp(&fence->host->syncpt,
+				fence->pts[i].id, fence->pts[i].thresh))
+			return false;
+	return true;
+}
+
+static void fence_idle(struct nvhost_fence *fence)
+{
+	if (atomic_xchg(&fence->busy, 0))
+		nvhost_module_idle(&fence->host->mod);
+}
+
+static void fence_free(struct nvhost_fence *fence)
+{
+	int i;
+
+	for (i = 0; i < fence->num_pts; i++)
+		if (fence->pts[i].ref)
+			nvhost_intr_put_ref(&fence->host->intr,
+					    fence->pts[i].ref);
+	fence_idle(fence);
+	kfree(fence);
+}
+
+static int nvhost_fence_release(struct inode *inode, struct file *filp)
+{
+	fence_free(filp->private_data);
+	return 0;
+}
+
+static unsigned int nvhost_fence_poll(struct file *filp, poll_table *wait)
+{
+	struct nvhost_fence *fence = filp->private_data;
+
+	poll_wait(filp, &fence->wq, wait);
+
+	if (!fence_signalled(fence))
+		return 0;
+	return POLLIN | POLLRDNORM;
+}
+
+static const struct file_operations nvhost_fence_fops = {
+	.owner = THIS_MODULE,
+	.release = nvhost_fence_release,
+	.poll = nvhost_fence_poll,
+};
+
+/* the host is released as soon as the last sync point expires, whether or
+ * not anyone is polling the fence */
+void nvhost_fence_signal(struct nvhost_fence *fence)
+{
+	if (fence_signalled(fence))
+		fence_idle(fence);
+	wake_up_interruptible(&fence->wq);
+}
+
+static struct nvhost_fence *fence_alloc(struct nvhost_master *host,
+					int num_pts)
+{
+	struct nvhost_fence *fence;
+
+	fence = kzalloc(sizeof(*fence) + num_pts * sizeof(fence->pts[0]),
+			GFP_KERNEL);
+	if (!fence)
+		return NULL;
+
+	fence->host = host;
+	init_waitqueue_head(&fence->wq);
+	atomic_set(&fence->busy, 0);
+	fence->num_pts = num_pts;
+	return fence;
+}
+
+static void fence_add_pt(struct nvhost_fence *fence, int *n, u32 id, u32 thresh)
+{
+	int i;
+
+	/* a later threshold on the same sync point subsumes an earlier one */
+	for (i = 0; i < *n; i++) {
+		if (fence->pts[i].id == id) {
+			if ((s32)(thresh - fence->pts[i].thresh) > 0)
+				fence->pts[i].thresh = thresh;
+			return;
+		}
+	}
+	fence->pts[*n].id = id;
+	fence->pts[*n].thresh = thresh;
+	(*n)++;
+}
+
+/*
+ * arm an interrupt action for every sync point that has not been reached
+ * yet, then hand the fence out as an anonymous fd
+ */
+static int fence_install(struct nvhost_fence *fence)
+{
+	struct nvhost_master *host = fence->host;
+	int i, fd, err;
+
+	for (i = 0; i < fence->num_pts; i++) {
+		struct nvhost_fence_pt *pt = &fence->pts[i];
+
+		if (nvhost_syncpt_min_cmp(&host->syncpt, pt->id, pt->thresh))
+			continue;
+
+		/* keep host alive while the fence is pending */
+		if (!atomic_xchg(&fence->busy, 1))
+			nvhost_module_busy(&host->mod);
+		if ((s32)(nvhost_syncpt_update_min(&host->syncpt, pt->id) -
+			  pt->thresh) >= 0)
+			continue;
+
+		err = nvhost_intr_add_action(&host->intr, pt->id, pt->thresh,
+				NVHOST_INTR_ACTION_SIGNAL_FENCE,
+				fence, &pt->ref);
+		if (err) {
+			pt->ref = NULL;
+			goto fail;
+		}
+	}
+
+	if (fence_signalled(fence))
+		fence_idle(fence);
+
+	fd = anon_inode_getfd("nvhost_fence", &nvhost_fence_fops, fence,
+			      O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		err = fd;
+		goto fail;
+	}
+	return fd;
+
+fail:
+	fence_free(fence);
+	return err;
+}
+
+int nvhost_fence_create(struct nvhost_master *host, u32 id, u32 thresh)
+{
+	struct nvhost_fence *fence;
+
+	if (id >= NV_HOST1X_SYNCPT_NB_PTS)
+		return -EINVAL;
+
+	fence = fence_alloc(host, 1);
+	if (!fence)
+		return -ENOMEM;
+
+	fence->pts[0].id = id;
+	fence->pts[0].thresh = thresh;
+	return fence_install(fence);
+}
+
+int nvhost_fence_merge(struct nvhost_master *host, int fd1, int fd2)
+{
+	struct file *f1, *f2;
+	struct nvhost_fence *a, *b, *fence;
+	int i, n = 0;
+	int err;
+
+	f1 = fget(fd1);
+	if (!f1)
+		return -EBADF;
+	f2 = fget(fd2);
+	if (!f2) {
+		fput(f1);
+		return -EBADF;
+	}
+
+	if (f1->f_op != &nvhost_fence_fops || f2->f_op != &nvhost_fence_fops) {
+		err = -EINVAL;
+		goto out;
+	}
+	a = f1->private_data;
+	b = f2->private_data;
+
+	if (a->num_pts + b->num_pts > NVHOST_FENCE_MAX_PTS) {
+		err = -E2BIG;
+		goto out;
+	}
+
+	fence = fence_alloc(host, a->num_pts + b->num_pts);
+	if (!fence) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < a->num_pts; i++)
+		fence_add_pt(fence, &n, a->pts[i].id, a->pts[i].thresh);
+	for (i = 0; i < b->num_pts; i++)
+		fence_add_pt(fence, &n, b->pts[i].id, b->pts[i].thresh);
+	fence->num_pts = n;
+
+	err = fence_install(fence);
+out:
+	fput(f2);
+	fput(f1);
+	return err;
+}
@@ -22,9 +22,15 @@
 
 #include "nvhost_intr.h"
 #include "dev.h"
+#include "nvhost_fence.h"
 #include <linux/interrupt.h>
 #include <linux/slab.h>
 #include <linux/irq.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
+#include <linux/random.h>
+#include <linux/vmalloc.h>
+#include <asm/div64.h>
 
 #define intr_to_dev(x) container_of(x, struct nvhost_master, intr)
 
@@ -46,6 +52,7 @@ static void enable_syncpt_interrupt(void __iomem *sync_regs, u32 id)
 /*** Wait list management ***/
 
 struct nvhost_waitlist {
+	struct rb_node node;
 	struct list_head list;
 	struct kref refcount;
 	u32 thresh;
@@ -68,40 +75,64 @@ static void waiter_release(struct kref *kref)
 	kfree(container_of(kref, struct nvhost_waitlist, refcount));
 }
 
+static inline struct nvhost_waitlist *first_waiter(struct rb_root *queue)
+{
+	struct rb_node *n = rb_first(queue);
+
+	return n ? rb_entry(n, struct nvhost_waitlist, node) : NULL;
+}
+
 /*
  * add a waiter to a waiter queue, sorted by threshold
  * returns true if it was added at the head of the queue
+ *
+ * thresholds are compared modulo 2^32; all pending thresholds of a sync
+ * point lie within half the counter range of its current value, so the
+ * wrapping comparison is a consistent order for the tree. waiters with
+ * equal thresholds are kept in submission order.
  */
 static bool add_waiter_to_queue(struct nvhost_waitlist *waiter,
-				struct list_head *queue)
+				struct rb_root *queue)
 {
-	struct nvhost_waitlist *pos;
+	struct rb_node **p = &queue->rb_node;
+	struct rb_node *parent = NULL;
 	u32 thresh = waiter->thresh;
+	bool leftmost = true;
+
+	while (*p) {
+		struct nvhost_waitlist *pos;
 
-	list_for_each_entry_reverse(pos, queue, list)
+		parent = *p;
+		pos = rb_entry(parent, struct nvhost_waitlist, node);
 		if ((s32)(pos->thresh - thresh) <= 0) {
-			list_add(&waiter->list, &pos->list);
-			return false;
+			p = &parent->rb_right;
+			leftmost = false;
+		} else {
+			p = &parent->rb_left;
 		}
+	}
 
-	list_add(&waiter->list, queue);
-	return true;
+	rb_link_node(&waiter->node, parent, p);
+	rb_insert_color(&waiter->node, queue);
+	return leftmost;
 }
 
 /*
  * run through a waiter queue for a single sync point ID
  * and gather all completed waiters into lists by actions
  */
-static void remove_completed_waiters(struct list_head *head, u32 sync,
+static void remove_completed_waiters(struct rb_root *queue, u32 sync,
 			struct list_head completed[NVHOST_INTR_ACTION_COUNT])
 {
 	struct list_head *dest;
-	struct nvhost_waitlist *waiter, *next, *prev;
+	struct nvhost_waitlist *waiter, *prev;
 
-	list_for_each_entry_safe(waiter, next, head, list) {
+	while ((waiter = first_waiter(queue)) != NULL) {
 		if ((s32)(waiter->thresh - sync) > 0)
 			break;
 
+		rb_erase(&waiter->node, queue);
+
 		dest = completed + waiter->action;
 
 		/* consolidate submit cleanups */
@@ -116,12 +147,10 @@ static void remove_completed_waiters(struct list_head *head, u32 sync,
 		}
 
 		/* PENDING->REMOVED or CANCELLED->HANDLED */
-		if (atomic_inc_return(&waiter->state) == WLS_HANDLED || !dest) {
-			list_del(&waiter->list);
+		if (atomic_inc_return(&waiter->state) == WLS_HANDLED || !dest)
 			kref_put(&waiter->refcount, waiter_release);
-		} else {
-			list_move_tail(&waiter->list, dest);
-		}
+		else
+			list_add_tail(&waiter->list, dest);
 	}
 }
 
@@ -157,6 +186,11 @@ static void action_wakeup_interruptible(struct nvhost_waitlist *waiter)
 	wake_up_interruptible(wq);
 }
 
+static void action_signal_fence(struct nvhost_waitlist *waiter)
+{
+	nvhost_fence_signal(waiter->data);
+}
+
 typedef void (*action_handler)(struct nvhost_waitlist *waiter);
 
 static action_handler action_handlers[NVHOST_INTR_ACTION_COUNT] = {
@@ -164,6 +198,7 @@ static action_handler action_handlers[NVHOST_INTR_ACTION_COUNT] = {
 	action_ctxsave,
 	action_wakeup,
 	action_wakeup_interruptible,
+	action_signal_fence,
 };
 
 static void run_handlers(struct list_head completed[NVHOST_INTR_ACTION_COUNT])
@@ -253,6 +288,7 @@ static irqreturn_t syncpt_thresh_fn(int irq, void *dev_id)
 	void __iomem *sync_regs = dev->sync_aperture;
 
 	struct list_head completed[NVHOST_INTR_ACTION_COUNT];
+	struct nvhost_waitlist *first;
 	u32 sync;
 	unsigned int i;
 
@@ -263,14 +299,22 @@ static irqreturn_t syncpt_thresh_fn(int irq, void *dev_id)
 
 	spin_lock(&syncpt->lock);
 
-	remove_completed_waiters(&syncpt->wait_head, sync, completed);
+	/* if the sync point moved past the next threshold while completed
+	 * waiters were being collected, take those waiters in the same pass
+	 * instead of re-arming the interrupt only to have it fire at once */
+	for (;;) {
+		remove_completed_waiters(&syncpt->wait_tree, sync, completed);
 
-	if (!list_empty(&syncpt->wait_head)) {
-		u32 thresh = list_first_entry(&syncpt->wait_head,
-					struct nvhost_waitlist, list)->thresh;
+		first = first_waiter(&syncpt->wait_tree);
+		if (!first)
+			break;
 
-		set_syncpt_threshold(sync_regs, id, thresh);
-		enable_syncpt_interrupt(sync_regs, id);
+		sync = nvhost_syncpt_update_min(&dev->syncpt, id);
+		if ((s32)(first->thresh - sync) > 0) {
+			set_syncpt_threshold(sync_regs, id, first->thresh);
+			enable_syncpt_interrupt(sync_regs, id);
+			break;
+		}
 	}
 
 	spin_unlock(&syncpt->lock);
@@ -346,9 +390,9 @@ int nvhost_intr_add_action(struct nvhost_intr *intr, u32 id, u32 thresh,
 		spin_lock(&syncpt->lock);
 	}
 
-	queue_was_empty = list_empty(&syncpt->wait_head);
+	queue_was_empty = RB_EMPTY_ROOT(&syncpt->wait_tree);
 
-	if (add_waiter_to_queue(waiter, &syncpt->wait_head)) {
+	if (add_waiter_to_queue(waiter, &syncpt->wait_tree)) {
 		/* added at head of list - new threshold value */
 		set_syncpt_threshold(sync_regs, id, thresh);
 
@@ -376,6 +420,154 @@ void nvhost_intr_put_ref(struct nvhost_intr *intr, void *ref)
 }
 
 
+#ifdef CONFIG_TEGRA_GRHOST_INTR_TEST
+/*
+ * waiter queue self-test. queues a large number of waiters with random
+ * thresholds against a simulated sync point counter which wraps during the
+ * run, cancels some of them, and advances the counter in random steps the
+ * way the threshold thread would. every completed batch must be in
+ * threshold order with equal thresholds in submission order, no waiter may
+ * complete early, and cancelled waiters must be dropped without being
+ * handled. the cost of an insertion and of a completion pass is reported.
+ */
+
+static unsigned int intr_test_waiters = 50000;
+module_param(intr_test_waiters, uint, 0444);
+MODULE_PARM_DESC(intr_test_waiters, "Number of waiters to queue");
+
+static unsigned int intr_test_seed = 1;
+module_param(intr_test_seed, uint, 0444);
+MODULE_PARM_DESC(intr_test_seed, "Seed of the waiter thresholds");
+
+#define INTR_TEST_START		0xfffff000u	/* wraps early in the run */
+#define INTR_TEST_RANGE		0x10000u	/* thresholds ahead of start */
+
+static int intr_test_check(struct list_head *done, u32 sync,
+			   unsigned int *handled)
+{
+	struct nvhost_waitlist *waiter, *next;
+	bool first = true;
+	u32 thresh = 0;
+	int count = 0;
+	int err = 0;
+
+	list_for_each_entry_safe(waiter, next, done, list) {
+		if ((s32)(waiter->thresh - sync) > 0)
+			err = -EINVAL;
+		if (!first && ((s32)(waiter->thresh - thresh) < 0 ||
+			       (waiter->thresh == thresh &&
+				waiter->count < count)))
+			err = -EINVAL;
+		first = false;
+		thresh = waiter->thresh;
+		count = waiter->count;
+
+		list_del(&waiter->list);
+		WARN_ON(atomic_xchg(&waiter->state, WLS_HANDLED) !=
+			WLS_REMOVED);
+		kref_put(&waiter->refcount, waiter_release);
+		(*handled)++;
+	}
+	return err;
+}
+
+static int nvhost_intr_test(void)
+{
+	struct list_head completed[NVHOST_INTR_ACTION_COUNT];
+	struct nvhost_waitlist **refs;
+	struct rb_root queue = RB_ROOT;
+	struct rnd_state rnd;
+	unsigned int nr, i, done = 0, cancelled = 0, nr_refs = 0, passes = 0;
+	u32 sync = INTR_TEST_START;
+	u64 add_ns = 0, remove_ns = 0;
+	ktime_t start;
+	int err = 0;
+
+	refs = vmalloc(intr_test_waiters * sizeof(*refs));
+	if (!refs)
+		return -ENOMEM;
+
+	prandom32_seed(&rnd, intr_test_seed);
+	for (i = 0; i < NVHOST_INTR_ACTION_COUNT; ++i)
+		INIT_LIST_HEAD(completed + i);
+
+	for (nr = 0; nr < intr_test_waiters; nr++) {
+		struct nvhost_waitlist *waiter;
+
+		waiter = kmalloc(sizeof(*waiter), GFP_KERNEL);
+		if (!waiter) {
+			err = -ENOMEM;
+			break;
+		}
+		INIT_LIST_HEAD(&waiter->list);
+		kref_init(&waiter->refcount);
+		waiter->thresh = INTR_TEST_START + 1 +
+			prandom32(&rnd) % INTR_TEST_RANGE;
+		waiter->action = NVHOST_INTR_ACTION_WAKEUP;
+		atomic_set(&waiter->state, WLS_PENDING);
+		waiter->data = NULL;
+		waiter->count = nr;	/* submission order */
+
+		/* keep a reference to one waiter in eight and cancel it */
+		if (!(prandom32(&rnd) % 8)) {
+			kref_get(&waiter->refcount);
+			refs[nr_refs++] = waiter;
+		}
+
+		start = ktime_get();
+		add_waiter_to_queue(waiter, &queue);
+		add_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+	}
+
+	for (i = 0; i < nr_refs; i++) {
+		if (atomic_read(&refs[i]->state) == WLS_PENDING)
+			cancelled++;
+		nvhost_intr_put_ref(NULL, refs[i]);
+	}
+
+	while (!RB_EMPTY_ROOT(&queue)) {
+		struct nvhost_waitlist *first;
+
+		sync += 1 + prandom32(&rnd) % 64;
+
+		start = ktime_get();
+		remove_completed_waiters(&queue, sync, completed);
+		remove_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+		passes++;
+
+		first = first_waiter(&queue);
+		if (first && (s32)(first->thresh - sync) <= 0)
+			err = -EINVAL;
+		if (intr_test_check(completed + NVHOST_INTR_ACTION_WAKEUP,
+				    sync, &done))
+			err = -EINVAL;
+		cond_resched();
+	}
+	vfree(refs);
+
+	if (nr)
+		do_div(add_ns, nr);
+	if (passes)
+		do_div(remove_ns, passes);
+	pr_info("nvhost_intr_test: %u waiters (%u cancelled), "
+		"%llu ns/add, %u passes, %llu ns/pass\n",
+		nr, cancelled, add_ns, passes, remove_ns);
+
+	/* cancelled waiters must be dropped without running their action */
+	if (done + cancelled != nr) {
+		pr_err("nvhost_intr_test: %u handled, %u cancelled of %u\n",
+		       done, cancelled, nr);
+		err = -EINVAL;
+	}
+	if (err)
+		pr_err("nvhost_intr_test: failed: %d\n", err);
+	else
+		pr_info("nvhost_intr_test: passed\n");
+	return err;
+}
+#endif
+
+
 /*** Init & shutdown ***/
 
 int nvhost_intr_init(struct nvhost_intr *intr, u32 irq_gen, u32 irq_sync)
@@ -397,12 +589,15 @@ int nvhost_intr_init(struct nvhost_intr *intr, u32 irq_gen, u32 irq_sync)
 		syncpt->irq = irq_sync + id;
 		syncpt->irq_requested = 0;
 		spin_lock_init(&syncpt->lock);
-		INIT_LIST_HEAD(&syncpt->wait_head);
+		syncpt->wait_tree = RB_ROOT;
 		snprintf(syncpt->thresh_irq_name,
 			 sizeof(syncpt->thresh_irq_name),
 			 "%s", nvhost_syncpt_name(id));
 	}
 
+#ifdef CONFIG_TEGRA_GRHOST_INTR_TEST
+	nvhost_intr_test();
+#endif
 	return 0;
 
 fail:
@@ -418,16 +613,19 @@ void nvhost_intr_deinit(struct nvhost_intr *intr)
 	for (id = 0, syncpt = intr->syncpt;
 	     id < NV_HOST1X_SYNCPT_NB_PTS;
 	     ++id, ++syncpt) {
-		struct nvhost_waitlist *waiter, *next;
-		list_for_each_entry_safe(waiter, next, &syncpt->wait_head, list) {
+		struct rb_node *n, *next;
+		for (n = rb_first(&syncpt->wait_tree); n; n = next) {
+			struct nvhost_waitlist *waiter =
+				rb_entry(n, struct nvhost_waitlist, node);
+			next = rb_next(n);
 			if (atomic_cmpxchg(&waiter->state, WLS_CANCELLED, WLS_HANDLED)
 				== WLS_CANCELLED) {
-				list_del(&waiter->list);
+				rb_erase(&waiter->node, &syncpt->wait_tree);
 				kref_put(&waiter->refcount, waiter_release);
 			}
 		}
 
-		if(!list_empty(&syncpt->wait_head)) {  // output diagnostics
+		if (!RB_EMPTY_ROOT(&syncpt->wait_tree)) {  // output diagnostics
 			printk("%s id=%d\n",__func__,id);
 			BUG_ON(1);
 		}
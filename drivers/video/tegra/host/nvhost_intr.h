@@ -24,6 +24,7 @@
 #define __NVHOST_INTR_H
 
 #include <linux/kthread.h>
+#include <linux/rbtree.h>
 #include <linux/semaphore.h>
 
 #include "nvhost_hardware.h"
@@ -55,6 +56,12 @@ enum nvhost_intr_action {
 	 */
 	NVHOST_INTR_ACTION_WAKEUP_INTERRUPTIBLE,
 
+	/**
+	 * Signal a fence fd.
+	 * 'data' points to a struct nvhost_fence
+	 */
+	NVHOST_INTR_ACTION_SIGNAL_FENCE,
+
 	NVHOST_INTR_ACTION_COUNT
 };
 
@@ -63,7 +70,7 @@ struct nvhost_intr_syncpt {
 	u8 irq_requested;
 	u16 irq;
 	spinlock_t lock;
-	struct list_head wait_head;
+	struct rb_root wait_tree;	/* waiters, sorted by threshold */
 	char thresh_irq_name[12];
 };
 
@@ -25,6 +25,7 @@
 #include <linux/io.h>
 #include <linux/rbtree.h>
 #include <linux/smp_lock.h>
+#include <linux/sort.h>
 #include <linux/vmalloc.h>
 #include <linux/wait.h>
 #include <linux/slab.h>
@@ -62,30 +63,33 @@ static void map_iovmm_area(struct nvmap_handle *h)
 }
 
 /* must be called inside nvmap_pin_lock, to ensure that an entire stream
- * of pins will complete without racing with a second stream. handle should
- * have nvmap_handle_get (or nvmap_validate_get) called before calling
- * this function. */
+ * of pins will complete without racing with a second stream, and with the
+ * MRU lock held. handle should have nvmap_handle_get (or nvmap_validate_get)
+ * called before calling this function. */
 static int pin_locked(struct nvmap_client *client, struct nvmap_handle *h)
 {
 	struct tegra_iovmm_area *area;
 	BUG_ON(!h->alloc);
 
-	nvmap_mru_lock(client->share);
 	if (atomic_inc_return(&h->pin) == 1) {
 		if (h->heap_pgalloc && !h->pgalloc.contig) {
 			area = nvmap_handle_iovmm_locked(client, h);
 			if (!area) {
 				/* no race here, inside the pin mutex */
 				atomic_dec(&h->pin);
-				nvmap_mru_unlock(client->share);
 				return -ENOMEM;
 			}
 			if (area != h->pgalloc.area)
 				h->pgalloc.dirty = true;
+			/* first maps are not remaps */
+			if (h->pgalloc.evicted) {
+				h->pgalloc.evicted = false;
+				client->iovm_remaps++;
+				client->iovm_remap_kb += h->size >> 10;
+			}
 			h->pgalloc.area = area;
 		}
 	}
-	nvmap_mru_unlock(client->share);
 	return 0;
 }
 
@@ -128,6 +132,7 @@ static int handle_unpin(struct nvmap_client *client,
 	return ret;
 }
 
+/* pins count handles, taking the MRU lock once for the whole array */
 static int pin_array_locked(struct nvmap_client *client,
 		struct nvmap_handle **h, int count)
 {
@@ -135,11 +140,13 @@ static int pin_array_locked(struct nvmap_client *client,
 	int i;
 	int err = 0;
 
+	nvmap_mru_lock(client->share);
 	for (pinned = 0; pinned < count; pinned++) {
 		err = pin_locked(client, h[pinned]);
 		if (err)
 			break;
 	}
+	nvmap_mru_unlock(client->share);
 
 	if (err) {
 		/* unpin pinned handles */
@@ -162,11 +169,13 @@ static int pin_array_locked(struct nvmap_client *client,
 		 * We have to do pinning again here since there might be is
 		 * no more incoming pin_wait wakeup calls from unpin
 		 * operations */
+		nvmap_mru_lock(client->share);
 		for (pinned = 0; pinned < count; pinned++) {
 			err = pin_locked(client, h[pinned]);
 			if (err)
 				break;
 		}
+		nvmap_mru_unlock(client->share);
 		if (err) {
 			pr_err("Pinning in empty iovmm failed!!!\n");
 			BUG_ON(1);
@@ -370,6 +379,8 @@ static int nvmap_reloc_pin_array(struct nvmap_client *client,
 				 int nr, struct nvmap_handle *gather)
 {
 	struct nvmap_handle *last_patch = NULL;
+	struct nvmap_handle *last_pin = NULL;
+	unsigned long pin_phys = 0;
 	unsigned int last_pfn = 0;
 	pte_t **pte;
 	void *addr;
@@ -423,7 +434,13 @@ static int nvmap_reloc_pin_array(struct nvmap_client *client,
 			last_pfn = pfn;
 		}
 
-		reloc_addr = handle_phys(pin) + arr[i].pin_offset;
+		/* relocations against the same handle are usually
+		 * consecutive */
+		if (pin != last_pin) {
+			pin_phys = handle_phys(pin);
+			last_pin = pin;
+		}
+		reloc_addr = pin_phys + arr[i].pin_offset;
 		__raw_writel(reloc_addr, addr + (phys & ~PAGE_MASK));
 	}
 
@@ -498,6 +515,18 @@ static int nvmap_validate_get_pin_array(struct nvmap_client *client,
 	return ret ?: count;
 }
 
+/* orders handles largest first, so that the big IOVMM areas of a batch are
+ * allocated while the address space is least fragmented */
+static int pin_array_cmp(const void *a, const void *b)
+{
+	const struct nvmap_handle *ha = *(const struct nvmap_handle **)a;
+	const struct nvmap_handle *hb = *(const struct nvmap_handle **)b;
+
+	if (ha->size == hb->size)
+		return 0;
+	return (ha->size > hb->size) ? -1 : 1;
+}
+
 /* a typical mechanism host1x clients use for using the Tegra graphics
  * processor is to build a command buffer which contains relocatable
  * memory handle commands, and rely on the kernel to convert these in-place
@@ -549,6 +578,8 @@ int nvmap_pin_array(struct nvmap_client *client, struct nvmap_handle *gather,
 	for (i = 0; i < count; i++)
 		unique_arr[i]->flags &= ~NVMAP_HANDLE_VISITED;
 
+	sort(unique_arr, count, sizeof(*unique_arr), pin_array_cmp, NULL);
+
 	ret = wait_pin_array_locked(client, unique_arr, count);
 
 	mutex_unlock(&client->share->pin_lock);
@@ -657,9 +688,13 @@ void *nvmap_mmap(struct nvmap_handle_ref *ref)
 
 	prot = nvmap_pgprot(h, pgprot_kernel);
 
-	if (h->heap_pgalloc)
-		return vm_map_ram(h->pgalloc.pages, h->size >> PAGE_SHIFT,
-				  -1, prot);
+	if (h->heap_pgalloc) {
+		p = vm_map_ram(h->pgalloc.pages, h->size >> PAGE_SHIFT,
+			       -1, prot);
+		if (p)
+			nvmap_handle_cpu_map(h);
+		return p;
+	}
 
 	/* carveout - explicitly map the pfns into a vmalloc area */
 
@@ -708,6 +743,8 @@ void *nvmap_mmap(struct nvmap_handle_ref *ref)
 		return NULL;
 	}
 
+	nvmap_handle_cpu_map(h);
+
 	/* leave the handle ref count incremented by 1, so that
 	 * the handle will not be freed while the kernel mapping exists.
 	 * nvmap_handle_put will be called by unmapping this address */
@@ -733,6 +770,7 @@ void nvmap_munmap(struct nvmap_handle_ref *ref, void *addr)
 		kfree(vm);
 		nvmap_usecount_dec(h);
 	}
+	nvmap_handle_cpu_unmap(h);
 	nvmap_handle_put(h);
 }
 
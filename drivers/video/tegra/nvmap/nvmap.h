@@ -49,6 +49,12 @@
 
 #define nvmap_ref_to_id(_ref)		((unsigned long)(_ref)->handle)
 
+#ifdef CONFIG_NVMAP_HIGHMEM_ONLY
+#define GFP_NVMAP		(__GFP_HIGHMEM | __GFP_NOWARN)
+#else
+#define GFP_NVMAP		(GFP_KERNEL | __GFP_HIGHMEM | __GFP_NOWARN)
+#endif
+
 struct nvmap_device;
 struct page;
 struct tegra_iovmm_area;
@@ -58,7 +64,10 @@ struct tegra_iovmm_area;
 struct nvmap_pgalloc {
 	struct page **pages;
 	struct tegra_iovmm_area *area;
-	struct list_head mru_list;	/* MRU entry for IOVMM reclamation */
+	struct list_head mru_list;	/* LRU entry for IOVMM reclamation */
+	unsigned long last_pin;		/* jiffies at the last IOVMM pin */
+	unsigned int pin_freq;		/* decaying IOVMM re-pin counter */
+	bool evicted;			/* area was taken by another handle */
 	bool contig;			/* contiguous system memory */
 	bool dirty;			/* area is invalid and needs mapping */
 };
@@ -81,6 +90,8 @@ struct nvmap_handle {
 	bool secure;		/* zap IOVMM area on unpin */
 	bool heap_pgalloc;	/* handle is page allocated (sysmem / iovmm) */
 	bool alloc;		/* handle has memory allocated */
+	bool cpu_dirty;		/* CPU may have written since the last clean */
+	atomic_t cpu_map;	/* number of live CPU mappings */
 	struct mutex lock;
 };
 
@@ -90,8 +101,7 @@ struct nvmap_share {
 	struct mutex pin_lock;
 #ifdef CONFIG_NVMAP_RECLAIM_UNPINNED_VM
 	struct mutex mru_lock;
-	struct list_head *mru_lists;
-	int nr_mru;
+	struct list_head lru_list;
 #endif
 };
 
@@ -111,6 +121,15 @@ struct nvmap_client {
 	bool				super;
 	atomic_t			count;
 	struct task_struct		*task;
+	struct list_head		list;		/* on device client list */
+	/* IOVMM statistics, updated under the share's MRU lock; word
+	 * sized so that debugfs can read them without it */
+	u32				iovm_remaps;
+	unsigned long			iovm_remap_kb;
+	u32				iovm_evictions;
+	/* cache write-backs performed and skipped for clean handles */
+	atomic_t			cache_clean_done;
+	atomic_t			cache_clean_skipped;
 	struct nvmap_carveout_commit	carveout_commit[0];
 };
 
@@ -227,6 +246,21 @@ static inline void nvmap_handle_put(struct nvmap_handle *h)
 		_nvmap_handle_free(h);
 }
 
+/* while a CPU mapping of a handle exists, the CPU may write to it at any
+ * time, so the handle must be assumed dirty until it is cleaned after the
+ * last mapping is gone */
+static inline void nvmap_handle_cpu_map(struct nvmap_handle *h)
+{
+	h->cpu_dirty = true;
+	smp_wmb();
+	atomic_inc(&h->cpu_map);
+}
+
+static inline void nvmap_handle_cpu_unmap(struct nvmap_handle *h)
+{
+	atomic_dec(&h->cpu_map);
+}
+
 static inline pgprot_t nvmap_pgprot(struct nvmap_handle *h, pgprot_t prot)
 {
 	if (h->flags == NVMAP_HANDLE_UNCACHEABLE)
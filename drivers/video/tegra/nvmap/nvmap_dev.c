@@ -44,6 +44,7 @@
 #include "nvmap.h"
 #include "nvmap_ioctl.h"
 #include "nvmap_mru.h"
+#include "nvmap_pp.h"
 #include "nvmap_common.h"
 
 #define NVMAP_NUM_PTES		64
@@ -79,6 +80,11 @@ struct nvmap_device {
 	struct nvmap_carveout_node *heaps;
 	int nr_carveouts;
 	struct nvmap_share iovmm_master;
+	struct list_head clients;
+	spinlock_t	clients_lock;
+#ifdef CONFIG_NVMAP_PAGE_POOLS
+	struct nvmap_page_pool pools[NVMAP_NUM_POOLS];
+#endif
 };
 
 struct nvmap_device *nvmap_dev;
@@ -137,6 +143,18 @@ struct nvmap_share *nvmap_get_share_from_dev(struct nvmap_device *dev)
 	return &dev->iovmm_master;
 }
 
+#ifdef CONFIG_NVMAP_PAGE_POOLS
+/* returns the page pool for handles with the given cache attribute, or NULL
+ * if pages of that attribute are not pooled */
+struct nvmap_page_pool *nvmap_get_page_pool(struct nvmap_device *dev,
+					    unsigned int flags)
+{
+	if (flags >= NVMAP_NUM_POOLS)
+		return NULL;
+	return &dev->pools[flags];
+}
+#endif
+
 /* allocates a PTE for the caller's use; returns the PTE pointer or
  * a negative errno. may be called from IRQs */
 pte_t **nvmap_alloc_pte_irq(struct nvmap_device *dev, void **vaddr)
@@ -658,6 +676,10 @@ struct nvmap_client *nvmap_create_client(struct nvmap_device *dev,
 	mutex_init(&client->ref_lock);
 	atomic_set(&client->count, 1);
 
+	spin_lock(&dev->clients_lock);
+	list_add(&client->list, &dev->clients);
+	spin_unlock(&dev->clients_lock);
+
 	return client;
 }
 
@@ -702,6 +724,10 @@ static void destroy_client(struct nvmap_client *client)
 	for (i = 0; i < client->dev->nr_carveouts; i++)
 		list_del(&client->carveout_commit[i].list);
 
+	spin_lock(&client->dev->clients_lock);
+	list_del(&client->list);
+	spin_unlock(&client->dev->clients_lock);
+
 	if (client->task)
 		put_task_struct(client->task);
 
@@ -895,8 +921,10 @@ static void nvmap_vma_close(struct vm_area_struct *vma)
 			BUG_ON(priv->handle->usecount < 0);
 		}
 		if (!atomic_dec_return(&priv->count)) {
-			if (priv->handle)
+			if (priv->handle) {
+				nvmap_handle_cpu_unmap(priv->handle);
 				nvmap_handle_put(priv->handle);
+			}
 			kfree(priv);
 		}
 	}
@@ -1056,6 +1084,71 @@ static struct file_operations debug_clients_fops = {
 	.release = single_release,
 };
 
+static int nvmap_debug_iovmm_clients_show(struct seq_file *s, void *unused)
+{
+	struct nvmap_device *dev = s->private;
+	struct nvmap_client *client;
+
+	seq_printf(s, "%-16s %16s %8s %10s %10s %10s\n", "CLIENT", "PROCESS",
+		   "PID", "REMAPS", "REMAP_KB", "EVICTIONS");
+	spin_lock(&dev->clients_lock);
+	list_for_each_entry(client, &dev->clients, list) {
+		client_stringify(client, s);
+		seq_printf(s, " %10u %10lu %10u\n", client->iovm_remaps,
+			   client->iovm_remap_kb, client->iovm_evictions);
+	}
+	spin_unlock(&dev->clients_lock);
+
+	return 0;
+}
+
+static int nvmap_debug_iovmm_clients_open(struct inode *inode,
+					  struct file *file)
+{
+	return single_open(file, nvmap_debug_iovmm_clients_show,
+			   inode->i_private);
+}
+
+static struct file_operations debug_iovmm_clients_fops = {
+	.open = nvmap_debug_iovmm_clients_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int nvmap_debug_cache_clients_show(struct seq_file *s, void *unused)
+{
+	struct nvmap_device *dev = s->private;
+	struct nvmap_client *client;
+
+	seq_printf(s, "%-16s %16s %8s %10s %10s\n", "CLIENT", "PROCESS",
+		   "PID", "CLEANED", "SKIPPED");
+	spin_lock(&dev->clients_lock);
+	list_for_each_entry(client, &dev->clients, list) {
+		client_stringify(client, s);
+		seq_printf(s, " %10u %10u\n",
+			   atomic_read(&client->cache_clean_done),
+			   atomic_read(&client->cache_clean_skipped));
+	}
+	spin_unlock(&dev->clients_lock);
+
+	return 0;
+}
+
+static int nvmap_debug_cache_clients_open(struct inode *inode,
+					  struct file *file)
+{
+	return single_open(file, nvmap_debug_cache_clients_show,
+			   inode->i_private);
+}
+
+static struct file_operations debug_cache_clients_fops = {
+	.open = nvmap_debug_cache_clients_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int nvmap_probe(struct platform_device *pdev)
 {
 	struct nvmap_platform_data *plat = pdev->dev.platform_data;
@@ -1091,6 +1184,7 @@ static int nvmap_probe(struct platform_device *pdev)
 	dev->dev_super.parent = &pdev->dev;
 
 	dev->handles = RB_ROOT;
+	INIT_LIST_HEAD(&dev->clients);
 
 	init_waitqueue_head(&dev->pte_wait);
 
@@ -1117,6 +1211,7 @@ static int nvmap_probe(struct platform_device *pdev)
 
 	spin_lock_init(&dev->ptelock);
 	spin_lock_init(&dev->handle_lock);
+	spin_lock_init(&dev->clients_lock);
 
 	for (i = 0; i < NVMAP_NUM_PTES; i++) {
 		unsigned long addr;
@@ -1208,6 +1303,25 @@ static int nvmap_probe(struct platform_device *pdev)
 		}
 	}
 
+	e = nvmap_page_pools_init(dev);
+	if (e) {
+		dev_err(&pdev->dev, "couldn't create page pools\n");
+		goto fail_heaps;
+	}
+	if (!IS_ERR_OR_NULL(nvmap_debug_root)) {
+		struct dentry *iovmm_root =
+			debugfs_create_dir("iovmm", nvmap_debug_root);
+		struct dentry *cache_root =
+			debugfs_create_dir("cache", nvmap_debug_root);
+		if (!IS_ERR_OR_NULL(iovmm_root))
+			debugfs_create_file("clients", 0444, iovmm_root,
+			    dev, &debug_iovmm_clients_fops);
+		if (!IS_ERR_OR_NULL(cache_root))
+			debugfs_create_file("clients", 0444, cache_root,
+			    dev, &debug_cache_clients_fops);
+		nvmap_page_pools_debugfs_init(dev, nvmap_debug_root);
+	}
+
 	platform_set_drvdata(pdev, dev);
 	nvmap_dev = dev;
 	return 0;
@@ -1219,7 +1333,6 @@ fail_heaps:
 	}
 fail:
 	kfree(dev->heaps);
-	nvmap_mru_destroy(&dev->iovmm_master);
 	if (dev->dev_super.minor != MISC_DYNAMIC_MINOR)
 		misc_deregister(&dev->dev_super);
 	if (dev->dev_user.minor != MISC_DYNAMIC_MINOR)
@@ -1243,6 +1356,8 @@ static int nvmap_remove(struct platform_device *pdev)
 	misc_deregister(&dev->dev_super);
 	misc_deregister(&dev->dev_user);
 
+	nvmap_page_pools_destroy(dev);
+
 	while ((n = rb_first(&dev->handles))) {
 		h = rb_entry(n, struct nvmap_handle, node);
 		rb_erase(&h->node, &dev->handles);
@@ -1252,8 +1367,6 @@ static int nvmap_remove(struct platform_device *pdev)
 	if (!IS_ERR_OR_NULL(dev->iovmm_master.iovmm))
 		tegra_iovmm_free_client(dev->iovmm_master.iovmm);
 
-	nvmap_mru_destroy(&dev->iovmm_master);
-
 	for (i = 0; i < dev->nr_carveouts; i++) {
 		struct nvmap_carveout_node *node = &dev->heaps[i];
 		nvmap_heap_remove_group(node->carveout, &heap_extra_attr_group);
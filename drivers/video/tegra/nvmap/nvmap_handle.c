@@ -40,14 +40,10 @@
 
 #include "nvmap.h"
 #include "nvmap_mru.h"
+#include "nvmap_pp.h"
 #include "nvmap_common.h"
 
 #define NVMAP_SECURE_HEAPS	(NVMAP_HEAP_CARVEOUT_IRAM | NVMAP_HEAP_IOVMM)
-#ifdef CONFIG_NVMAP_HIGHMEM_ONLY
-#define GFP_NVMAP		(__GFP_HIGHMEM | __GFP_NOWARN)
-#else
-#define GFP_NVMAP		(GFP_KERNEL | __GFP_HIGHMEM | __GFP_NOWARN)
-#endif
 /* handles may be arbitrarily large (16+MiB), and any handle allocated from
  * the kernel (i.e., not a carveout handle) includes its array of pages. to
  * preserve kmalloc space, if the array of pages exceeds PAGELIST_VMALLOC_MIN,
@@ -73,9 +69,33 @@ static inline void altfree(void *ptr, size_t len)
 		kfree(ptr);
 }
 
+/* pages of a freed handle may have been written through a cacheable
+ * mapping (including one set up when the handle's flags were changed at
+ * mmap time), so they are cleaned before they are pooled: otherwise dirty
+ * lines could later be evicted over data written by a device. */
+static void handle_pages_clean(struct page **pages, unsigned int nr_page)
+{
+	unsigned long base;
+	unsigned int i;
+	bool flush_inner = true;
+
+	if (nr_page * PAGE_SIZE >= FLUSH_CLEAN_BY_SET_WAY_THRESHOLD) {
+		inner_flush_cache_all();
+		flush_inner = false;
+	}
+
+	for (i = 0; i < nr_page; i++) {
+		if (flush_inner)
+			__flush_dcache_page(page_mapping(pages[i]), pages[i]);
+		base = page_to_phys(pages[i]);
+		outer_flush_range(base, base + PAGE_SIZE);
+	}
+}
+
 void _nvmap_handle_free(struct nvmap_handle *h)
 {
 	struct nvmap_device *dev = h->dev;
+	struct nvmap_page_pool *pool;
 	unsigned int i, nr_page;
 
 	if (nvmap_handle_remove(dev, h) != 0)
@@ -100,8 +120,12 @@ void _nvmap_handle_free(struct nvmap_handle *h)
 	if (h->pgalloc.area)
 		tegra_iovmm_free_vm(h->pgalloc.area);
 
+	pool = nvmap_get_page_pool(dev, h->flags);
+	if (pool)
+		handle_pages_clean(h->pgalloc.pages, nr_page);
 	for (i = 0; i < nr_page; i++)
-		__free_page(h->pgalloc.pages[i]);
+		if (!nvmap_page_pool_release(pool, h->pgalloc.pages[i]))
+			__free_page(h->pgalloc.pages[i]);
 
 	altfree(h->pgalloc.pages, nr_page * sizeof(struct page *));
 
@@ -109,8 +133,6 @@ out:
 	kfree(h);
 }
 
-extern void __flush_dcache_page(struct address_space *, struct page *);
-
 static struct page *nvmap_alloc_pages_exact(gfp_t gfp,
 	size_t size, bool flush_inner)
 {
@@ -163,13 +185,14 @@ static int handle_page_alloc(struct nvmap_client *client,
 		contiguous = true;
 #endif
 
-	if (size >= FLUSH_CLEAN_BY_SET_WAY_THRESHOLD) {
-		inner_flush_cache_all();
-		flush_inner = false;
-	}
 	h->pgalloc.area = NULL;
 	if (contiguous) {
 		struct page *page;
+
+		if (size >= FLUSH_CLEAN_BY_SET_WAY_THRESHOLD) {
+			inner_flush_cache_all();
+			flush_inner = false;
+		}
 		page = nvmap_alloc_pages_exact(GFP_NVMAP, size, flush_inner);
 		if (!page)
 			goto fail;
@@ -178,7 +201,23 @@ static int handle_page_alloc(struct nvmap_client *client,
 			pages[i] = nth_page(page, i);
 
 	} else {
+		struct nvmap_page_pool *pool;
+
+		/* pooled pages are already clean for this cache attribute;
+		 * only the remainder needs to come from the OS */
+		pool = nvmap_get_page_pool(client->dev, h->flags);
 		for (i = 0; i < nr_page; i++) {
+			pages[i] = nvmap_page_pool_alloc(pool);
+			if (!pages[i])
+				break;
+		}
+
+		if ((nr_page - i) * PAGE_SIZE >= FLUSH_CLEAN_BY_SET_WAY_THRESHOLD) {
+			inner_flush_cache_all();
+			flush_inner = false;
+		}
+
+		for (; i < nr_page; i++) {
 			pages[i] = nvmap_alloc_pages_exact(GFP_NVMAP, PAGE_SIZE,
 				flush_inner);
 			if (!pages[i])
@@ -488,6 +527,9 @@ struct nvmap_handle_ref *nvmap_create_handle(struct nvmap_client *client,
 	BUG_ON(!h->owner);
 	h->size = h->orig_size = size;
 	h->flags = NVMAP_HANDLE_WRITE_COMBINE;
+	/* recycled pages or carveout may still hold lines dirtied by their
+	 * previous owner, so the first clean must not be skipped */
+	h->cpu_dirty = true;
 	mutex_init(&h->lock);
 
 	nvmap_handle_add(client->dev, h);
@@ -27,6 +27,10 @@
 #include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/err.h>
+#include <linux/rbtree.h>
+#include <linux/ktime.h>
+#include <linux/random.h>
+#include <linux/moduleparam.h>
 
 #include <mach/nvmap.h>
 #include "nvmap.h"
@@ -35,6 +39,8 @@
 
 #include <asm/tlbflush.h>
 #include <asm/cacheflush.h>
+#include <asm/sizes.h>
+#include <asm/div64.h>
 
 /*
  * "carveouts" are platform-defined regions of physically contiguous memory
@@ -68,9 +74,21 @@
  * and to ensure that the minimum free block size in the carveout (i.e., the
  * "small" threshold) is still a meaningful size.
  *
+ * free blocks are indexed by size: each power-of-2 size class has its own
+ * rbtree of free blocks, sorted by base address, in which every node also
+ * records the largest free block in its subtree. an allocation only visits
+ * the size classes which can possibly satisfy it, and in each class
+ * descends straight to the lowest (BOTTOM_UP) or highest (TOP_DOWN) block
+ * which is large enough, so the result is identical to an address-order
+ * scan of all free blocks. a lookup costs O(log n) per size class, plus
+ * O(log n) for every large enough block which is stepped over because the
+ * alignment padding does not leave room for the allocation. the all_list
+ * is kept in address order and tiles the whole heap, so coalescing a freed
+ * block only needs to look at its two neighbours.
  */
 
 #define MAX_BUDDY_NR	128	/* maximum buddies in a buddy allocator */
+#define NR_FREE_BUCKETS	BITS_PER_LONG	/* one free tree per log2(size) */
 
 enum direction {
 	TOP_DOWN,
@@ -111,7 +129,8 @@ struct list_block {
 	size_t size;
 	size_t align;
 	struct nvmap_heap *heap;
-	struct list_head free_list;
+	struct rb_node free_node;
+	size_t max_size;	/* largest free block in the free_node subtree */
 };
 
 struct combo_block {
@@ -135,7 +154,7 @@ struct buddy_heap {
 
 struct nvmap_heap {
 	struct list_head all_list;
-	struct list_head free_list;
+	struct rb_root free_tree[NR_FREE_BUCKETS];
 	struct mutex lock;
 	struct list_head buddy_list;
 	unsigned int min_buddy_shift;
@@ -160,6 +179,196 @@ static inline unsigned int order_of(size_t len, size_t min_shift)
 	return fls(len)-1;
 }
 
+static inline struct rb_root *free_tree_of(struct nvmap_heap *heap,
+					   size_t size)
+{
+	return &heap->free_tree[fls_long(size) - 1];
+}
+
+static inline struct list_block *free_entry(struct rb_node *n)
+{
+	return rb_entry(n, struct list_block, free_node);
+}
+
+static inline size_t free_max_size(struct rb_node *n)
+{
+	return n ? free_entry(n)->max_size : 0;
+}
+
+static void free_augment_cb(struct rb_node *node, void *unused)
+{
+	struct list_block *b = free_entry(node);
+
+	b->max_size = max(b->size, max(free_max_size(node->rb_left),
+				       free_max_size(node->rb_right)));
+}
+
+/* adds b to the free tree for its size class; must be called while holding
+ * the heap's lock, and before any change to b->size. */
+static void free_insert(struct nvmap_heap *heap, struct list_block *b)
+{
+	struct rb_root *root = free_tree_of(heap, b->size);
+	struct rb_node **p = &root->rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*p) {
+		struct list_block *n;
+
+		parent = *p;
+		n = free_entry(parent);
+		if (b->block.base < n->block.base)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	b->block.type = BLOCK_EMPTY;
+	b->max_size = b->size;
+	rb_link_node(&b->free_node, parent, p);
+	rb_insert_color(&b->free_node, root);
+	rb_augment_insert(&b->free_node, free_augment_cb, NULL);
+}
+
+static void free_erase(struct nvmap_heap *heap, struct list_block *b)
+{
+	struct rb_node *deepest = rb_augment_erase_begin(&b->free_node);
+
+	rb_erase(&b->free_node, free_tree_of(heap, b->size));
+	rb_augment_erase_end(deepest, free_augment_cb, NULL);
+}
+
+/* lowest and highest addressed blocks of at least len bytes in the
+ * subtree rooted at n */
+static struct rb_node *free_leftmost(struct rb_node *n, size_t len)
+{
+	if (free_max_size(n) < len)
+		return NULL;
+
+	for (;;) {
+		if (free_max_size(n->rb_left) >= len)
+			n = n->rb_left;
+		else if (free_entry(n)->size >= len)
+			return n;
+		else
+			n = n->rb_right;
+	}
+}
+
+static struct rb_node *free_rightmost(struct rb_node *n, size_t len)
+{
+	if (free_max_size(n) < len)
+		return NULL;
+
+	for (;;) {
+		if (free_max_size(n->rb_right) >= len)
+			n = n->rb_right;
+		else if (free_entry(n)->size >= len)
+			return n;
+		else
+			n = n->rb_left;
+	}
+}
+
+/* next and previous blocks of at least len bytes in address order,
+ * skipping every subtree which has no block that large */
+static struct rb_node *free_next(struct rb_node *n, size_t len)
+{
+	struct rb_node *parent;
+	struct rb_node *next;
+
+	for (;;) {
+		next = free_leftmost(n->rb_right, len);
+		if (next)
+			return next;
+
+		while ((parent = rb_parent(n)) && n == parent->rb_right)
+			n = parent;
+		if (!parent)
+			return NULL;
+
+		n = parent;
+		if (free_entry(n)->size >= len)
+			return n;
+	}
+}
+
+static struct rb_node *free_prev(struct rb_node *n, size_t len)
+{
+	struct rb_node *parent;
+	struct rb_node *prev;
+
+	for (;;) {
+		prev = free_rightmost(n->rb_left, len);
+		if (prev)
+			return prev;
+
+		while ((parent = rb_parent(n)) && n == parent->rb_left)
+			n = parent;
+		if (!parent)
+			return NULL;
+
+		n = parent;
+		if (free_entry(n)->size >= len)
+			return n;
+	}
+}
+
+/* returns the lowest-addressed block in the size class which can hold len
+ * bytes at the requested alignment without crossing base_max, or NULL.
+ * blocks above best are not considered, since best is a candidate already
+ * found in another size class. */
+static struct list_block *bucket_first_fit(struct rb_root *root, size_t len,
+					   size_t align, unsigned long base_max,
+					   struct list_block *best,
+					   unsigned long *fix_base)
+{
+	struct rb_node *n;
+
+	for (n = free_leftmost(root->rb_node, len); n; n = free_next(n, len)) {
+		struct list_block *i = free_entry(n);
+		unsigned long base = ALIGN(i->block.base, align);
+
+		if (best && i->block.base > best->block.base)
+			break;
+
+		/* needed for compaction. relocated chunk
+		 * should never go up */
+		if (base_max && base > base_max)
+			break;
+
+		if (base - i->block.base < i->size &&
+		    i->size - (base - i->block.base) >= len) {
+			*fix_base = base;
+			return i;
+		}
+	}
+	return NULL;
+}
+
+/* returns the highest-addressed block in the size class which can hold len
+ * bytes at the requested alignment, ignoring blocks below best. */
+static struct list_block *bucket_last_fit(struct rb_root *root, size_t len,
+					  size_t align, struct list_block *best,
+					  unsigned long *fix_base)
+{
+	struct rb_node *n;
+
+	for (n = free_rightmost(root->rb_node, len); n; n = free_prev(n, len)) {
+		struct list_block *i = free_entry(n);
+		unsigned long base;
+
+		if (best && i->block.base < best->block.base)
+			break;
+
+		base = (i->block.base + i->size - len) & ~(align - 1);
+		if (base >= i->block.base) {
+			*fix_base = base;
+			return i;
+		}
+	}
+	return NULL;
+}
+
 /* returns the free size in bytes of the buddy heap; must be called while
  * holding the parent heap's lock. */
 static void buddy_stat(struct buddy_heap *heap, struct heap_stat *stat)
@@ -186,14 +395,14 @@ static void buddy_stat(struct buddy_heap *heap, struct heap_stat *stat)
 /* returns the free size of the heap (including any free blocks in any
  * buddy-heap suballocators; must be called while holding the parent
  * heap's lock. */
-static unsigned long heap_stat(struct nvmap_heap *heap, struct heap_stat *stat)
+static unsigned long __heap_stat(struct nvmap_heap *heap,
+				 struct heap_stat *stat)
 {
 	struct buddy_heap *bh;
 	struct list_block *l = NULL;
 	unsigned long base = -1ul;
 
 	memset(stat, 0, sizeof(*stat));
-	mutex_lock(&heap->lock);
 	list_for_each_entry(l, &heap->all_list, all_list) {
 		stat->total += l->size;
 		stat->largest = max(l->size, stat->largest);
@@ -210,16 +419,27 @@ static unsigned long heap_stat(struct nvmap_heap *heap, struct heap_stat *stat)
 		stat->count--;
 	}
 
-	list_for_each_entry(l, &heap->free_list, free_list) {
+	list_for_each_entry(l, &heap->all_list, all_list) {
+		if (l->block.type != BLOCK_EMPTY)
+			continue;
 		stat->free += l->size;
 		stat->free_count++;
 		stat->free_largest = max(l->size, stat->free_largest);
 	}
-	mutex_unlock(&heap->lock);
 
 	return base;
 }
 
+static unsigned long heap_stat(struct nvmap_heap *heap, struct heap_stat *stat)
+{
+	unsigned long base;
+
+	mutex_lock(&heap->lock);
+	base = __heap_stat(heap, stat);
+	mutex_unlock(&heap->lock);
+	return base;
+}
+
 static ssize_t heap_name_show(struct device *dev,
 			      struct device_attribute *attr, char *buf);
 
@@ -384,6 +604,49 @@ static struct buddy_heap *do_buddy_free(struct nvmap_heap_block *block)
 }
 
 
+/* returns the free block which an address-order scan in direction dir
+ * would pick for len bytes at the requested alignment, and the aligned
+ * base inside it, or NULL. must be called while holding the heap's lock. */
+static struct list_block *heap_find_fit(struct nvmap_heap *heap, size_t len,
+					size_t align, enum direction dir,
+					unsigned long base_max,
+					unsigned long *fix_base)
+{
+	struct list_block *b = NULL;
+	struct list_block *i;
+	unsigned long base;
+	unsigned int bucket;
+
+	/* size classes below the one containing len can never fit it; every
+	 * other class may, so take the best candidate across all of them */
+	for (bucket = fls_long(len) - 1; bucket < NR_FREE_BUCKETS; bucket++) {
+		struct rb_root *root = &heap->free_tree[bucket];
+
+		if (RB_EMPTY_ROOT(root))
+			continue;
+
+		if (dir == BOTTOM_UP)
+			i = bucket_first_fit(root, len, align, base_max,
+					     b, &base);
+		else
+			i = bucket_last_fit(root, len, align, b, &base);
+		if (i) {
+			b = i;
+			*fix_base = base;
+		}
+	}
+	return b;
+}
+
+static enum direction alloc_direction(struct nvmap_heap *heap, size_t len)
+{
+#ifdef CONFIG_NVMAP_CARVEOUT_COMPACTOR
+	return BOTTOM_UP;
+#else
+	return (len <= heap->small_alloc) ? BOTTOM_UP : TOP_DOWN;
+#endif
+}
+
 /*
  * base_max limits position of allocated chunk in memory.
  * if base_max is 0 then there is no such limitation.
@@ -393,10 +656,9 @@ static struct nvmap_heap_block *do_heap_alloc(struct nvmap_heap *heap,
 					      unsigned int mem_prot,
 					      unsigned long base_max)
 {
-	struct list_block *b = NULL;
-	struct list_block *i = NULL;
+	struct list_block *b;
 	struct list_block *rem = NULL;
-	unsigned long fix_base;
+	unsigned long fix_base = 0;
 	enum direction dir;
 
 	/* since pages are only mappable with one cache attribute,
@@ -410,47 +672,13 @@ static struct nvmap_heap_block *do_heap_alloc(struct nvmap_heap *heap,
 		len = PAGE_ALIGN(len);
 	}
 
-#ifdef CONFIG_NVMAP_CARVEOUT_COMPACTOR
-	dir = BOTTOM_UP;
-#else
-	dir = (len <= heap->small_alloc) ? BOTTOM_UP : TOP_DOWN;
-#endif
-
-	if (dir == BOTTOM_UP) {
-		list_for_each_entry(i, &heap->free_list, free_list) {
-			size_t fix_size;
-			fix_base = ALIGN(i->block.base, align);
-			fix_size = i->size - (fix_base - i->block.base);
-
-			/* needed for compaction. relocated chunk
-			 * should never go up */
-			if (base_max && fix_base > base_max) {
-				break;
-			}
-
-			if (fix_size >= len) {
-				b = i;
-				break;
-			}
-		}
-	} else {
-		list_for_each_entry_reverse(i, &heap->free_list, free_list) {
-			if (i->size >= len) {
-				fix_base = i->block.base + i->size - len;
-				fix_base &= ~(align-1);
-				if (fix_base >= i->block.base) {
-					b = i;
-					break;
-				}
-			}
-		}
-	}
-
+	dir = alloc_direction(heap, len);
+	b = heap_find_fit(heap, len, align, dir, base_max, &fix_base);
 	if (!b)
 		return NULL;
 
-	if (dir == BOTTOM_UP)
-		b->block.type = BLOCK_FIRST_FIT;
+	free_erase(heap, b);
+	b->block.type = BLOCK_FIRST_FIT;
 
 	/* split free block */
 	if (b->block.base != fix_base) {
@@ -463,15 +691,15 @@ static struct nvmap_heap_block *do_heap_alloc(struct nvmap_heap *heap,
 			goto out;
 		}
 
-		rem->block.type = BLOCK_EMPTY;
 		rem->block.base = b->block.base;
 		rem->orig_addr = rem->block.base;
 		rem->size = fix_base - rem->block.base;
+		rem->heap = heap;
 		b->block.base = fix_base;
 		b->orig_addr = fix_base;
 		b->size -= rem->size;
 		list_add_tail(&rem->all_list,  &b->all_list);
-		list_add_tail(&rem->free_list, &b->free_list);
+		free_insert(heap, rem);
 	}
 
 	b->orig_addr = b->block.base;
@@ -482,18 +710,17 @@ static struct nvmap_heap_block *do_heap_alloc(struct nvmap_heap *heap,
 		if (!rem)
 			goto out;
 
-		rem->block.type = BLOCK_EMPTY;
 		rem->block.base = b->block.base + len;
 		rem->size = b->size - len;
 		BUG_ON(rem->size > b->size);
 		rem->orig_addr = rem->block.base;
+		rem->heap = heap;
 		b->size = len;
 		list_add(&rem->all_list,  &b->all_list);
-		list_add(&rem->free_list, &b->free_list);
+		free_insert(heap, rem);
 	}
 
 out:
-	list_del(&b->free_list);
 	b->heap = heap;
 	b->mem_prot = mem_prot;
 	b->align = align;
@@ -509,7 +736,9 @@ static void freelist_debug(struct nvmap_heap *heap, const char *title,
 
 	dev_debug(&heap->dev, "%s\n", title);
 	i = 0;
-	list_for_each_entry(n, &heap->free_list, free_list) {
+	list_for_each_entry(n, &heap->all_list, all_list) {
+		if (n->block.type != BLOCK_EMPTY)
+			continue;
 		dev_debug(&heap->dev,"\t%d [%p..%p]%s\n", i, (void *)n->orig_addr,
 			  (void *)(n->orig_addr + n->size),
 			  (n == token) ? "<--" : "");
@@ -529,28 +758,18 @@ static struct list_block *do_heap_free(struct nvmap_heap_block *block)
 	BUG_ON(b->block.base > b->orig_addr);
 	b->size += (b->block.base - b->orig_addr);
 	b->block.base = b->orig_addr;
-
-	freelist_debug(heap, "free list before", b);
-
-	/* Find position of first free block to the right of freed one */
-	list_for_each_entry(n, &heap->free_list, free_list) {
-		if (n->block.base > b->block.base)
-			break;
-	}
-
-	/* Add freed block before found free one */
-	list_add_tail(&b->free_list, &n->free_list);
 	BUG_ON(list_empty(&b->all_list));
 
-	freelist_debug(heap, "free list pre-merge", b);
+	freelist_debug(heap, "free list before", b);
 
 	/* merge freed block with next if they connect
 	 * freed block becomes bigger, next one is destroyed */
-	if (!list_is_last(&b->free_list, &heap->free_list)) {
-		n = list_first_entry(&b->free_list, struct list_block, free_list);
-		if (n->block.base == b->block.base + b->size) {
+	if (!list_is_last(&b->all_list, &heap->all_list)) {
+		n = list_first_entry(&b->all_list, struct list_block, all_list);
+		if (n->block.type == BLOCK_EMPTY &&
+		    n->block.base == b->block.base + b->size) {
+			free_erase(heap, n);
 			list_del(&n->all_list);
-			list_del(&n->free_list);
 			BUG_ON(b->orig_addr >= n->orig_addr);
 			b->size += n->size;
 			kmem_cache_free(block_cache, n);
@@ -559,11 +778,12 @@ static struct list_block *do_heap_free(struct nvmap_heap_block *block)
 
 	/* merge freed block with prev if they connect
 	 * previous free block becomes bigger, freed one is destroyed */
-	if (b->free_list.prev != &heap->free_list) {
-		n = list_entry(b->free_list.prev, struct list_block, free_list);
-		if (n->block.base + n->size == b->block.base) {
+	if (b->all_list.prev != &heap->all_list) {
+		n = list_entry(b->all_list.prev, struct list_block, all_list);
+		if (n->block.type == BLOCK_EMPTY &&
+		    n->block.base + n->size == b->block.base) {
+			free_erase(heap, n);
 			list_del(&b->all_list);
-			list_del(&b->free_list);
 			BUG_ON(n->orig_addr >= b->orig_addr);
 			n->size += b->size;
 			kmem_cache_free(block_cache, b);
@@ -571,8 +791,8 @@ static struct list_block *do_heap_free(struct nvmap_heap_block *block)
 		}
 	}
 
+	free_insert(heap, b);
 	freelist_debug(heap, "free list after", b);
-	b->block.type = BLOCK_EMPTY;
 	return b;
 }
 
@@ -949,6 +1169,7 @@ struct nvmap_heap *nvmap_heap_create(struct device *parent, const char *name,
 {
 	struct nvmap_heap *h = NULL;
 	struct list_block *l = NULL;
+	unsigned int i;
 
 	if (WARN_ON(buddy_size && buddy_size < NVMAP_HEAP_MIN_BUDDY_SIZE)) {
 		dev_warn(parent, "%s: buddy_size %u too small\n", __func__,
@@ -1009,15 +1230,16 @@ struct nvmap_heap *nvmap_heap_create(struct device *parent, const char *name,
 	h->buddy_heap_size = buddy_size;
 	if (buddy_size)
 		h->min_buddy_shift = ilog2(buddy_size / MAX_BUDDY_NR);
-	INIT_LIST_HEAD(&h->free_list);
+	for (i = 0; i < NR_FREE_BUCKETS; i++)
+		h->free_tree[i] = RB_ROOT;
 	INIT_LIST_HEAD(&h->buddy_list);
 	INIT_LIST_HEAD(&h->all_list);
 	mutex_init(&h->lock);
 	l->block.base = base;
-	l->block.type = BLOCK_EMPTY;
 	l->size = len;
 	l->orig_addr = base;
-	list_add_tail(&l->free_list, &h->free_list);
+	l->heap = h;
+	free_insert(h, l);
 	list_add_tail(&l->all_list, &h->all_list);
 
 	inner_flush_cache_all();
@@ -1116,3 +1338,432 @@ void nvmap_heap_deinit(void)
 	block_cache = NULL;
 	buddy_heap_cache = NULL;
 }
+
+#ifdef CONFIG_NVMAP_HEAP_TEST
+/*
+ * allocation trace self-test. replays a pseudo-random alloc/free trace
+ * against a heap which is never backed by memory and, side by side, against
+ * a copy of the allocator this heap used before the free blocks were
+ * indexed by size. every lookup, every placement and the final free blocks
+ * of the two must be identical. lookup latency of both, allocation failures
+ * and the final fragmentation are reported, so that a change to the free
+ * index can be judged on the same trace before and after.
+ */
+
+#define HEAP_TEST_BASE		0x10000000UL
+
+static unsigned int heap_test_size = SZ_64M;
+module_param(heap_test_size, uint, 0444);
+MODULE_PARM_DESC(heap_test_size, "Size of the test heap in bytes");
+
+static unsigned int heap_test_ops = 100000;
+module_param(heap_test_ops, uint, 0444);
+MODULE_PARM_DESC(heap_test_ops, "Number of alloc/free operations to replay");
+
+static unsigned int heap_test_live = 1024;
+module_param(heap_test_live, uint, 0444);
+MODULE_PARM_DESC(heap_test_live, "Maximum number of live allocations");
+
+static unsigned int heap_test_seed = 1;
+module_param(heap_test_seed, uint, 0444);
+MODULE_PARM_DESC(heap_test_seed, "Seed of the allocation trace");
+
+struct heap_test_lat {
+	u64 total;
+	u64 max;
+	unsigned long count;
+};
+
+static void heap_test_account(struct heap_test_lat *lat, ktime_t start)
+{
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	lat->total += ns;
+	lat->max = max(lat->max, ns);
+	lat->count++;
+}
+
+static void heap_test_report(const char *name, struct heap_test_lat *lat)
+{
+	u64 avg = lat->total;
+
+	if (lat->count)
+		do_div(avg, lat->count);
+	pr_info("nvmap_heap_test: %-6s %lu lookups, avg %llu ns, max %llu ns\n",
+		name, lat->count, avg, lat->max);
+}
+
+/*
+ * the old allocator: a single free list in address order, scanned linearly
+ * for allocation and again to find the insertion point on free. the code
+ * below is do_heap_alloc() and do_heap_free() as they were, reduced to the
+ * free list (the test never relocates, so base_max and orig_addr are left
+ * out).
+ */
+struct heap_test_block {
+	struct list_head free_list;
+	unsigned long base;
+	size_t size;
+};
+
+struct heap_test_alloc {
+	struct nvmap_heap_block *block;
+	struct heap_test_block *old;
+};
+
+/* *overrun is set if the old scan picks a block whose aligned base lies
+ * past its end: fix_size wraps around there, and the old allocator went
+ * on to corrupt its free list. */
+static struct heap_test_block *heap_test_old_fit(struct list_head *free_list,
+						 size_t len, size_t align,
+						 enum direction dir,
+						 unsigned long *fix_base,
+						 bool *overrun)
+{
+	struct heap_test_block *i;
+
+	*overrun = false;
+	if (dir == BOTTOM_UP) {
+		list_for_each_entry(i, free_list, free_list) {
+			size_t fix_size;
+			*fix_base = ALIGN(i->base, align);
+			fix_size = i->size - (*fix_base - i->base);
+
+			if (fix_size >= len) {
+				*overrun = *fix_base - i->base > i->size;
+				return i;
+			}
+		}
+	} else {
+		list_for_each_entry_reverse(i, free_list, free_list) {
+			if (i->size >= len) {
+				*fix_base = i->base + i->size - len;
+				*fix_base &= ~(align-1);
+				if (*fix_base >= i->base)
+					return i;
+			}
+		}
+	}
+	return NULL;
+}
+
+static struct heap_test_block *heap_test_old_alloc(struct heap_test_block *b,
+						   unsigned long fix_base,
+						   size_t len)
+{
+	struct heap_test_block *rem;
+
+	/* split free block */
+	if (b->base != fix_base) {
+		/* insert a new free block before allocated */
+		rem = kzalloc(sizeof(*rem), GFP_KERNEL);
+		if (!rem)
+			return NULL;
+
+		rem->base = b->base;
+		rem->size = fix_base - b->base;
+		b->base = fix_base;
+		b->size -= rem->size;
+		list_add_tail(&rem->free_list, &b->free_list);
+	}
+
+	if (b->size > len) {
+		/* insert a new free block after allocated */
+		rem = kzalloc(sizeof(*rem), GFP_KERNEL);
+		if (!rem)
+			return NULL;
+
+		rem->base = b->base + len;
+		rem->size = b->size - len;
+		b->size = len;
+		list_add(&rem->free_list, &b->free_list);
+	}
+
+	list_del(&b->free_list);
+	return b;
+}
+
+static void heap_test_old_free(struct list_head *free_list,
+			       struct heap_test_block *b)
+{
+	struct heap_test_block *n;
+
+	/* Find position of first free block to the right of freed one */
+	list_for_each_entry(n, free_list, free_list) {
+		if (n->base > b->base)
+			break;
+	}
+
+	/* Add freed block before found free one */
+	list_add_tail(&b->free_list, &n->free_list);
+
+	/* merge freed block with next if they connect */
+	if (!list_is_last(&b->free_list, free_list)) {
+		n = list_first_entry(&b->free_list, struct heap_test_block,
+				     free_list);
+		if (n->base == b->base + b->size) {
+			list_del(&n->free_list);
+			b->size += n->size;
+			kfree(n);
+		}
+	}
+
+	/* merge freed block with prev if they connect */
+	if (b->free_list.prev != free_list) {
+		n = list_entry(b->free_list.prev, struct heap_test_block,
+			       free_list);
+		if (n->base + n->size == b->base) {
+			list_del(&b->free_list);
+			n->size += b->size;
+			kfree(b);
+		}
+	}
+}
+
+/* true if the free blocks of heap are exactly those on free_list */
+static bool heap_test_same_free(struct nvmap_heap *heap,
+				struct list_head *free_list)
+{
+	struct list_head *o = free_list->next;
+	struct list_block *l;
+
+	list_for_each_entry(l, &heap->all_list, all_list) {
+		struct heap_test_block *b;
+
+		if (l->block.type != BLOCK_EMPTY)
+			continue;
+		if (o == free_list)
+			return false;
+		b = list_entry(o, struct heap_test_block, free_list);
+		if (b->base != l->block.base || b->size != l->size)
+			return false;
+		o = o->next;
+	}
+	return o == free_list;
+}
+
+/* mostly small and page sized buffers, with the odd frame buffer sized one */
+static size_t heap_test_len(struct rnd_state *rnd)
+{
+	u32 r = prandom32(rnd);
+
+	switch (r % 8) {
+	case 0: case 1: case 2:
+		return 32 + (r >> 8) % SZ_4K;
+	case 3: case 4: case 5:
+		return PAGE_SIZE * (1 + (r >> 8) % 16);
+	case 6:
+		return SZ_64K + (r >> 8) % SZ_512K;
+	default:
+		return SZ_1M + (r >> 8) % SZ_4M;
+	}
+}
+
+static size_t heap_test_align(struct rnd_state *rnd)
+{
+	static const size_t aligns[] = { 32, 256, PAGE_SIZE, SZ_1M };
+
+	return aligns[prandom32(rnd) % ARRAY_SIZE(aligns)];
+}
+
+static int __init nvmap_heap_test(void)
+{
+	struct heap_test_lat tree[2], list[2];
+	struct heap_test_alloc *live;
+	struct heap_test_block *old, *tmp;
+	struct nvmap_heap *heap;
+	struct list_block *l;
+	struct heap_stat stat;
+	struct rnd_state rnd;
+	LIST_HEAD(old_free);
+	unsigned long nr_live = 0, failed = 0, mismatch = 0, overrun = 0;
+	unsigned int op, i;
+	bool same_free;
+	int err = -ENOMEM;
+
+	if (!block_cache || !heap_test_live)
+		return -ENODEV;
+
+	live = kcalloc(heap_test_live, sizeof(*live), GFP_KERNEL);
+	heap = kzalloc(sizeof(*heap), GFP_KERNEL);
+	l = kmem_cache_zalloc(block_cache, GFP_KERNEL);
+	old = kzalloc(sizeof(*old), GFP_KERNEL);
+	if (!live || !heap || !l || !old) {
+		kfree(old);
+		goto out;
+	}
+
+	INIT_LIST_HEAD(&heap->all_list);
+	INIT_LIST_HEAD(&heap->buddy_list);
+	for (i = 0; i < NR_FREE_BUCKETS; i++)
+		heap->free_tree[i] = RB_ROOT;
+	mutex_init(&heap->lock);
+	heap->small_alloc = SZ_1M;
+	heap->name = "test";
+
+	l->block.base = HEAP_TEST_BASE;
+	l->orig_addr = l->block.base;
+	l->size = heap_test_size;
+	l->heap = heap;
+	list_add_tail(&l->all_list, &heap->all_list);
+	free_insert(heap, l);
+	l = NULL;
+
+	old->base = HEAP_TEST_BASE;
+	old->size = heap_test_size;
+	list_add_tail(&old->free_list, &old_free);
+
+	memset(tree, 0, sizeof(tree));
+	memset(list, 0, sizeof(list));
+	prandom32_seed(&rnd, heap_test_seed);
+
+	mutex_lock(&heap->lock);
+	for (op = 0; op < heap_test_ops; op++) {
+		struct heap_test_alloc *a = &live[nr_live];
+		struct list_block *b;
+		unsigned long base_new = 0, base_old = 0;
+		enum direction dir;
+		size_t len, align;
+		ktime_t start;
+		bool wrapped;
+
+		if (!(op % 1024)) {
+			mutex_unlock(&heap->lock);
+			cond_resched();
+			mutex_lock(&heap->lock);
+		}
+
+		if (nr_live && (nr_live == heap_test_live ||
+				prandom32(&rnd) % 2)) {
+			i = prandom32(&rnd) % nr_live;
+			do_heap_free(live[i].block);
+			heap_test_old_free(&old_free, live[i].old);
+			live[i] = live[--nr_live];
+			continue;
+		}
+
+		len = heap_test_len(&rnd);
+		align = heap_test_align(&rnd);
+
+		/* exercise both directions, whatever this kernel's policy */
+		for (dir = TOP_DOWN; dir <= BOTTOM_UP; dir++) {
+			start = ktime_get();
+			b = heap_find_fit(heap, len, align, dir, 0, &base_new);
+			heap_test_account(&tree[dir], start);
+
+			start = ktime_get();
+			old = heap_test_old_fit(&old_free, len, align, dir,
+						&base_old, &wrapped);
+			heap_test_account(&list[dir], start);
+
+			if (wrapped || (!b && !old) ||
+			    (b && old && base_new == base_old))
+				continue;
+			if (!mismatch++)
+				pr_err("nvmap_heap_test: op %u: %zu@%zu "
+				       "dir %d: new %08lx old %08lx\n",
+				       op, len, align, dir,
+				       b ? base_new : 0, old ? base_old : 0);
+		}
+
+		/* allocations the old allocator would have corrupted its
+		 * free list on are left out of the trace */
+		dir = alloc_direction(heap, len);
+		old = heap_test_old_fit(&old_free, len, align, dir,
+					&base_old, &wrapped);
+		if (wrapped) {
+			overrun++;
+			continue;
+		}
+		a->old = NULL;
+		if (old) {
+			a->old = heap_test_old_alloc(old, base_old, len);
+			if (!a->old) {
+				mutex_unlock(&heap->lock);
+				goto out_free;
+			}
+		}
+		a->block = do_heap_alloc(heap, len, align,
+					 NVMAP_HANDLE_WRITE_COMBINE, 0);
+
+		if (a->block && a->old && a->block->base == a->old->base) {
+			nr_live++;
+			continue;
+		}
+		if (!a->block && !a->old) {
+			failed++;
+			continue;
+		}
+		if (!mismatch++)
+			pr_err("nvmap_heap_test: op %u: %zu@%zu placed at "
+			       "new %08lx old %08lx\n", op, len, align,
+			       a->block ? a->block->base : 0,
+			       a->old ? a->old->base : 0);
+		if (a->block)
+			do_heap_free(a->block);
+		if (a->old)
+			heap_test_old_free(&old_free, a->old);
+	}
+
+	__heap_stat(heap, &stat);
+	same_free = heap_test_same_free(heap, &old_free);
+	mutex_unlock(&heap->lock);
+
+	heap_test_report("tree", &tree[BOTTOM_UP]);
+	heap_test_report("list", &list[BOTTOM_UP]);
+	heap_test_report("tree-r", &tree[TOP_DOWN]);
+	heap_test_report("list-r", &list[TOP_DOWN]);
+	pr_info("nvmap_heap_test: %u ops, %lu failed allocs, %lu skipped, "
+		"%lu live, %zu free blocks, %zu free bytes, largest %zu\n",
+		heap_test_ops, failed, overrun, nr_live, stat.free_count,
+		stat.free, stat.free_largest);
+	if (!same_free) {
+		pr_err("nvmap_heap_test: free blocks differ from the old "
+		       "allocator\n");
+		mismatch++;
+	}
+
+out_free:
+	mutex_lock(&heap->lock);
+	while (nr_live) {
+		nr_live--;
+		do_heap_free(live[nr_live].block);
+		heap_test_old_free(&old_free, live[nr_live].old);
+	}
+	mutex_unlock(&heap->lock);
+
+	list_for_each_entry_safe(old, tmp, &old_free, free_list) {
+		list_del(&old->free_list);
+		kfree(old);
+	}
+
+	/* everything must have coalesced back into the initial block */
+	l = list_first_entry(&heap->all_list, struct list_block, all_list);
+	if (!list_is_singular(&heap->all_list) ||
+	    l->block.base != HEAP_TEST_BASE || l->size != heap_test_size) {
+		pr_err("nvmap_heap_test: heap did not coalesce\n");
+		err = -EINVAL;
+		l = NULL;
+		goto out;
+	}
+	free_erase(heap, l);
+	if (op < heap_test_ops)
+		err = -ENOMEM;
+	else if (mismatch)
+		err = -EINVAL;
+	else
+		err = 0;
+	if (mismatch)
+		pr_err("nvmap_heap_test: %lu differences from the old "
+		       "allocator\n", mismatch);
+	else if (!err)
+		pr_info("nvmap_heap_test: passed\n");
+out:
+	if (l)
+		kmem_cache_free(block_cache, l);
+	kfree(heap);
+	kfree(live);
+	return err;
+}
+late_initcall(nvmap_heap_test);
+#endif
@@ -292,6 +292,7 @@ int nvmap_map_into_caller_ptr(struct file *filp, void __user *arg)
 
 	vpriv->handle = h;
 	vpriv->offs = op.offset;
+	nvmap_handle_cpu_map(h);
 
 	if (op.flags == NVMAP_HANDLE_INNER_CACHEABLE) {
 		if (h->orig_size & ~PAGE_MASK) {
@@ -560,8 +561,9 @@ out:
 	return ret;
 }
 
-static int cache_maint(struct nvmap_client *client, struct nvmap_handle *h,
-		       unsigned long start, unsigned long end, unsigned int op)
+static int do_cache_maint(struct nvmap_client *client, struct nvmap_handle *h,
+			  unsigned long start, unsigned long end,
+			  unsigned int op)
 {
 	pgprot_t prot;
 	pte_t **pte = NULL;
@@ -641,6 +643,36 @@ out:
 	return err;
 }
 
+/* write-backs are skipped for handles which the CPU can not have written
+ * since their last full clean, e.g. buffers filled by a decoder and only
+ * ever handed to the display. invalidates are always performed. */
+static int cache_maint(struct nvmap_client *client, struct nvmap_handle *h,
+		       unsigned long start, unsigned long end, unsigned int op)
+{
+	bool cacheable = h->flags != NVMAP_HANDLE_UNCACHEABLE &&
+			 h->flags != NVMAP_HANDLE_WRITE_COMBINE;
+	int err;
+
+	if (!cacheable || op == NVMAP_CACHE_OP_INV)
+		return do_cache_maint(client, h, start, end, op);
+
+	if (op == NVMAP_CACHE_OP_WB && !atomic_read(&h->cpu_map)) {
+		smp_rmb();
+		if (!h->cpu_dirty) {
+			atomic_inc(&client->cache_clean_skipped);
+			return 0;
+		}
+	}
+
+	err = do_cache_maint(client, h, start, end, op);
+	if (!err) {
+		atomic_inc(&client->cache_clean_done);
+		if (!start && end >= h->size && !atomic_read(&h->cpu_map))
+			h->cpu_dirty = false;
+	}
+	return err;
+}
+
 static int rw_handle_page(struct nvmap_handle *h, int is_read,
 			  unsigned long start, unsigned long rw_addr,
 			  unsigned long bytes, unsigned long kaddr, pte_t *pte)
@@ -727,6 +759,8 @@ static ssize_t rw_handle(struct nvmap_client *client, struct nvmap_handle *h,
 		if(is_read)
 			cache_maint(client, h, h_offs,
 				h_offs + elem_size, NVMAP_CACHE_OP_INV);
+		else
+			h->cpu_dirty = true;
 
 		ret = rw_handle_page(h, is_read, h_offs, sys_addr,
 				     elem_size, (unsigned long)addr, *pte);
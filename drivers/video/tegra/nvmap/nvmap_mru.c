@@ -20,6 +20,7 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <linux/jiffies.h>
 #include <linux/list.h>
 #include <linux/slab.h>
 
@@ -31,42 +32,100 @@
 #include "nvmap_mru.h"
 
 /* if IOVMM reclamation is enabled (CONFIG_NVMAP_RECLAIM_UNPINNED_VM),
- * unpinned handles are placed onto a most-recently-used eviction list;
- * multiple lists are maintained, segmented by size (sizes were chosen to
- * roughly correspond with common sizes for graphics surfaces).
+ * unpinned handles are placed onto a least-recently-used list, shared by
+ * all handle sizes; the most recently unpinned handle is at the head.
  *
- * if a handle is located on the MRU list, then the code below may
+ * if a handle is located on the LRU list, then the code below may
  * steal its IOVMM area at any time to satisfy a pin operation if no
- * free IOVMM space is available
+ * free IOVMM space is available.
+ *
+ * victims are chosen among the LRU_SCAN_WINDOW least recently unpinned
+ * handles. each handle tracks how often it is re-pinned (a counter which
+ * is halved every PIN_FREQ_PERIOD), so that surfaces which are re-pinned
+ * every frame are not evicted ahead of cold ones just because they happen
+ * to have been unpinned a little earlier.
  */
 
-static const size_t mru_cutoff[] = {
-	262144, 393216, 786432, 1048576, 1572864
-};
+#define LRU_SCAN_WINDOW		32
+#define PIN_FREQ_PERIOD		HZ
+#define PIN_FREQ_MAX		0xffff
+
+size_t nvmap_mru_vm_size(struct tegra_iovmm_client *iovmm)
+{
+	size_t vm_size = tegra_iovmm_get_vm_size(iovmm);
+	return (vm_size >> 2) * 3;
+}
+
+/* returns the decayed re-pin frequency of h at time now */
+static unsigned int pin_freq(struct nvmap_handle *h, unsigned long now)
+{
+	unsigned long periods = (now - h->pgalloc.last_pin) / PIN_FREQ_PERIOD;
+
+	if (periods >= 16)
+		return 0;
+	return h->pgalloc.pin_freq >> periods;
+}
 
-static inline struct list_head *mru_list(struct nvmap_share *share, size_t size)
+static void note_pin(struct nvmap_handle *h)
 {
-	unsigned int i;
+	unsigned long now = jiffies;
 
-	BUG_ON(!share->mru_lists);
-	for (i = 0; i < ARRAY_SIZE(mru_cutoff); i++)
-		if (size <= mru_cutoff[i])
+	h->pgalloc.pin_freq = min_t(unsigned int, pin_freq(h, now) + 1,
+				    PIN_FREQ_MAX);
+	h->pgalloc.last_pin = now;
+}
+
+/* returns true if evicting a is cheaper than evicting b: colder handles
+ * first, and among equally cold handles the one which frees more space */
+static bool cheaper_victim(struct nvmap_handle *a, struct nvmap_handle *b,
+			   unsigned long now)
+{
+	unsigned int fa = pin_freq(a, now);
+	unsigned int fb = pin_freq(b, now);
+
+	if (fa != fb)
+		return fa < fb;
+	return a->pgalloc.area->iovm_length > b->pgalloc.area->iovm_length;
+}
+
+/* picks the cheapest victim among the least recently unpinned handles. if
+ * fit is non-zero, only handles whose area can be re-used directly for a
+ * fit-byte allocation (without wasting more than half of it) qualify. */
+static struct nvmap_handle *lru_victim(struct nvmap_share *share, size_t fit)
+{
+	struct nvmap_handle *h, *victim = NULL;
+	unsigned long now = jiffies;
+	unsigned int scanned = 0;
+
+	list_for_each_entry_reverse(h, &share->lru_list, pgalloc.mru_list) {
+		size_t len = h->pgalloc.area->iovm_length;
+
+		if (scanned++ == LRU_SCAN_WINDOW)
 			break;
 
-	return &share->mru_lists[i];
+		if (fit && (len < fit || len / 2 >= fit))
+			continue;
+
+		if (!victim || cheaper_victim(h, victim, now))
+			victim = h;
+	}
+	return victim;
 }
 
-size_t nvmap_mru_vm_size(struct tegra_iovmm_client *iovmm)
+static void lru_evict(struct nvmap_client *c, struct nvmap_handle *evict)
 {
-	size_t vm_size = tegra_iovmm_get_vm_size(iovmm);
-	return (vm_size >> 2) * 3;
+	BUG_ON(atomic_read(&evict->pin) != 0);
+	BUG_ON(!evict->pgalloc.area);
+	list_del(&evict->pgalloc.mru_list);
+	INIT_LIST_HEAD(&evict->pgalloc.mru_list);
+	evict->pgalloc.evicted = true;
+	c->iovm_evictions++;
 }
 
 /*  nvmap_mru_vma_lock should be acquired by the caller before calling this */
 void nvmap_mru_insert_locked(struct nvmap_share *share, struct nvmap_handle *h)
 {
-	size_t len = h->pgalloc.area->iovm_length;
-	list_add(&h->pgalloc.mru_list, mru_list(share, len));
+	list_add(&h->pgalloc.mru_list, &share->lru_list);
 }
 
 void nvmap_mru_remove(struct nvmap_share *s, struct nvmap_handle *h)
@@ -79,29 +138,28 @@ void nvmap_mru_remove(struct nvmap_share *s, struct nvmap_handle *h)
 }
 
 /* returns a tegra_iovmm_area for a handle. if the handle already has
- * an iovmm_area allocated, the handle is simply removed from its MRU list
+ * an iovmm_area allocated, the handle is simply removed from the LRU list
  * and the existing iovmm_area is returned.
  *
  * if no existing allocation exists, try to allocate a new IOVMM area.
  *
- * if a new area can not be allocated, try to re-use the most-recently-unpinned
- * handle's allocation.
+ * if a new area can not be allocated, try to re-use the area of the
+ * cheapest similarly-sized victim on the LRU list.
  *
- * and if that fails, iteratively evict handles from the MRU lists and free
- * their allocations, until the new allocation succeeds.
+ * and if that fails, iteratively evict the cheapest handles from the LRU
+ * list and free their allocations, until the new allocation succeeds.
  */
 struct tegra_iovmm_area *nvmap_handle_iovmm_locked(struct nvmap_client *c,
 					    struct nvmap_handle *h)
 {
-	struct list_head *mru;
-	struct nvmap_handle *evict = NULL;
+	struct nvmap_handle *evict;
 	struct tegra_iovmm_area *vm = NULL;
-	unsigned int i, idx;
 	pgprot_t prot;
 
 	BUG_ON(!h || !c || !c->share);
 
 	prot = nvmap_pgprot(h, pgprot_kernel);
+	note_pin(h);
 
 	if (h->pgalloc.area) {
 		BUG_ON(list_empty(&h->pgalloc.mru_list));
@@ -116,68 +174,29 @@ struct tegra_iovmm_area *nvmap_handle_iovmm_locked(struct nvmap_client *c,
 		INIT_LIST_HEAD(&h->pgalloc.mru_list);
 		return vm;
 	}
-	/* attempt to re-use the most recently unpinned IOVMM area in the
-	 * same size bin as the current handle. If that fails, iteratively
-	 * evict handles (starting from the current bin) until an allocation
-	 * succeeds or no more areas can be evicted */
-	mru = mru_list(c->share, h->size);
-	if (!list_empty(mru))
-		evict = list_first_entry(mru, struct nvmap_handle,
-					 pgalloc.mru_list);
-
-	if (evict && evict->pgalloc.area->iovm_length >= h->size) {
-		list_del(&evict->pgalloc.mru_list);
+
+	evict = lru_victim(c->share, h->size);
+	if (evict) {
+		lru_evict(c, evict);
 		vm = evict->pgalloc.area;
 		evict->pgalloc.area = NULL;
-		INIT_LIST_HEAD(&evict->pgalloc.mru_list);
 		return vm;
 	}
 
-	idx = mru - c->share->mru_lists;
-
-	for (i = 0; i < c->share->nr_mru && !vm; i++, idx++) {
-		if (idx >= c->share->nr_mru)
-			idx = 0;
-		mru = &c->share->mru_lists[idx];
-		while (!list_empty(mru) && !vm) {
-			evict = list_first_entry(mru, struct nvmap_handle,
-						 pgalloc.mru_list);
-
-			BUG_ON(atomic_read(&evict->pin) != 0);
-			BUG_ON(!evict->pgalloc.area);
-			list_del(&evict->pgalloc.mru_list);
-			INIT_LIST_HEAD(&evict->pgalloc.mru_list);
-			tegra_iovmm_free_vm(evict->pgalloc.area);
-			evict->pgalloc.area = NULL;
-			vm = tegra_iovmm_create_vm(c->share->iovmm,
-						   NULL, h->size, prot);
-		}
+	while (!vm && !list_empty(&c->share->lru_list)) {
+		evict = lru_victim(c->share, 0);
+		lru_evict(c, evict);
+		tegra_iovmm_free_vm(evict->pgalloc.area);
+		evict->pgalloc.area = NULL;
+		vm = tegra_iovmm_create_vm(c->share->iovmm,
+					   NULL, h->size, prot);
 	}
 	return vm;
 }
 
 int nvmap_mru_init(struct nvmap_share *share)
 {
-	int i;
 	mutex_init(&share->mru_lock);
-	share->nr_mru = ARRAY_SIZE(mru_cutoff) + 1;
-
-	share->mru_lists = kzalloc(sizeof(struct list_head) * share->nr_mru,
-				   GFP_KERNEL);
-
-	if (!share->mru_lists)
-		return -ENOMEM;
-
-	for (i = 0; i <= share->nr_mru; i++)
-		INIT_LIST_HEAD(&share->mru_lists[i]);
-
+	INIT_LIST_HEAD(&share->lru_list);
 	return 0;
 }
-
-void nvmap_mru_destroy(struct nvmap_share *share)
-{
-	if (share->mru_lists)
-		kfree(share->mru_lists);
-
-	share->mru_lists = NULL;
-}
@@ -45,8 +45,6 @@ static inline void nvmap_mru_unlock(struct nvmap_share *share)
 
 int nvmap_mru_init(struct nvmap_share *share);
 
-void nvmap_mru_destroy(struct nvmap_share *share);
-
 size_t nvmap_mru_vm_size(struct tegra_iovmm_client *iovmm);
 
 void nvmap_mru_insert_locked(struct nvmap_share *share, struct nvmap_handle *h);
@@ -61,7 +59,6 @@ struct tegra_iovmm_area *nvmap_handle_iovmm_locked(struct nvmap_client *c,
 #define nvmap_mru_lock(_s)	do { } while (0)
 #define nvmap_mru_unlock(_s)	do { } while (0)
 #define nvmap_mru_init(_s)	0
-#define nvmap_mru_destroy(_s)	do { } while (0)
 #define nvmap_mru_vm_size(_a)	tegra_iovmm_get_vm_size(_a)
 
 static inline void nvmap_mru_insert_locked(struct nvmap_share *share,
@@ -0,0 +1,148 @@
+/*
+ * drivers/video/tegra/nvmap/nvmap_pin_bench.c
+ *
+ * Pin throughput benchmark for nvmap IOVMM handles
+ *
+ * Copyright (c) 2011, NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <linux/err.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+#include <asm/div64.h>
+#include <asm/sizes.h>
+
+#include <mach/nvmap.h>
+
+#include "nvmap.h"
+
+/*
+ * pins and unpins a set of IOVMM handles the way a submit does, doubling
+ * the size of the set each round, and reports pins per second and how many
+ * pins had to remap an area which was evicted in between. the set is
+ * capped at the client's IOVMM limit, since a set which cannot be pinned
+ * even in an empty address space is a BUG in pin_array_locked().
+ */
+
+static unsigned int pin_bench_handles = 512;
+module_param(pin_bench_handles, uint, 0444);
+MODULE_PARM_DESC(pin_bench_handles, "Largest handle set to pin at once");
+
+static unsigned int pin_bench_size = SZ_64K;
+module_param(pin_bench_size, uint, 0444);
+MODULE_PARM_DESC(pin_bench_size, "Size of each handle in bytes");
+
+static unsigned int pin_bench_passes = 1000;
+module_param(pin_bench_passes, uint, 0444);
+MODULE_PARM_DESC(pin_bench_passes, "Pin/unpin passes over each handle set");
+
+static int pin_bench_round(struct nvmap_client *client, unsigned long *ids,
+			   unsigned int nr)
+{
+	u32 remaps = client->iovm_remaps;
+	ktime_t start = ktime_get();
+	unsigned int pass;
+	u64 ns, rate;
+	int err;
+
+	for (pass = 0; pass < pin_bench_passes; pass++) {
+		err = nvmap_pin_ids(client, nr, ids);
+		if (err)
+			return err;
+		nvmap_unpin_ids(client, nr, ids);
+		cond_resched();
+	}
+
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	rate = (u64)nr * pin_bench_passes * NSEC_PER_SEC;
+	do_div(rate, max_t(u64, ns, 1));
+	do_div(ns, (u64)nr * pin_bench_passes);
+
+	pr_info("nvmap_pin_bench: %4u handles: %llu pins/s, %llu ns/pin, "
+		"%u remaps\n", nr, rate, ns, client->iovm_remaps - remaps);
+	return 0;
+}
+
+static int __init nvmap_pin_bench(void)
+{
+	struct nvmap_client *client;
+	unsigned long *ids;
+	unsigned int nr = 0;
+	unsigned int round;
+	int err = 0;
+
+	if (!nvmap_dev || !pin_bench_handles || !pin_bench_size)
+		return -ENODEV;
+
+	client = nvmap_create_client(nvmap_dev, "pin_bench");
+	if (!client)
+		return -ENOMEM;
+
+	pin_bench_size = PAGE_ALIGN(pin_bench_size);
+	pin_bench_handles = min_t(size_t, pin_bench_handles,
+				  client->iovm_limit / pin_bench_size);
+	if (!pin_bench_handles) {
+		err = -EINVAL;
+		goto out_client;
+	}
+
+	ids = kcalloc(pin_bench_handles, sizeof(*ids), GFP_KERNEL);
+	if (!ids) {
+		err = -ENOMEM;
+		goto out_client;
+	}
+
+	for (round = 1; ; round = min(round * 2, pin_bench_handles)) {
+		for (; nr < round; nr++) {
+			struct nvmap_handle_ref *ref;
+
+			ref = nvmap_create_handle(client, pin_bench_size);
+			if (IS_ERR(ref)) {
+				err = PTR_ERR(ref);
+				goto out;
+			}
+			ids[nr] = nvmap_ref_to_id(ref);
+			err = nvmap_alloc_handle_id(client, ids[nr],
+						    NVMAP_HEAP_IOVMM, 0,
+						    NVMAP_HANDLE_WRITE_COMBINE);
+			if (err) {
+				nvmap_free_handle_id(client, ids[nr]);
+				goto out;
+			}
+		}
+
+		err = pin_bench_round(client, ids, nr);
+		if (err || nr == pin_bench_handles)
+			break;
+	}
+
+out:
+	if (err)
+		pr_err("nvmap_pin_bench: failed at %u handles: %d\n", nr, err);
+	while (nr)
+		nvmap_free_handle_id(client, ids[--nr]);
+	kfree(ids);
+out_client:
+	nvmap_client_put(client);
+	return err;
+}
+late_initcall(nvmap_pin_bench);
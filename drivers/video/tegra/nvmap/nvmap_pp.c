@@ -0,0 +1,284 @@
+/*
+ * drivers/video/tegra/nvmap/nvmap_pp.c
+ *
+ * Page pools for nvmap system memory handles
+ *
+ * Copyright (c) 2011, NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/kernel.h>
+#include <linux/jiffies.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/workqueue.h>
+
+#include <asm/cacheflush.h>
+#include <asm/outercache.h>
+
+#include <mach/nvmap.h>
+
+#include "nvmap.h"
+#include "nvmap_pp.h"
+#include "nvmap_common.h"
+
+/* every page allocated for a non-contiguous handle used to be allocated,
+ * split and cleaned from the inner and outer caches individually. the page
+ * pools keep a stock of pages which are already safe to map with a given
+ * cache attribute, so the common case of allocating a surface is just
+ * popping pages off a list.
+ *
+ * pages enter a pool either from the background refill worker, which
+ * cleans them in one batch, or when a handle with the same cache attribute
+ * is freed, which cleans them too since the handle may have been mapped
+ * cacheable at some point. under memory pressure the shrinker returns
+ * pooled pages to the OS, and the pools then do not grow again for
+ * NVMAP_POOL_BACKOFF, so that the next allocation does not immediately
+ * take back what reclaim just got.
+ */
+
+#define NVMAP_POOL_BACKOFF	(5 * HZ)
+
+static const char *pool_names[NVMAP_NUM_POOLS] = {
+	[NVMAP_HANDLE_UNCACHEABLE] = "uc",
+	[NVMAP_HANDLE_WRITE_COMBINE] = "wc",
+	[NVMAP_HANDLE_INNER_CACHEABLE] = "iwb",
+};
+
+static struct nvmap_device *pool_dev;
+
+/* must be called while holding the pool's lock */
+static bool pool_may_grow(struct nvmap_page_pool *pool)
+{
+	return time_after_eq(jiffies, pool->grow_after);
+}
+
+struct page *nvmap_page_pool_alloc(struct nvmap_page_pool *pool)
+{
+	struct page *page = NULL;
+	bool refill;
+
+	if (!pool)
+		return NULL;
+
+	mutex_lock(&pool->lock);
+	if (!list_empty(&pool->page_list)) {
+		page = list_first_entry(&pool->page_list, struct page, lru);
+		list_del(&page->lru);
+		pool->npages--;
+		pool->hits++;
+	} else {
+		pool->misses++;
+	}
+	refill = pool->npages < pool->max_pages / 2 && pool_may_grow(pool);
+	mutex_unlock(&pool->lock);
+
+	if (refill)
+		schedule_work(&pool->refill_work);
+
+	return page;
+}
+
+/* returns true if the pool took ownership of page */
+bool nvmap_page_pool_release(struct nvmap_page_pool *pool, struct page *page)
+{
+	bool ret = false;
+
+	if (!pool)
+		return false;
+
+	mutex_lock(&pool->lock);
+	if (pool->npages < pool->max_pages && pool_may_grow(pool)) {
+		list_add(&page->lru, &pool->page_list);
+		pool->npages++;
+		ret = true;
+	}
+	mutex_unlock(&pool->lock);
+	return ret;
+}
+
+static void nvmap_page_pool_refill(struct work_struct *work)
+{
+	struct nvmap_page_pool *pool;
+	struct page *page, *tmp;
+	unsigned int nr, i;
+	LIST_HEAD(pages);
+
+	pool = container_of(work, struct nvmap_page_pool, refill_work);
+
+	mutex_lock(&pool->lock);
+	nr = (pool->npages < pool->max_pages && pool_may_grow(pool)) ?
+		pool->max_pages - pool->npages : 0;
+	mutex_unlock(&pool->lock);
+
+	/* don't fight reclaim for memory: give up on the first failure */
+	for (i = 0; i < nr; i++) {
+		page = alloc_page(GFP_NVMAP | __GFP_NORETRY);
+		if (!page)
+			break;
+		list_add(&page->lru, &pages);
+	}
+	nr = i;
+
+	if (!nr)
+		return;
+
+	if (nr * PAGE_SIZE >= FLUSH_CLEAN_BY_SET_WAY_THRESHOLD) {
+		inner_flush_cache_all();
+		list_for_each_entry(page, &pages, lru)
+			outer_flush_range(page_to_phys(page),
+					  page_to_phys(page) + PAGE_SIZE);
+	} else {
+		list_for_each_entry(page, &pages, lru) {
+			__flush_dcache_page(page_mapping(page), page);
+			outer_flush_range(page_to_phys(page),
+					  page_to_phys(page) + PAGE_SIZE);
+		}
+	}
+
+	mutex_lock(&pool->lock);
+	list_for_each_entry_safe(page, tmp, &pages, lru) {
+		if (pool->npages >= pool->max_pages)
+			break;
+		list_move(&page->lru, &pool->page_list);
+		pool->npages++;
+		pool->refills++;
+	}
+	mutex_unlock(&pool->lock);
+
+	/* the pool may have been refilled by freed handles in the meantime */
+	list_for_each_entry_safe(page, tmp, &pages, lru) {
+		list_del(&page->lru);
+		__free_page(page);
+	}
+}
+
+static unsigned int nvmap_page_pool_free(struct nvmap_page_pool *pool,
+					 unsigned int nr)
+{
+	struct page *page;
+	unsigned int freed = 0;
+	LIST_HEAD(pages);
+
+	mutex_lock(&pool->lock);
+	while (freed < nr && !list_empty(&pool->page_list)) {
+		page = list_first_entry(&pool->page_list, struct page, lru);
+		list_move(&page->lru, &pages);
+		pool->npages--;
+		freed++;
+	}
+	pool->shrunk += freed;
+	mutex_unlock(&pool->lock);
+
+	while (!list_empty(&pages)) {
+		page = list_first_entry(&pages, struct page, lru);
+		list_del(&page->lru);
+		__free_page(page);
+	}
+	return freed;
+}
+
+static int nvmap_page_pool_shrink(struct shrinker *shrinker,
+				  int nr_to_scan, gfp_t gfp_mask)
+{
+	struct nvmap_page_pool *pool;
+	bool pressure = nr_to_scan > 0;
+	unsigned int i;
+	int total = 0;
+
+	if (!pool_dev)
+		return 0;
+
+	for (i = 0; i < NVMAP_NUM_POOLS; i++) {
+		pool = nvmap_get_page_pool(pool_dev, i);
+		if (pressure) {
+			mutex_lock(&pool->lock);
+			pool->grow_after = jiffies + NVMAP_POOL_BACKOFF;
+			mutex_unlock(&pool->lock);
+		}
+		if (nr_to_scan > 0)
+			nr_to_scan -= nvmap_page_pool_free(pool, nr_to_scan);
+		total += pool->npages;
+	}
+	return total;
+}
+
+static struct shrinker nvmap_page_pool_shrinker = {
+	.shrink = nvmap_page_pool_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+int nvmap_page_pools_init(struct nvmap_device *dev)
+{
+	unsigned int i;
+
+	for (i = 0; i < NVMAP_NUM_POOLS; i++) {
+		struct nvmap_page_pool *pool = nvmap_get_page_pool(dev, i);
+
+		mutex_init(&pool->lock);
+		INIT_LIST_HEAD(&pool->page_list);
+		INIT_WORK(&pool->refill_work, nvmap_page_pool_refill);
+		pool->max_pages = CONFIG_NVMAP_PAGE_POOL_SIZE;
+		pool->grow_after = jiffies;
+	}
+
+	pool_dev = dev;
+	register_shrinker(&nvmap_page_pool_shrinker);
+	return 0;
+}
+
+void nvmap_page_pools_debugfs_init(struct nvmap_device *dev,
+				   struct dentry *debug_root)
+{
+	struct dentry *pools_root;
+	unsigned int i;
+
+	pools_root = debugfs_create_dir("pagepool", debug_root);
+	if (IS_ERR_OR_NULL(pools_root))
+		return;
+
+	for (i = 0; i < NVMAP_NUM_POOLS; i++) {
+		struct nvmap_page_pool *pool = nvmap_get_page_pool(dev, i);
+		struct dentry *root;
+
+		root = debugfs_create_dir(pool_names[i], pools_root);
+		if (IS_ERR_OR_NULL(root))
+			continue;
+
+		debugfs_create_u32("max_pages", 0644, root, &pool->max_pages);
+		debugfs_create_u32("pages", 0444, root, &pool->npages);
+		debugfs_create_u32("hits", 0444, root, &pool->hits);
+		debugfs_create_u32("misses", 0444, root, &pool->misses);
+		debugfs_create_u32("refills", 0444, root, &pool->refills);
+		debugfs_create_u32("shrunk", 0444, root, &pool->shrunk);
+	}
+}
+
+void nvmap_page_pools_destroy(struct nvmap_device *dev)
+{
+	unsigned int i;
+
+	unregister_shrinker(&nvmap_page_pool_shrinker);
+	pool_dev = NULL;
+
+	for (i = 0; i < NVMAP_NUM_POOLS; i++) {
+		struct nvmap_page_pool *pool = nvmap_get_page_pool(dev, i);
+
+		cancel_work_sync(&pool->refill_work);
+		nvmap_page_pool_free(pool, pool->npages);
+	}
+}
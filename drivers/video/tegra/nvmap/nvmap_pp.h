@@ -0,0 +1,81 @@
+/*
+ * drivers/video/tegra/nvmap/nvmap_pp.h
+ *
+ * Page pools for nvmap system memory handles
+ *
+ * Copyright (c) 2011, NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __VIDEO_TEGRA_NVMAP_PP_H
+#define __VIDEO_TEGRA_NVMAP_PP_H
+
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/types.h>
+#include <linux/workqueue.h>
+
+#include <mach/nvmap.h>
+
+struct dentry;
+struct nvmap_device;
+struct page;
+
+/* one pool per non-cacheable attribute: indexed by the handle's
+ * NVMAP_HANDLE_UNCACHEABLE, _WRITE_COMBINE or _INNER_CACHEABLE flag */
+#define NVMAP_NUM_POOLS		(NVMAP_HANDLE_CACHEABLE)
+
+struct nvmap_page_pool {
+	struct mutex lock;
+	struct list_head page_list;	/* pages ready to be handed out */
+	u32 npages;
+	u32 max_pages;
+	u32 hits;			/* allocations served from the pool */
+	u32 misses;			/* allocations that went to the OS */
+	u32 refills;			/* pages added by the refill worker */
+	u32 shrunk;			/* pages returned to the OS by the shrinker */
+	unsigned long grow_after;	/* jiffies; set by the shrinker */
+	struct work_struct refill_work;
+};
+
+#ifdef CONFIG_NVMAP_PAGE_POOLS
+
+struct nvmap_page_pool *nvmap_get_page_pool(struct nvmap_device *dev,
+					    unsigned int flags);
+
+struct page *nvmap_page_pool_alloc(struct nvmap_page_pool *pool);
+
+bool nvmap_page_pool_release(struct nvmap_page_pool *pool, struct page *page);
+
+int nvmap_page_pools_init(struct nvmap_device *dev);
+
+void nvmap_page_pools_debugfs_init(struct nvmap_device *dev,
+				   struct dentry *debug_root);
+
+void nvmap_page_pools_destroy(struct nvmap_device *dev);
+
+#else
+
+#define nvmap_get_page_pool(_d, _f)		NULL
+#define nvmap_page_pool_alloc(_p)		NULL
+#define nvmap_page_pool_release(_p, _pg)	false
+#define nvmap_page_pools_init(_d)		0
+#define nvmap_page_pools_debugfs_init(_d, _r)	do { } while (0)
+#define nvmap_page_pools_destroy(_d)		do { } while (0)
+
+#endif
+
+#endif
@@ -106,7 +106,9 @@ static void dentry_iput(struct dentry * dentry)
 {
 	struct inode *inode = dentry->d_inode;
 	if (inode) {
+		write_seqcount_begin(&dentry->d_seq);
 		dentry->d_inode = NULL;
+		write_seqcount_end(&dentry->d_seq);
 		list_del_init(&dentry->d_alias);
 		spin_unlock(&dentry->d_lock);
 		spin_unlock(&dcache_lock);
@@ -951,6 +953,7 @@ struct dentry *d_alloc(struct dentry * parent, const struct qstr *name)
 	atomic_set(&dentry->d_count, 1);
 	dentry->d_flags = DCACHE_UNHASHED;
 	spin_lock_init(&dentry->d_lock);
+	seqcount_init(&dentry->d_seq);
 	dentry->d_inode = NULL;
 	dentry->d_parent = NULL;
 	dentry->d_sb = NULL;
@@ -1443,6 +1446,62 @@ next:
  	return found;
 }
 
+/**
+ * __d_lookup_rcu - search for a dentry without taking any locks
+ * @parent: parent dentry
+ * @name: qstr of name we wish to find
+ * @seq: returns the d_seq of the dentry found
+ *
+ * For the lockless part of the path walk.  The caller must hold
+ * rcu_read_lock() and must make sure @parent's d_op has neither d_hash nor
+ * d_compare.  No reference is taken: the returned dentry (and the name
+ * compare that picked it) is only valid until read_seqcount_retry() on its
+ * d_seq with the returned @seq says otherwise.
+ */
+struct dentry *__d_lookup_rcu(struct dentry *parent, struct qstr *name,
+			      unsigned *seq)
+{
+	unsigned int len = name->len;
+	unsigned int hash = name->hash;
+	const unsigned char *str = name->name;
+	struct hlist_head *head = d_hash(parent, hash);
+	struct hlist_node *node;
+	struct dentry *dentry;
+
+	hlist_for_each_entry_rcu(dentry, node, head, d_hash) {
+		const unsigned char *tname;
+		unsigned int tlen;
+		unsigned s;
+
+		if (dentry->d_name.hash != hash)
+			continue;
+seqretry:
+		s = read_seqcount_begin(&dentry->d_seq);
+		if (dentry->d_parent != parent)
+			continue;
+		if (d_unhashed(dentry))
+			continue;
+		tlen = dentry->d_name.len;
+		tname = dentry->d_name.name;
+		if (read_seqcount_retry(&dentry->d_seq, s)) {
+			cpu_relax();
+			goto seqretry;
+		}
+		/*
+		 * A concurrent d_move() may still be rewriting d_iname under
+		 * us; a torn compare is caught by the caller's d_seq check.
+		 * An external name is only freed after a grace period.
+		 */
+		if (tlen != len)
+			continue;
+		if (memcmp(tname, str, len))
+			continue;
+		*seq = s;
+		return dentry;
+	}
+	return NULL;
+}
+
 /**
  * d_hash_and_lookup - hash the qstr then search for a dentry
  * @dir: Directory to search in
@@ -1676,6 +1735,12 @@ static void d_move_locked(struct dentry * dentry, struct dentry * target)
 		spin_lock_nested(&target->d_lock, DENTRY_D_LOCK_NESTED);
 	}
 
+	/* Unhash the target: dput() will then get rid of it */
+	__d_drop(target);
+
+	write_seqcount_begin(&dentry->d_seq);
+	write_seqcount_begin(&target->d_seq);
+
 	/* Move the dentry to the target hash queue, if on different bucket */
 	if (d_unhashed(dentry))
 		goto already_unhashed;
@@ -1686,9 +1751,6 @@ already_unhashed:
 	list = d_hash(target->d_parent, target->d_name.hash);
 	__d_rehash(dentry, list);
 
-	/* Unhash the target: dput() will then get rid of it */
-	__d_drop(target);
-
 	list_del(&dentry->d_u.d_child);
 	list_del(&target->d_u.d_child);
 
@@ -1709,6 +1771,8 @@ already_unhashed:
 	}
 
 	list_add(&dentry->d_u.d_child, &dentry->d_parent->d_subdirs);
+	write_seqcount_end(&target->d_seq);
+	write_seqcount_end(&dentry->d_seq);
 	spin_unlock(&target->d_lock);
 	fsnotify_d_move(dentry);
 	spin_unlock(&dentry->d_lock);
@@ -1803,6 +1867,9 @@ static void __d_materialise_dentry(struct dentry *dentry, struct dentry *anon)
 {
 	struct dentry *dparent, *aparent;
 
+	write_seqcount_begin(&dentry->d_seq);
+	write_seqcount_begin(&anon->d_seq);
+
 	switch_names(dentry, anon);
 	swap(dentry->d_name.hash, anon->d_name.hash);
 
@@ -1823,6 +1890,9 @@ static void __d_materialise_dentry(struct dentry *dentry, struct dentry *anon)
 	else
 		INIT_LIST_HEAD(&anon->d_u.d_child);
 
+	write_seqcount_end(&anon->d_seq);
+	write_seqcount_end(&dentry->d_seq);
+
 	anon->d_flags &= ~DCACHE_DISCONNECTED;
 }
 
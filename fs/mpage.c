@@ -681,6 +681,7 @@ int
 mpage_writepages(struct address_space *mapping,
 		struct writeback_control *wbc, get_block_t get_block)
 {
+	struct blk_plug plug;
 	int ret;
 
 	if (!get_block)
@@ -693,9 +694,11 @@ mpage_writepages(struct address_space *mapping,
 			.use_writepage = 1,
 		};
 
+		blk_start_plug(&plug);
 		ret = write_cache_pages(mapping, wbc, __mpage_writepage, &mpd);
 		if (mpd.bio)
 			mpage_bio_submit(WRITE, mpd.bio);
+		blk_finish_plug(&plug);
 	}
 	return ret;
 }
@@ -481,6 +481,182 @@ ok:
 	return security_inode_permission(inode, MAY_EXEC);
 }
 
+#ifndef CONFIG_SECURITY
+/*
+ * Lockless path walk.
+ *
+ * Intermediate components that are already in the dcache are resolved under
+ * rcu_read_lock() and vfsmount_lock, without touching d_lock, d_count or
+ * mnt_count.  Every dentry we step on is validated against its d_seq, and
+ * the one we stop at is turned into a real reference before the ordinary
+ * walk takes over from there.  Anything that may block, or that we do not
+ * know how to do without references (.., symlinks, ->d_hash, ->d_compare,
+ * ->d_revalidate, ->permission, ACLs, dcache misses), simply ends the
+ * lockless part early.
+ *
+ * LSM hooks may sleep and look at i_security, which is not RCU-freed, so
+ * this is only built without CONFIG_SECURITY.
+ */
+
+/*
+ * Inodes without ->destroy_inode are RCU-freed by destroy_inode(); others
+ * only if the filesystem says so.
+ */
+static inline int inode_rcu_safe(struct super_block *sb)
+{
+	return !sb->s_op->destroy_inode ||
+		(sb->s_type->fs_flags & FS_RCU_INODES);
+}
+
+/*
+ * exec_permission() for the lockless walk: returns 0 only if the DAC bits
+ * alone grant search permission; everything else is left to the ordinary
+ * walk, which also does the capability checks.
+ */
+static inline int exec_permission_rcu(struct inode *inode)
+{
+	if (inode->i_op->permission)
+		return -ECHILD;
+	if (IS_POSIXACL(inode) && inode->i_op->check_acl)
+		return -ECHILD;
+	return acl_permission_check(inode, MAY_EXEC, NULL);
+}
+
+/*
+ * Walk as many leading components of *@namep as possible without taking
+ * references, then move nd->path and *@namep past them.  The last
+ * component is always left to the caller.  If the dentry we stopped at
+ * changed under us, nothing is moved and the caller redoes the whole walk.
+ */
+static void path_walk_rcu(const char **namep, struct nameidata *nd)
+{
+	const char *name = *namep;
+	struct vfsmount *mnt = nd->path.mnt;
+	struct dentry *dentry = nd->path.dentry;
+	struct inode *inode;
+	unsigned seq;
+
+	if (nd->flags & LOOKUP_REVAL)
+		return;
+
+	br_read_lock(vfsmount_lock);
+	rcu_read_lock();
+	seq = read_seqcount_begin(&dentry->d_seq);
+	inode = dentry->d_inode;
+
+	for (;;) {
+		struct dentry *child;
+		unsigned long hash;
+		struct qstr this;
+		unsigned int c;
+		unsigned cseq;
+		const char *p;
+
+		if (exec_permission_rcu(inode))
+			break;
+
+		this.name = p = name;
+		c = *(const unsigned char *)p;
+
+		hash = init_name_hash();
+		do {
+			p++;
+			hash = partial_name_hash(c, hash);
+			c = *(const unsigned char *)p;
+		} while (c && (c != '/'));
+		this.len = p - (const char *) this.name;
+		this.hash = end_name_hash(hash);
+
+		/* the last component is the caller's */
+		if (!c)
+			break;
+		while (*++p == '/');
+		if (!*p)
+			break;
+
+		if (this.name[0] == '.') {
+			if (this.len == 1) {
+				name = p;
+				continue;
+			}
+			if (this.len == 2 && this.name[1] == '.')
+				break;
+		}
+
+		if (dentry->d_op &&
+		    (dentry->d_op->d_hash || dentry->d_op->d_compare))
+			break;
+		child = __d_lookup_rcu(dentry, &this, &cseq);
+		if (!child)
+			break;
+		/* is the inode we checked still that of our directory? */
+		if (read_seqcount_retry(&dentry->d_seq, seq))
+			break;
+		if (child->d_op && child->d_op->d_revalidate)
+			break;
+
+		while (d_mountpoint(child)) {
+			struct vfsmount *mounted;
+
+			mounted = __lookup_mnt(mnt, child, 1);
+			if (!mounted)
+				break;
+			if (read_seqcount_retry(&child->d_seq, cseq))
+				goto out;
+			mnt = mounted;
+			child = mounted->mnt_root;
+			cseq = read_seqcount_begin(&child->d_seq);
+		}
+
+		inode = child->d_inode;
+		if (!inode || read_seqcount_retry(&child->d_seq, cseq))
+			break;
+		if (!inode_rcu_safe(child->d_sb))
+			break;
+		if (inode->i_op->follow_link || !inode->i_op->lookup)
+			break;
+
+		dentry = child;
+		seq = cseq;
+		name = p;
+	}
+out:
+	if (name == *namep)
+		goto unlock;
+
+	/*
+	 * Legitimize where we got to.  d_seq is bumped under d_lock before
+	 * a dentry can be unhashed or killed, so if it still matches, the
+	 * dentry is live and __d_lookup()'s way of grabbing it is safe.  mnt
+	 * cannot lose its last reference while we hold vfsmount_lock.
+	 */
+	spin_lock(&dentry->d_lock);
+	if (read_seqcount_retry(&dentry->d_seq, seq)) {
+		spin_unlock(&dentry->d_lock);
+		goto unlock;
+	}
+	atomic_inc(&dentry->d_count);
+	spin_unlock(&dentry->d_lock);
+	mntget(mnt);
+	rcu_read_unlock();
+	br_read_unlock(vfsmount_lock);
+
+	path_put(&nd->path);
+	nd->path.mnt = mnt;
+	nd->path.dentry = dentry;
+	*namep = name;
+	return;
+
+unlock:
+	rcu_read_unlock();
+	br_read_unlock(vfsmount_lock);
+}
+#else
+static inline void path_walk_rcu(const char **namep, struct nameidata *nd)
+{
+}
+#endif
+
 static __always_inline void set_root(struct nameidata *nd)
 {
 	if (!nd->root.mnt)
@@ -826,6 +1002,8 @@ static int link_path_walk(const char *name, struct nameidata *nd)
 	if (!*name)
 		goto return_reval;
 
+	path_walk_rcu(&name, nd);
+
 	inode = nd->path.dentry->d_inode;
 	if (nd->depth)
 		lookup_flags = LOOKUP_FOLLOW | (nd->flags & LOOKUP_CONTINUE);
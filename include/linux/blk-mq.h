@@ -0,0 +1,112 @@
+#ifndef BLK_MQ_H
+#define BLK_MQ_H
+/*
+ * Multi-queue block submission.
+ *
+ * A multi-queue device has no request_fn, no elevator and no use for
+ * ->queue_lock.  Each CPU submits into its own software queue; software
+ * queues are mapped onto the hardware dispatch queues the driver asked
+ * for, and requests come from per hardware queue pools whose tags are
+ * allocated with atomic bitops.  Bios are merged only into requests that
+ * have not reached the driver yet, and only if BLK_MQ_F_SHOULD_MERGE is
+ * set.  Barriers are not supported and fail with -EOPNOTSUPP, like on any
+ * queue without an ordered mode.
+ *
+ * ->queue_rq() runs in process context, possibly on several CPUs at once
+ * for the same hardware queue, and must not sleep.  There is no request
+ * timeout handling: the driver owns a request until it ends it with
+ * blk_mq_end_io(), directly or through blk_complete_request().
+ */
+
+#include <linux/blkdev.h>
+
+struct blk_mq_hw_ctx {
+	spinlock_t		lock;		/* protects ->dispatch */
+	struct list_head	dispatch;	/* requests the driver bounced */
+
+	unsigned long		state;		/* BLK_MQ_S_* */
+	unsigned long		flags;		/* BLK_MQ_F_* */
+	struct work_struct	run_work;
+
+	struct request_queue	*queue;
+	void			*driver_data;
+	unsigned int		queue_num;
+
+	unsigned int		nr_ctx;
+	struct blk_mq_ctx	**ctxs;
+	unsigned long		*ctx_map;	/* software queues with work */
+
+	unsigned int		queue_depth;
+	struct request		**rqs;
+	unsigned long		*tag_map;
+	wait_queue_head_t	tag_wait;
+};
+
+typedef int (queue_rq_fn)(struct blk_mq_hw_ctx *, struct request *);
+typedef struct blk_mq_hw_ctx *(map_queue_fn)(struct request_queue *,
+					      const int);
+typedef int (init_hctx_fn)(struct blk_mq_hw_ctx *, void *, unsigned int);
+typedef void (exit_hctx_fn)(struct blk_mq_hw_ctx *, unsigned int);
+
+struct blk_mq_ops {
+	/* hand one request to the hardware, returns BLK_MQ_RQ_QUEUE_* */
+	queue_rq_fn		*queue_rq;
+
+	/* pick the hardware queue for a CPU, usually blk_mq_map_queue() */
+	map_queue_fn		*map_queue;
+
+	/* optional, run from softirq after blk_complete_request() */
+	softirq_done_fn		*complete;
+
+	/* optional per hardware queue setup and teardown */
+	init_hctx_fn		*init_hctx;
+	exit_hctx_fn		*exit_hctx;
+};
+
+struct blk_mq_reg {
+	struct blk_mq_ops	*ops;
+	unsigned int		nr_hw_queues;
+	unsigned int		queue_depth;	/* per hardware queue */
+	unsigned int		cmd_size;	/* per-request driver data */
+	int			numa_node;
+	unsigned int		flags;		/* BLK_MQ_F_* */
+};
+
+enum {
+	BLK_MQ_RQ_QUEUE_OK	= 0,	/* queued fine */
+	BLK_MQ_RQ_QUEUE_BUSY	= 1,	/* requeue and retry later */
+	BLK_MQ_RQ_QUEUE_ERROR	= 2,	/* end the request with -EIO */
+
+	BLK_MQ_F_SHOULD_MERGE	= 1 << 0,
+
+	BLK_MQ_S_STOPPED	= 0,
+
+	BLK_MQ_MAX_DEPTH	= 2048,
+};
+
+extern struct request_queue *blk_mq_init_queue(struct blk_mq_reg *, void *);
+extern void blk_mq_free_queue(struct request_queue *);
+
+extern struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *,
+					      const int);
+extern void blk_mq_insert_request(struct request *, bool);
+extern void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *, bool);
+extern void blk_mq_run_queues(struct request_queue *, bool);
+extern void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *);
+extern void blk_mq_start_hw_queue(struct blk_mq_hw_ctx *);
+extern void blk_mq_start_stopped_hw_queues(struct request_queue *);
+extern void blk_mq_end_io(struct request *, int);
+
+/*
+ * Driver command data lives right after the request.
+ */
+static inline void *blk_mq_rq_to_pdu(struct request *rq)
+{
+	return (void *) rq + sizeof(*rq);
+}
+
+#define queue_for_each_hw_ctx(q, hctx, i)				\
+	for ((i) = 0; (i) < (q)->nr_hw_queues &&			\
+	     ({ hctx = (q)->queue_hw_ctx[i]; 1; }); (i)++)
+
+#endif /* BLK_MQ_H */
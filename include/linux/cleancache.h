@@ -0,0 +1,86 @@
+#ifndef _LINUX_CLEANCACHE_H
+#define _LINUX_CLEANCACHE_H
+/*
+ * Compressed cache for clean page cache pages.
+ *
+ * Reclaim compresses clean file pages as it evicts them; a later page
+ * cache insertion at the same index takes the copy back, so the new page
+ * comes out of add_to_page_cache() already uptodate.  Since an entry can
+ * only exist while its page is absent from the page cache, it goes stale
+ * only when the file changes behind the page cache's back: truncation,
+ * invalidation and direct I/O drop the entries of the range they touch.
+ */
+
+#include <linux/fs.h>
+#include <linux/mm_types.h>
+
+struct cleancache_entry;
+struct ctl_table;
+
+#ifdef CONFIG_CLEANCACHE
+
+extern unsigned long sysctl_cleancache_kbytes;
+extern int cleancache_sysctl_handler(struct ctl_table *, int,
+				     void __user *, size_t *, loff_t *);
+
+extern struct cleancache_entry *
+cleancache_prepare(struct address_space *mapping, struct page *page);
+extern void cleancache_put(struct address_space *mapping, pgoff_t index,
+			   struct cleancache_entry *entry);
+extern void cleancache_discard(struct cleancache_entry *entry);
+extern struct cleancache_entry *
+cleancache_take(struct address_space *mapping, pgoff_t index);
+extern void cleancache_restore(struct page *page,
+			       struct cleancache_entry *entry);
+extern int cleancache_readahead(struct address_space *mapping, pgoff_t index);
+extern void cleancache_invalidate_range(struct address_space *mapping,
+					pgoff_t start, pgoff_t end);
+extern void cleancache_get_stats(unsigned long *pages, unsigned long *bytes);
+
+#else /* CONFIG_CLEANCACHE */
+
+static inline struct cleancache_entry *
+cleancache_prepare(struct address_space *mapping, struct page *page)
+{
+	return NULL;
+}
+
+static inline void cleancache_put(struct address_space *mapping,
+				  pgoff_t index, struct cleancache_entry *entry)
+{
+}
+
+static inline void cleancache_discard(struct cleancache_entry *entry)
+{
+}
+
+static inline struct cleancache_entry *
+cleancache_take(struct address_space *mapping, pgoff_t index)
+{
+	return NULL;
+}
+
+static inline void cleancache_restore(struct page *page,
+				      struct cleancache_entry *entry)
+{
+}
+
+static inline int cleancache_readahead(struct address_space *mapping,
+				       pgoff_t index)
+{
+	return 0;
+}
+
+static inline void cleancache_invalidate_range(struct address_space *mapping,
+					       pgoff_t start, pgoff_t end)
+{
+}
+
+#endif /* CONFIG_CLEANCACHE */
+
+static inline void cleancache_invalidate_mapping(struct address_space *mapping)
+{
+	cleancache_invalidate_range(mapping, 0, ~0UL);
+}
+
+#endif /* _LINUX_CLEANCACHE_H */
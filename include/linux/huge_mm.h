@@ -0,0 +1,106 @@
+#ifndef _LINUX_HUGE_MM_H
+#define _LINUX_HUGE_MM_H
+/*
+ * Transparent huge pages for anonymous memory.
+ *
+ * Anonymous faults in eligible vmas allocate a naturally aligned,
+ * physically contiguous block of THP_NR pages and map all of it at once;
+ * khugepaged later copies scattered groups into such blocks.  The pages
+ * are ordinary order-0 pages mapped by ordinary ptes, so rmap, swap,
+ * migration, mprotect and munmap need no special cases: it is up to the
+ * architecture to map a fully populated block with one TLB entry
+ * (pte_mklarge()) and to go back to small TLB entries as soon as any of
+ * its ptes changes.
+ */
+
+#include <linux/mm.h>
+#include <linux/sched.h>
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+
+#define THP_ORDER	(PTE_LARGE_SHIFT - PAGE_SHIFT)
+#define THP_NR		(1 << THP_ORDER)
+#define THP_SIZE	(1UL << PTE_LARGE_SHIFT)
+#define THP_MASK	(~(THP_SIZE - 1))
+
+enum transparent_hugepage_flag {
+	TRANSPARENT_HUGEPAGE_FLAG,
+	TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG,
+	TRANSPARENT_HUGEPAGE_DEFRAG_FLAG,
+	TRANSPARENT_HUGEPAGE_DEFRAG_REQ_MADV_FLAG,
+};
+
+extern unsigned long transparent_hugepage_flags;
+
+#define transparent_hugepage_test(vma, __flag, __req_madv_flag)		\
+	((transparent_hugepage_flags & (1 << (__flag))) ||		\
+	 ((transparent_hugepage_flags & (1 << (__req_madv_flag))) &&	\
+	  ((vma)->vm_flags & VM_HUGEPAGE)))
+
+extern int hugepage_vma_check(struct vm_area_struct *vma);
+extern struct page *alloc_transhuge_page(struct vm_area_struct *vma,
+					 unsigned long haddr);
+extern int hugepage_madvise(struct vm_area_struct *vma,
+			    unsigned long *vm_flags, int advice);
+extern int __khugepaged_enter(struct mm_struct *mm);
+extern void __khugepaged_exit(struct mm_struct *mm);
+
+static inline int transparent_hugepage_enabled(struct vm_area_struct *vma)
+{
+	return transparent_hugepage_test(vma, TRANSPARENT_HUGEPAGE_FLAG,
+					 TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG) &&
+		hugepage_vma_check(vma);
+}
+
+static inline int khugepaged_fork(struct mm_struct *mm, struct mm_struct *oldmm)
+{
+	if (test_bit(MMF_VM_HUGEPAGE, &oldmm->flags))
+		return __khugepaged_enter(mm);
+	return 0;
+}
+
+static inline void khugepaged_exit(struct mm_struct *mm)
+{
+	if (test_bit(MMF_VM_HUGEPAGE, &mm->flags))
+		__khugepaged_exit(mm);
+}
+
+static inline int khugepaged_enter(struct vm_area_struct *vma)
+{
+	if (!test_bit(MMF_VM_HUGEPAGE, &vma->vm_mm->flags) &&
+	    transparent_hugepage_enabled(vma))
+		return __khugepaged_enter(vma->vm_mm);
+	return 0;
+}
+
+#else /* CONFIG_TRANSPARENT_HUGEPAGE */
+
+static inline int transparent_hugepage_enabled(struct vm_area_struct *vma)
+{
+	return 0;
+}
+
+static inline int hugepage_madvise(struct vm_area_struct *vma,
+				   unsigned long *vm_flags, int advice)
+{
+	BUG();
+	return 0;
+}
+
+static inline int khugepaged_fork(struct mm_struct *mm, struct mm_struct *oldmm)
+{
+	return 0;
+}
+
+static inline void khugepaged_exit(struct mm_struct *mm)
+{
+}
+
+static inline int khugepaged_enter(struct vm_area_struct *vma)
+{
+	return 0;
+}
+
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
+#endif /* _LINUX_HUGE_MM_H */
@@ -49,6 +49,14 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 #endif
 #ifdef CONFIG_HUGETLB_PAGE
 		HTLB_BUDDY_PGALLOC, HTLB_BUDDY_PGALLOC_FAIL,
+#endif
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+		THP_FAULT_ALLOC, THP_FAULT_FALLBACK,
+		THP_COLLAPSE_ALLOC, THP_COLLAPSE_ALLOC_FAILED,
+		THP_SPLIT,
+#endif
+#ifdef CONFIG_CLEANCACHE
+		CLEANCACHE_PUT, CLEANCACHE_HIT, CLEANCACHE_EVICT,
 #endif
 		UNEVICTABLE_PGCULLED,	/* culled to noreclaim list */
 		UNEVICTABLE_PGSCANNED,	/* scanned for reclaimability */
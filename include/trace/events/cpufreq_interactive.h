@@ -0,0 +1,105 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM cpufreq_interactive
+
+#if !defined(_TRACE_CPUFREQ_INTERACTIVE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_CPUFREQ_INTERACTIVE_H
+
+#include <linux/tracepoint.h>
+
+/**
+ * cpufreq_interactive_target - called when the timer picks a new speed
+ * @cpu:	cpu the load was sampled on
+ * @load:	load used for the decision, in percent
+ * @curtarg:	previous target speed, in kHz
+ * @targ:	new target speed, in kHz
+ *
+ * Allows to see what load drove each speed change.
+ */
+TRACE_EVENT(cpufreq_interactive_target,
+
+	TP_PROTO(unsigned int cpu, int load, unsigned int curtarg,
+		 unsigned int targ),
+
+	TP_ARGS(cpu, load, curtarg, targ),
+
+	TP_STRUCT__entry(
+		__field( unsigned int,	cpu	)
+		__field( int,		load	)
+		__field( unsigned int,	curtarg	)
+		__field( unsigned int,	targ	)
+	),
+
+	TP_fast_assign(
+		__entry->cpu		= cpu;
+		__entry->load		= load;
+		__entry->curtarg	= curtarg;
+		__entry->targ		= targ;
+	),
+
+	TP_printk("cpu=%u, load=%d, curtarg=%u, targ=%u",
+		  __entry->cpu, __entry->load, __entry->curtarg, __entry->targ)
+);
+
+/**
+ * cpufreq_interactive_setspeed - called after the cpufreq driver was asked
+ * to run at a new speed
+ * @cpu:	cpu whose speed was set
+ * @targ:	requested speed, in kHz
+ * @actual:	speed the policy reports afterwards, in kHz
+ *
+ * Together with cpufreq_interactive_boost, shows the delay from an input
+ * event to the clock actually going up.
+ */
+TRACE_EVENT(cpufreq_interactive_setspeed,
+
+	TP_PROTO(unsigned int cpu, unsigned int targ, unsigned int actual),
+
+	TP_ARGS(cpu, targ, actual),
+
+	TP_STRUCT__entry(
+		__field( unsigned int,	cpu	)
+		__field( unsigned int,	targ	)
+		__field( unsigned int,	actual	)
+	),
+
+	TP_fast_assign(
+		__entry->cpu		= cpu;
+		__entry->targ		= targ;
+		__entry->actual		= actual;
+	),
+
+	TP_printk("cpu=%u, targ=%u, actual=%u",
+		  __entry->cpu, __entry->targ, __entry->actual)
+);
+
+/**
+ * cpufreq_interactive_boost - called when a floor raised the target speed
+ * @reason:	"input" for an input event, "qos" for a PM_QOS_CPU_FREQ_MIN
+ *		request
+ * @freq:	floor, in kHz
+ *
+ * Only fires when at least one cpu was below the floor.
+ */
+TRACE_EVENT(cpufreq_interactive_boost,
+
+	TP_PROTO(const char *reason, unsigned int freq),
+
+	TP_ARGS(reason, freq),
+
+	TP_STRUCT__entry(
+		__string( reason,	reason	)
+		__field( unsigned int,	freq	)
+	),
+
+	TP_fast_assign(
+		__assign_str(reason, reason);
+		__entry->freq		= freq;
+	),
+
+	TP_printk("reason=%s, freq=%u", __get_str(reason), __entry->freq)
+);
+
+#endif /*  _TRACE_CPUFREQ_INTERACTIVE_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
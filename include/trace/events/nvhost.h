@@ -0,0 +1,72 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM nvhost
+
+#if !defined(_TRACE_NVHOST_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_NVHOST_H
+
+#include <linux/tracepoint.h>
+
+/**
+ * nvhost_cdma_end - called when a submit has been queued to command DMA
+ * @name:	channel name
+ * @slots:	push buffer slots used by the submit
+ * @pb_used:	push buffer slots in use after the submit
+ *
+ * Allows to track push buffer occupancy per submit.
+ */
+TRACE_EVENT(nvhost_cdma_end,
+
+	TP_PROTO(const char *name, unsigned int slots, unsigned int pb_used),
+
+	TP_ARGS(name, slots, pb_used),
+
+	TP_STRUCT__entry(
+		__field( const char *,	name	)
+		__field( unsigned int,	slots	)
+		__field( unsigned int,	pb_used	)
+	),
+
+	TP_fast_assign(
+		__entry->name		= name;
+		__entry->slots		= slots;
+		__entry->pb_used	= pb_used;
+	),
+
+	TP_printk("name=%s, slots=%u, pb_used=%u",
+		  __entry->name, __entry->slots, __entry->pb_used)
+);
+
+/**
+ * nvhost_cdma_stall - called when a submitter slept waiting on command DMA
+ * @name:	channel name
+ * @event:	what was waited for (push buffer space, sync queue space, ...)
+ * @us:		time slept, in microseconds
+ *
+ * Allows to track how often and how long submitters block.
+ */
+TRACE_EVENT(nvhost_cdma_stall,
+
+	TP_PROTO(const char *name, int event, u32 us),
+
+	TP_ARGS(name, event, us),
+
+	TP_STRUCT__entry(
+		__field( const char *,	name	)
+		__field( int,		event	)
+		__field( u32,		us	)
+	),
+
+	TP_fast_assign(
+		__entry->name		= name;
+		__entry->event		= event;
+		__entry->us		= us;
+	),
+
+	TP_printk("name=%s, event=%d, us=%u",
+		  __entry->name, __entry->event, __entry->us)
+);
+
+#endif /*  _TRACE_NVHOST_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
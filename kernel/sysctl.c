@@ -38,6 +38,7 @@
 #include <linux/writeback.h>
 #include <linux/ratelimit.h>
 #include <linux/compaction.h>
+#include <linux/cleancache.h>
 #include <linux/hugetlb.h>
 #include <linux/initrd.h>
 #include <linux/key.h>
@@ -1149,6 +1150,15 @@ static struct ctl_table vm_table[] = {
 	},
 
 #endif /* CONFIG_COMPACTION */
+#ifdef CONFIG_CLEANCACHE
+	{
+		.procname	= "cleancache_kbytes",
+		.data		= &sysctl_cleancache_kbytes,
+		.maxlen		= sizeof(sysctl_cleancache_kbytes),
+		.mode		= 0644,
+		.proc_handler	= cleancache_sysctl_handler,
+	},
+#endif
 	{
 		.procname	= "min_free_kbytes",
 		.data		= &min_free_kbytes,
@@ -0,0 +1,483 @@
+/*
+ *  linux/mm/cleancache.c
+ *
+ *  Compressed cache for evicted clean page cache pages.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ *
+ * Entries live in a single rbtree sorted by (mapping, index), so that
+ * the entries of a file range are adjacent, and on an LRU list from which
+ * the oldest ones are dropped when the pool outgrows cleancache_kbytes or
+ * when the shrinker is asked for memory.
+ *
+ * Entries are inserted and taken out again under the tree_lock of their
+ * mapping (see __remove_mapping() and add_to_page_cache_locked()), which
+ * is what keeps a page and its compressed copy from both existing.  The
+ * tree_lock is taken from interrupts (end of writeback), so cleancache_lock
+ * nests inside it with interrupts off, and every other path has to
+ * disable them too.  Those paths work in batches of CLEANCACHE_BATCH
+ * entries to keep the interrupts-off sections short.
+ */
+
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/highmem.h>
+#include <linux/pagemap.h>
+#include <linux/lzo.h>
+#include <linux/percpu.h>
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/sched.h>
+#include <linux/swap.h>
+#include <linux/sysctl.h>
+#include <linux/vmstat.h>
+#include <linux/cleancache.h>
+
+struct cleancache_entry {
+	struct rb_node node;
+	struct list_head lru;
+	struct address_space *mapping;
+	pgoff_t index;
+	size_t len;
+	unsigned char data[0];
+};
+
+/* Pages that do not compress below this are not worth keeping */
+#define CLEANCACHE_MAX_LEN	(PAGE_SIZE * 3 / 4)
+
+/* Entries dropped per cleancache_lock hold */
+#define CLEANCACHE_BATCH	32
+
+unsigned long sysctl_cleancache_kbytes __read_mostly;
+
+static DEFINE_SPINLOCK(cleancache_lock);
+static struct rb_root cleancache_root = RB_ROOT;
+static LIST_HEAD(cleancache_lru);
+static unsigned long cleancache_pages;
+static unsigned long cleancache_bytes;
+
+static DEFINE_PER_CPU(void *, cleancache_wrkmem);
+static DEFINE_PER_CPU(unsigned char *, cleancache_dst);
+static int cleancache_ready __read_mostly;
+
+static inline size_t entry_size(struct cleancache_entry *entry)
+{
+	return ksize(entry);
+}
+
+static int entry_cmp(struct address_space *mapping, pgoff_t index,
+		     struct cleancache_entry *entry)
+{
+	if (mapping != entry->mapping)
+		return mapping < entry->mapping ? -1 : 1;
+	if (index != entry->index)
+		return index < entry->index ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Returns the first entry at or after (@mapping, @index).
+ */
+static struct cleancache_entry *entry_lookup(struct address_space *mapping,
+					     pgoff_t index)
+{
+	struct rb_node *node = cleancache_root.rb_node;
+	struct cleancache_entry *found = NULL;
+
+	while (node) {
+		struct cleancache_entry *entry;
+
+		entry = rb_entry(node, struct cleancache_entry, node);
+		if (entry_cmp(mapping, index, entry) <= 0) {
+			found = entry;
+			node = node->rb_left;
+		} else
+			node = node->rb_right;
+	}
+	return found;
+}
+
+static struct cleancache_entry *entry_find(struct address_space *mapping,
+					   pgoff_t index)
+{
+	struct cleancache_entry *entry = entry_lookup(mapping, index);
+
+	if (entry && entry->mapping == mapping && entry->index == index)
+		return entry;
+	return NULL;
+}
+
+static void entry_unlink(struct cleancache_entry *entry)
+{
+	rb_erase(&entry->node, &cleancache_root);
+	list_del(&entry->lru);
+	entry->mapping->nrcleancache--;
+	cleancache_pages--;
+	cleancache_bytes -= entry_size(entry);
+}
+
+/*
+ * Drop the oldest entries, at most @nr of them, until the pool fits in
+ * @limit bytes.  Called with cleancache_lock held, returns the number
+ * of entries dropped.
+ */
+static unsigned long cleancache_evict(unsigned long limit, unsigned long nr)
+{
+	unsigned long evicted = 0;
+
+	while (cleancache_bytes > limit && evicted < nr) {
+		struct cleancache_entry *entry;
+
+		entry = list_entry(cleancache_lru.prev,
+				   struct cleancache_entry, lru);
+		entry_unlink(entry);
+		kfree(entry);
+		evicted++;
+	}
+	if (evicted)
+		count_vm_events(CLEANCACHE_EVICT, evicted);
+	return evicted;
+}
+
+/*
+ * Shrink the pool to @limit bytes from a context that can sleep.
+ */
+static void cleancache_evict_to(unsigned long limit)
+{
+	unsigned long flags, evicted;
+
+	do {
+		spin_lock_irqsave(&cleancache_lock, flags);
+		evicted = cleancache_evict(limit, CLEANCACHE_BATCH);
+		spin_unlock_irqrestore(&cleancache_lock, flags);
+		cond_resched();
+	} while (evicted == CLEANCACHE_BATCH);
+}
+
+/**
+ * cleancache_prepare - compress a clean page that reclaim is evicting
+ * @mapping: the page's mapping
+ * @page: the locked page
+ *
+ * Done before __remove_mapping() takes the tree_lock, so that only the
+ * insertion happens with interrupts off.  Returns NULL if the page is
+ * not worth keeping.
+ */
+struct cleancache_entry *cleancache_prepare(struct address_space *mapping,
+					    struct page *page)
+{
+	struct cleancache_entry *entry = NULL;
+	unsigned char *src, *dst;
+	size_t len;
+	int ret;
+
+	if (!cleancache_ready || !sysctl_cleancache_kbytes ||
+	    !PageUptodate(page) || PageDirty(page) || PageSwapBacked(page))
+		return NULL;
+	/*
+	 * Only regular inode data mappings: end_writeback() drops their
+	 * entries before the address_space can be reused.  Block device
+	 * pages are left out: a filesystem rewrites the same blocks through
+	 * its file mappings, and nothing would drop the stale bdev copy.
+	 */
+	if (!mapping->host || mapping != &mapping->host->i_data ||
+	    S_ISBLK(mapping->host->i_mode))
+		return NULL;
+
+	dst = get_cpu_var(cleancache_dst);
+	src = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_1_compress(src, PAGE_SIZE, dst, &len,
+			       __get_cpu_var(cleancache_wrkmem));
+	kunmap_atomic(src, KM_USER0);
+
+	if (ret == LZO_E_OK && len <= CLEANCACHE_MAX_LEN) {
+		entry = kmalloc(sizeof(*entry) + len,
+				GFP_NOWAIT | __GFP_NOWARN);
+		if (entry) {
+			memcpy(entry->data, dst, len);
+			entry->len = len;
+		}
+	}
+	put_cpu_var(cleancache_dst);
+
+	return entry;
+}
+
+/**
+ * cleancache_put - insert a prepared entry for the page at @index
+ *
+ * Called under @mapping's tree_lock, in the same critical section that
+ * removed the page from the page cache, so interrupts are off.  Takes
+ * ownership of @entry, which may be NULL.
+ */
+void cleancache_put(struct address_space *mapping, pgoff_t index,
+		    struct cleancache_entry *entry)
+{
+	struct rb_node **p, *parent;
+
+	if (!entry)
+		return;
+
+	entry->mapping = mapping;
+	entry->index = index;
+
+	spin_lock(&cleancache_lock);
+again:
+	p = &cleancache_root.rb_node;
+	parent = NULL;
+	while (*p) {
+		struct cleancache_entry *this;
+		int cmp;
+
+		parent = *p;
+		this = rb_entry(parent, struct cleancache_entry, node);
+		cmp = entry_cmp(mapping, index, this);
+		if (cmp < 0)
+			p = &parent->rb_left;
+		else if (cmp > 0)
+			p = &parent->rb_right;
+		else {
+			/* the page was just there, so this copy is stale */
+			WARN_ON_ONCE(1);
+			entry_unlink(this);
+			kfree(this);
+			goto again;
+		}
+	}
+	rb_link_node(&entry->node, parent, p);
+	rb_insert_color(&entry->node, &cleancache_root);
+	list_add(&entry->lru, &cleancache_lru);
+	mapping->nrcleancache++;
+	cleancache_pages++;
+	cleancache_bytes += entry_size(entry);
+
+	/*
+	 * One entry is at most CLEANCACHE_MAX_LEN, so a batch is plenty to
+	 * make room for it; a bigger excess left by lowering the limit is
+	 * trimmed by the sysctl handler.
+	 */
+	cleancache_evict(sysctl_cleancache_kbytes << 10, CLEANCACHE_BATCH);
+	spin_unlock(&cleancache_lock);
+
+	count_vm_event(CLEANCACHE_PUT);
+}
+
+void cleancache_discard(struct cleancache_entry *entry)
+{
+	kfree(entry);
+}
+
+/**
+ * cleancache_take - remove the entry for @index from the pool
+ *
+ * Called under @mapping's tree_lock, with interrupts off, right after a
+ * page was inserted at @index.  The caller hands the entry to
+ * cleancache_restore() once it has dropped the lock.
+ */
+struct cleancache_entry *cleancache_take(struct address_space *mapping,
+					 pgoff_t index)
+{
+	struct cleancache_entry *entry;
+
+	if (!mapping->nrcleancache)
+		return NULL;
+
+	spin_lock(&cleancache_lock);
+	entry = entry_find(mapping, index);
+	if (entry)
+		entry_unlink(entry);
+	spin_unlock(&cleancache_lock);
+
+	return entry;
+}
+
+/**
+ * cleancache_restore - fill a new page cache page from its entry
+ * @page: the locked page, not uptodate yet
+ * @entry: what cleancache_take() returned for it, or NULL
+ *
+ * The page is uptodate afterwards unless decompression failed, in which
+ * case the caller reads it as usual.  Frees @entry.
+ */
+void cleancache_restore(struct page *page, struct cleancache_entry *entry)
+{
+	size_t len = PAGE_SIZE;
+	unsigned char *dst;
+	int ret;
+
+	if (!entry)
+		return;
+
+	dst = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_decompress_safe(entry->data, entry->len, dst, &len);
+	kunmap_atomic(dst, KM_USER0);
+	kfree(entry);
+
+	if (ret == LZO_E_OK && len == PAGE_SIZE) {
+		flush_dcache_page(page);
+		SetPageUptodate(page);
+		count_vm_event(CLEANCACHE_HIT);
+	}
+}
+
+/**
+ * cleancache_readahead - restore a page instead of reading it ahead
+ *
+ * Readahead found no page at @index.  If the pool has a copy, put it
+ * back in the page cache now and return 1, so that the page is left out
+ * of the I/O.
+ */
+int cleancache_readahead(struct address_space *mapping, pgoff_t index)
+{
+	struct page *page;
+	unsigned long flags;
+	int found;
+
+	if (!mapping->nrcleancache)
+		return 0;
+
+	spin_lock_irqsave(&cleancache_lock, flags);
+	found = entry_find(mapping, index) != NULL;
+	spin_unlock_irqrestore(&cleancache_lock, flags);
+	if (!found)
+		return 0;
+
+	page = page_cache_alloc_cold(mapping);
+	if (!page)
+		return 0;
+	if (add_to_page_cache_lru(page, mapping, index, GFP_KERNEL)) {
+		page_cache_release(page);
+		return 0;
+	}
+	unlock_page(page);
+	page_cache_release(page);
+	return 1;
+}
+
+/**
+ * cleancache_invalidate_range - drop the entries of a file range
+ * @mapping: the file
+ * @start: first page index
+ * @end: last page index, inclusive
+ *
+ * Needed whenever the file changes without going through its page
+ * cache pages, and when the inode goes away.  The caller can sleep.
+ */
+void cleancache_invalidate_range(struct address_space *mapping,
+				 pgoff_t start, pgoff_t end)
+{
+	struct cleancache_entry *entry, *tmp;
+	unsigned long flags;
+	LIST_HEAD(batch);
+	int nr;
+
+	/*
+	 * No unlocked nrcleancache check here: nothing orders it against
+	 * an insertion that the caller's page cache walk just missed.
+	 */
+	do {
+		nr = 0;
+		spin_lock_irqsave(&cleancache_lock, flags);
+		entry = entry_lookup(mapping, start);
+		while (entry && entry->mapping == mapping &&
+		       entry->index <= end && nr < CLEANCACHE_BATCH) {
+			struct rb_node *next = rb_next(&entry->node);
+
+			start = entry->index + 1;
+			entry_unlink(entry);
+			list_add(&entry->lru, &batch);
+			nr++;
+			if (!start)
+				break;
+			entry = next ? rb_entry(next, struct cleancache_entry,
+						node) : NULL;
+		}
+		spin_unlock_irqrestore(&cleancache_lock, flags);
+
+		list_for_each_entry_safe(entry, tmp, &batch, lru)
+			kfree(entry);
+		INIT_LIST_HEAD(&batch);
+		cond_resched();
+	} while (nr == CLEANCACHE_BATCH && start);
+}
+EXPORT_SYMBOL(cleancache_invalidate_range);
+
+void cleancache_get_stats(unsigned long *pages, unsigned long *bytes)
+{
+	*pages = cleancache_pages;
+	*bytes = cleancache_bytes;
+}
+
+int cleancache_sysctl_handler(struct ctl_table *table, int write,
+			      void __user *buffer, size_t *length,
+			      loff_t *ppos)
+{
+	int ret;
+
+	ret = proc_doulongvec_minmax(table, write, buffer, length, ppos);
+	if (!ret && write)
+		cleancache_evict_to(sysctl_cleancache_kbytes << 10);
+	return ret;
+}
+
+static int cleancache_shrink(struct shrinker *shrink, int nr_to_scan,
+			     gfp_t gfp_mask)
+{
+	unsigned long flags, evicted;
+	int nr;
+
+	while (nr_to_scan > 0) {
+		nr = min(nr_to_scan, CLEANCACHE_BATCH);
+		spin_lock_irqsave(&cleancache_lock, flags);
+		evicted = cleancache_evict(0, nr);
+		spin_unlock_irqrestore(&cleancache_lock, flags);
+		if (!evicted)
+			break;
+		nr_to_scan -= evicted;
+	}
+	return cleancache_pages;
+}
+
+static struct shrinker cleancache_shrinker = {
+	.shrink = cleancache_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __init cleancache_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		void *wrkmem;
+		unsigned char *dst;
+
+		wrkmem = kmalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
+		dst = kmalloc(lzo1x_worst_compress(PAGE_SIZE), GFP_KERNEL);
+		if (!wrkmem || !dst) {
+			kfree(wrkmem);
+			kfree(dst);
+			goto out_free;
+		}
+		per_cpu(cleancache_wrkmem, cpu) = wrkmem;
+		per_cpu(cleancache_dst, cpu) = dst;
+	}
+
+	/* Up to a sixteenth of memory by default */
+	sysctl_cleancache_kbytes = (totalram_pages / 16) << (PAGE_SHIFT - 10);
+	register_shrinker(&cleancache_shrinker);
+	cleancache_ready = 1;
+	return 0;
+
+out_free:
+	for_each_possible_cpu(cpu) {
+		kfree(per_cpu(cleancache_wrkmem, cpu));
+		kfree(per_cpu(cleancache_dst, cpu));
+		per_cpu(cleancache_wrkmem, cpu) = NULL;
+		per_cpu(cleancache_dst, cpu) = NULL;
+	}
+	printk(KERN_ERR "cleancache: failed to allocate buffers\n");
+	return -ENOMEM;
+}
+module_init(cleancache_init)
@@ -33,6 +33,7 @@
 #include <linux/cpuset.h>
 #include <linux/hardirq.h> /* for BUG_ON(!in_atomic()) only */
 #include <linux/memcontrol.h>
+#include <linux/cleancache.h>
 #include <linux/mm_inline.h> /* for page_is_file_cache() */
 #include "internal.h"
 
@@ -397,6 +398,7 @@ EXPORT_SYMBOL(filemap_write_and_wait_range);
 int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 		pgoff_t offset, gfp_t gfp_mask)
 {
+	struct cleancache_entry *entry;
 	int error;
 
 	VM_BUG_ON(!PageLocked(page));
@@ -419,7 +421,9 @@ int add_to_page_cache_locked(struct page *page, struct address_space *mapping,
 			__inc_zone_page_state(page, NR_FILE_PAGES);
 			if (PageSwapBacked(page))
 				__inc_zone_page_state(page, NR_SHMEM);
+			entry = cleancache_take(mapping, offset);
 			spin_unlock_irq(&mapping->tree_lock);
+			cleancache_restore(page, entry);
 		} else {
 			page->mapping = NULL;
 			spin_unlock_irq(&mapping->tree_lock);
@@ -1168,6 +1172,11 @@ no_cached_page:
 			desc->error = error;
 			goto out;
 		}
+		if (PageUptodate(page)) {
+			/* restored from the compressed cache */
+			unlock_page(page);
+			goto page_ok;
+		}
 		goto readpage;
 	}
 
@@ -1417,7 +1426,9 @@ static int page_cache_read(struct file *file, pgoff_t offset)
 			return -ENOMEM;
 
 		ret = add_to_page_cache_lru(page, mapping, offset, GFP_KERNEL);
-		if (ret == 0)
+		if (ret == 0 && PageUptodate(page))
+			unlock_page(page);	/* from the compressed cache */
+		else if (ret == 0)
 			ret = mapping->a_ops->readpage(file, page);
 		else if (ret == -EEXIST)
 			ret = 0; /* losing race to add is OK */
@@ -2172,6 +2183,7 @@ generic_file_direct_write(struct kiocb *iocb, const struct iovec *iov,
 		invalidate_inode_pages2_range(mapping,
 					      pos >> PAGE_CACHE_SHIFT, end);
 	}
+	cleancache_invalidate_range(mapping, pos >> PAGE_CACHE_SHIFT, end);
 
 	if (written > 0) {
 		loff_t end = pos + written;
@@ -2460,12 +2472,15 @@ ssize_t generic_file_aio_write(struct kiocb *iocb, const struct iovec *iov,
 {
 	struct file *file = iocb->ki_filp;
 	struct inode *inode = file->f_mapping->host;
+	struct blk_plug plug;
 	ssize_t ret;
 
 	BUG_ON(iocb->ki_pos != pos);
 
 	mutex_lock(&inode->i_mutex);
+	blk_start_plug(&plug);
 	ret = __generic_file_aio_write(iocb, iov, nr_segs, &iocb->ki_pos);
+	blk_finish_plug(&plug);
 	mutex_unlock(&inode->i_mutex);
 
 	if (ret > 0 || ret == -EIOCBQUEUED) {
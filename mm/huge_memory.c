@@ -0,0 +1,809 @@
+/*
+ * Transparent huge pages for anonymous memory.
+ *
+ * Faults in eligible areas map a whole naturally aligned group of
+ * THP_NR contiguous pages at once (see do_anonymous_page()), and
+ * khugepaged copies groups that were populated piecemeal into a fresh
+ * contiguous block.  Either way the architecture is then asked to map
+ * the group with a single TLB entry.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/highmem.h>
+#include <linux/hugetlb.h>
+#include <linux/mmu_notifier.h>
+#include <linux/rmap.h>
+#include <linux/ksm.h>
+#include <linux/swap.h>
+#include <linux/memcontrol.h>
+#include <linux/mman.h>
+#include <linux/kthread.h>
+#include <linux/wait.h>
+#include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/huge_mm.h>
+
+#include <asm/tlbflush.h>
+#include <asm/pgalloc.h>
+#include "internal.h"
+
+/*
+ * By default huge pages are only used in areas that asked for them with
+ * MADV_HUGEPAGE, and allocating one may compact memory.
+ */
+unsigned long transparent_hugepage_flags __read_mostly =
+	(1 << TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG) |
+	(1 << TRANSPARENT_HUGEPAGE_DEFRAG_FLAG);
+
+/* The number of pages to scan per wakeup */
+static unsigned int khugepaged_pages_to_scan __read_mostly = THP_NR * 8;
+
+/* Milliseconds khugepaged should sleep between batches */
+static unsigned int khugepaged_scan_sleep_millisecs __read_mostly = 10000;
+
+/* The number of groups copied into a huge page */
+static unsigned int khugepaged_pages_collapsed;
+
+/* The number of times the whole list of mms has been scanned */
+static unsigned int khugepaged_full_scans;
+
+static DECLARE_WAIT_QUEUE_HEAD(khugepaged_wait);
+static DEFINE_SPINLOCK(khugepaged_mm_lock);
+
+#define MM_SLOTS_HASH_SHIFT 10
+#define MM_SLOTS_HASH_HEADS (1 << MM_SLOTS_HASH_SHIFT)
+
+/**
+ * struct mm_slot - khugepaged information per mm that is being scanned
+ * @hash: link to the mm_slots hash list
+ * @mm_node: link into the mm_slots list, rooted in khugepaged_scan.mm_head
+ * @mm: the mm that this information is valid for
+ */
+struct mm_slot {
+	struct hlist_node hash;
+	struct list_head mm_node;
+	struct mm_struct *mm;
+};
+
+/**
+ * struct khugepaged_scan - cursor for scanning
+ * @mm_head: the head of the mm list to scan
+ * @mm_slot: the current mm_slot we are scanning, NULL between passes
+ * @address: the next address inside that to be scanned
+ *
+ * There is only the one khugepaged_scan instance of this cursor structure.
+ */
+struct khugepaged_scan {
+	struct list_head mm_head;
+	struct mm_slot *mm_slot;
+	unsigned long address;
+};
+
+static struct khugepaged_scan khugepaged_scan = {
+	.mm_head = LIST_HEAD_INIT(khugepaged_scan.mm_head),
+};
+
+static struct hlist_head mm_slots_hash[MM_SLOTS_HASH_HEADS];
+static struct kmem_cache *mm_slot_cache __read_mostly;
+
+static inline struct mm_slot *alloc_mm_slot(void)
+{
+	if (!mm_slot_cache)	/* initialization failed */
+		return NULL;
+	return kmem_cache_zalloc(mm_slot_cache, GFP_KERNEL);
+}
+
+static inline void free_mm_slot(struct mm_slot *mm_slot)
+{
+	kmem_cache_free(mm_slot_cache, mm_slot);
+}
+
+static struct mm_slot *get_mm_slot(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+	struct hlist_head *bucket;
+	struct hlist_node *node;
+
+	bucket = &mm_slots_hash[hash_ptr(mm, MM_SLOTS_HASH_SHIFT)];
+	hlist_for_each_entry(mm_slot, node, bucket, hash) {
+		if (mm == mm_slot->mm)
+			return mm_slot;
+	}
+	return NULL;
+}
+
+static void insert_to_mm_slots_hash(struct mm_struct *mm,
+				    struct mm_slot *mm_slot)
+{
+	struct hlist_head *bucket;
+
+	bucket = &mm_slots_hash[hash_ptr(mm, MM_SLOTS_HASH_SHIFT)];
+	mm_slot->mm = mm;
+	hlist_add_head(&mm_slot->hash, bucket);
+}
+
+static inline int khugepaged_test_exit(struct mm_struct *mm)
+{
+	return atomic_read(&mm->mm_users) == 0;
+}
+
+static int khugepaged_should_run(void)
+{
+	return (transparent_hugepage_flags &
+		((1 << TRANSPARENT_HUGEPAGE_FLAG) |
+		 (1 << TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG))) &&
+		!list_empty(&khugepaged_scan.mm_head);
+}
+
+int hugepage_vma_check(struct vm_area_struct *vma)
+{
+	if (vma->vm_file || vma->vm_ops)
+		return 0;
+	if (vma->vm_flags & (VM_SHARED | VM_MAYSHARE | VM_HUGETLB |
+			     VM_SPECIAL | VM_INSERTPAGE | VM_MIXEDMAP |
+			     VM_SAO | VM_GROWSDOWN | VM_GROWSUP))
+		return 0;
+	return 1;
+}
+
+/*
+ * Allocate THP_NR contiguous pages for the group at @haddr and split
+ * them, so that each is freed, reclaimed and migrated on its own.
+ */
+struct page *alloc_transhuge_page(struct vm_area_struct *vma,
+				  unsigned long haddr)
+{
+	gfp_t gfp = GFP_HIGHUSER_MOVABLE | __GFP_NOWARN | __GFP_NORETRY;
+	struct page *page;
+
+	if (!transparent_hugepage_test(vma, TRANSPARENT_HUGEPAGE_DEFRAG_FLAG,
+				TRANSPARENT_HUGEPAGE_DEFRAG_REQ_MADV_FLAG))
+		gfp &= ~__GFP_WAIT;
+
+	page = alloc_pages(gfp, THP_ORDER);
+	if (page)
+		split_page(page, THP_ORDER);
+	return page;
+}
+
+int hugepage_madvise(struct vm_area_struct *vma,
+		     unsigned long *vm_flags, int advice)
+{
+	switch (advice) {
+	case MADV_HUGEPAGE:
+		if (*vm_flags & (VM_SHARED | VM_MAYSHARE | VM_HUGETLB |
+				 VM_SPECIAL | VM_SAO))
+			return -EINVAL;
+		if (*vm_flags & VM_HUGEPAGE)
+			return 0;
+		/*
+		 * The vma does not carry the new flag yet: khugepaged checks
+		 * it again under mmap_sem before doing anything.
+		 */
+		if (!test_bit(MMF_VM_HUGEPAGE, &vma->vm_mm->flags) &&
+		    __khugepaged_enter(vma->vm_mm))
+			return -ENOMEM;
+		*vm_flags |= VM_HUGEPAGE;
+		break;
+
+	case MADV_NOHUGEPAGE:
+		/*
+		 * There is no vm_flags bit left to remember the opt-out, so
+		 * this only cancels MADV_HUGEPAGE: with "always" the area is
+		 * still eligible.
+		 */
+		*vm_flags &= ~VM_HUGEPAGE;
+		break;
+	}
+
+	return 0;
+}
+
+int __khugepaged_enter(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+	int wakeup;
+
+	mm_slot = alloc_mm_slot();
+	if (!mm_slot)
+		return -ENOMEM;
+
+	/* __khugepaged_exit() must not run from under us */
+	VM_BUG_ON(khugepaged_test_exit(mm));
+	if (unlikely(test_and_set_bit(MMF_VM_HUGEPAGE, &mm->flags))) {
+		free_mm_slot(mm_slot);
+		return 0;
+	}
+
+	spin_lock(&khugepaged_mm_lock);
+	insert_to_mm_slots_hash(mm, mm_slot);
+	/*
+	 * Queue it last, to let the area settle down a little before
+	 * khugepaged looks at it.
+	 */
+	wakeup = list_empty(&khugepaged_scan.mm_head);
+	list_add_tail(&mm_slot->mm_node, &khugepaged_scan.mm_head);
+	spin_unlock(&khugepaged_mm_lock);
+
+	atomic_inc(&mm->mm_count);
+	if (wakeup)
+		wake_up_interruptible(&khugepaged_wait);
+
+	return 0;
+}
+
+void __khugepaged_exit(struct mm_struct *mm)
+{
+	struct mm_slot *mm_slot;
+	int free = 0;
+
+	spin_lock(&khugepaged_mm_lock);
+	mm_slot = get_mm_slot(mm);
+	if (mm_slot && khugepaged_scan.mm_slot != mm_slot) {
+		hlist_del(&mm_slot->hash);
+		list_del(&mm_slot->mm_node);
+		free = 1;
+	}
+	spin_unlock(&khugepaged_mm_lock);
+
+	if (free) {
+		clear_bit(MMF_VM_HUGEPAGE, &mm->flags);
+		free_mm_slot(mm_slot);
+		mmdrop(mm);
+	} else if (mm_slot) {
+		/*
+		 * khugepaged is scanning this mm: wait for it to drop
+		 * mmap_sem before the pagetables are freed.  It notices
+		 * the exit and frees the mm_slot itself.
+		 */
+		down_write(&mm->mmap_sem);
+		up_write(&mm->mmap_sem);
+	}
+}
+
+static void collect_mm_slot(struct mm_slot *mm_slot)
+{
+	struct mm_struct *mm = mm_slot->mm;
+
+	VM_BUG_ON(!spin_is_locked(&khugepaged_mm_lock));
+
+	if (khugepaged_test_exit(mm)) {
+		hlist_del(&mm_slot->hash);
+		list_del(&mm_slot->mm_node);
+		free_mm_slot(mm_slot);
+		mmdrop(mm);
+	}
+}
+
+static pmd_t *khugepaged_find_pmd(struct mm_struct *mm, unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return NULL;
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return NULL;
+	pmd = pmd_offset(pud, address);
+	if (!pmd_present(*pmd))
+		return NULL;
+	return pmd;
+}
+
+/*
+ * Returns the page mapped by @pteval if khugepaged may replace it: a
+ * private anonymous page mapped only here.
+ */
+static struct page *khugepaged_pte_page(struct vm_area_struct *vma,
+					unsigned long address, pte_t pteval)
+{
+	struct page *page;
+
+	if (!pte_present(pteval))
+		return NULL;
+	page = vm_normal_page(vma, address, pteval);
+	if (!page || !PageAnon(page) || PageKsm(page) ||
+	    page_mapcount(page) != 1)
+		return NULL;
+	return page;
+}
+
+/*
+ * Copy the pages of the group at @haddr into a new contiguous block.
+ *
+ * Every old page must be locked, isolated from the LRU and referenced
+ * only by its pte, which then cannot change while we hold the pte lock:
+ * any other user (reclaim, migration, get_user_pages) makes us give up.
+ * Called with mmap_sem held for read.
+ */
+static void khugepaged_collapse(struct mm_struct *mm,
+				struct vm_area_struct *vma,
+				unsigned long haddr, pmd_t *pmd)
+{
+	struct page *new_page, *old[THP_NR];
+	pte_t *pte, orig[THP_NR];
+	spinlock_t *ptl;
+	int i, charged, isolated;
+
+	new_page = alloc_transhuge_page(vma, haddr);
+	if (!new_page) {
+		count_vm_event(THP_COLLAPSE_ALLOC_FAILED);
+		return;
+	}
+	count_vm_event(THP_COLLAPSE_ALLOC);
+
+	for (charged = 0; charged < THP_NR; charged++)
+		if (mem_cgroup_newpage_charge(new_page + charged, mm,
+					      GFP_KERNEL))
+			goto out_free;
+
+	mmu_notifier_invalidate_range_start(mm, haddr, haddr + THP_SIZE);
+	pte = pte_offset_map_lock(mm, pmd, haddr, &ptl);
+
+	for (isolated = 0; isolated < THP_NR; isolated++) {
+		unsigned long address = haddr + (isolated << PAGE_SHIFT);
+		struct page *page;
+
+		page = khugepaged_pte_page(vma, address, pte[isolated]);
+		if (!page || !trylock_page(page))
+			break;
+		if (isolate_lru_page(page)) {
+			unlock_page(page);
+			break;
+		}
+		/* one reference for the pte, one for the isolation */
+		if (page_count(page) != 2) {
+			unlock_page(page);
+			putback_lru_page(page);
+			break;
+		}
+		inc_zone_page_state(page, NR_ISOLATED_ANON);
+		old[isolated] = page;
+	}
+	if (isolated != THP_NR)
+		goto out_putback;
+
+	flush_cache_range(vma, haddr, haddr + THP_SIZE);
+	for (i = 0; i < THP_NR; i++)
+		orig[i] = ptep_get_and_clear(mm, haddr + (i << PAGE_SHIFT),
+					     pte + i);
+	flush_tlb_range(vma, haddr, haddr + THP_SIZE);
+
+	for (i = 0; i < THP_NR; i++) {
+		unsigned long address = haddr + (i << PAGE_SHIFT);
+		struct page *page = new_page + i;
+		pte_t entry;
+
+		copy_user_highpage(page, old[i], address, vma);
+		__SetPageUptodate(page);
+
+		entry = mk_pte(page, vma->vm_page_prot);
+		if (pte_write(orig[i]))
+			entry = pte_mkwrite(pte_mkdirty(entry));
+		entry = pte_mkyoung(entry);
+
+		page_add_new_anon_rmap(page, vma, address);
+		set_pte_at(mm, address, pte + i, entry);
+		update_mmu_cache(vma, address, pte + i);
+
+		page_remove_rmap(old[i]);
+	}
+	pte_mklarge(mm, haddr, pte);
+	pte_unmap_unlock(pte, ptl);
+	mmu_notifier_invalidate_range_end(mm, haddr, haddr + THP_SIZE);
+
+	for (i = 0; i < THP_NR; i++) {
+		dec_zone_page_state(old[i], NR_ISOLATED_ANON);
+		unlock_page(old[i]);
+		/* drop the isolation and the pte references */
+		put_page(old[i]);
+		put_page(old[i]);
+	}
+	khugepaged_pages_collapsed++;
+	return;
+
+out_putback:
+	for (i = 0; i < isolated; i++) {
+		dec_zone_page_state(old[i], NR_ISOLATED_ANON);
+		unlock_page(old[i]);
+		putback_lru_page(old[i]);
+	}
+	pte_unmap_unlock(pte, ptl);
+	mmu_notifier_invalidate_range_end(mm, haddr, haddr + THP_SIZE);
+out_free:
+	for (i = 0; i < THP_NR; i++) {
+		if (i < charged)
+			mem_cgroup_uncharge_page(new_page + i);
+		put_page(new_page + i);
+	}
+}
+
+/*
+ * Look at one group: if its pages already happen to be contiguous just
+ * try to map it large, otherwise copy it if it is fully populated and
+ * still in use.
+ */
+static void khugepaged_scan_group(struct mm_struct *mm,
+				  struct vm_area_struct *vma,
+				  unsigned long haddr)
+{
+	unsigned long pfn = 0;
+	int i, contiguous = 1, referenced = 0;
+	spinlock_t *ptl;
+	pmd_t *pmd;
+	pte_t *pte;
+
+	pmd = khugepaged_find_pmd(mm, haddr);
+	if (!pmd)
+		return;
+
+	pte = pte_offset_map_lock(mm, pmd, haddr, &ptl);
+	for (i = 0; i < THP_NR; i++) {
+		unsigned long address = haddr + (i << PAGE_SHIFT);
+		struct page *page;
+
+		page = khugepaged_pte_page(vma, address, pte[i]);
+		if (!page || !PageLRU(page)) {
+			pte_unmap_unlock(pte, ptl);
+			return;
+		}
+		if (pte_young(pte[i]) || PageReferenced(page))
+			referenced = 1;
+		if (!i)
+			pfn = page_to_pfn(page);
+		if (page_to_pfn(page) != pfn + i || (pfn & (THP_NR - 1)))
+			contiguous = 0;
+	}
+	if (contiguous)
+		pte_mklarge(mm, haddr, pte);
+	pte_unmap_unlock(pte, ptl);
+
+	if (!contiguous && referenced)
+		khugepaged_collapse(mm, vma, haddr, pmd);
+}
+
+/*
+ * Called with khugepaged_mm_lock held, which is dropped while the mm
+ * is scanned and taken again before returning.  Returns the number of
+ * pages accounted as scanned.
+ */
+static unsigned int khugepaged_scan_mm_slot(unsigned int pages)
+{
+	struct mm_slot *mm_slot;
+	struct mm_struct *mm;
+	struct vm_area_struct *vma;
+	unsigned int progress = 0;
+
+	VM_BUG_ON(!pages);
+	VM_BUG_ON(!spin_is_locked(&khugepaged_mm_lock));
+
+	if (khugepaged_scan.mm_slot)
+		mm_slot = khugepaged_scan.mm_slot;
+	else {
+		mm_slot = list_entry(khugepaged_scan.mm_head.next,
+				     struct mm_slot, mm_node);
+		khugepaged_scan.address = 0;
+		khugepaged_scan.mm_slot = mm_slot;
+	}
+	spin_unlock(&khugepaged_mm_lock);
+
+	mm = mm_slot->mm;
+	down_read(&mm->mmap_sem);
+	if (unlikely(khugepaged_test_exit(mm)))
+		vma = NULL;
+	else
+		vma = find_vma(mm, khugepaged_scan.address);
+
+	for (; vma; vma = vma->vm_next) {
+		unsigned long hstart, hend;
+
+		cond_resched();
+		if (unlikely(khugepaged_test_exit(mm))) {
+			progress++;
+			break;
+		}
+		hstart = (vma->vm_start + ~THP_MASK) & THP_MASK;
+		hend = vma->vm_end & THP_MASK;
+		if (!vma->anon_vma || hstart >= hend ||
+		    !transparent_hugepage_enabled(vma)) {
+			progress++;
+			continue;
+		}
+		if (khugepaged_scan.address < hstart)
+			khugepaged_scan.address = hstart;
+
+		while (khugepaged_scan.address < hend) {
+			cond_resched();
+			if (unlikely(khugepaged_test_exit(mm)))
+				goto breakouterloop;
+			khugepaged_scan_group(mm, vma, khugepaged_scan.address);
+			khugepaged_scan.address += THP_SIZE;
+			progress += THP_NR;
+			if (progress >= pages)
+				goto breakouterloop;
+		}
+	}
+breakouterloop:
+	up_read(&mm->mmap_sem);
+
+	spin_lock(&khugepaged_mm_lock);
+	VM_BUG_ON(khugepaged_scan.mm_slot != mm_slot);
+	/*
+	 * Move on once this mm is done with or dying: __khugepaged_exit()
+	 * leaves the mm_slot at the cursor for us to free.
+	 */
+	if (khugepaged_test_exit(mm) || !vma) {
+		if (mm_slot->mm_node.next != &khugepaged_scan.mm_head) {
+			khugepaged_scan.mm_slot = list_entry(
+				mm_slot->mm_node.next,
+				struct mm_slot, mm_node);
+			khugepaged_scan.address = 0;
+		} else {
+			khugepaged_scan.mm_slot = NULL;
+			khugepaged_full_scans++;
+		}
+		collect_mm_slot(mm_slot);
+	}
+
+	return progress;
+}
+
+static void khugepaged_do_scan(void)
+{
+	unsigned int progress = 0, pass_through_head = 0;
+	unsigned int pages = khugepaged_pages_to_scan;
+
+	while (progress < pages) {
+		cond_resched();
+
+		spin_lock(&khugepaged_mm_lock);
+		if (!khugepaged_scan.mm_slot)
+			pass_through_head++;
+		if (list_empty(&khugepaged_scan.mm_head) ||
+		    pass_through_head >= 2) {
+			spin_unlock(&khugepaged_mm_lock);
+			break;
+		}
+		progress += khugepaged_scan_mm_slot(pages - progress);
+		spin_unlock(&khugepaged_mm_lock);
+	}
+}
+
+static int khugepaged(void *none)
+{
+	set_user_nice(current, 19);
+
+	while (!kthread_should_stop()) {
+		if (khugepaged_should_run())
+			khugepaged_do_scan();
+
+		if (khugepaged_should_run()) {
+			schedule_timeout_interruptible(
+			    msecs_to_jiffies(khugepaged_scan_sleep_millisecs));
+		} else {
+			wait_event_interruptible(khugepaged_wait,
+				khugepaged_should_run() || kthread_should_stop());
+		}
+	}
+	return 0;
+}
+
+#ifdef CONFIG_SYSFS
+
+static ssize_t double_flag_show(char *buf,
+				enum transparent_hugepage_flag enabled,
+				enum transparent_hugepage_flag req_madv)
+{
+	if (test_bit(enabled, &transparent_hugepage_flags))
+		return sprintf(buf, "[always] madvise never\n");
+	if (test_bit(req_madv, &transparent_hugepage_flags))
+		return sprintf(buf, "always [madvise] never\n");
+	return sprintf(buf, "always madvise [never]\n");
+}
+
+static ssize_t double_flag_store(const char *buf, size_t count,
+				 enum transparent_hugepage_flag enabled,
+				 enum transparent_hugepage_flag req_madv)
+{
+	if (!memcmp("always", buf, min(sizeof("always")-1, count))) {
+		set_bit(enabled, &transparent_hugepage_flags);
+		clear_bit(req_madv, &transparent_hugepage_flags);
+	} else if (!memcmp("madvise", buf, min(sizeof("madvise")-1, count))) {
+		clear_bit(enabled, &transparent_hugepage_flags);
+		set_bit(req_madv, &transparent_hugepage_flags);
+	} else if (!memcmp("never", buf, min(sizeof("never")-1, count))) {
+		clear_bit(enabled, &transparent_hugepage_flags);
+		clear_bit(req_madv, &transparent_hugepage_flags);
+	} else
+		return -EINVAL;
+
+	return count;
+}
+
+static ssize_t enabled_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return double_flag_show(buf, TRANSPARENT_HUGEPAGE_FLAG,
+				TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG);
+}
+
+static ssize_t enabled_store(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	ssize_t ret;
+
+	ret = double_flag_store(buf, count, TRANSPARENT_HUGEPAGE_FLAG,
+				TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG);
+	if (ret > 0)
+		wake_up_interruptible(&khugepaged_wait);
+	return ret;
+}
+static struct kobj_attribute enabled_attr =
+	__ATTR(enabled, 0644, enabled_show, enabled_store);
+
+static ssize_t defrag_show(struct kobject *kobj,
+			   struct kobj_attribute *attr, char *buf)
+{
+	return double_flag_show(buf, TRANSPARENT_HUGEPAGE_DEFRAG_FLAG,
+				TRANSPARENT_HUGEPAGE_DEFRAG_REQ_MADV_FLAG);
+}
+
+static ssize_t defrag_store(struct kobject *kobj,
+			    struct kobj_attribute *attr,
+			    const char *buf, size_t count)
+{
+	return double_flag_store(buf, count, TRANSPARENT_HUGEPAGE_DEFRAG_FLAG,
+				 TRANSPARENT_HUGEPAGE_DEFRAG_REQ_MADV_FLAG);
+}
+static struct kobj_attribute defrag_attr =
+	__ATTR(defrag, 0644, defrag_show, defrag_store);
+
+static struct attribute *hugepage_attr[] = {
+	&enabled_attr.attr,
+	&defrag_attr.attr,
+	NULL,
+};
+
+static struct attribute_group hugepage_attr_group = {
+	.attrs = hugepage_attr,
+};
+
+static ssize_t scan_sleep_millisecs_show(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_scan_sleep_millisecs);
+}
+
+static ssize_t scan_sleep_millisecs_store(struct kobject *kobj,
+					  struct kobj_attribute *attr,
+					  const char *buf, size_t count)
+{
+	unsigned long msecs;
+	int err;
+
+	err = strict_strtoul(buf, 10, &msecs);
+	if (err || msecs > UINT_MAX)
+		return -EINVAL;
+
+	khugepaged_scan_sleep_millisecs = msecs;
+	wake_up_interruptible(&khugepaged_wait);
+
+	return count;
+}
+static struct kobj_attribute scan_sleep_millisecs_attr =
+	__ATTR(scan_sleep_millisecs, 0644, scan_sleep_millisecs_show,
+	       scan_sleep_millisecs_store);
+
+static ssize_t pages_to_scan_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_pages_to_scan);
+}
+
+static ssize_t pages_to_scan_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	unsigned long pages;
+	int err;
+
+	err = strict_strtoul(buf, 10, &pages);
+	if (err || !pages || pages > UINT_MAX)
+		return -EINVAL;
+
+	khugepaged_pages_to_scan = pages;
+
+	return count;
+}
+static struct kobj_attribute pages_to_scan_attr =
+	__ATTR(pages_to_scan, 0644, pages_to_scan_show, pages_to_scan_store);
+
+static ssize_t pages_collapsed_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_pages_collapsed);
+}
+static struct kobj_attribute pages_collapsed_attr =
+	__ATTR_RO(pages_collapsed);
+
+static ssize_t full_scans_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_full_scans);
+}
+static struct kobj_attribute full_scans_attr = __ATTR_RO(full_scans);
+
+static struct attribute *khugepaged_attr[] = {
+	&scan_sleep_millisecs_attr.attr,
+	&pages_to_scan_attr.attr,
+	&pages_collapsed_attr.attr,
+	&full_scans_attr.attr,
+	NULL,
+};
+
+static struct attribute_group khugepaged_attr_group = {
+	.attrs = khugepaged_attr,
+	.name = "khugepaged",
+};
+#endif /* CONFIG_SYSFS */
+
+static int __init hugepage_init(void)
+{
+	struct task_struct *khugepaged_thread;
+	int err;
+#ifdef CONFIG_SYSFS
+	struct kobject *hugepage_kobj;
+
+	hugepage_kobj = kobject_create_and_add("transparent_hugepage",
+					       mm_kobj);
+	if (!hugepage_kobj) {
+		printk(KERN_ERR "hugepage: failed kobject create\n");
+		return -ENOMEM;
+	}
+
+	err = sysfs_create_group(hugepage_kobj, &hugepage_attr_group);
+	if (err) {
+		printk(KERN_ERR "hugepage: failed register hugepage group\n");
+		goto out;
+	}
+
+	err = sysfs_create_group(hugepage_kobj, &khugepaged_attr_group);
+	if (err) {
+		printk(KERN_ERR "hugepage: failed register khugepaged group\n");
+		goto out;
+	}
+#endif
+
+	mm_slot_cache = KMEM_CACHE(mm_slot, 0);
+	if (!mm_slot_cache) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	khugepaged_thread = kthread_run(khugepaged, NULL, "khugepaged");
+	if (IS_ERR(khugepaged_thread)) {
+		printk(KERN_ERR "khugepaged: creating kthread failed\n");
+		err = PTR_ERR(khugepaged_thread);
+		goto out_free;
+	}
+
+	return 0;
+
+out_free:
+	kmem_cache_destroy(mm_slot_cache);
+	mm_slot_cache = NULL;
+out:
+#ifdef CONFIG_SYSFS
+	kobject_put(hugepage_kobj);
+#endif
+	return err;
+}
+module_init(hugepage_init)
@@ -46,6 +46,7 @@
 #include <linux/highmem.h>
 #include <linux/pagemap.h>
 #include <linux/ksm.h>
+#include <linux/huge_mm.h>
 #include <linux/rmap.h>
 #include <linux/module.h>
 #include <linux/delayacct.h>
@@ -2824,6 +2825,85 @@ static inline int check_stack_guard_page(struct vm_area_struct *vma, unsigned lo
 	return 0;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Populate the whole aligned group around @address with fresh pages from
+ * one contiguous block, so that it can be mapped with a single TLB entry.
+ * Returns 1 if it did, 0 if the caller should fall back to a single page.
+ */
+static int do_anonymous_large_page(struct mm_struct *mm,
+		struct vm_area_struct *vma, unsigned long address, pmd_t *pmd)
+{
+	unsigned long haddr = address & THP_MASK;
+	struct page *page;
+	spinlock_t *ptl;
+	pte_t *page_table;
+	int i, charged;
+
+	if (haddr < vma->vm_start || haddr + THP_SIZE > vma->vm_end)
+		return 0;
+
+	page_table = pte_offset_map(pmd, haddr);
+	for (i = 0; i < THP_NR; i++)
+		if (!pte_none(page_table[i]))
+			break;
+	pte_unmap(page_table);
+	if (i < THP_NR)
+		return 0;
+
+	page = alloc_transhuge_page(vma, haddr);
+	if (!page) {
+		count_vm_event(THP_FAULT_FALLBACK);
+		return 0;
+	}
+	for (charged = 0; charged < THP_NR; charged++) {
+		clear_user_highpage(page + charged,
+				    haddr + (charged << PAGE_SHIFT));
+		__SetPageUptodate(page + charged);
+		if (mem_cgroup_newpage_charge(page + charged, mm, GFP_KERNEL))
+			goto release;
+	}
+
+	page_table = pte_offset_map_lock(mm, pmd, haddr, &ptl);
+	for (i = 0; i < THP_NR; i++)
+		if (!pte_none(page_table[i]))
+			goto unlock;
+
+	for (i = 0; i < THP_NR; i++) {
+		unsigned long addr = haddr + (i << PAGE_SHIFT);
+		pte_t entry;
+
+		entry = mk_pte(page + i, vma->vm_page_prot);
+		if (vma->vm_flags & VM_WRITE)
+			entry = pte_mkwrite(pte_mkdirty(entry));
+		page_add_new_anon_rmap(page + i, vma, addr);
+		set_pte_at(mm, addr, page_table + i, entry);
+		update_mmu_cache(vma, addr, page_table + i);
+	}
+	add_mm_counter(mm, MM_ANONPAGES, THP_NR);
+	pte_mklarge(mm, haddr, page_table);
+	pte_unmap_unlock(page_table, ptl);
+	count_vm_event(THP_FAULT_ALLOC);
+	return 1;
+
+unlock:
+	pte_unmap_unlock(page_table, ptl);
+release:
+	for (i = 0; i < THP_NR; i++) {
+		if (i < charged)
+			mem_cgroup_uncharge_page(page + i);
+		page_cache_release(page + i);
+	}
+	return 0;
+}
+#else
+static inline int do_anonymous_large_page(struct mm_struct *mm,
+		struct vm_area_struct *vma, unsigned long address, pmd_t *pmd)
+{
+	return 0;
+}
+#endif
+
 /*
  * We enter with non-exclusive mmap_sem (to exclude vma changes,
  * but allow concurrent faults), and pte mapped but not yet locked.
@@ -2856,6 +2936,11 @@ static int do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	/* Allocate our own private page. */
 	if (unlikely(anon_vma_prepare(vma)))
 		goto oom;
+	if (transparent_hugepage_enabled(vma)) {
+		khugepaged_enter(vma);
+		if (do_anonymous_large_page(mm, vma, address, pmd))
+			return 0;
+	}
 	page = alloc_zeroed_user_highpage_movable(vma, address);
 	if (!page)
 		goto oom;
@@ -17,6 +17,7 @@
 #include <linux/highmem.h>
 #include <linux/pagevec.h>
 #include <linux/task_io_accounting_ops.h>
+#include <linux/cleancache.h>
 #include <linux/buffer_head.h>	/* grr. try_to_release_page,
 				   do_invalidatepage */
 #include "internal.h"
@@ -215,6 +216,8 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	pgoff_t next;
 	int i;
 
+	cleancache_invalidate_range(mapping, lstart >> PAGE_CACHE_SHIFT,
+				    lend >> PAGE_CACHE_SHIFT);
 	if (mapping->nrpages == 0)
 		return;
 
@@ -290,6 +293,8 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		pagevec_release(&pvec);
 		mem_cgroup_uncharge_end();
 	}
+	/* pages reclaimed while we were at it */
+	cleancache_invalidate_range(mapping, lstart >> PAGE_CACHE_SHIFT, end);
 }
 EXPORT_SYMBOL(truncate_inode_pages_range);
 
@@ -361,6 +366,7 @@ unsigned long invalidate_mapping_pages(struct address_space *mapping,
 		mem_cgroup_uncharge_end();
 		cond_resched();
 	}
+	cleancache_invalidate_range(mapping, start, end);
 	return ret;
 }
 EXPORT_SYMBOL(invalidate_mapping_pages);
@@ -486,6 +492,7 @@ int invalidate_inode_pages2_range(struct address_space *mapping,
 		mem_cgroup_uncharge_end();
 		cond_resched();
 	}
+	cleancache_invalidate_range(mapping, start, end);
 	return ret;
 }
 EXPORT_SYMBOL_GPL(invalidate_inode_pages2_range);
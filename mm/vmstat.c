@@ -17,6 +17,7 @@
 #include <linux/vmstat.h>
 #include <linux/sched.h>
 #include <linux/math64.h>
+#include <linux/cleancache.h>
 
 #ifdef CONFIG_VM_EVENT_COUNTERS
 DEFINE_PER_CPU(struct vm_event_state, vm_event_states) = {{0}};
@@ -802,6 +803,20 @@ static const char * const vmstat_text[] = {
 	"htlb_buddy_alloc_success",
 	"htlb_buddy_alloc_fail",
 #endif
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	"thp_fault_alloc",
+	"thp_fault_fallback",
+	"thp_collapse_alloc",
+	"thp_collapse_alloc_failed",
+	"thp_split",
+#endif
+
+#ifdef CONFIG_CLEANCACHE
+	"cleancache_put",
+	"cleancache_hit",
+	"cleancache_evict",
+#endif
 	"unevictable_pgs_culled",
 	"unevictable_pgs_scanned",
 	"unevictable_pgs_rescued",
@@ -811,6 +826,12 @@ static const char * const vmstat_text[] = {
 	"unevictable_pgs_stranded",
 	"unevictable_pgs_mlockfreed",
 #endif
+
+#ifdef CONFIG_CLEANCACHE
+	/* Size of the compressed cache, filled in by vmstat_start() */
+	"cleancache_pages",
+	"cleancache_bytes",
+#endif
 };
 
 static void zoneinfo_show_print(struct seq_file *m, pg_data_t *pgdat,
@@ -915,13 +936,8 @@ static void *vmstat_start(struct seq_file *m, loff_t *pos)
 	if (*pos >= ARRAY_SIZE(vmstat_text))
 		return NULL;
 
-#ifdef CONFIG_VM_EVENT_COUNTERS
-	v = kmalloc(NR_VM_ZONE_STAT_ITEMS * sizeof(unsigned long)
-			+ sizeof(struct vm_event_state), GFP_KERNEL);
-#else
-	v = kmalloc(NR_VM_ZONE_STAT_ITEMS * sizeof(unsigned long),
+	v = kmalloc(ARRAY_SIZE(vmstat_text) * sizeof(unsigned long),
 			GFP_KERNEL);
-#endif
 	m->private = v;
 	if (!v)
 		return ERR_PTR(-ENOMEM);
@@ -932,6 +948,10 @@ static void *vmstat_start(struct seq_file *m, loff_t *pos)
 	all_vm_events(e);
 	e[PGPGIN] /= 2;		/* sectors -> kbytes */
 	e[PGPGOUT] /= 2;
+#endif
+#ifdef CONFIG_CLEANCACHE
+	cleancache_get_stats(&v[ARRAY_SIZE(vmstat_text) - 2],
+			     &v[ARRAY_SIZE(vmstat_text) - 1]);
 #endif
 	return v + *pos;
 }
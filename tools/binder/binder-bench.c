@@ -0,0 +1,568 @@
+/* $(CROSS_COMPILE)cc -Wall -Wextra -O2 -o binder-bench binder-bench.c -lrt */
+
+/*
+ * Copyright (c) 2011, NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Measures binder call throughput and latency with N independent
+ * client/server process pairs.  Each client makes synchronous calls to its
+ * own server, which replies with a payload of the same size, and the run
+ * is repeated for 1, 2, 4, ... up to the requested number of pairs, so the
+ * output shows how far unrelated pairs scale.
+ *
+ * Servers and clients find each other through a small registry that takes
+ * the context manager role, so servicemanager must not be running, or the
+ * benchmark must run as the uid that last held the role.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "../../drivers/staging/android/binder.h"
+
+/*-------------------------------------------------------------------------*/
+
+#define MAP_SIZE	(128 * 1024)
+#define MAX_PAYLOAD	(16 * 1024)
+
+enum {
+	CODE_REGISTER = 1,	/* server to registry: object, pair index */
+	CODE_LOOKUP,		/* client to registry: pair index */
+	CODE_PING,		/* client to server */
+};
+
+static const char *device = "/dev/binder";
+static unsigned max_pairs = 4;
+static unsigned calls = 10000;
+static unsigned payload = 64;
+
+/* shared with the children: per call latencies and per client run time */
+static uint32_t *latencies;
+static double *elapsed;
+
+static unsigned char payload_buf[MAX_PAYLOAD];
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+/*-------------------------------------------------------------------------*/
+
+/* commands queued for the next BINDER_WRITE_READ */
+struct wbuf {
+	unsigned char data[512];
+	size_t len;
+};
+
+static void put(struct wbuf *w, const void *p, size_t n)
+{
+	if (w->len + n > sizeof(w->data)) {
+		fprintf(stderr, "command buffer overflow\n");
+		exit(1);
+	}
+	memcpy(w->data + w->len, p, n);
+	w->len += n;
+}
+
+static void put_cmd(struct wbuf *w, uint32_t cmd)
+{
+	put(w, &cmd, sizeof(cmd));
+}
+
+static void put_free(struct wbuf *w, const void *buffer)
+{
+	put_cmd(w, BC_FREE_BUFFER);
+	put(w, &buffer, sizeof(buffer));
+}
+
+/* take a strong reference so the handle outlives the buffer it came in */
+static void put_acquire(struct wbuf *w, uint32_t handle)
+{
+	put_cmd(w, BC_INCREFS);
+	put(w, &handle, sizeof(handle));
+	put_cmd(w, BC_ACQUIRE);
+	put(w, &handle, sizeof(handle));
+}
+
+static void put_transaction(struct wbuf *w, uint32_t cmd, size_t handle,
+			    unsigned code, const void *data, size_t size,
+			    const size_t *offsets, size_t nr_offsets)
+{
+	struct binder_transaction_data tr;
+
+	memset(&tr, 0, sizeof(tr));
+	tr.target.handle = handle;
+	tr.code = code;
+	tr.data_size = size;
+	tr.offsets_size = nr_offsets * sizeof(*offsets);
+	tr.data.ptr.buffer = data;
+	tr.data.ptr.offsets = offsets;
+	put_cmd(w, cmd);
+	put(w, &tr, sizeof(tr));
+}
+
+static int binder_open(void)
+{
+	int fd = open(device, O_RDWR);
+
+	if (fd < 0)
+		die(device);
+	if (mmap(NULL, MAP_SIZE, PROT_READ, MAP_PRIVATE, fd, 0) == MAP_FAILED)
+		die("mmap");
+	return fd;
+}
+
+/* sends what is queued in w and, if rsize, waits for work */
+static size_t talk(int fd, struct wbuf *w, void *rbuf, size_t rsize)
+{
+	struct binder_write_read bwr;
+
+	bwr.write_size = w->len;
+	bwr.write_consumed = 0;
+	bwr.write_buffer = (unsigned long) w->data;
+	bwr.read_size = rsize;
+	bwr.read_consumed = 0;
+	bwr.read_buffer = (unsigned long) rbuf;
+
+	while (ioctl(fd, BINDER_WRITE_READ, &bwr) < 0)
+		if (errno != EINTR)
+			die("BINDER_WRITE_READ");
+	w->len = 0;
+	return bwr.read_consumed;
+}
+
+typedef void (*tr_handler)(struct wbuf *w, uint32_t cmd,
+			   struct binder_transaction_data *tr);
+
+/*
+ * Hands BR_TRANSACTION and BR_REPLY to fn and acknowledges the reference
+ * count requests for our own objects into w.
+ */
+static void parse(struct wbuf *w, unsigned char *p, size_t size, tr_handler fn)
+{
+	unsigned char *end = p + size;
+
+	while (p < end) {
+		struct binder_transaction_data tr;
+		struct binder_ptr_cookie pc;
+		uint32_t cmd;
+
+		memcpy(&cmd, p, sizeof(cmd));
+		p += sizeof(cmd);
+
+		switch (cmd) {
+		case BR_NOOP:
+		case BR_TRANSACTION_COMPLETE:
+		case BR_SPAWN_LOOPER:
+			break;
+		case BR_INCREFS:
+		case BR_ACQUIRE:
+			memcpy(&pc, p, sizeof(pc));
+			p += sizeof(pc);
+			put_cmd(w, cmd == BR_INCREFS ? BC_INCREFS_DONE :
+						       BC_ACQUIRE_DONE);
+			put(w, &pc, sizeof(pc));
+			break;
+		case BR_RELEASE:
+		case BR_DECREFS:
+			p += sizeof(pc);
+			break;
+		case BR_TRANSACTION:
+		case BR_REPLY:
+			memcpy(&tr, p, sizeof(tr));
+			p += sizeof(tr);
+			fn(w, cmd, &tr);
+			break;
+		case BR_DEAD_REPLY:
+		case BR_FAILED_REPLY:
+			fprintf(stderr, "%d: call failed\n", getpid());
+			exit(1);
+		default:
+			fprintf(stderr, "%d: unexpected return %#x\n",
+				getpid(), cmd);
+			exit(1);
+		}
+	}
+}
+
+/*-------------------------------------------------------------------------*/
+
+struct reg_msg {
+	struct flat_binder_object obj;
+	uint32_t index;
+};
+
+static const size_t obj_offset[1];	/* the object is at offset 0 */
+
+static uint32_t *reg_handles;
+static unsigned nr_reg_handles;
+static unsigned reg_found;
+
+/* the registry: remembers a handle per pair and hands it to the client */
+static void registry_handler(struct wbuf *w, uint32_t cmd,
+			     struct binder_transaction_data *tr)
+{
+	static struct flat_binder_object reply_obj;
+	static uint32_t status;
+	const struct reg_msg *msg = tr->data.ptr.buffer;
+	const uint32_t *index = tr->code == CODE_REGISTER ?
+		&msg->index : tr->data.ptr.buffer;
+
+	if (cmd != BR_TRANSACTION)
+		return;
+
+	if (*index >= nr_reg_handles) {
+		fprintf(stderr, "registry: bad pair %u\n", *index);
+		exit(1);
+	}
+
+	if (tr->code == CODE_REGISTER) {
+		reg_handles[msg->index] = msg->obj.handle;
+		put_acquire(w, msg->obj.handle);
+	} else if (tr->code == CODE_LOOKUP && reg_handles[*index]) {
+		memset(&reply_obj, 0, sizeof(reply_obj));
+		reply_obj.type = BINDER_TYPE_HANDLE;
+		reply_obj.handle = reg_handles[*index];
+		put_free(w, tr->data.ptr.buffer);
+		put_transaction(w, BC_REPLY, 0, 0, &reply_obj,
+				sizeof(reply_obj), obj_offset, 1);
+		reg_found++;
+		return;
+	}
+
+	/* registered, or looked up too early: the client retries */
+	status = tr->code == CODE_REGISTER ? 0 : ENOENT;
+	put_free(w, tr->data.ptr.buffer);
+	put_transaction(w, BC_REPLY, 0, 0, &status, sizeof(status), NULL, 0);
+}
+
+static void registry(unsigned pairs)
+{
+	unsigned char rbuf[256];
+	struct wbuf w = { .len = 0 };
+	int fd = binder_open();
+	int tries;
+
+	/* the previous run's registry may not be released yet */
+	for (tries = 0; ioctl(fd, BINDER_SET_CONTEXT_MGR, 0) < 0; tries++) {
+		if (errno != EBUSY || tries == 100) {
+			perror("BINDER_SET_CONTEXT_MGR (is servicemanager "
+			       "running?)");
+			exit(1);
+		}
+		usleep(10000);
+	}
+
+	reg_handles = calloc(pairs, sizeof(*reg_handles));
+	if (!reg_handles)
+		die("calloc");
+	nr_reg_handles = pairs;
+
+	put_cmd(&w, BC_ENTER_LOOPER);
+	while (reg_found < pairs)
+		parse(&w, rbuf, talk(fd, &w, rbuf, sizeof(rbuf)),
+		      registry_handler);
+	talk(fd, &w, NULL, 0);
+
+	/* keep the context manager alive until the parent is done */
+	pause();
+	exit(0);
+}
+
+/*-------------------------------------------------------------------------*/
+
+static int call_done;
+static const void *call_reply;
+static size_t call_reply_size;
+
+/* a synchronous call: send tr from w and wait for the BR_REPLY */
+static void call_handler(struct wbuf *w, uint32_t cmd,
+			 struct binder_transaction_data *tr)
+{
+	(void) w;
+	if (cmd != BR_REPLY) {
+		fprintf(stderr, "%d: unexpected transaction\n", getpid());
+		exit(1);
+	}
+	call_reply = tr->data.ptr.buffer;
+	call_reply_size = tr->data_size;
+	call_done = 1;
+}
+
+static void call(int fd, struct wbuf *w)
+{
+	unsigned char rbuf[256];
+
+	call_done = 0;
+	while (!call_done)
+		parse(w, rbuf, talk(fd, w, rbuf, sizeof(rbuf)), call_handler);
+}
+
+static void server_handler(struct wbuf *w, uint32_t cmd,
+			   struct binder_transaction_data *tr)
+{
+	if (cmd != BR_TRANSACTION || tr->code != CODE_PING) {
+		fprintf(stderr, "%d: unexpected call %u\n", getpid(),
+			tr->code);
+		exit(1);
+	}
+	put_free(w, tr->data.ptr.buffer);
+	put_transaction(w, BC_REPLY, 0, 0, payload_buf, payload, NULL, 0);
+}
+
+static void server(unsigned index)
+{
+	static int cookie;
+	unsigned char rbuf[256];
+	struct wbuf w = { .len = 0 };
+	struct reg_msg msg;
+	int fd = binder_open();
+
+	memset(&msg, 0, sizeof(msg));
+	msg.obj.type = BINDER_TYPE_BINDER;
+	msg.obj.flags = 0x7f;
+	msg.obj.binder = &cookie;
+	msg.obj.cookie = &cookie;
+	msg.index = index;
+
+	put_transaction(&w, BC_TRANSACTION, 0, CODE_REGISTER, &msg,
+			sizeof(msg), obj_offset, 1);
+	call(fd, &w);
+	put_free(&w, call_reply);
+
+	put_cmd(&w, BC_ENTER_LOOPER);
+	for (;;)
+		parse(&w, rbuf, talk(fd, &w, rbuf, sizeof(rbuf)),
+		      server_handler);
+}
+
+static void client(unsigned index, int ready, int start)
+{
+	uint32_t *lat = latencies + (size_t) index * calls;
+	struct wbuf w = { .len = 0 };
+	uint32_t handle;
+	double t0, t;
+	unsigned i;
+	char c = 0;
+	int fd = binder_open();
+
+	for (;;) {
+		put_transaction(&w, BC_TRANSACTION, 0, CODE_LOOKUP, &index,
+				sizeof(index), NULL, 0);
+		call(fd, &w);
+		if (call_reply_size == sizeof(struct flat_binder_object))
+			break;
+		put_free(&w, call_reply);
+		usleep(1000);
+	}
+	handle = ((const struct flat_binder_object *) call_reply)->handle;
+	put_acquire(&w, handle);
+	put_free(&w, call_reply);
+	talk(fd, &w, NULL, 0);
+
+	if (write(ready, &c, 1) != 1 || read(start, &c, 1) != 1)
+		die("start");
+
+	t0 = now();
+	for (i = 0; i < calls; i++) {
+		t = now();
+		put_transaction(&w, BC_TRANSACTION, handle, CODE_PING,
+				payload_buf, payload, NULL, 0);
+		call(fd, &w);
+		lat[i] = (now() - t) * 1e9;
+		put_free(&w, call_reply);
+	}
+	elapsed[index] = now() - t0;
+	talk(fd, &w, NULL, 0);
+	exit(0);
+}
+
+/*-------------------------------------------------------------------------*/
+
+static pid_t spawn(void (*fn)(unsigned, int, int), unsigned index,
+		   int ready, int start)
+{
+	pid_t pid = fork();
+
+	if (pid < 0)
+		die("fork");
+	if (pid == 0)
+		fn(index, ready, start);
+	return pid;
+}
+
+static void registry_main(unsigned pairs, int ready, int start)
+{
+	(void) ready;
+	(void) start;
+	registry(pairs);
+}
+
+static void server_main(unsigned index, int ready, int start)
+{
+	(void) ready;
+	(void) start;
+	server(index);
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int run(unsigned pairs)
+{
+	size_t total = (size_t) pairs * calls;
+	pid_t reg, *servers, *clients;
+	int ready[2], start[2];
+	double secs = 0, sum = 0;
+	unsigned i;
+	int status, ret = 0;
+	char c = 0;
+
+	servers = calloc(pairs, sizeof(*servers));
+	clients = calloc(pairs, sizeof(*clients));
+	if (!servers || !clients || pipe(ready) < 0 || pipe(start) < 0)
+		die("setup");
+
+	reg = spawn(registry_main, pairs, -1, -1);
+	for (i = 0; i < pairs; i++)
+		servers[i] = spawn(server_main, i, -1, -1);
+	for (i = 0; i < pairs; i++)
+		clients[i] = spawn(client, i, ready[1], start[0]);
+	close(ready[1]);
+	close(start[0]);
+
+	/* all pairs are connected before any of them starts calling */
+	for (i = 0; i < pairs; i++)
+		if (read(ready[0], &c, 1) != 1) {
+			fprintf(stderr, "a client failed to connect\n");
+			exit(1);
+		}
+	for (i = 0; i < pairs; i++)
+		if (write(start[1], &c, 1) != 1)
+			die("start");
+
+	for (i = 0; i < pairs; i++) {
+		waitpid(clients[i], &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			ret = -1;
+	}
+	for (i = 0; i < pairs; i++)
+		kill(servers[i], SIGTERM);
+	kill(reg, SIGTERM);
+	for (i = 0; i < pairs; i++)
+		waitpid(servers[i], NULL, 0);
+	waitpid(reg, NULL, 0);
+
+	close(ready[0]);
+	close(start[1]);
+	free(servers);
+	free(clients);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < pairs; i++)
+		if (elapsed[i] > secs)
+			secs = elapsed[i];
+	for (i = 0; i < total; i++)
+		sum += latencies[i];
+	qsort(latencies, total, sizeof(*latencies), cmp_u32);
+
+	printf("%3u pairs: %8.0f calls/s, %7.0f calls/s per pair, "
+	       "latency mean %.1f p50 %.1f p99 %.1f max %.1f us\n",
+	       pairs, total / secs, total / secs / pairs, sum / total / 1e3,
+	       latencies[total / 2] / 1e3, latencies[total * 99 / 100] / 1e3,
+	       latencies[total - 1] / 1e3);
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-d device] [-p max pairs] [-n calls] [-s bytes]\n",
+		name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned pairs;
+	int c;
+
+	while ((c = getopt(argc, argv, "d:p:n:s:")) != -1) {
+		switch (c) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'p':
+			max_pairs = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			calls = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			payload = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!max_pairs || !calls || payload > MAX_PAYLOAD)
+		usage(argv[0]);
+
+	latencies = mmap(NULL, (size_t) max_pairs * calls * sizeof(*latencies),
+			 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+			 -1, 0);
+	elapsed = mmap(NULL, max_pairs * sizeof(*elapsed),
+		       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+		       -1, 0);
+	if (latencies == MAP_FAILED || elapsed == MAP_FAILED)
+		die("mmap");
+
+	printf("%s: %u calls per pair, %u byte payloads\n",
+	       device, calls, payload);
+	for (pairs = 1; pairs < max_pairs; pairs *= 2)
+		if (run(pairs) < 0)
+			return 1;
+	return run(max_pairs) < 0;
+}
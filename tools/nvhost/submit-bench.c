@@ -0,0 +1,350 @@
+/* $(CROSS_COMPILE)cc -Wall -Wextra -O2 -o submit-bench submit-bench.c -lrt */
+
+/*
+ * Copyright (c) 2011, NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Measures channel submits per second through the legacy write() stream
+ * followed by the NULL_KICKOFF ioctl, and through the single-call SUBMIT
+ * ioctl, with the same cmdbufs and relocs.  Null kickoffs pin the handles
+ * and patch the relocs like a real submit, but the gathers are not fetched
+ * and the sync point is incremented by the CPU, so what is measured is the
+ * cost of the submit path itself.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <linux/types.h>
+
+/*-------------------------------------------------------------------------*/
+
+/* from arch/arm/mach-tegra/include/mach/nvhost.h */
+
+#define NVHOST_IOCTL_MAGIC 'H'
+
+struct nvhost_submit_hdr {
+	__u32 syncpt_id;
+	__u32 syncpt_incrs;
+	__u32 num_cmdbufs;
+	__u32 num_relocs;
+};
+
+struct nvhost_cmdbuf {
+	__u32 mem;
+	__u32 offset;
+	__u32 words;
+};
+
+struct nvhost_reloc {
+	__u32 cmdbuf_mem;
+	__u32 cmdbuf_offset;
+	__u32 target;
+	__u32 target_offset;
+};
+
+struct nvhost_get_param_args {
+	__u32 value;
+};
+
+struct nvhost_set_nvmap_fd_args {
+	__u32 fd;
+};
+
+#define NVHOST_SUBMIT_VERSION_V1		0x1
+#define NVHOST_SUBMIT_FLAG_NULL_KICKOFF		(1 << 0)
+
+struct nvhost_submit_args {
+	__u32 submit_version;
+	__u32 syncpt_id;
+	__u32 syncpt_incrs;
+	__u32 num_cmdbufs;
+	__u32 num_relocs;
+	__u32 num_waitchks;
+	__u32 waitchk_mask;
+	__u32 flags;
+	__u64 cmdbufs;
+	__u64 relocs;
+	__u64 waitchks;
+	__u32 fence;
+	__u32 pad;
+};
+
+#define NVHOST_IOCTL_CHANNEL_GET_SYNCPOINTS	\
+	_IOR(NVHOST_IOCTL_MAGIC, 2, struct nvhost_get_param_args)
+#define NVHOST_IOCTL_CHANNEL_SET_NVMAP_FD	\
+	_IOW(NVHOST_IOCTL_MAGIC, 5, struct nvhost_set_nvmap_fd_args)
+#define NVHOST_IOCTL_CHANNEL_NULL_KICKOFF	\
+	_IOR(NVHOST_IOCTL_MAGIC, 6, struct nvhost_get_param_args)
+#define NVHOST_IOCTL_CHANNEL_SUBMIT		\
+	_IOWR(NVHOST_IOCTL_MAGIC, 8, struct nvhost_submit_args)
+
+/* from drivers/video/tegra/nvmap/nvmap_ioctl.h */
+
+#define NVMAP_IOC_MAGIC 'N'
+
+struct nvmap_create_handle {
+	__u32 size;
+	__u32 handle;
+};
+
+struct nvmap_alloc_handle {
+	__u32 handle;
+	__u32 heap_mask;
+	__u32 flags;
+	__u32 align;
+};
+
+#define NVMAP_HEAP_SYSMEM		(1ul << 31)
+#define NVMAP_HEAP_CARVEOUT_GENERIC	(1ul << 0)
+#define NVMAP_HANDLE_WRITE_COMBINE	(0x1ul << 0)
+
+#define NVMAP_IOC_CREATE  _IOWR(NVMAP_IOC_MAGIC, 0, struct nvmap_create_handle)
+#define NVMAP_IOC_ALLOC    _IOW(NVMAP_IOC_MAGIC, 3, struct nvmap_alloc_handle)
+#define NVMAP_IOC_FREE       _IO(NVMAP_IOC_MAGIC, 4)
+
+/*-------------------------------------------------------------------------*/
+
+#define CMDBUF_SIZE	4096
+#define CMDBUF_WORDS	16
+
+static const char *channel = "/dev/nvhost-gr2d";
+static unsigned submits = 100000;
+static unsigned nr_cmdbufs = 1;
+static unsigned nr_relocs = 8;
+
+static __u32 cmdbuf_mem;
+static __u32 syncpt_id;
+static struct nvhost_cmdbuf *cmdbufs;
+static struct nvhost_reloc *relocs;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int open_channel(int nvmap)
+{
+	struct nvhost_set_nvmap_fd_args fd_args = { .fd = nvmap };
+	struct nvhost_get_param_args param;
+	int fd;
+
+	fd = open(channel, O_RDWR);
+	if (fd < 0) {
+		perror(channel);
+		return -1;
+	}
+	if (ioctl(fd, NVHOST_IOCTL_CHANNEL_SET_NVMAP_FD, &fd_args) < 0 ||
+	    ioctl(fd, NVHOST_IOCTL_CHANNEL_GET_SYNCPOINTS, &param) < 0) {
+		perror("channel setup");
+		close(fd);
+		return -1;
+	}
+	if (!param.value) {
+		fprintf(stderr, "%s has no sync points\n", channel);
+		close(fd);
+		return -1;
+	}
+	syncpt_id = ffs(param.value) - 1;
+	return fd;
+}
+
+/* one header, the cmdbufs and the relocs in a single write, then a flush */
+static int submit_write(int fd, char *buf, size_t len)
+{
+	struct nvhost_submit_hdr *hdr = (struct nvhost_submit_hdr *) buf;
+	struct nvhost_get_param_args fence;
+	char *p = buf + sizeof(*hdr);
+
+	hdr->syncpt_id = syncpt_id;
+	hdr->syncpt_incrs = 1;
+	hdr->num_cmdbufs = nr_cmdbufs;
+	hdr->num_relocs = nr_relocs;
+	memcpy(p, cmdbufs, nr_cmdbufs * sizeof(*cmdbufs));
+	p += nr_cmdbufs * sizeof(*cmdbufs);
+	memcpy(p, relocs, nr_relocs * sizeof(*relocs));
+
+	if (write(fd, buf, len) != (ssize_t) len)
+		return -1;
+	return ioctl(fd, NVHOST_IOCTL_CHANNEL_NULL_KICKOFF, &fence);
+}
+
+static int submit_ioctl(int fd)
+{
+	struct nvhost_submit_args args;
+
+	memset(&args, 0, sizeof(args));
+	args.submit_version = NVHOST_SUBMIT_VERSION_V1;
+	args.syncpt_id = syncpt_id;
+	args.syncpt_incrs = 1;
+	args.num_cmdbufs = nr_cmdbufs;
+	args.num_relocs = nr_relocs;
+	args.flags = NVHOST_SUBMIT_FLAG_NULL_KICKOFF;
+	args.cmdbufs = (unsigned long) cmdbufs;
+	args.relocs = (unsigned long) relocs;
+	return ioctl(fd, NVHOST_IOCTL_CHANNEL_SUBMIT, &args);
+}
+
+/* each mode gets its own channel context, since the legacy stream state
+ * lives in the context */
+static int run(int nvmap, int use_ioctl)
+{
+	size_t len = sizeof(struct nvhost_submit_hdr) +
+		nr_cmdbufs * sizeof(*cmdbufs) + nr_relocs * sizeof(*relocs);
+	char *buf = malloc(len);
+	double start, elapsed;
+	unsigned i;
+	int fd;
+
+	if (!buf)
+		return -1;
+	fd = open_channel(nvmap);
+	if (fd < 0) {
+		free(buf);
+		return -1;
+	}
+
+	start = now();
+	for (i = 0; i < submits; i++) {
+		int err = use_ioctl ? submit_ioctl(fd) :
+				      submit_write(fd, buf, len);
+
+		if (err) {
+			perror(use_ioctl ? "submit ioctl" : "write submit");
+			break;
+		}
+	}
+	elapsed = now() - start;
+
+	close(fd);
+	free(buf);
+	if (i < submits)
+		return -1;
+
+	printf("%-12s %u submits in %.3f s: %.0f submits/s, %.2f us/submit\n",
+	       use_ioctl ? "ioctl" : "write+flush", submits, elapsed,
+	       submits / elapsed, elapsed * 1e6 / submits);
+	return 0;
+}
+
+static int setup_cmdbuf(int nvmap)
+{
+	struct nvmap_create_handle create = { .size = CMDBUF_SIZE };
+	struct nvmap_alloc_handle alloc;
+	unsigned i;
+
+	if (ioctl(nvmap, NVMAP_IOC_CREATE, &create) < 0) {
+		perror("nvmap create");
+		return -1;
+	}
+	cmdbuf_mem = create.handle;
+
+	alloc.handle = cmdbuf_mem;
+	alloc.heap_mask = NVMAP_HEAP_SYSMEM | NVMAP_HEAP_CARVEOUT_GENERIC;
+	alloc.flags = NVMAP_HANDLE_WRITE_COMBINE;
+	alloc.align = 32;
+	if (ioctl(nvmap, NVMAP_IOC_ALLOC, &alloc) < 0) {
+		perror("nvmap alloc");
+		return -1;
+	}
+
+	cmdbufs = calloc(nr_cmdbufs, sizeof(*cmdbufs));
+	relocs = calloc(nr_relocs ? nr_relocs : 1, sizeof(*relocs));
+	if (!cmdbufs || !relocs)
+		return -1;
+
+	for (i = 0; i < nr_cmdbufs; i++) {
+		cmdbufs[i].mem = cmdbuf_mem;
+		cmdbufs[i].offset = (i * CMDBUF_WORDS * 4) % CMDBUF_SIZE;
+		cmdbufs[i].words = CMDBUF_WORDS;
+	}
+	/* every reloc patches a word of the cmdbuf with its own address */
+	for (i = 0; i < nr_relocs; i++) {
+		relocs[i].cmdbuf_mem = cmdbuf_mem;
+		relocs[i].cmdbuf_offset = (i * 4) % CMDBUF_SIZE;
+		relocs[i].target = cmdbuf_mem;
+		relocs[i].target_offset = 0;
+	}
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-d channel] [-n submits] [-c cmdbufs] [-r relocs]\n",
+		name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int nvmap;
+	int c;
+	int ret = 0;
+
+	while ((c = getopt(argc, argv, "d:n:c:r:")) != -1) {
+		switch (c) {
+		case 'd':
+			channel = optarg;
+			break;
+		case 'n':
+			submits = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			nr_cmdbufs = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			nr_relocs = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!submits || !nr_cmdbufs)
+		usage(argv[0]);
+
+	nvmap = open("/dev/nvmap", O_RDWR);
+	if (nvmap < 0) {
+		perror("/dev/nvmap");
+		return 1;
+	}
+	if (setup_cmdbuf(nvmap) < 0) {
+		close(nvmap);
+		return 1;
+	}
+
+	printf("%s: %u cmdbufs, %u relocs per submit\n",
+	       channel, nr_cmdbufs, nr_relocs);
+	if (run(nvmap, 0) < 0 || run(nvmap, 1) < 0)
+		ret = 1;
+
+	ioctl(nvmap, NVMAP_IOC_FREE, cmdbuf_mem);
+	free(cmdbufs);
+	free(relocs);
+	close(nvmap);
+	return ret;
+}
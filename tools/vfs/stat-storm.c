@@ -0,0 +1,217 @@
+/* $(CROSS_COMPILE)cc -Wall -O2 -pthread -o stat-storm stat-storm.c -lrt */
+
+/*
+ * stat-storm: path lookup scaling microbenchmark
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * Builds a chain of depth directories under the given directory, with one
+ * file per thread at the bottom, and has 1, 2, 4, ... up to the requested
+ * number of threads stat() their own file as fast as they can for a fixed
+ * time.  Every lookup walks the same leading directories, which is where
+ * reference counts and d_lock used to bounce between cpus, so the calls
+ * per second per thread show how well path lookup scales.  The tree is
+ * removed at the end.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define MAX_PATH	4096
+
+static const char *base = ".";
+static unsigned max_threads = 4;
+static unsigned depth = 8;
+static unsigned duration = 5;
+
+struct worker {
+	pthread_t thread;
+	char path[MAX_PATH];
+	unsigned long calls;
+	unsigned long errors;
+};
+
+static volatile int running;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* base/stat-storm/d0/d1/.../d<depth - 1> */
+static int dir_path(char *buf, unsigned levels)
+{
+	int len = snprintf(buf, MAX_PATH, "%s/stat-storm", base);
+	unsigned i;
+
+	for (i = 0; i < levels && len < MAX_PATH; i++)
+		len += snprintf(buf + len, MAX_PATH - len, "/d%u", i);
+	if (len >= MAX_PATH) {
+		fprintf(stderr, "path too long\n");
+		exit(1);
+	}
+	return len;
+}
+
+static void make_tree(struct worker *w)
+{
+	char path[MAX_PATH];
+	unsigned i;
+	int fd;
+
+	for (i = 0; i <= depth; i++) {
+		dir_path(path, i);
+		if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+			perror(path);
+			exit(1);
+		}
+	}
+	for (i = 0; i < max_threads; i++) {
+		if (snprintf(w[i].path, MAX_PATH, "%.*s/f%u",
+			     MAX_PATH - 16, path, i) >= MAX_PATH) {
+			fprintf(stderr, "path too long\n");
+			exit(1);
+		}
+		fd = open(w[i].path, O_WRONLY | O_CREAT, 0644);
+		if (fd < 0) {
+			perror(w[i].path);
+			exit(1);
+		}
+		close(fd);
+	}
+}
+
+static void remove_tree(struct worker *w)
+{
+	char path[MAX_PATH];
+	unsigned i;
+
+	for (i = 0; i < max_threads; i++)
+		unlink(w[i].path);
+	for (i = depth + 1; i-- > 0; ) {
+		dir_path(path, i);
+		rmdir(path);
+	}
+}
+
+static void *storm(void *arg)
+{
+	struct worker *w = arg;
+	struct stat st;
+
+	while (!running)
+		;
+	while (running == 1) {
+		if (stat(w->path, &st) < 0)
+			w->errors++;
+		w->calls++;
+	}
+	return NULL;
+}
+
+static int run(struct worker *w, unsigned threads)
+{
+	unsigned long calls = 0, errors = 0;
+	double start, elapsed;
+	unsigned i;
+
+	running = 0;
+	for (i = 0; i < threads; i++) {
+		w[i].calls = w[i].errors = 0;
+		if (pthread_create(&w[i].thread, NULL, storm, &w[i])) {
+			fprintf(stderr, "pthread_create failed\n");
+			running = 2;
+			while (i-- > 0)
+				pthread_join(w[i].thread, NULL);
+			return -1;
+		}
+	}
+
+	start = now();
+	running = 1;
+	sleep(duration);
+	running = 2;
+	elapsed = now() - start;
+
+	for (i = 0; i < threads; i++) {
+		pthread_join(w[i].thread, NULL);
+		calls += w[i].calls;
+		errors += w[i].errors;
+	}
+
+	printf("%3u threads: %10.0f stats/s, %9.0f per thread, "
+	       "%.3f us/stat%s\n", threads, calls / elapsed,
+	       calls / elapsed / threads, elapsed * 1e6 * threads / calls,
+	       errors ? " (errors)" : "");
+	return errors ? -1 : 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-t max threads] [-d depth] [-s seconds] [dir]\n",
+		name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct worker *w;
+	unsigned threads;
+	int c, ret = 0;
+
+	while ((c = getopt(argc, argv, "t:d:s:")) != -1) {
+		switch (c) {
+		case 't':
+			max_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			depth = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind < argc)
+		base = argv[optind++];
+	if (optind < argc || !max_threads || !duration)
+		usage(argv[0]);
+
+	w = calloc(max_threads, sizeof(*w));
+	if (!w) {
+		perror("calloc");
+		return 1;
+	}
+	make_tree(w);
+
+	printf("%s: %u directories deep, %u s per run\n",
+	       w[0].path, depth, duration);
+	for (threads = 1; threads < max_threads; threads *= 2)
+		if (run(w, threads) < 0) {
+			ret = 1;
+			break;
+		}
+	if (!ret && run(w, max_threads) < 0)
+		ret = 1;
+
+	remove_tree(w);
+	free(w);
+	return ret;
+}
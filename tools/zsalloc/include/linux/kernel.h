@@ -0,0 +1,141 @@
+/*
+ * Userspace stand-ins for the kernel interfaces zsalloc.c uses, so that
+ * the allocator can be built unmodified into zs-replay.  Pages are
+ * page-aligned heap blocks, kmap_atomic() is their address, and the pool
+ * lock only checks that it is not taken twice, since the harness is
+ * single threaded.
+ */
+
+#ifndef _ZS_SHIM_KERNEL_H
+#define _ZS_SHIM_KERNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+
+#include <linux/types.h>
+
+#define PAGE_SHIFT	12
+#define PAGE_SIZE	(1UL << PAGE_SHIFT)
+
+#define likely(x)	__builtin_expect(!!(x), 1)
+#define unlikely(x)	__builtin_expect(!!(x), 0)
+
+#define ALIGN(x, a)	(((x) + (a) - 1) & ~((__typeof__(x))(a) - 1))
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define BUG_ON(cond)							\
+	do {								\
+		if (unlikely(cond)) {					\
+			fprintf(stderr, "BUG at %s:%d: %s\n",		\
+				__FILE__, __LINE__, #cond);		\
+			abort();					\
+		}							\
+	} while (0)
+
+#define WARN_ONCE(cond, ...)						\
+	({								\
+		static int __warned;					\
+		int __ret = !!(cond);					\
+		if (__ret && !__warned) {				\
+			__warned = 1;					\
+			fprintf(stderr, __VA_ARGS__);			\
+		}							\
+		__ret;							\
+	})
+
+/* gfp flags only matter for the injected failures */
+#define __GFP_HIGHMEM	0x02u
+#define __GFP_WAIT	0x10u
+#define __GFP_IO	0x40u
+#define __GFP_FS	0x80u
+#define __GFP_NOWARN	0x200u
+#define __GFP_NORETRY	0x1000u
+#define GFP_NOWAIT	0u
+#define GFP_NOIO	(__GFP_WAIT)
+#define GFP_KERNEL	(__GFP_WAIT | __GFP_IO | __GFP_FS)
+
+/* percentage of page allocations that fail, set by the harness */
+extern unsigned int shim_fail_percent;
+/* pages currently allocated through alloc_pages() */
+extern unsigned long shim_pages;
+
+static inline void *kmalloc(size_t size, gfp_t flags)
+{
+	(void)flags;
+	return malloc(size);
+}
+
+static inline void *kzalloc(size_t size, gfp_t flags)
+{
+	(void)flags;
+	return calloc(1, size);
+}
+
+static inline void kfree(const void *p)
+{
+	free((void *)p);
+}
+
+struct page {
+	unsigned long private;
+	unsigned int order;
+	void *virtual;
+};
+
+#define page_private(page)		((page)->private)
+#define set_page_private(page, v)	((page)->private = (v))
+
+static inline struct page *alloc_pages(gfp_t flags, unsigned int order)
+{
+	struct page *page;
+
+	(void)flags;
+	if (shim_fail_percent && (unsigned)rand() % 100 < shim_fail_percent)
+		return NULL;
+
+	page = calloc(1, sizeof(*page));
+	if (!page)
+		return NULL;
+	if (posix_memalign(&page->virtual, PAGE_SIZE, PAGE_SIZE << order)) {
+		free(page);
+		return NULL;
+	}
+	/* stale data, like a freshly allocated kernel page */
+	memset(page->virtual, 0x6b, PAGE_SIZE << order);
+	page->order = order;
+	shim_pages += 1UL << order;
+	return page;
+}
+
+#define alloc_page(flags)	alloc_pages(flags, 0)
+
+static inline void __free_pages(struct page *page, unsigned int order)
+{
+	BUG_ON(page->order != order);
+	shim_pages -= 1UL << order;
+	free(page->virtual);
+	free(page);
+}
+
+enum km_type { KM_USER0, KM_USER1 };
+
+static inline void *kmap_atomic(struct page *page, enum km_type type)
+{
+	(void)type;
+	return page->virtual;
+}
+
+static inline void kunmap_atomic(void *addr, enum km_type type)
+{
+	(void)addr;
+	(void)type;
+}
+
+#endif
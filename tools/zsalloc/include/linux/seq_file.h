@@ -0,0 +1,20 @@
+#ifndef _ZS_SHIM_SEQ_FILE_H
+#define _ZS_SHIM_SEQ_FILE_H
+
+#include <linux/kernel.h>
+
+struct seq_file {
+	FILE *file;
+};
+
+static inline int seq_printf(struct seq_file *m, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vfprintf(m->file, fmt, args);
+	va_end(args);
+	return 0;
+}
+
+#endif
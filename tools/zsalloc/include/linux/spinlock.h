@@ -0,0 +1,28 @@
+#ifndef _ZS_SHIM_SPINLOCK_H
+#define _ZS_SHIM_SPINLOCK_H
+
+#include <linux/kernel.h>
+
+/* single threaded: only catch recursion and unbalanced unlocks */
+typedef struct {
+	int locked;
+} spinlock_t;
+
+static inline void spin_lock_init(spinlock_t *lock)
+{
+	lock->locked = 0;
+}
+
+static inline void spin_lock(spinlock_t *lock)
+{
+	BUG_ON(lock->locked);
+	lock->locked = 1;
+}
+
+static inline void spin_unlock(spinlock_t *lock)
+{
+	BUG_ON(!lock->locked);
+	lock->locked = 0;
+}
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef _ZS_SHIM_TYPES_H
+#define _ZS_SHIM_TYPES_H
+
+#include_next <linux/types.h>
+
+typedef __u8 u8;
+typedef __u16 u16;
+typedef __u32 u32;
+typedef __u64 u64;
+typedef unsigned int gfp_t;
+
+#endif
@@ -0,0 +1,425 @@
+/*
+ * zs-replay: run drivers/staging/zram/zsalloc.c in userspace against a
+ * swap trace
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * The allocator is built unmodified against the stand-ins in include/ and
+ * driven the way zram drives it: every stored page becomes an object of
+ * its compressed size plus the zram object header, pages that compress
+ * worse than zram's max_zpage_size are stored outside the allocator, and
+ * rewriting a page frees its old object.  Objects carry a pattern that is
+ * checked when they are freed and after every compaction, and the pool's
+ * page count is checked against the pages the stand-ins handed out.
+ *
+ * A trace is a text file with one operation per line:
+ *
+ *	w <index> <size>	page <index> swapped out, compressed to <size>
+ *	r <index>		page <index> swapped in, its slot freed
+ *	c			compact every size class
+ *
+ * Lines starting with '#' are ignored.  Without a trace file, -g makes up
+ * a swap storm over a working set of pages, and -o saves it for replay.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/kernel.h>
+#include <linux/seq_file.h>
+
+#include "zsalloc.h"
+#include "zsalloc_int.h"
+
+unsigned int shim_fail_percent;
+unsigned long shim_pages;
+
+/* as in zram_drv.h */
+#define MAX_ZPAGE_SIZE		(PAGE_SIZE / 4 * 3)
+
+struct zobj_header {
+	u32 hash;		/* the write generation here */
+	u32 table_idx;
+};
+
+struct entry {
+	struct page *page;	/* NULL if not stored in the pool */
+	u32 offset;
+	u32 size;		/* compressed size, 0 if the page is empty */
+	u32 gen;
+};
+
+static struct entry *table;
+static unsigned long nr_entries;
+static struct zs_pool *pool;
+
+static unsigned int refuse_percent;
+static unsigned long compact_interval;
+static int verbose;
+
+static struct {
+	unsigned long ops, writes, frees, uncompressed, failed;
+	unsigned long compactions, compacted_pages, refused;
+	unsigned long live, peak_pages;
+	u64 stored_bytes;
+	double compact_secs;
+} st;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned char pattern(unsigned long index, u32 gen, u32 i)
+{
+	return (index * 31 + gen * 7 + i) & 0xff;
+}
+
+static void *obj_addr(struct entry *e)
+{
+	return (char *)kmap_atomic(e->page, KM_USER0) + e->offset;
+}
+
+static void check_entry(unsigned long index)
+{
+	struct entry *e = &table[index];
+	struct zobj_header *h = obj_addr(e);
+	unsigned char *data = (unsigned char *)(h + 1);
+	u32 i;
+
+	if (h->table_idx != index || h->hash != e->gen ||
+	    zs_get_object_size(h) != e->size + sizeof(*h)) {
+		fprintf(stderr, "page %lu: bad object header\n", index);
+		exit(1);
+	}
+	for (i = 0; i < e->size; i++)
+		if (data[i] != pattern(index, e->gen, i)) {
+			fprintf(stderr, "page %lu: corrupt at byte %u\n",
+				index, i);
+			exit(1);
+		}
+}
+
+static void check_pool(void)
+{
+	unsigned long i, inuse = 0;
+
+	for (i = 0; i < nr_entries; i++)
+		if (table[i].page)
+			check_entry(i);
+	for (i = 0; i < zs_get_nr_classes(); i++)
+		inuse += pool->classes[i].nr_inuse;
+	if (inuse != st.live || pool->total_pages != shim_pages) {
+		fprintf(stderr, "accounting: %lu objects, %lu live, %llu pool "
+			"pages, %lu allocated\n", inuse, st.live,
+			(unsigned long long)pool->total_pages, shim_pages);
+		exit(1);
+	}
+}
+
+static void drop(unsigned long index)
+{
+	struct entry *e = &table[index];
+
+	if (e->page) {
+		check_entry(index);
+		zs_free(pool, e->page, e->offset);
+		st.live--;
+		st.stored_bytes -= e->size;
+	}
+	e->page = NULL;
+	e->size = 0;
+}
+
+static void store(unsigned long index, u32 size)
+{
+	struct entry *e = &table[index];
+	struct zobj_header *h;
+	unsigned char *data;
+	u32 i;
+
+	drop(index);
+	st.writes++;
+
+	if (size > MAX_ZPAGE_SIZE) {
+		st.uncompressed++;
+		return;
+	}
+	if (zs_malloc(pool, size + sizeof(*h), &e->page, &e->offset,
+		      GFP_NOIO | __GFP_HIGHMEM)) {
+		st.failed++;
+		return;
+	}
+
+	e->size = size;
+	e->gen++;
+	h = obj_addr(e);
+	h->hash = e->gen;
+	h->table_idx = index;
+	data = (unsigned char *)(h + 1);
+	for (i = 0; i < size; i++)
+		data[i] = pattern(index, e->gen, i);
+
+	st.live++;
+	st.stored_bytes += size;
+	if (shim_pages > st.peak_pages)
+		st.peak_pages = shim_pages;
+}
+
+/* the zram_relocate() contract, refusing a share of moves at random */
+static int relocate(void *arg, void *obj, struct page *old_page,
+		    u32 old_offset, struct page *page, u32 offset)
+{
+	struct zobj_header *h = obj;
+	struct entry *e;
+
+	(void)arg;
+	if (h->table_idx >= nr_entries) {
+		fprintf(stderr, "relocate: bad index %u\n", h->table_idx);
+		exit(1);
+	}
+	e = &table[h->table_idx];
+	if (e->page != old_page || e->offset != old_offset) {
+		fprintf(stderr, "relocate: page %u is not at the old slot\n",
+			h->table_idx);
+		exit(1);
+	}
+	if (refuse_percent && (unsigned)rand() % 100 < refuse_percent) {
+		st.refused++;
+		return 1;
+	}
+	e->page = page;
+	e->offset = offset;
+	return 0;
+}
+
+static void compact(void)
+{
+	unsigned long freed = 0;
+	unsigned int i;
+	double t = now();
+
+	for (i = 0; i < zs_get_nr_classes(); i++) {
+		while (zs_compact_zspage(pool, i, relocate, NULL, &freed))
+			;
+		zs_compact_done(pool, i);
+	}
+	st.compact_secs += now() - t;
+	st.compactions++;
+	st.compacted_pages += freed;
+	check_pool();
+}
+
+static void op(char cmd, unsigned long index, u32 size)
+{
+	if (cmd != 'c' && index >= nr_entries) {
+		fprintf(stderr, "page %lu is past the device, see -n\n", index);
+		exit(1);
+	}
+
+	switch (cmd) {
+	case 'w':
+		store(index, size);
+		break;
+	case 'r':
+		drop(index);
+		st.frees++;
+		break;
+	case 'c':
+		compact();
+		break;
+	}
+
+	st.ops++;
+	if (compact_interval && st.ops % compact_interval == 0)
+		compact();
+}
+
+static void replay(FILE *f)
+{
+	char line[128];
+	unsigned long index;
+	unsigned int size;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (line[0] == 'c')
+			op('c', 0, 0);
+		else if (sscanf(line, "w %lu %u", &index, &size) == 2)
+			op('w', index, size);
+		else if (sscanf(line, "r %lu", &index) == 1)
+			op('r', index, 0);
+		else {
+			fprintf(stderr, "bad trace line: %s", line);
+			exit(1);
+		}
+	}
+}
+
+/*
+ * Compressed sizes roughly as LZO gives them for anonymous memory: a few
+ * nearly empty pages, most between a sixth and a half of a page, and some
+ * that do not compress.
+ */
+static u32 random_size(void)
+{
+	unsigned int r = rand() % 100;
+
+	if (r < 10)
+		return 16 + rand() % 200;
+	if (r < 75)
+		return PAGE_SIZE / 6 + rand() % (PAGE_SIZE / 3);
+	if (r < 93)
+		return PAGE_SIZE / 2 + rand() % (PAGE_SIZE / 4);
+	return MAX_ZPAGE_SIZE + 1 + rand() % (PAGE_SIZE / 4);
+}
+
+/* swap outs of random pages, with swap ins slightly less frequent */
+static void generate(unsigned long ops, FILE *out)
+{
+	unsigned long i;
+
+	for (i = 0; i < ops; i++) {
+		unsigned long index = rand() % nr_entries;
+
+		if (rand() % 100 < 55) {
+			u32 size = random_size();
+
+			if (out)
+				fprintf(out, "w %lu %u\n", index, size);
+			op('w', index, size);
+		} else {
+			if (out)
+				fprintf(out, "r %lu\n", index);
+			op('r', index, 0);
+		}
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-n pages] [-c interval] [-r refuse%%] "
+		"[-f fail%%] [-s seed] [-v]\n"
+		"       [-g ops [-o trace]] [trace]\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct seq_file seq = { .file = stdout };
+	unsigned long gen_ops = 0, i;
+	const char *out_path = NULL;
+	unsigned int seed = 1;
+	FILE *in = NULL, *out = NULL;
+	double t;
+	int c;
+
+	nr_entries = 65536;
+	while ((c = getopt(argc, argv, "n:c:r:f:s:g:o:v")) != -1) {
+		switch (c) {
+		case 'n':
+			nr_entries = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			compact_interval = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			refuse_percent = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			shim_fail_percent = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'g':
+			gen_ops = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			out_path = optarg;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!nr_entries || (!gen_ops) == (optind == argc) ||
+	    (out_path && !gen_ops))
+		usage(argv[0]);
+
+	if (!gen_ops) {
+		in = fopen(argv[optind], "r");
+		if (!in) {
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+	if (out_path) {
+		out = fopen(out_path, "w");
+		if (!out) {
+			perror(out_path);
+			return 1;
+		}
+	}
+
+	srand(seed);
+	table = calloc(nr_entries, sizeof(*table));
+	pool = zs_create_pool();
+	if (!table || !pool) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	t = now();
+	if (gen_ops)
+		generate(gen_ops, out);
+	else
+		replay(in);
+	t = now() - t;
+	check_pool();
+
+	printf("%lu ops in %.3f s, %lu writes (%lu uncompressed, %lu failed), "
+	       "%lu frees\n", st.ops, t, st.writes, st.uncompressed,
+	       st.failed, st.frees);
+	printf("%lu objects, %llu bytes in %lu pages (peak %lu), "
+	       "%llu%% used, %llu bytes total\n", st.live,
+	       (unsigned long long)st.stored_bytes, shim_pages, st.peak_pages,
+	       shim_pages ? (unsigned long long)st.stored_bytes * 100 /
+			    (shim_pages * PAGE_SIZE) : 0,
+	       (unsigned long long)zs_get_total_size_bytes(pool));
+	if (st.compactions)
+		printf("%lu compactions, %lu pages released, %lu moves "
+		       "refused, %.3f ms per compaction\n", st.compactions,
+		       st.compacted_pages, st.refused,
+		       st.compact_secs * 1e3 / st.compactions);
+	if (verbose)
+		zs_show_classes(pool, &seq);
+
+	for (i = 0; i < nr_entries; i++)
+		drop(i);
+	check_pool();
+	zs_destroy_pool(pool);
+	if (shim_pages) {
+		fprintf(stderr, "%lu pages leaked\n", shim_pages);
+		return 1;
+	}
+
+	free(table);
+	if (in)
+		fclose(in);
+	if (out)
+		fclose(out);
+	return 0;
+}